@@ -0,0 +1,118 @@
+using System;
+using FluentAssertions;
+using QuMail.EmailProtocol.Services;
+using Xunit;
+
+namespace QuMail.EmailProtocol.Tests;
+
+/// <summary>
+/// Tests for the decrypted-content cache behind inbox and message views
+/// </summary>
+public class DecryptedContentCacheTests
+{
+    private DateTime _now = new DateTime(2025, 1, 1, 0, 0, 0, DateTimeKind.Utc);
+
+    private DecryptedContentCache NewCache(long budget = 1 << 20, long userBudget = 0, int ttlSeconds = 60) =>
+        new DecryptedContentCache(budget, TimeSpan.FromSeconds(ttlSeconds), userBudget, () => _now);
+
+    [Fact]
+    public void TryGet_AfterSet_HitsForOwnerOnly()
+    {
+        // Arrange
+        using var cache = NewCache();
+        var id = Guid.NewGuid();
+        cache.Set("alice@test.com", id, DecryptedContentCache.FieldBody, "hello ✓");
+
+        // Act
+        var ownerHit = cache.TryGet("alice@test.com", id, DecryptedContentCache.FieldBody, out var body);
+        var otherHit = cache.TryGet("mallory@test.com", id, DecryptedContentCache.FieldBody, out _);
+        var otherField = cache.TryGet("alice@test.com", id, DecryptedContentCache.FieldSubject, out _);
+
+        // Assert
+        ownerHit.Should().BeTrue();
+        body.Should().Be("hello ✓");
+        otherHit.Should().BeFalse("entries are isolated per owner");
+        otherField.Should().BeFalse();
+        var stats = cache.GetStats();
+        stats.Hits.Should().Be(1);
+        stats.Misses.Should().Be(2);
+    }
+
+    [Fact]
+    public void TryGet_AfterTtl_MissesAndReleasesEntry()
+    {
+        // Arrange
+        using var cache = NewCache(ttlSeconds: 60);
+        var id = Guid.NewGuid();
+        cache.Set("alice@test.com", id, DecryptedContentCache.FieldSubject, "subject");
+
+        // Act
+        _now = _now.AddSeconds(61);
+        var hit = cache.TryGet("alice@test.com", id, DecryptedContentCache.FieldSubject, out _);
+
+        // Assert
+        hit.Should().BeFalse();
+        var stats = cache.GetStats();
+        stats.Expirations.Should().Be(1);
+        stats.Entries.Should().Be(0);
+        stats.Bytes.Should().Be(0);
+    }
+
+    [Fact]
+    public void Set_OverBudget_EvictsLeastRecentlyUsed()
+    {
+        // Arrange - room for about three 1000-byte entries
+        using var cache = NewCache(budget: 3600, userBudget: 3600);
+        var ids = new[] { Guid.NewGuid(), Guid.NewGuid(), Guid.NewGuid(), Guid.NewGuid() };
+        var value = new string('x', 1000);
+        for (int i = 0; i < 3; i++) cache.Set("alice@test.com", ids[i], DecryptedContentCache.FieldBody, value);
+
+        // Act - touch the oldest so the second one becomes least recently used
+        cache.TryGet("alice@test.com", ids[0], DecryptedContentCache.FieldBody, out _);
+        cache.Set("alice@test.com", ids[3], DecryptedContentCache.FieldBody, value);
+
+        // Assert
+        cache.TryGet("alice@test.com", ids[0], DecryptedContentCache.FieldBody, out _).Should().BeTrue();
+        cache.TryGet("alice@test.com", ids[1], DecryptedContentCache.FieldBody, out _).Should().BeFalse();
+        cache.TryGet("alice@test.com", ids[3], DecryptedContentCache.FieldBody, out _).Should().BeTrue();
+        cache.GetStats().Evictions.Should().Be(1);
+        cache.GetStats().Bytes.Should().BeLessThanOrEqualTo(3600);
+    }
+
+    [Fact]
+    public void Set_OverUserBudget_EvictsOnlyThatUsersEntries()
+    {
+        // Arrange - each user may hold about two entries
+        using var cache = NewCache(budget: 100_000, userBudget: 2400);
+        var value = new string('x', 1000);
+        var bobId = Guid.NewGuid();
+        cache.Set("bob@test.com", bobId, DecryptedContentCache.FieldBody, value);
+
+        // Act
+        for (int i = 0; i < 5; i++) cache.Set("alice@test.com", Guid.NewGuid(), DecryptedContentCache.FieldBody, value);
+
+        // Assert
+        cache.TryGet("bob@test.com", bobId, DecryptedContentCache.FieldBody, out _).Should().BeTrue();
+        cache.GetStats().Entries.Should().Be(3);
+    }
+
+    [Fact]
+    public void RemoveUser_DropsOnlyThatUser()
+    {
+        // Arrange
+        using var cache = NewCache();
+        var id = Guid.NewGuid();
+        cache.Set("alice@test.com", id, DecryptedContentCache.FieldBody, "a");
+        cache.Set("alice@test.com", id, DecryptedContentCache.FieldAttachment(0), "b");
+        cache.Set("bob@test.com", id, DecryptedContentCache.FieldBody, "c");
+
+        // Act
+        cache.RemoveUser("alice@test.com");
+
+        // Assert
+        cache.TryGet("alice@test.com", id, DecryptedContentCache.FieldBody, out _).Should().BeFalse();
+        cache.TryGet("bob@test.com", id, DecryptedContentCache.FieldBody, out var bob).Should().BeTrue();
+        bob.Should().Be("c");
+        cache.GetStats().Users.Should().Be(1);
+    }
+}
@@ -1,6 +1,18 @@
 using System;
 using System.Collections.Generic;
+using System.Linq;
+using System.Net.Http;
 using System.Text.Json;
+using System.Threading.Tasks;
+using Microsoft.AspNetCore.Mvc;
+using Microsoft.EntityFrameworkCore;
+using Microsoft.Extensions.Logging.Abstractions;
+using Moq;
+using QuMail.EmailProtocol.Controllers;
+using QuMail.EmailProtocol.Data;
+using QuMail.EmailProtocol.Interfaces;
+using QuMail.EmailProtocol.Models;
+using QuMail.EmailProtocol.Services;
 using Xunit;
 using FluentAssertions;
 
@@ -51,6 +63,61 @@ public class EmailControllerIntegrationTests
         }
     }
 
+    [Fact]
+    public async Task InboxPageEndpoint_CursorPaging_VisitsEveryEmailOnceNewestFirst()
+    {
+        // This test pages GetInboxPage over an in-memory database: pages follow
+        // (SentAt, Id) descending, the returned cursor leads to the next page, and
+        // emails sharing a SentAt are neither skipped nor repeated
+
+        // Arrange
+        using var context = NewInMemoryContext();
+        var sameTime = new DateTime(2025, 1, 1, 12, 0, 0, DateTimeKind.Utc);
+        var emails = new List<Email>();
+        for (int i = 0; i < 7; i++) emails.Add(NewInboxEmail("recipient@test.com", sameTime, i % 2 == 0 ? "NONE" : "PQC_3_LAYER"));
+        for (int i = 0; i < 5; i++) emails.Add(NewInboxEmail("recipient@test.com", sameTime.AddMinutes(-i - 1), "NONE"));
+        emails.Add(NewInboxEmail("other@test.com", sameTime, "NONE"));
+        context.Emails.AddRange(emails);
+        await context.SaveChangesAsync();
+        var expected = emails.Where(e => e.RecipientEmail == "recipient@test.com")
+            .OrderByDescending(e => e.SentAt).ThenByDescending(e => e.Id).ToList();
+        var controller = NewController(context);
+
+        // Act - Page with limit 4, following nextCursor
+        var seen = new List<(Guid Id, string Subject)>();
+        var pages = 0;
+        string? cursor = null;
+        do
+        {
+            var result = await controller.GetInboxPage("recipient@test.com", cursor, limit: 4);
+            var page = JsonSerializer.SerializeToElement(result.Should().BeOfType<OkObjectResult>().Subject.Value);
+            foreach (var e in page.GetProperty("emails").EnumerateArray())
+                seen.Add((e.GetProperty("Id").GetGuid(), e.GetProperty("Subject").GetString()!));
+            cursor = page.GetProperty("nextCursor").GetString();
+            page.GetProperty("hasMore").GetBoolean().Should().Be(cursor != null);
+            pages++;
+        } while (cursor != null);
+
+        // Assert
+        pages.Should().Be(3);
+        seen.Select(e => e.Id).Should().Equal(expected.Select(e => e.Id));
+        seen.Select(e => e.Subject).Should().Equal(expected.Select(e => e.Subject));
+    }
+
+    [Fact]
+    public async Task InboxPageEndpoint_InvalidCursor_ReturnsBadRequest()
+    {
+        // Arrange
+        using var context = NewInMemoryContext();
+        var controller = NewController(context);
+
+        // Act
+        var result = await controller.GetInboxPage("recipient@test.com", "not-a-cursor", limit: 4);
+
+        // Assert
+        result.Should().BeOfType<BadRequestObjectResult>();
+    }
+
     [Fact]
     public void InboxEndpoint_NonPQCEmail_AttemptsAutomaticDecryption()
     {
@@ -111,12 +178,10 @@ public class EmailControllerIntegrationTests
     {
         // This test verifies the decryption flow removes layers in correct reverse order
 
-        // Arrange - Start with fully encrypted data
-        var otpEnvelope = new Dictionary<string, string>
-        {
-            ["otp_key_id"] = "K123",
-            ["ciphertext_b64url"] = "ENCRYPTED_AES_ENVELOPE"
-        };
+        // Arrange - Start with fully encrypted data (OTP over AES over the PQC envelope)
+        var pqcJson = JsonSerializer.Serialize(SimulatePQCEncryption("Hello World", "test_public_key"));
+        var aesEnvelopeIn = SimulateAESEncryption(Convert.ToBase64String(System.Text.Encoding.UTF8.GetBytes(pqcJson)));
+        var otpEnvelope = SimulateOTPEncryption(JsonSerializer.Serialize(aesEnvelopeIn));
 
         // Phase 1: Decrypt OTP layer
         var aesEnvelopeJson = SimulateOTPDecryption(otpEnvelope);
@@ -268,6 +333,47 @@ public class EmailControllerIntegrationTests
         return System.Text.Encoding.UTF8.GetString(Convert.FromBase64String(base64Part));
     }
 
+    private static AuthDbContext NewInMemoryContext()
+    {
+        var options = new DbContextOptionsBuilder<AuthDbContext>()
+            .UseInMemoryDatabase($"inbox-{Guid.NewGuid()}")
+            .Options;
+        return new AuthDbContext(options);
+    }
+
+    private static EmailController NewController(AuthDbContext context)
+    {
+        var otpEngine = Mock.Of<IOneTimePadEngine>();
+        var keyManager = Mock.Of<IQuantumKeyManager>();
+        var kyber = new Level3KyberPQC();
+        var enhanced = new Level3EnhancedPQC();
+        return new EmailController(
+            context,
+            NullLogger<EmailController>.Instance,
+            kyber,
+            new Level3PQCEmailService(kyber, otpEngine, keyManager),
+            enhanced,
+            new Level3HybridEncryption(enhanced, otpEngine, keyManager),
+            new DecryptedContentCache(1 << 20, TimeSpan.FromMinutes(5)),
+            new KeyManagerClient(new HttpClient()));
+    }
+
+    // Plain-text subject: not an envelope, so the page returns it without calling a service
+    private static Email NewInboxEmail(string recipient, DateTime sentAt, string encryptionMethod)
+    {
+        var id = Guid.NewGuid();
+        return new Email
+        {
+            Id = id,
+            SenderEmail = "sender@test.com",
+            RecipientEmail = recipient,
+            Subject = $"Subject {id}",
+            Body = "Body",
+            SentAt = sentAt,
+            EncryptionMethod = encryptionMethod
+        };
+    }
+
     private string SimulatePQCDecryption(Dictionary<string, string> envelope, string privateKey)
     {
         var encryptedBody = envelope["encryptedBody"];
@@ -0,0 +1,155 @@
+using System;
+using System.Collections.Generic;
+using System.Linq;
+using System.Net;
+using System.Net.Http;
+using System.Text;
+using System.Threading;
+using System.Threading.Tasks;
+using FluentAssertions;
+using QuMail.EmailProtocol.Services;
+using Xunit;
+
+namespace QuMail.EmailProtocol.Tests;
+
+/// <summary>
+/// Tests for the Key Manager client behind the in-process AES layer
+/// </summary>
+public class KeyManagerClientTests
+{
+    private sealed class FakeKm : HttpMessageHandler
+    {
+        public readonly Dictionary<string, byte[]> Keys = new();
+        public bool HasBatchRoute = true;
+        public string? JsonKeyField;     // "key_hex" or "key" (base64): answer key requests in JSON
+        public readonly List<string> Requests = new();
+
+        private HttpResponseMessage KeyResponse(byte[] key, string? keyId)
+        {
+            if (JsonKeyField == null)
+                return new HttpResponseMessage(HttpStatusCode.OK) { Content = new ByteArrayContent(key) };
+            var value = JsonKeyField == "key_hex" ? Convert.ToHexString(key) : Convert.ToBase64String(key);
+            var idField = keyId == null ? "" : $",\"key_id\":\"{keyId}\"";
+            return new HttpResponseMessage(HttpStatusCode.OK)
+            {
+                Content = new StringContent($"{{\"{JsonKeyField}\":\"{value}\"{idField}}}", Encoding.UTF8, "application/json")
+            };
+        }
+
+        protected override async Task<HttpResponseMessage> SendAsync(HttpRequestMessage request, CancellationToken cancellationToken)
+        {
+            var path = request.RequestUri!.AbsolutePath;
+            Requests.Add($"{request.Method} {path}");
+
+            if (request.Method == HttpMethod.Get && path == "/otp/keys")
+            {
+                if (JsonKeyField != null) return KeyResponse(new byte[16], "K-json");
+                var response = new HttpResponseMessage(HttpStatusCode.OK) { Content = new ByteArrayContent(new byte[16]) };
+                response.Headers.Add("X-Key-Id", "K-new");
+                return response;
+            }
+            if (request.Method == HttpMethod.Post && path == "/otp/keys/batch")
+            {
+                if (!HasBatchRoute) return new HttpResponseMessage(HttpStatusCode.NotFound);
+                var body = await request.Content!.ReadAsStringAsync(cancellationToken);
+                var found = Keys.Where(k => body.Contains($"\"{k.Key}\""))
+                                .Select(k => $"\"{k.Key}\":\"{Convert.ToHexString(k.Value)}\"");
+                return new HttpResponseMessage(HttpStatusCode.OK)
+                {
+                    Content = new StringContent("{\"keys\":{" + string.Join(",", found) + "},\"missing\":[]}", Encoding.UTF8, "application/json")
+                };
+            }
+            if (request.Method == HttpMethod.Get && path.StartsWith("/otp/keys/"))
+            {
+                return Keys.TryGetValue(path["/otp/keys/".Length..], out var key)
+                    ? KeyResponse(key, null)
+                    : new HttpResponseMessage(HttpStatusCode.NotFound);
+            }
+            return new HttpResponseMessage(HttpStatusCode.NotFound);
+        }
+    }
+
+    private static KeyManagerClient NewClient(FakeKm km) =>
+        new KeyManagerClient(new HttpClient(km) { BaseAddress = new Uri("http://km.test/") });
+
+    [Fact]
+    public async Task NewKeyAsync_ReturnsKeyAndIdFromHeader()
+    {
+        // Arrange
+        var km = new FakeKm();
+
+        // Act
+        var (keyId, key) = await NewClient(km).NewKeyAsync(16);
+
+        // Assert
+        keyId.Should().Be("K-new");
+        key.Should().HaveCount(16);
+    }
+
+    [Fact]
+    public async Task GetKeysAsync_OneBatchRequestLeavesOutUnknownIds()
+    {
+        // Arrange
+        var km = new FakeKm();
+        km.Keys["K-1"] = new byte[] { 1, 2, 3 };
+        km.Keys["K-2"] = new byte[] { 4, 5, 6 };
+
+        // Act
+        var keys = await NewClient(km).GetKeysAsync(new[] { "K-1", "K-2", "K-1", "K-gone" });
+
+        // Assert
+        keys.Keys.Should().BeEquivalentTo("K-1", "K-2");
+        keys["K-2"].Should().Equal(4, 5, 6);
+        km.Requests.Should().Equal("POST /otp/keys/batch");
+    }
+
+    [Fact]
+    public async Task GetKeysAsync_KmWithoutBatchRoute_FallsBackToPerIdLookups()
+    {
+        // Arrange
+        var km = new FakeKm { HasBatchRoute = false };
+        km.Keys["K-1"] = new byte[] { 7 };
+
+        // Act
+        var keys = await NewClient(km).GetKeysAsync(new[] { "K-1", "K-gone" });
+
+        // Assert
+        keys.Should().ContainKey("K-1").WhoseValue.Should().Equal(7);
+        keys.Should().NotContainKey("K-gone");
+        km.Requests.Should().Equal("POST /otp/keys/batch", "GET /otp/keys/K-1", "GET /otp/keys/K-gone");
+    }
+
+    [Theory]
+    [InlineData("key_hex")]
+    [InlineData("key")]
+    public async Task NewKeyAsync_JsonResponse_ReadsKeyAndIdFromBody(string field)
+    {
+        // Arrange
+        var km = new FakeKm { JsonKeyField = field };
+
+        // Act
+        var (keyId, key) = await NewClient(km).NewKeyAsync(16);
+
+        // Assert
+        keyId.Should().Be("K-json");
+        key.Should().HaveCount(16);
+    }
+
+    [Theory]
+    [InlineData("key_hex")]
+    [InlineData("key")]
+    public async Task GetKeyAsync_JsonResponse_DecodesKey(string field)
+    {
+        // Arrange
+        var km = new FakeKm { JsonKeyField = field, HasBatchRoute = false };
+        km.Keys["K-1"] = new byte[] { 0xde, 0xad, 0xbe, 0xef };
+
+        // Act
+        var key = await NewClient(km).GetKeyAsync("K-1");
+        var keys = await NewClient(km).GetKeysAsync(new[] { "K-1" });
+
+        // Assert
+        key.Should().Equal(0xde, 0xad, 0xbe, 0xef);
+        keys["K-1"].Should().Equal(0xde, 0xad, 0xbe, 0xef);
+    }
+}
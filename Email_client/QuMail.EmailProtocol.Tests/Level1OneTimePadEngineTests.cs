@@ -0,0 +1,127 @@
+using System;
+using System.Linq;
+using System.Security.Cryptography;
+using FluentAssertions;
+using QuMail.EmailProtocol.Services;
+using Xunit;
+
+namespace QuMail.EmailProtocol.Tests;
+
+/// <summary>
+/// Tests for the vectorised one-time pad and key expansion core
+/// </summary>
+public class Level1OneTimePadEngineTests
+{
+    private static byte[] Random(int length)
+    {
+        var bytes = new byte[length];
+        RandomNumberGenerator.Fill(bytes);
+        return bytes;
+    }
+
+    [Fact]
+    public void Xor_EveryLengthAndOffset_MatchesBytewiseXor()
+    {
+        // Arrange - lengths and offsets around the 16/32/64-byte vector widths
+        var data = Random(300);
+        var pad = Random(300);
+
+        foreach (var offset in new[] { 0, 1, 7 })
+        {
+            for (int length = 0; length <= 200; length++)
+            {
+                var output = new byte[length];
+
+                // Act
+                Level1OneTimePadEngine.Xor(data.AsSpan(offset, length), pad.AsSpan(offset, length), output);
+
+                // Assert
+                var expected = Enumerable.Range(offset, length).Select(i => (byte)(data[i] ^ pad[i])).ToArray();
+                output.Should().Equal(expected, $"length {length} at offset {offset}");
+            }
+        }
+    }
+
+    [Fact]
+    public void Xor_InPlace_RoundTrips()
+    {
+        // Arrange
+        var plaintext = Random(1000);
+        var pad = Random(1024);
+        var buffer = (byte[])plaintext.Clone();
+
+        // Act
+        Level1OneTimePadEngine.Xor(buffer, pad, buffer);
+        var changed = !buffer.SequenceEqual(plaintext);
+        Level1OneTimePadEngine.Xor(buffer, pad, buffer);
+
+        // Assert
+        changed.Should().BeTrue();
+        buffer.Should().Equal(plaintext);
+    }
+
+    [Fact]
+    public void Xor_PadShorterThanData_Throws()
+    {
+        var act = () => Level1OneTimePadEngine.Xor(new byte[10], new byte[9], new byte[10]);
+
+        act.Should().Throw<ArgumentException>();
+    }
+
+    [Fact]
+    public void EncryptDecrypt_WithLongerKey_RoundTrips()
+    {
+        // Arrange
+        var engine = new Level1OneTimePadEngine();
+        var plaintext = Random(4097);
+        var key = Random(5000);
+
+        // Act
+        var encrypted = engine.Encrypt(plaintext, key, "K-1");
+        var decrypted = engine.Decrypt(encrypted.EncryptedData, key);
+
+        // Assert
+        encrypted.BytesUsed.Should().Be(plaintext.Length);
+        decrypted.Should().Equal(plaintext);
+    }
+
+    [Fact]
+    public void ExpandKey_MatchesLegacySha256Chain()
+    {
+        // Arrange - the PQC layers' original array-based expansion; output must not change
+        static byte[] Legacy(byte[] key, int requiredLength)
+        {
+            if (requiredLength <= key.Length) return key.Take(requiredLength).ToArray();
+            var expanded = new byte[requiredLength];
+            var rounds = (requiredLength + key.Length - 1) / key.Length;
+            using var sha256 = SHA256.Create();
+            var currentKey = key;
+            var offset = 0;
+            for (int round = 0; round < rounds; round++)
+            {
+                var hash = sha256.ComputeHash(currentKey.Concat(BitConverter.GetBytes(round)).ToArray());
+                var bytesToCopy = Math.Min(hash.Length, requiredLength - offset);
+                Array.Copy(hash, 0, expanded, offset, bytesToCopy);
+                offset += bytesToCopy;
+                currentKey = hash;
+            }
+            return expanded;
+        }
+
+        // Seeds over 32 bytes run fewer rounds than there are hash blocks to fill
+        foreach (var seedLength in new[] { 16, 32, 48, 64 })
+        {
+            var seed = Random(seedLength);
+            foreach (var length in new[] { 1, 16, 31, 32, 33, 64, 97, 100, 1000 })
+            {
+                var expanded = new byte[length];
+
+                // Act
+                Level1OneTimePadEngine.ExpandKey(seed, expanded);
+
+                // Assert
+                expanded.Should().Equal(Legacy(seed, length), $"seed {seedLength}, length {length}");
+            }
+        }
+    }
+}
@@ -0,0 +1,195 @@
+using System;
+using System.Security.Cryptography;
+using FluentAssertions;
+using QuMail.EmailProtocol.Services;
+using Xunit;
+
+namespace QuMail.EmailProtocol.Tests;
+
+/// <summary>
+/// Tests for the libqmcrypto bindings. They only run where the library is deployed next to
+/// the test assembly (libqmcrypto.so / qmcrypto.dll, see level2new/qm_crypto.h) and pass
+/// trivially elsewhere, since the backend falls back to the HTTP services without it.
+/// </summary>
+public class NativeCryptoTests
+{
+    private static readonly byte[] Key = Convert.FromHexString("000102030405060708090a0b0c0d0e0f");
+    private static readonly byte[] Iv = Convert.FromHexString("0a0b0c0d0e0f101112131415");
+    private static readonly byte[] Aad = { (byte)'a', (byte)'b' };
+    private static readonly byte[] Plaintext = System.Text.Encoding.UTF8.GetBytes("{\"plaintext\":\"hi there\"}");
+
+    [Fact]
+    public void Seal_MatchesAesServiceOutput()
+    {
+        if (!NativeCrypto.IsAvailable) return;
+
+        // Arrange - expected values from aes_gcm_demo with the same key, IV and AAD
+        using var key = NativeCrypto.CreateGcmKey(Key);
+        var ciphertext = new byte[Plaintext.Length];
+        var tag = new byte[NativeCrypto.TagLength];
+
+        // Act
+        NativeCrypto.Seal(key, Iv, Aad, Plaintext, ciphertext, tag);
+
+        // Assert
+        Convert.ToHexString(ciphertext).Should().BeEquivalentTo("7a4ed78311451f3f537b60453cacd9e4313acb78d9324f09");
+        Convert.ToHexString(tag).Should().BeEquivalentTo("4c4b3f80e0d40ba5584e881c0a2d8eb9");
+    }
+
+    [Fact]
+    public void TryOpen_TamperedTag_FailsWithoutWritingPlaintext()
+    {
+        if (!NativeCrypto.IsAvailable) return;
+
+        // Arrange
+        using var key = NativeCrypto.CreateGcmKey(Key);
+        var ciphertext = new byte[Plaintext.Length];
+        var tag = new byte[NativeCrypto.TagLength];
+        NativeCrypto.Seal(key, Iv, Aad, Plaintext, ciphertext, tag);
+        var opened = new byte[ciphertext.Length];
+
+        // Act
+        var ok = NativeCrypto.TryOpen(key, Iv, Aad, ciphertext, tag, opened);
+        tag[0] ^= 1;
+        var tampered = new byte[ciphertext.Length];
+        var tamperedOk = NativeCrypto.TryOpen(key, Iv, Aad, ciphertext, tag, tampered);
+
+        // Assert
+        ok.Should().BeTrue();
+        opened.Should().Equal(Plaintext);
+        tamperedOk.Should().BeFalse();
+        tampered.Should().OnlyContain(b => b == 0);
+    }
+
+    [Fact]
+    public void CreateGcmKey_BadLength_Throws()
+    {
+        if (!NativeCrypto.IsAvailable) return;
+
+        var act = () => NativeCrypto.CreateGcmKey(new byte[5]);
+
+        act.Should().Throw<ArgumentException>();
+    }
+
+    [Fact]
+    public void HkdfSha256_MatchesRfc5869TestCase1()
+    {
+        if (!NativeCrypto.IsAvailable) return;
+
+        // Arrange - RFC 5869 appendix A.1
+        var ikm = Convert.FromHexString("0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b");
+        var salt = Convert.FromHexString("000102030405060708090a0b0c");
+        var info = Convert.FromHexString("f0f1f2f3f4f5f6f7f8f9");
+        var okm = new byte[42];
+
+        // Act
+        NativeCrypto.HkdfSha256(ikm, salt, info, okm);
+
+        // Assert
+        Convert.ToHexString(okm).Should().BeEquivalentTo(
+            "3cb25f25faacd57a90434f64d0362f2a2d2d0a90cf1a5a4c5db02d56ecc4c5bf34007208d5b887185865");
+    }
+
+    [Fact]
+    public void HkdfSha256_MatchesFrameworkHkdf()
+    {
+        if (!NativeCrypto.IsAvailable) return;
+
+        foreach (var length in new[] { 1, 32, 33, 100, NativeCrypto.HkdfMaxOutputLength })
+        {
+            // Arrange
+            var ikm = RandomNumberGenerator.GetBytes(48);
+            var info = RandomNumberGenerator.GetBytes(20);
+            var native = new byte[length];
+            var managed = new byte[length];
+
+            // Act - empty salt on both sides, i.e. 32 zero bytes
+            NativeCrypto.HkdfSha256(ikm, ReadOnlySpan<byte>.Empty, info, native);
+            HKDF.DeriveKey(HashAlgorithmName.SHA256, ikm, managed, ReadOnlySpan<byte>.Empty, info);
+
+            // Assert
+            native.Should().Equal(managed, $"length {length}");
+        }
+    }
+
+    [Fact]
+    public void HkdfSha256_OutputOverRfcLimit_Throws()
+    {
+        if (!NativeCrypto.IsAvailable) return;
+
+        var act = () => NativeCrypto.HkdfSha256(new byte[32], new byte[32], new byte[1], new byte[NativeCrypto.HkdfMaxOutputLength + 1]);
+
+        act.Should().Throw<ArgumentException>();
+    }
+
+    [Fact]
+    public void Sha256AndHmac_MatchFramework()
+    {
+        if (!NativeCrypto.IsAvailable) return;
+
+        foreach (var length in new[] { 0, 3, 55, 56, 64, 1000 })
+        {
+            // Arrange
+            var data = RandomNumberGenerator.GetBytes(length);
+            var key = RandomNumberGenerator.GetBytes(length + 1);
+            var digest = new byte[NativeCrypto.Sha256Length];
+            var mac = new byte[NativeCrypto.Sha256Length];
+
+            // Act
+            NativeCrypto.Sha256(data, digest);
+            NativeCrypto.HmacSha256(key, data, mac);
+
+            // Assert
+            digest.Should().Equal(SHA256.HashData(data), $"SHA-256 of {length} bytes");
+            mac.Should().Equal(HMACSHA256.HashData(key, data), $"HMAC over {length} bytes");
+        }
+    }
+
+    [Fact]
+    public void Sha256Many_MatchesOneAtATime()
+    {
+        if (!NativeCrypto.IsAvailable) return;
+
+        // Arrange - 19 messages: two full batches of eight plus a remainder
+        const int Count = 19, Length = 70;
+        var messages = RandomNumberGenerator.GetBytes(Count * Length);
+        var digests = new byte[Count * NativeCrypto.Sha256Length];
+
+        // Act
+        NativeCrypto.Sha256Many(messages, Length, Count, digests);
+
+        // Assert
+        for (int i = 0; i < Count; i++)
+            digests.AsSpan(i * NativeCrypto.Sha256Length, NativeCrypto.Sha256Length).ToArray()
+                .Should().Equal(SHA256.HashData(messages.AsSpan(i * Length, Length)), $"message {i}");
+    }
+
+    [Fact]
+    public void Sha256ChainExpand_MatchesSha256Chain()
+    {
+        if (!NativeCrypto.IsAvailable) return;
+
+        foreach (var seedLength in new[] { 32, 48 })
+        foreach (var length in new[] { 33, 64, 100, 1000 })
+        {
+            // Arrange - block r = SHA-256(previous || r as little-endian int32), from the seed, for
+            // ceil(length / seed length) rounds; anything past them stays zero
+            var seed = RandomNumberGenerator.GetBytes(seedLength);
+            var expected = length <= seedLength ? seed[..length] : new byte[length];
+            var rounds = (length + seedLength - 1) / seedLength;
+            var previous = seed;
+            for (int round = 0, offset = 0; length > seedLength && round < rounds && offset < length; round++, offset += 32)
+            {
+                previous = SHA256.HashData([.. previous, .. BitConverter.GetBytes(round)]);
+                previous.AsSpan(0, Math.Min(32, length - offset)).CopyTo(expected.AsSpan(offset));
+            }
+            var native = new byte[length];
+
+            // Act
+            NativeCrypto.Sha256ChainExpand(seed, native);
+
+            // Assert
+            native.Should().Equal(expected, $"seed {seedLength}, length {length}");
+        }
+    }
+}
@@ -0,0 +1,101 @@
+using System;
+using System.Linq;
+using System.Threading;
+using System.Threading.Tasks;
+using FluentAssertions;
+using QuMail.EmailProtocol.Services;
+using Xunit;
+
+namespace QuMail.EmailProtocol.Tests;
+
+/// <summary>
+/// Tests for the bounded-concurrency pipeline used by attachment encryption
+/// </summary>
+public class ParallelPipelineTests
+{
+    [Fact]
+    public async Task RunAsync_ReturnsResultsInInputOrder()
+    {
+        // Arrange - later items finish first
+        var items = Enumerable.Range(0, 10).ToArray();
+
+        // Act
+        var results = await ParallelPipeline.RunAsync(items, _ => 1,
+            async (i, _) => { await Task.Delay((10 - i) * 5); return $"env-{i}"; },
+            maxConcurrency: 4, maxInFlightBytes: 100);
+
+        // Assert
+        results.Should().Equal(items.Select(i => $"env-{i}"));
+    }
+
+    [Fact]
+    public async Task RunAsync_RespectsConcurrencyAndByteLimits()
+    {
+        // Arrange
+        var sizes = new long[] { 40, 40, 40, 10, 10, 10, 10, 10 };
+        int running = 0, maxRunning = 0;
+        long bytes = 0, maxBytes = 0;
+        var gate = new object();
+
+        // Act
+        await ParallelPipeline.RunAsync(sizes, s => s, async (s, _) =>
+        {
+            lock (gate)
+            {
+                running++; bytes += s;
+                maxRunning = Math.Max(maxRunning, running);
+                maxBytes = Math.Max(maxBytes, bytes);
+            }
+            await Task.Delay(20);
+            lock (gate) { running--; bytes -= s; }
+            return s;
+        }, maxConcurrency: 3, maxInFlightBytes: 90);
+
+        // Assert
+        maxRunning.Should().BeLessThanOrEqualTo(3);
+        maxBytes.Should().BeLessThanOrEqualTo(90);
+    }
+
+    [Fact]
+    public async Task RunAsync_ItemLargerThanByteLimit_RunsAlone()
+    {
+        // Arrange
+        var sizes = new long[] { 10, 500, 10 };
+        int running = 0, runningWithLarge = 0;
+
+        // Act
+        var results = await ParallelPipeline.RunAsync(sizes, s => s, async (s, _) =>
+        {
+            var now = Interlocked.Increment(ref running);
+            if (s == 500) runningWithLarge = now;
+            await Task.Delay(20);
+            Interlocked.Decrement(ref running);
+            return s;
+        }, maxConcurrency: 4, maxInFlightBytes: 100);
+
+        // Assert
+        results.Should().Equal(10, 500, 10);
+        runningWithLarge.Should().Be(1);
+    }
+
+    [Fact]
+    public async Task RunAsync_StepFails_RethrowsAndSkipsUnstartedItems()
+    {
+        // Arrange
+        var items = Enumerable.Range(0, 20).ToArray();
+        int started = 0;
+
+        // Act
+        var act = () => ParallelPipeline.RunAsync(items, _ => 1, async (i, _) =>
+        {
+            Interlocked.Increment(ref started);
+            await Task.Delay(5);
+            if (i == 1) throw new InvalidOperationException("relay down");
+            return i;
+        }, maxConcurrency: 2, maxInFlightBytes: 100);
+
+        // Assert
+        await act.Should().ThrowAsync<InvalidOperationException>().WithMessage("relay down");
+        started.Should().BeLessThan(items.Length);
+    }
+}
@@ -0,0 +1,179 @@
+using System;
+using System.Linq;
+using System.Text;
+using FluentAssertions;
+using QuMail.EmailProtocol.Services;
+using Xunit;
+
+namespace QuMail.EmailProtocol.Tests;
+
+/// <summary>
+/// Tests for the binary QE envelope shared with the native code and the relays
+/// </summary>
+public class QuMailEnvelopeTests
+{
+    // aes_gcm_demo <000102..0f> <101112..1b> --seal-env K-42 --aad cafe <<< "hello" (no newline)
+    private const string NativeGcmEnvelopeHex =
+        "51450201010103044b2d3432040c101112131415161718191a1b0502cafe070526285707ef08105efb0cf6cdd32975fe97a84e24ed19d7";
+
+    // The same seal from before the header was authenticated (version 1)
+    private const string NativeGcmEnvelopeV1Hex =
+        "51450101010103044b2d3432040c101112131415161718191a1b0502cafe070526285707ef08107edf4ce739847030f339007128eed735";
+
+    [Fact]
+    public void Parse_NativeGcmEnvelope_ReadsAllFields()
+    {
+        // Act
+        var env = QuMailEnvelope.Parse(Convert.FromHexString(NativeGcmEnvelopeHex));
+
+        // Assert
+        env.Algorithm.Should().Be(QuMailEnvelope.AlgAesGcm);
+        env.IsInner.Should().BeFalse();
+        env.KeyId.Should().Be("K-42");
+        Convert.ToHexString(env.Iv).Should().Be("101112131415161718191A1B");
+        Convert.ToHexString(env.Aad).Should().Be("CAFE");
+        Convert.ToHexString(env.Ciphertext).Should().Be("26285707EF");
+        Convert.ToHexString(env.Tag).Should().Be("5EFB0CF6CDD32975FE97A84E24ED19D7");
+    }
+
+    [Fact]
+    public void AuthenticatedData_CoversHeaderInVersion2_AadOnlyInVersion1()
+    {
+        // Arrange
+        var v2 = QuMailEnvelope.Parse(Convert.FromHexString(NativeGcmEnvelopeHex));
+        var v1 = QuMailEnvelope.Parse(Convert.FromHexString(NativeGcmEnvelopeV1Hex));
+
+        // Act & Assert: "QE" 2 | ALG 1 | KEY_ID "K-42", then the AAD value
+        Convert.ToHexString(v2.AuthenticatedData()).Should().Be("51450201010103044B2D3432CAFE");
+        Convert.ToHexString(v1.AuthenticatedData()).Should().Be("CAFE");
+        v1.FormatVersion.Should().Be(1);
+        Convert.ToHexString(v1.Encode()).Should().BeEquivalentTo(NativeGcmEnvelopeV1Hex);
+    }
+
+    [Fact]
+    public void Encode_MatchesNativeByteForByte()
+    {
+        // Arrange
+        var env = new QuMailEnvelope
+        {
+            Algorithm = QuMailEnvelope.AlgAesGcm,
+            KeyId = "K-42",
+            Iv = Convert.FromHexString("101112131415161718191a1b"),
+            Aad = Convert.FromHexString("cafe"),
+            Ciphertext = Convert.FromHexString("26285707ef"),
+            Tag = Convert.FromHexString("5efb0cf6cdd32975fe97a84e24ed19d7")
+        };
+
+        // Act & Assert
+        Convert.ToHexString(env.Encode()).Should().BeEquivalentTo(NativeGcmEnvelopeHex);
+    }
+
+    [Fact]
+    public void NestedLayers_AddConstantOverhead()
+    {
+        // Arrange
+        var payload = new byte[1 << 20];
+        new Random(7).NextBytes(payload);
+        var inner = new QuMailEnvelope
+        {
+            Algorithm = QuMailEnvelope.AlgAesGcm,
+            KeyId = "K-1",
+            Iv = new byte[12],
+            Ciphertext = payload,
+            Tag = new byte[16]
+        }.Encode();
+
+        // Act
+        var outer = new QuMailEnvelope
+        {
+            Algorithm = QuMailEnvelope.AlgOtpXor,
+            Flags = QuMailEnvelope.FlagInner,
+            KeyId = "K-2",
+            Ciphertext = inner
+        }.Encode();
+
+        // Assert
+        (outer.Length - payload.Length).Should().BeLessThan(100);
+        var parsed = QuMailEnvelope.Parse(outer);
+        parsed.IsInner.Should().BeTrue();
+        QuMailEnvelope.Parse(parsed.Ciphertext).Ciphertext.SequenceEqual(payload).Should().BeTrue();
+    }
+
+    [Fact]
+    public void Parse_SkipsExtensionRecords()
+    {
+        // Arrange: append an extension record (type 0x90) to the native envelope
+        var bytes = Convert.FromHexString(NativeGcmEnvelopeHex).Concat(new byte[] { 0x90, 0x02, 0xAA, 0xBB }).ToArray();
+
+        // Act & Assert
+        QuMailEnvelope.Parse(bytes).KeyId.Should().Be("K-42");
+    }
+
+    [Fact]
+    public void Compression_RoundTripsAfterFlags_LikeNative()
+    {
+        // Arrange: qm_envelope_encode() of an inner OTP layer over a deflate stream
+        const string nativeHex = "51450201010202010109010103034b2d370703789c03";
+        var env = new QuMailEnvelope
+        {
+            Algorithm = QuMailEnvelope.AlgOtpXor,
+            Flags = QuMailEnvelope.FlagInner,
+            Compression = QuMailEnvelope.CompressionDeflate,
+            KeyId = "K-7",
+            Ciphertext = new byte[] { 0x78, 0x9c, 0x03 }
+        };
+
+        // Act
+        var encoded = env.Encode();
+        var parsed = QuMailEnvelope.Parse(encoded);
+
+        // Assert
+        Convert.ToHexString(encoded).Should().BeEquivalentTo(nativeHex);
+        parsed.Compression.Should().Be(QuMailEnvelope.CompressionDeflate);
+        QuMailEnvelope.Parse(Convert.FromHexString(NativeGcmEnvelopeHex)).Compression.Should().Be(QuMailEnvelope.CompressionNone);
+    }
+
+    [Theory]
+    [InlineData("")]
+    [InlineData("5145")]                       // header only, truncated
+    [InlineData("514503010101070100")]         // unknown version
+    [InlineData("5145010101010701")]           // ciphertext length past the end
+    [InlineData("51450107020000")]             // missing algorithm
+    [InlineData("514501010101")]               // missing ciphertext
+    [InlineData("514501010101010102070100")]   // duplicate algorithm
+    [InlineData("5145010101010701000a01ff")]   // unknown mandatory type
+    [InlineData("514501010101070100090201ff")] // compression record longer than one byte
+    public void TryParse_MalformedEnvelope_ReturnsFalse(string hex)
+    {
+        // Act
+        var ok = QuMailEnvelope.TryParse(Convert.FromHexString(hex), out var env);
+
+        // Assert
+        ok.Should().BeFalse();
+        env.Should().BeNull();
+    }
+
+    [Fact]
+    public void LooksLikeEnvelope_RejectsJsonEnvelopes()
+    {
+        QuMailEnvelope.LooksLikeEnvelope(Encoding.UTF8.GetBytes("{\"otp_key_id\":\"K1\"}")).Should().BeFalse();
+    }
+
+    [Fact]
+    public void StoredText_RoundTrips_AndIgnoresJsonAndPlainText()
+    {
+        // Arrange
+        var env = new QuMailEnvelope { Algorithm = QuMailEnvelope.AlgOtpXor, KeyId = "K1", Ciphertext = new byte[] { 1, 2, 3 } };
+
+        // Act
+        var stored = env.ToStoredText();
+
+        // Assert
+        stored.Should().StartWith("UUU");
+        QuMailEnvelope.TryDecodeStored(stored, out var bytes).Should().BeTrue();
+        bytes.Should().Equal(env.Encode());
+        QuMailEnvelope.TryDecodeStored("{\"otp_key_id\":\"K1\",\"ciphertext_b64url\":\"AAAA\"}", out _).Should().BeFalse();
+        QuMailEnvelope.TryDecodeStored("UUUhello world", out _).Should().BeFalse();
+        QuMailEnvelope.TryDecodeStored(null, out _).Should().BeFalse();
+    }
+}
@@ -0,0 +1,68 @@
+using System.Linq;
+using System.Threading.Tasks;
+using FluentAssertions;
+using Microsoft.Extensions.Logging.Abstractions;
+using QuMail.EmailProtocol.Models;
+using QuMail.EmailProtocol.Services;
+using Xunit;
+
+namespace QuMail.EmailProtocol.Tests;
+
+/// <summary>
+/// Tests for the concurrent key store in SecureKeyManager
+/// </summary>
+public class SecureKeyManagerTests
+{
+    private static SecureKeyManager NewManager() => new SecureKeyManager(NullLogger<SecureKeyManager>.Instance);
+
+    [Fact]
+    public async Task GetKeyAsync_ConcurrentRequestsForOneId_ShareOneKey()
+    {
+        // Arrange
+        var manager = NewManager();
+
+        // Act
+        var keys = await Task.WhenAll(Enumerable.Range(0, 64)
+            .Select(_ => Task.Run(() => manager.GetKeyAsync("K-shared", 128))));
+
+        // Assert
+        keys.Select(k => k.Data).Distinct().Should().HaveCount(1, "every caller must get the same key bytes");
+        keys[0].Size.Should().Be(128);
+    }
+
+    [Fact]
+    public async Task GetKeyAsync_DifferentIds_GetIndependentKeys()
+    {
+        // Arrange
+        var manager = NewManager();
+
+        // Act
+        var keys = await Task.WhenAll(Enumerable.Range(0, 32)
+            .Select(i => Task.Run(() => manager.GetKeyAsync($"K-{i}", 32))));
+
+        // Assert
+        keys.Select(k => k.Id).Should().OnlyHaveUniqueItems();
+        keys.Select(k => System.Convert.ToBase64String(k.Data)).Should().OnlyHaveUniqueItems();
+    }
+
+    [Fact]
+    public async Task RespondToKeyExchangeAsync_Accept_StoresSharedKeyForLaterLookups()
+    {
+        // Arrange
+        var manager = NewManager();
+        var keyId = await manager.InitiateKeyExchangeAsync(new KeyExchangeRequest
+        {
+            SenderEmail = "alice@test.com",
+            RecipientEmail = "bob@test.com",
+            SenderPublicKey = "alice-pk"
+        });
+
+        // Act
+        await manager.RespondToKeyExchangeAsync(keyId, "bob-pk", accept: true);
+        var key = await manager.GetKeyAsync(keyId, 999);
+
+        // Assert
+        key.Size.Should().Be(32, "the exchanged key is returned, not a freshly generated one");
+        (await manager.GetKeyExchangeAsync(keyId))!.Status.Should().Be(KeyExchangeStatus.Accepted);
+    }
+}
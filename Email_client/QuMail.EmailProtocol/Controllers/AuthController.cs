@@ -21,12 +21,14 @@ public class AuthController : ControllerBase
     private readonly AuthDbContext _context;
     private readonly IConfiguration _configuration;
     private readonly ILogger<AuthController> _logger;
+    private readonly DecryptedContentCache _decryptedCache;
 
-    public AuthController(AuthDbContext context, IConfiguration configuration, ILogger<AuthController> logger)
+    public AuthController(AuthDbContext context, IConfiguration configuration, ILogger<AuthController> logger, DecryptedContentCache decryptedCache)
     {
         _context = context;
         _configuration = configuration;
         _logger = logger;
+        _decryptedCache = decryptedCache;
     }
 
     [HttpPost("register")]
@@ -206,6 +208,10 @@ public class AuthController : ControllerBase
     {
         try
         {
+            // Plaintext of this user's mail should not outlive the session
+            var email = User.FindFirst(ClaimTypes.Email)?.Value;
+            if (!string.IsNullOrEmpty(email)) _decryptedCache.RemoveUser(email);
+
             return Ok(new { message = "Logged out successfully" });
         }
         catch (Exception ex)
@@ -251,6 +257,7 @@ public class AuthController : ControllerBase
             _context.Users.Remove(user);
             
             await _context.SaveChangesAsync();
+            _decryptedCache.RemoveUser(user.Email);
 
             _logger.LogInformation($"User account deleted: {user.Email} (ID: {user.Id})");
             
@@ -7,9 +7,11 @@ using System.Text.Json;
 using System.Text.Json.Serialization;
 using System.Net.Http;
 using System.Net.Http.Json;
+using System.Net.Http.Headers;
 using Microsoft.Extensions.Logging;
 using System.Net.Mail;
 using System.Net;
+using System.Security.Cryptography;
 using QuMail.EmailProtocol.Configuration;
 using QuMail.EmailProtocol.Services;
 
@@ -25,6 +27,8 @@ public class EmailController : ControllerBase
     private readonly Level3PQCEmailService _pqcEmailService;
     private readonly Level3EnhancedPQC _enhancedPQC;
     private readonly Level3HybridEncryption _hybridEncryption;
+    private readonly DecryptedContentCache _decryptedCache;
+    private readonly KeyManagerClient _keyManager;
     private static readonly HttpClient _http = new HttpClient
     {
         Timeout = TimeSpan.FromSeconds(30)
@@ -32,6 +36,22 @@ public class EmailController : ControllerBase
     private const string OtpBaseUrl = "http://otp-server:2021";
     private const string AesBaseUrl = "http://aes-server:2022";
     private const int MaxRetries = 3;
+    private const int AesKeyBytes = 16;      // what the AES service asks the KM for
+    private const int AesIvBytes = 12;
+
+    // Compression ahead of the OTP/AES layers is opt-in: OTP_COMPRESSION=auto|deflate|zstd, default none.
+    // A compressed length depends on the content, so once attacker-chosen text (a quoted reply, a
+    // forwarded attachment) shares a message with secrets, the ciphertext length -- and the pad size
+    // the layered seal asks the KM for -- reveals how well the two compress together (CRIME/BREACH).
+    private static readonly string OtpCompression =
+        Environment.GetEnvironmentVariable("OTP_COMPRESSION") is { Length: > 0 } comp ? comp.ToLowerInvariant() : "none";
+
+    // Attachments of one message are encrypted side by side: at most ATTACHMENT_CONCURRENCY
+    // at once (default 4) and ATTACHMENT_INFLIGHT_MB of attachment data in flight (default 64)
+    private static readonly int AttachmentConcurrency =
+        int.TryParse(Environment.GetEnvironmentVariable("ATTACHMENT_CONCURRENCY"), out var c) && c > 0 ? c : 4;
+    private static readonly long AttachmentInFlightBytes =
+        (long.TryParse(Environment.GetEnvironmentVariable("ATTACHMENT_INFLIGHT_MB"), out var mb) && mb > 0 ? mb : 64) * 1024 * 1024;
 
     public EmailController(
         AuthDbContext context, 
@@ -39,7 +59,9 @@ public class EmailController : ControllerBase
         Level3KyberPQC kyberPQC,
         Level3PQCEmailService pqcEmailService,
         Level3EnhancedPQC enhancedPQC,
-        Level3HybridEncryption hybridEncryption)
+        Level3HybridEncryption hybridEncryption,
+        DecryptedContentCache decryptedCache,
+        KeyManagerClient keyManager)
     {
         _context = context;
         _logger = logger;
@@ -47,6 +69,8 @@ public class EmailController : ControllerBase
         _pqcEmailService = pqcEmailService;
         _enhancedPQC = enhancedPQC;
         _hybridEncryption = hybridEncryption;
+        _decryptedCache = decryptedCache;
+        _keyManager = keyManager;
     }
 
     [HttpGet("pqc/public-key/{email}")]
@@ -131,15 +155,11 @@ public class EmailController : ControllerBase
             if (request.Attachments != null && request.Attachments.Count > 0)
             {
                 _logger.LogInformation("Encrypting {Count} attachments with PQC 2-layer (PQC + OTP)", request.Attachments.Count);
-                var encrypted = new List<object>(request.Attachments.Count);
-                foreach (var a in request.Attachments)
+                attachmentsJson = await EncryptAttachmentsAsync(request.Attachments, async content =>
                 {
-                    var pqcEnvelope = await EncryptSingleWithPQC2LayerAsync(a.ContentBase64, recipient.PqcPublicKey);
-
-                    var finalEnvelope = await EncryptBodyAsync(pqcEnvelope);
-                    encrypted.Add(new { fileName = a.FileName, contentType = a.ContentType, envelope = finalEnvelope });
-                }
-                attachmentsJson = JsonSerializer.Serialize(encrypted, _jsonOptions);
+                    var pqcEnvelope = await EncryptSingleWithPQC2LayerAsync(content, recipient.PqcPublicKey);
+                    return await EncryptBodyAsync(pqcEnvelope);
+                });
             }
 
             var sender = await _context.Users.FirstOrDefaultAsync(u => u.Email == request.SenderEmail);
@@ -207,35 +227,15 @@ public class EmailController : ControllerBase
                 });
             }
 
-            _logger.LogInformation("Applying AES encryption to PQC data");
-            
-            var pqcSubjectForAES = PreparePqcEnvelopeForAES(request.PqcEncryptedSubject);
-            var pqcBodyForAES = PreparePqcEnvelopeForAES(request.PqcEncryptedBody);
-            
-            var aesSubject = await EncryptWithAESGCMAsync(pqcSubjectForAES);
-            var aesBody = await EncryptWithAESGCMAsync(pqcBodyForAES);
-
-            _logger.LogInformation("Applying OTP encryption to AES data");
-            var finalSubject = await EncryptBodyAsync(aesSubject);
-            var finalBody = await EncryptBodyAsync(aesBody);
+            _logger.LogInformation("Applying AES and OTP encryption to PQC data");
+            var finalSubject = await SealLayersAsync(request.PqcEncryptedSubject);
+            var finalBody = await SealLayersAsync(request.PqcEncryptedBody);
 
             string? attachmentsJson = null;
             if (request.Attachments != null && request.Attachments.Count > 0)
             {
                 _logger.LogInformation("Encrypting {Count} attachments with PQC 3-layer (PQC + AES + OTP)", request.Attachments.Count);
-                var encrypted = new List<object>(request.Attachments.Count);
-                foreach (var a in request.Attachments)
-                {
-                    var pqcEnvelope = await EncryptSingleWithPQC3LayerAsync(a.ContentBase64, recipient.PqcPublicKey);
-
-                    var pqcEnvelopeForAES = pqcEnvelope;
-
-                    var aesEnvelope = await EncryptWithAESGCMAsync(pqcEnvelopeForAES);
-
-                    var finalEnvelope = await EncryptBodyAsync(aesEnvelope);
-                    encrypted.Add(new { fileName = a.FileName, contentType = a.ContentType, envelope = finalEnvelope });
-                }
-                attachmentsJson = JsonSerializer.Serialize(encrypted, _jsonOptions);
+                attachmentsJson = await EncryptAttachmentsPQC3LayerAsync(request.Attachments, recipient.PqcPublicKey);
             }
 
             var sender = await _context.Users.FirstOrDefaultAsync(u => u.Email == request.SenderEmail);
@@ -411,9 +411,26 @@ public class EmailController : ControllerBase
                 .OrderByDescending(e => e.SentAt)
                 .ToListAsync();
 
+            // Subjects, bodies and attachment envelopes of all non-PQC emails are decrypted in one batch
+            var fields = new List<(string Owner, Guid EmailId, string Field, string Ciphertext)>();
+            var attachmentEntries = new List<AttachmentEntry>?[emailEntities.Count];
+            for (int i = 0; i < emailEntities.Count; i++)
+            {
+                var e = emailEntities[i];
+                if (e.EncryptionMethod == "PQC_2_LAYER" || e.EncryptionMethod == "PQC_3_LAYER") continue;
+                fields.Add((e.RecipientEmail, e.Id, DecryptedContentCache.FieldSubject, e.Subject));
+                fields.Add((e.RecipientEmail, e.Id, DecryptedContentCache.FieldBody, e.Body));
+                attachmentEntries[i] = ParseAttachments(e.Attachments);
+                if (attachmentEntries[i] != null)
+                    fields.AddRange(AttachmentFields(e, attachmentEntries[i]!));
+            }
+            var plaintexts = await DecryptFieldsAsync(fields);
+
             var emails = new List<object>(emailEntities.Count);
-            foreach (var e in emailEntities)
+            int next = 0;
+            for (int i = 0; i < emailEntities.Count; i++)
             {
+                var e = emailEntities[i];
                 if (e.EncryptionMethod == "PQC_2_LAYER" || e.EncryptionMethod == "PQC_3_LAYER")
                 {
                     _logger.LogInformation("PQC email detected - returning encrypted data (frontend will decrypt via separate endpoint)");
@@ -432,9 +449,19 @@ public class EmailController : ControllerBase
                 }
                 else
                 {
-                    var decryptedBody = await TryDecryptBodyAsync(e.Body);
-                    var decryptedSubject = await TryDecryptBodyAsync(e.Subject);
-                    var attachments = await TryDecryptAttachmentsAsync(e.Attachments);
+                    var decryptedSubject = plaintexts[next++];
+                    var decryptedBody = plaintexts[next++];
+                    object[]? attachments = null;
+                    if (attachmentEntries[i] != null)
+                    {
+                        var list = new List<object>(attachmentEntries[i]!.Count);
+                        foreach (var a in attachmentEntries[i]!)
+                        {
+                            var contentBase64 = a.envelope != null ? plaintexts[next++] : a.contentBase64!;
+                            list.Add(new { fileName = a.fileName, contentType = a.contentType, contentBase64 });
+                        }
+                        attachments = list.ToArray();
+                    }
                     emails.Add(new
                     {
                         e.Id,
@@ -464,6 +491,198 @@ public class EmailController : ControllerBase
         }
     }
 
+    private const int InboxPageDefault = 50;
+    private const int InboxPageMax = 200;
+
+    /// <summary>
+    /// Lazy inbox: one keyset-paged query over metadata (no bodies or attachments
+    /// are loaded), newest first. Only the subjects of the returned page are
+    /// decrypted; bodies and attachments come from GET message/{emailId}.
+    /// Pass the returned nextCursor back as ?cursor= for the next page.
+    /// </summary>
+    [HttpGet("inbox/{userEmail}/page")]
+    public async Task<IActionResult> GetInboxPage(string userEmail, [FromQuery] string? cursor = null, [FromQuery] int limit = InboxPageDefault)
+    {
+        try
+        {
+            limit = Math.Clamp(limit, 1, InboxPageMax);
+
+            var query = _context.Emails.AsNoTracking().Where(e => e.RecipientEmail == userEmail);
+            if (!string.IsNullOrEmpty(cursor))
+            {
+                if (!TryDecodeInboxCursor(cursor, out var afterSentAt, out var afterId))
+                {
+                    return BadRequest(new {
+                        success = false,
+                        message = "Invalid cursor"
+                    });
+                }
+                query = query.Where(e => e.SentAt < afterSentAt || (e.SentAt == afterSentAt && e.Id.CompareTo(afterId) < 0));
+            }
+
+            var rows = await query
+                .OrderByDescending(e => e.SentAt)
+                .ThenByDescending(e => e.Id)
+                .Select(e => new
+                {
+                    e.Id,
+                    e.SenderEmail,
+                    e.RecipientEmail,
+                    e.Subject,
+                    e.SentAt,
+                    e.IsRead,
+                    e.EncryptionMethod,
+                    HasAttachments = e.Attachments != null && e.Attachments != ""
+                })
+                .Take(limit + 1)
+                .ToListAsync();
+
+            var hasMore = rows.Count > limit;
+            if (hasMore) rows.RemoveAt(rows.Count - 1);
+
+            // PQC subjects go back encrypted, as in GetInbox; the rest are decrypted in one batch
+            var subjects = rows.Select(e => e.Subject).ToArray();
+            var encrypted = Enumerable.Range(0, rows.Count)
+                .Where(i => rows[i].EncryptionMethod != "PQC_2_LAYER" && rows[i].EncryptionMethod != "PQC_3_LAYER")
+                .ToList();
+            var decrypted = await DecryptFieldsAsync(encrypted
+                .Select(i => (userEmail, rows[i].Id, DecryptedContentCache.FieldSubject, rows[i].Subject)).ToList());
+            for (int j = 0; j < encrypted.Count; j++) subjects[encrypted[j]] = decrypted[j];
+
+            var emails = rows.Select((e, i) => new
+            {
+                e.Id,
+                e.SenderEmail,
+                e.RecipientEmail,
+                Subject = subjects[i],
+                e.SentAt,
+                e.IsRead,
+                e.EncryptionMethod,
+                e.HasAttachments
+            }).ToList();
+
+            var last = rows.Count > 0 ? rows[rows.Count - 1] : null;
+            return Ok(new {
+                success = true,
+                emails = emails,
+                hasMore = hasMore,
+                nextCursor = hasMore && last != null ? EncodeInboxCursor(last.SentAt, last.Id) : null
+            });
+        }
+        catch (Exception ex)
+        {
+            return BadRequest(new {
+                success = false,
+                message = $"Failed to get inbox page: {ex.Message}"
+            });
+        }
+    }
+
+    /// <summary>
+    /// Body and attachments of one message, decrypted on demand (the companion
+    /// of GetInboxPage). PQC messages are returned encrypted, as in GetInbox;
+    /// the frontend decrypts them via decrypt-to-pqc/decrypt-to-pqc2.
+    /// </summary>
+    [HttpGet("message/{emailId}")]
+    public async Task<IActionResult> GetMessage(Guid emailId)
+    {
+        try
+        {
+            var e = await _context.Emails.FindAsync(emailId);
+            if (e == null)
+            {
+                return NotFound(new {
+                    success = false,
+                    message = "Email not found"
+                });
+            }
+
+            if (e.EncryptionMethod == "PQC_2_LAYER" || e.EncryptionMethod == "PQC_3_LAYER")
+            {
+                return Ok(new {
+                    success = true,
+                    email = new
+                    {
+                        e.Id,
+                        Body = e.Body,
+                        attachments = new object[] { },
+                        e.EncryptionMethod
+                    }
+                });
+            }
+
+            // Body and attachment envelopes in one batch
+            var entries = ParseAttachments(e.Attachments);
+            var fields = new List<(string Owner, Guid EmailId, string Field, string Ciphertext)>
+            {
+                (e.RecipientEmail, e.Id, DecryptedContentCache.FieldBody, e.Body)
+            };
+            if (entries != null) fields.AddRange(AttachmentFields(e, entries));
+            var plaintexts = await DecryptFieldsAsync(fields);
+
+            object[]? attachments = null;
+            if (entries != null)
+            {
+                int next = 1;
+                attachments = entries.Select(a => (object)new
+                {
+                    fileName = a.fileName,
+                    contentType = a.contentType,
+                    contentBase64 = a.envelope != null ? plaintexts[next++] : a.contentBase64!
+                }).ToArray();
+            }
+
+            return Ok(new {
+                success = true,
+                email = new
+                {
+                    e.Id,
+                    Body = plaintexts[0],
+                    attachments = attachments,
+                    e.EncryptionMethod
+                }
+            });
+        }
+        catch (Exception ex)
+        {
+            return BadRequest(new {
+                success = false,
+                message = $"Failed to get message: {ex.Message}"
+            });
+        }
+    }
+
+    [HttpGet("cache-stats")]
+    public IActionResult GetDecryptCacheStats()
+    {
+        return Ok(new {
+            success = true,
+            cache = _decryptedCache.GetStats()
+        });
+    }
+
+    // Inbox cursor: base64url of SentAt ticks (8 bytes) + Id (16 bytes) of the last row served
+    private static string EncodeInboxCursor(DateTime sentAt, Guid id)
+    {
+        var raw = new byte[24];
+        BitConverter.TryWriteBytes(raw.AsSpan(0, 8), sentAt.Ticks);
+        id.TryWriteBytes(raw.AsSpan(8));
+        return Convert.ToBase64String(raw).TrimEnd('=').Replace('+', '-').Replace('/', '_');
+    }
+
+    private static bool TryDecodeInboxCursor(string cursor, out DateTime sentAt, out Guid id)
+    {
+        sentAt = default;
+        id = default;
+        var raw = new byte[24];
+        if (!Convert.TryFromBase64String(Base64UrlToBase64(cursor), raw, out var n) || n != raw.Length) return false;
+        var ticks = BitConverter.ToInt64(raw, 0);
+        if (ticks < DateTime.MinValue.Ticks || ticks > DateTime.MaxValue.Ticks) return false;
+        sentAt = new DateTime(ticks, DateTimeKind.Utc);
+        id = new Guid(raw.AsSpan(8));
+        return true;
+    }
+
     [HttpGet("sent/{userEmail}")]
     public async Task<IActionResult> GetSentEmails(string userEmail)
     {
@@ -729,7 +948,17 @@ public class EmailController : ControllerBase
             bool subjectDecryptionFailed = false;
             bool bodyDecryptionFailed = false;
 
-            if (TryParseEnvelope(email.Subject, out var otpSubjectEnvelope))
+            // Sealed by /api/layers/seal: opening the QE layers yields the PQC envelope itself
+            var layeredSubject = QuMailEnvelope.TryDecodeStored(email.Subject, out var subjectLayers);
+            var layeredBody = QuMailEnvelope.TryDecodeStored(email.Body, out var bodyLayers);
+
+            if (layeredSubject)
+            {
+                var opened = await TryOpenLayersToPqcAsync(subjectLayers);
+                subjectDecryptionFailed = opened == null;
+                aesSubject = opened ?? "[Decryption Failed - OTP key may have expired]";
+            }
+            else if (TryParseEnvelope(email.Subject, out var otpSubjectEnvelope))
             {
                 aesSubject = await DecryptOTPAsync(otpSubjectEnvelope);
                 if (aesSubject == "OTP decryption failed" || aesSubject == "Decryption failed")
@@ -745,7 +974,13 @@ public class EmailController : ControllerBase
                 aesSubject = email.Subject;
             }
 
-            if (TryParseEnvelope(email.Body, out var otpBodyEnvelope))
+            if (layeredBody)
+            {
+                var opened = await TryOpenLayersToPqcAsync(bodyLayers);
+                bodyDecryptionFailed = opened == null;
+                aesBody = opened ?? "[Decryption Failed - OTP key may have expired. The encryption key for this message is no longer available.]";
+            }
+            else if (TryParseEnvelope(email.Body, out var otpBodyEnvelope))
             {
                 aesBody = await DecryptOTPAsync(otpBodyEnvelope);
                 if (aesBody == "OTP decryption failed" || aesBody == "Decryption failed")
@@ -759,10 +994,16 @@ public class EmailController : ControllerBase
             {
                 _logger.LogWarning("Failed to parse OTP envelope for body");
                 aesBody = email.Body;
+            }
+
             _logger.LogInformation("Decrypting AES layer for subject and body");
             string pqcSubject, pqcBody;
 
-            if (!subjectDecryptionFailed && TryParseAESEnvelope(aesSubject, out var aesSubjectEnvelope))
+            if (layeredSubject)
+            {
+                pqcSubject = aesSubject;
+            }
+            else if (!subjectDecryptionFailed && TryParseAESEnvelope(aesSubject, out var aesSubjectEnvelope))
             {
                 try
                 {
@@ -785,7 +1026,11 @@ public class EmailController : ControllerBase
                 pqcSubject = aesSubject;
             }
 
-            if (!bodyDecryptionFailed && TryParseAESEnvelope(aesBody, out var aesBodyEnvelope))
+            if (layeredBody)
+            {
+                pqcBody = aesBody;
+            }
+            else if (!bodyDecryptionFailed && TryParseAESEnvelope(aesBody, out var aesBodyEnvelope))
             {
                 try
                 {
@@ -830,7 +1075,17 @@ public class EmailController : ControllerBase
                                 {
                                     _logger.LogInformation("Processing attachment {Index}: {FileName}", idx, fileName);
 
-                                    if (TryParseEnvelope(envelope, out var otpEnvelope))
+                                    if (QuMailEnvelope.TryDecodeStored(envelope, out var layers))
+                                    {
+                                        var pqcEnvelope = await TryOpenLayersToPqcAsync(layers);
+                                        if (pqcEnvelope == null)
+                                        {
+                                            _logger.LogWarning("Opening the OTP/AES layers failed for attachment {Index}: {FileName}, skipping", idx, fileName);
+                                            continue;
+                                        }
+                                        decryptedAttachments.Add(new { fileName, contentType, pqcEnvelope });
+                                    }
+                                    else if (TryParseEnvelope(envelope, out var otpEnvelope))
                                     {
                                         var aesEnvelope = await DecryptOTPAsync(otpEnvelope);
 
@@ -907,12 +1162,16 @@ public class EmailController : ControllerBase
         DefaultIgnoreCondition = JsonIgnoreCondition.WhenWritingNull
     };
 
-    private sealed record OtpEncryptRequest(string text);
-    private sealed record OtpEncryptResponse(string key_id, string ciphertext_b64url);
-    private sealed record OtpDecryptRequest(string key_id, string ciphertext_b64url);
+    // PostAsJsonAsync's defaults, i.e. the body the AES service seals
+    private static readonly JsonSerializerOptions _aesRequestJsonOptions = new JsonSerializerOptions(JsonSerializerDefaults.Web);
+
+    private sealed record OtpEncryptRequest(string text, string? compression = null);
+    private sealed record OtpEncryptResponse(string key_id, string ciphertext_b64url, string? compression = null);
+    private sealed record OtpDecryptRequest(string key_id, string ciphertext_b64url, string? compression = null);
     private sealed record OtpDecryptResponse(string? plaintext_b64url, string? text);
 
-    private sealed record BodyEnvelope(string otp_key_id, string ciphertext_b64url);
+    // compression: what the OTP service compressed the text with before the pad; null for none
+    private sealed record BodyEnvelope(string otp_key_id, string ciphertext_b64url, string? compression = null);
 
     private bool TryParseEnvelope(string body, out BodyEnvelope envelope)
     {
@@ -958,7 +1217,7 @@ public class EmailController : ControllerBase
         {
             _logger.LogInformation("Calling OTP encrypt API at {OtpUrl}/api/otp/encrypt for plaintext length {Length}", OtpBaseUrl, plaintext?.Length ?? 0);
 
-            var req = new OtpEncryptRequest(plaintext);
+            var req = new OtpEncryptRequest(plaintext, OtpCompression);
             using var response = await _http.PostAsJsonAsync($"{OtpBaseUrl}/api/otp/encrypt", req, _jsonOptions);
 
             _logger.LogInformation("OTP encrypt API response status: {StatusCode}", response.StatusCode);
@@ -972,7 +1231,7 @@ public class EmailController : ControllerBase
                 throw new InvalidOperationException("Invalid encrypt response");
             }
 
-            var envelope = new BodyEnvelope(res.key_id, res.ciphertext_b64url);
+            var envelope = new BodyEnvelope(res.key_id, res.ciphertext_b64url, res.compression);
             _logger.LogInformation("OTP encryption successful, key_id: {KeyId}", res.key_id);
             return JsonSerializer.Serialize(envelope, _jsonOptions);
         }, "OTP encryption");
@@ -1122,6 +1381,12 @@ public class EmailController : ControllerBase
         try
         {
             _logger.LogInformation("Attempting to decrypt body: {Body}", body);
+
+            if (QuMailEnvelope.TryDecodeStored(body, out var stored))
+            {
+                _logger.LogInformation("Detected QE envelope, opening it layer by layer");
+                return Convert.ToBase64String(await OpenEnvelopeAsync(stored));
+            }
             
             if (TryParseAESEnvelope(body, out var aesEnvelope))
             {
@@ -1159,12 +1424,311 @@ public class EmailController : ControllerBase
         }
     }
 
+    private const int DecryptBatchMax = 500;            // the services' per-request limit
+    private const int DecryptFallbackConcurrency = 8;
+
+    private sealed record OtpBatchResult(string? text, string? error);
+    private sealed record GcmBatchResult(string? plaintext_b64, string? error);
+    private sealed record DecryptBatchResponse<T>(List<T>? results);
+
+    /// <summary>
+    /// TryDecryptBodyAsync for many bodies at once, results in the same order.
+    /// All OTP envelopes go to the OTP service in one decrypt-batch call and all
+    /// AES envelopes to the AES service in another (chunked at DecryptBatchMax);
+    /// each service resolves its key ids with a single KM lookup and decrypts on
+    /// a worker pool. QE envelopes are opened alongside, DecryptFallbackConcurrency
+    /// at a time. Anything a batch could not decrypt falls back to
+    /// TryDecryptBodyAsync.
+    /// </summary>
+    private async Task<(string[] Texts, bool[] Decrypted)> DecryptBodiesAsync(IReadOnlyList<string> bodies)
+    {
+        var results = new string?[bodies.Count];
+        var decrypted = new bool[bodies.Count];
+        var otp = new List<(int Index, BodyEnvelope Envelope)>();
+        var aes = new List<(int Index, AESEnvelope Envelope)>();
+        var qe = new List<(int Index, byte[] Envelope)>();
+        for (int i = 0; i < bodies.Count; i++)
+        {
+            if (QuMailEnvelope.TryDecodeStored(bodies[i], out var stored)) qe.Add((i, stored));
+            else if (TryParseAESEnvelope(bodies[i], out var aesEnvelope)) aes.Add((i, aesEnvelope));
+            else if (TryParseEnvelope(bodies[i], out var otpEnvelope)) otp.Add((i, otpEnvelope));
+            else if (TryParsePQCEnvelope(bodies[i], out var pqcEnvelope)) results[i] = JsonSerializer.Serialize(pqcEnvelope, _jsonOptions);
+            else results[i] = bodies[i];
+        }
+
+        var otpTask = DecryptOtpBatchAsync(otp.Select(o => o.Envelope).ToList());
+        var aesTask = DecryptAesBatchAsync(aes.Select(a => a.Envelope).ToList());
+        var qeTask = OpenStoredEnvelopesAsync(qe.Select(q => q.Envelope).ToList());
+        await Task.WhenAll(otpTask, aesTask, qeTask);
+
+        for (int j = 0; j < otp.Count; j++)
+        {
+            var text = otpTask.Result[j];
+            // An OTP layer over a PQC envelope goes back to the frontend as the envelope, as in TryDecryptBodyAsync
+            if (text != null && TryParsePQCEnvelope(text, out var pqcEnvelope)) text = JsonSerializer.Serialize(pqcEnvelope, _jsonOptions);
+            results[otp[j].Index] = text;
+            decrypted[otp[j].Index] = text != null;
+        }
+        for (int j = 0; j < aes.Count; j++)
+        {
+            results[aes[j].Index] = aesTask.Result[j];
+            decrypted[aes[j].Index] = aesTask.Result[j] != null;
+        }
+        for (int j = 0; j < qe.Count; j++)
+        {
+            results[qe[j].Index] = qeTask.Result[j];
+            decrypted[qe[j].Index] = qeTask.Result[j] != null;
+        }
+
+        var missed = Enumerable.Range(0, bodies.Count).Where(i => results[i] == null).ToList();
+        if (missed.Count > 0)
+        {
+            _logger.LogWarning("Batch decrypt left {Count} of {Total} bodies, decrypting them one by one", missed.Count, bodies.Count);
+            using var gate = new SemaphoreSlim(DecryptFallbackConcurrency);
+            await Task.WhenAll(missed.Select(async i =>
+            {
+                await gate.WaitAsync();
+                try { results[i] = await TryDecryptBodyAsync(bodies[i]); }
+                finally { gate.Release(); }
+            }));
+        }
+        return (results!, decrypted);
+    }
+
+    /// <summary>
+    /// DecryptBodiesAsync behind the decrypted-content cache: fields already cached
+    /// for their owner cost no crypto or KM call. Only plaintext the OTP/AES services
+    /// produced is cached, never the fallback path's "failed" placeholders.
+    /// </summary>
+    private async Task<string[]> DecryptFieldsAsync(IReadOnlyList<(string Owner, Guid EmailId, string Field, string Ciphertext)> fields)
+    {
+        var texts = new string[fields.Count];
+        var misses = new List<int>();
+        for (int i = 0; i < fields.Count; i++)
+        {
+            var f = fields[i];
+            if (_decryptedCache.TryGet(f.Owner, f.EmailId, f.Field, out var cached)) texts[i] = cached;
+            else misses.Add(i);
+        }
+        if (misses.Count == 0) return texts;
+
+        var (plain, decrypted) = await DecryptBodiesAsync(misses.Select(i => fields[i].Ciphertext).ToList());
+        for (int j = 0; j < misses.Count; j++)
+        {
+            var f = fields[misses[j]];
+            texts[misses[j]] = plain[j];
+            if (decrypted[j]) _decryptedCache.Set(f.Owner, f.EmailId, f.Field, plain[j]);
+        }
+        return texts;
+    }
+
+    // Cache fields of the encrypted attachments, numbered by position among the parsed entries
+    private static IEnumerable<(string Owner, Guid EmailId, string Field, string Ciphertext)> AttachmentFields(Email e, List<AttachmentEntry> entries)
+    {
+        for (int n = 0; n < entries.Count; n++)
+        {
+            if (entries[n].envelope != null)
+                yield return (e.RecipientEmail, e.Id, DecryptedContentCache.FieldAttachment(n), entries[n].envelope!);
+        }
+    }
+
+    // QE envelopes carry binary content (attachments), so their plaintext comes back
+    // base64. Entries stay null where a layer could not be opened
+    private async Task<string?[]> OpenStoredEnvelopesAsync(IReadOnlyList<byte[]> envelopes)
+    {
+        var texts = new string?[envelopes.Count];
+        if (envelopes.Count == 0) return texts;
+        using var gate = new SemaphoreSlim(DecryptFallbackConcurrency);
+        await Task.WhenAll(envelopes.Select(async (envelope, i) =>
+        {
+            await gate.WaitAsync();
+            try { texts[i] = Convert.ToBase64String(await OpenEnvelopeAsync(envelope)); }
+            catch (Exception ex) { _logger.LogWarning(ex, "Opening a QE envelope failed"); }
+            finally { gate.Release(); }
+        }));
+        return texts;
+    }
+
+    /// <summary>
+    /// Opens a stored QE envelope one layer at a time, handing each layer to the
+    /// service that seals it (which also undoes the compression the layer records),
+    /// until a layer not marked inner yields the plaintext.
+    /// </summary>
+    private async Task<byte[]> OpenEnvelopeAsync(byte[] envelope)
+    {
+        while (true)
+        {
+            var layer = QuMailEnvelope.Parse(envelope);
+            var url = layer.Algorithm switch
+            {
+                QuMailEnvelope.AlgOtpXor => $"{OtpBaseUrl}/api/otp/decrypt-env",
+                QuMailEnvelope.AlgAesGcm => $"{AesBaseUrl}/api/gcm/decrypt-env",
+                QuMailEnvelope.AlgAesGcmChunked => $"{AesBaseUrl}/api/gcm/decrypt-chunked?key_id={Uri.EscapeDataString(layer.KeyId ?? "")}",
+                _ => throw new NotSupportedException($"No service opens envelope algorithm {layer.Algorithm}")
+            };
+            // A QMC1 layer sends only its container; the key id goes in the query
+            var payload = layer.Algorithm == QuMailEnvelope.AlgAesGcmChunked
+                ? await PostBytesAsync(url, layer.Ciphertext, "application/octet-stream")
+                : await PostBytesAsync(url, envelope, QuMailEnvelope.ContentType);
+            if (!layer.IsInner) return payload;
+            envelope = payload;
+        }
+    }
+
+    private static async Task<byte[]> PostBytesAsync(string url, byte[] body, string contentType)
+    {
+        using var content = new ByteArrayContent(body);
+        content.Headers.ContentType = new MediaTypeHeaderValue(contentType);
+        using var response = await _http.PostAsync(url, content);
+        response.EnsureSuccessStatusCode();
+        return await response.Content.ReadAsByteArrayAsync();
+    }
+
+    // Entries stay null where the OTP service could not decrypt (or the batch call failed)
+    private async Task<string?[]> DecryptOtpBatchAsync(IReadOnlyList<BodyEnvelope> envelopes)
+    {
+        var texts = new string?[envelopes.Count];
+        try
+        {
+            for (int off = 0; off < envelopes.Count; off += DecryptBatchMax)
+            {
+                var items = envelopes.Skip(off).Take(DecryptBatchMax)
+                    .Select(e => new OtpDecryptRequest(e.otp_key_id, e.ciphertext_b64url, e.compression)).ToList();
+                using var response = await _http.PostAsJsonAsync($"{OtpBaseUrl}/api/otp/decrypt-batch", new { items }, _jsonOptions);
+                response.EnsureSuccessStatusCode();
+                var res = await response.Content.ReadFromJsonAsync<DecryptBatchResponse<OtpBatchResult>>(_jsonOptions);
+                if (res?.results == null || res.results.Count != items.Count)
+                    throw new InvalidOperationException("OTP decrypt-batch returned a malformed response");
+                for (int j = 0; j < items.Count; j++) texts[off + j] = res.results[j].text;
+            }
+        }
+        catch (Exception ex)
+        {
+            _logger.LogWarning(ex, "OTP batch decrypt failed");
+        }
+        return texts;
+    }
+
+    // Opened in-process when libqmcrypto is there; the rest goes to the AES service.
+    // Entries stay null where neither could decrypt (or the batch call failed)
+    private async Task<string?[]> DecryptAesBatchAsync(IReadOnlyList<AESEnvelope> envelopes)
+    {
+        var texts = NativeCrypto.IsAvailable ? await OpenAesInProcessAsync(envelopes) : new string?[envelopes.Count];
+        var pending = Enumerable.Range(0, envelopes.Count).Where(i => texts[i] == null).ToList();
+        try
+        {
+            for (int off = 0; off < pending.Count; off += DecryptBatchMax)
+            {
+                var items = pending.Skip(off).Take(DecryptBatchMax).Select(i => envelopes[i]).Select(e => new
+                {
+                    key_id = e.KeyId,
+                    iv_hex = e.IvHex,
+                    ciphertext_hex = e.CiphertextHex,
+                    tag_hex = e.TagHex,
+                    aad_hex = e.AadHex
+                }).ToList();
+                using var response = await _http.PostAsJsonAsync($"{AesBaseUrl}/api/gcm/decrypt-batch", new { items });
+                response.EnsureSuccessStatusCode();
+                var res = await response.Content.ReadFromJsonAsync<DecryptBatchResponse<GcmBatchResult>>(_jsonOptions);
+                if (res?.results == null || res.results.Count != items.Count)
+                    throw new InvalidOperationException("AES decrypt-batch returned a malformed response");
+                for (int j = 0; j < items.Count; j++)
+                {
+                    var b64 = res.results[j].plaintext_b64;
+                    if (b64 != null) texts[pending[off + j]] = UnwrapAesPlaintext(Encoding.UTF8.GetString(Convert.FromBase64String(b64)));
+                }
+            }
+        }
+        catch (Exception ex)
+        {
+            _logger.LogWarning(ex, "AES batch decrypt failed");
+        }
+        return texts;
+    }
+
+    // Same as the AES service, with the key bytes fetched from the KM in one batch. Entries stay null
+    // where that was not possible (unknown key, tag mismatch, KM unreachable)
+    private async Task<string?[]> OpenAesInProcessAsync(IReadOnlyList<AESEnvelope> envelopes)
+    {
+        var texts = new string?[envelopes.Count];
+        Dictionary<string, byte[]> keys;
+        try
+        {
+            keys = await _keyManager.GetKeysAsync(envelopes.Select(e => e.KeyId));
+        }
+        catch (Exception ex)
+        {
+            _logger.LogWarning(ex, "KM key lookup for in-process AES decrypt failed");
+            return texts;
+        }
+
+        try
+        {
+            foreach (var group in Enumerable.Range(0, envelopes.Count).GroupBy(i => envelopes[i].KeyId))
+            {
+                if (!keys.TryGetValue(group.Key, out var key) || key.Length != AesKeyBytes) continue;
+                using var ks = NativeCrypto.CreateGcmKey(key);
+                foreach (var i in group)
+                    texts[i] = TryOpenAesInProcess(ks, envelopes[i]);
+            }
+        }
+        finally
+        {
+            foreach (var key in keys.Values) CryptographicOperations.ZeroMemory(key);
+        }
+        return texts;
+    }
+
+    private static string? TryOpenAesInProcess(NativeCrypto.GcmKey key, AESEnvelope envelope)
+    {
+        byte[] iv, ciphertext, tag, aad;
+        try
+        {
+            iv = Convert.FromHexString(envelope.IvHex);
+            ciphertext = Convert.FromHexString(envelope.CiphertextHex);
+            tag = Convert.FromHexString(envelope.TagHex);
+            aad = string.IsNullOrEmpty(envelope.AadHex) ? Array.Empty<byte>() : Convert.FromHexString(envelope.AadHex);
+        }
+        catch (FormatException)
+        {
+            return null;
+        }
+        if (iv.Length == 0 || tag.Length != NativeCrypto.TagLength) return null;
+
+        var plaintext = new byte[ciphertext.Length];
+        try
+        {
+            return NativeCrypto.TryOpen(key, iv, aad, ciphertext, tag, plaintext)
+                ? UnwrapAesPlaintext(Encoding.UTF8.GetString(plaintext))
+                : null;
+        }
+        finally
+        {
+            CryptographicOperations.ZeroMemory(plaintext);
+        }
+    }
+
+    // The AES service seals the request body as sent, {"plaintext": "..."}; same unwrapping as DecryptAESAsync
+    private static string UnwrapAesPlaintext(string content)
+    {
+        try
+        {
+            using var doc = JsonDocument.Parse(content);
+            if (doc.RootElement.ValueKind == JsonValueKind.Object && doc.RootElement.TryGetProperty("plaintext", out var plaintext))
+                return plaintext.GetString() ?? string.Empty;
+        }
+        catch (JsonException)
+        {
+        }
+        return content;
+    }
+
     private async Task<string> DecryptOTPAsync(BodyEnvelope envelope)
     {
         try
         {
             _logger.LogInformation("Calling OTP decrypt API with key_id: {KeyId}", envelope.otp_key_id);
-            var req = new OtpDecryptRequest(envelope.otp_key_id, envelope.ciphertext_b64url);
+            var req = new OtpDecryptRequest(envelope.otp_key_id, envelope.ciphertext_b64url, envelope.compression);
             using var response = await _http.PostAsJsonAsync($"{OtpBaseUrl}/api/otp/decrypt", req, _jsonOptions);
             response.EnsureSuccessStatusCode();
             var res = await response.Content.ReadFromJsonAsync<OtpDecryptResponse>(_jsonOptions);
@@ -1204,6 +1768,12 @@ public class EmailController : ControllerBase
 
     private async Task<string> DecryptAESAsync(AESEnvelope envelope)
     {
+        if (NativeCrypto.IsAvailable)
+        {
+            var opened = (await OpenAesInProcessAsync(new[] { envelope }))[0];
+            if (opened != null) return opened;
+        }
+
         try
         {
             _logger.LogInformation("=== AES DECRYPT START ===");
@@ -1390,14 +1960,17 @@ public class EmailController : ControllerBase
         return s;
     }
 
-    private async Task<object[]?> TryDecryptAttachmentsAsync(string? attachmentsJson)
+    private sealed record AttachmentEntry(string fileName, string contentType, string? envelope, string? contentBase64);
+
+    // Stored attachment list -> entries that carry either an envelope or plain base64; null if none
+    private List<AttachmentEntry>? ParseAttachments(string? attachmentsJson)
     {
         if (string.IsNullOrWhiteSpace(attachmentsJson)) return null;
         try
         {
             var list = JsonSerializer.Deserialize<List<Dictionary<string, object>>>(attachmentsJson, _jsonOptions);
             if (list == null || list.Count == 0) return null;
-            var result = new List<object>(list.Count);
+            var result = new List<AttachmentEntry>(list.Count);
             foreach (var item in list)
             {
                 var fileName = item.ContainsKey("fileName") ? item["fileName"]?.ToString() :
@@ -1415,26 +1988,21 @@ public class EmailController : ControllerBase
                 var plainBase64 = item.ContainsKey("contentBase64") ? item["contentBase64"]?.ToString() :
                                  (item.ContainsKey("ContentBase64") ? item["ContentBase64"]?.ToString() : null);
 
-                string contentBase64;
                 if (!string.IsNullOrWhiteSpace(envelope))
                 {
-                    _logger.LogInformation("Decrypting attachment: {FileName}", fileName);
-                    contentBase64 = await TryDecryptBodyAsync(envelope);
+                    result.Add(new AttachmentEntry(fileName, contentType, envelope, null));
                 }
                 else if (!string.IsNullOrWhiteSpace(plainBase64))
                 {
                     _logger.LogWarning("Found plain (unencrypted) attachment: {FileName}", fileName);
-                    contentBase64 = plainBase64;
+                    result.Add(new AttachmentEntry(fileName, contentType, null, plainBase64));
                 }
                 else
                 {
                     _logger.LogWarning("Skipping attachment with no envelope or contentBase64: {FileName}", fileName);
-                    continue;
                 }
-
-                result.Add(new { fileName, contentType, contentBase64 });
             }
-            return result.ToArray();
+            return result;
         }
         catch (Exception ex)
         {
@@ -1442,6 +2010,28 @@ public class EmailController : ControllerBase
             return null;
         }
     }
+
+    private async Task<object[]?> TryDecryptAttachmentsAsync(string? attachmentsJson)
+    {
+        var entries = ParseAttachments(attachmentsJson);
+        if (entries == null) return null;
+        var result = new List<object>(entries.Count);
+        foreach (var a in entries)
+        {
+            string contentBase64;
+            if (a.envelope != null)
+            {
+                _logger.LogInformation("Decrypting attachment: {FileName}", a.fileName);
+                contentBase64 = await TryDecryptBodyAsync(a.envelope);
+            }
+            else
+            {
+                contentBase64 = a.contentBase64!;
+            }
+            result.Add(new { fileName = a.fileName, contentType = a.contentType, contentBase64 });
+        }
+        return result.ToArray();
+    }
     private async Task TrySendExternallyAsync(SendEmailRequest request, User recipient, string subjectEnvelope, string bodyEnvelope)
     {
         try
@@ -1570,45 +2160,89 @@ public class EmailController : ControllerBase
         }
     }
 
-    private async Task<string?> EncryptAttachmentsOTPAsync(List<SendAttachment>? attachments)
+    /// <summary>
+    /// Runs encrypt over every attachment's content through ParallelPipeline
+    /// (AttachmentConcurrency / AttachmentInFlightBytes) and returns the stored
+    /// attachments JSON, in the order the attachments were given.
+    /// </summary>
+    private async Task<string?> EncryptAttachmentsAsync(List<SendAttachment>? attachments, Func<string, Task<string>> encrypt)
     {
         if (attachments == null || attachments.Count == 0) return null;
 
-        var encrypted = new List<object>(attachments.Count);
-        foreach (var a in attachments)
-        {
-            var envelope = await EncryptBodyAsync(a.ContentBase64);
-            encrypted.Add(new { fileName = a.FileName, contentType = a.ContentType, envelope });
-        }
+        var envelopes = await ParallelPipeline.RunAsync(
+            attachments,
+            a => (long)a.ContentBase64.Length,
+            (a, _) => encrypt(a.ContentBase64),
+            AttachmentConcurrency,
+            AttachmentInFlightBytes);
+
+        var encrypted = attachments
+            .Select((a, i) => new { fileName = a.FileName, contentType = a.ContentType, envelope = envelopes[i] })
+            .ToList();
         return JsonSerializer.Serialize(encrypted, _jsonOptions);
     }
 
-    private async Task<string?> EncryptAttachmentsPQC2LayerAsync(List<SendAttachment>? attachments, string recipientPublicKey)
+    private Task<string?> EncryptAttachmentsOTPAsync(List<SendAttachment>? attachments) =>
+        EncryptAttachmentsAsync(attachments, SealAttachmentOtpAsync);
+
+    /// <summary>
+    /// AES layer over an attachment's raw bytes as a QMC1 container (encrypt-chunked,
+    /// 64 KiB chunks sealed separately) instead of hex inside JSON, wrapped in a QE
+    /// envelope that carries the key id. Content that is not valid base64 goes
+    /// through EncryptWithAESGCMAsync as before.
+    /// </summary>
+    private async Task<string> SealAttachmentChunkedAsync(string contentBase64)
     {
-        if (attachments == null || attachments.Count == 0) return null;
+        var data = new byte[contentBase64.Length / 4 * 3];
+        if (!Convert.TryFromBase64String(contentBase64, data, out var n))
+            return await EncryptWithAESGCMAsync(contentBase64);
 
-        var encrypted = new List<object>(attachments.Count);
-        foreach (var a in attachments)
+        return await RetryAsync(async () =>
         {
-            var envelope = await EncryptSingleWithPQC2LayerAsync(a.ContentBase64, recipientPublicKey);
-            encrypted.Add(new { fileName = a.FileName, contentType = a.ContentType, envelope });
-        }
-        return JsonSerializer.Serialize(encrypted, _jsonOptions);
+            using var content = new ByteArrayContent(data, 0, n);
+            content.Headers.ContentType = new MediaTypeHeaderValue("application/octet-stream");
+            using var response = await _http.PostAsync($"{AesBaseUrl}/api/gcm/encrypt-chunked", content);
+            response.EnsureSuccessStatusCode();
+            var keyId = response.Headers.TryGetValues("X-Key-Id", out var ids) ? ids.FirstOrDefault() : null;
+            if (string.IsNullOrEmpty(keyId))
+                throw new InvalidOperationException("AES encrypt-chunked returned no key id");
+            var envelope = new QuMailEnvelope
+            {
+                Algorithm = QuMailEnvelope.AlgAesGcmChunked,
+                KeyId = keyId,
+                Ciphertext = await response.Content.ReadAsByteArrayAsync()
+            };
+            return envelope.ToStoredText();
+        }, "AES attachment encryption");
     }
 
-    private async Task<string?> EncryptAttachmentsPQC3LayerAsync(List<SendAttachment>? attachments, string recipientPublicKey)
+    /// <summary>
+    /// OTP layer over an attachment's raw bytes as a QE envelope (encrypt-env), so
+    /// the pad covers the compressed file rather than its base64 text in JSON.
+    /// Content that is not valid base64 goes through EncryptBodyAsync as before.
+    /// </summary>
+    private async Task<string> SealAttachmentOtpAsync(string contentBase64)
     {
-        if (attachments == null || attachments.Count == 0) return null;
+        var data = new byte[contentBase64.Length / 4 * 3];
+        if (!Convert.TryFromBase64String(contentBase64, data, out var n))
+            return await EncryptBodyAsync(contentBase64);
 
-        var encrypted = new List<object>(attachments.Count);
-        foreach (var a in attachments)
+        return await RetryAsync(async () =>
         {
-            var envelope = await EncryptSingleWithPQC3LayerAsync(a.ContentBase64, recipientPublicKey);
-            encrypted.Add(new { fileName = a.FileName, contentType = a.ContentType, envelope });
-        }
-        return JsonSerializer.Serialize(encrypted, _jsonOptions);
+            var envelope = await PostBytesAsync($"{OtpBaseUrl}/api/otp/encrypt-env?compression={OtpCompression}",
+                                                data.AsSpan(0, n).ToArray(), "application/octet-stream");
+            if (!QuMailEnvelope.LooksLikeEnvelope(envelope))
+                throw new InvalidOperationException("OTP encrypt-env did not return an envelope");
+            return Convert.ToBase64String(envelope);
+        }, "OTP attachment encryption");
     }
 
+    private Task<string?> EncryptAttachmentsPQC2LayerAsync(List<SendAttachment>? attachments, string recipientPublicKey) =>
+        EncryptAttachmentsAsync(attachments, content => EncryptSingleWithPQC2LayerAsync(content, recipientPublicKey));
+
+    private Task<string?> EncryptAttachmentsPQC3LayerAsync(List<SendAttachment>? attachments, string recipientPublicKey) =>
+        EncryptAttachmentsAsync(attachments, async content => await SealLayersAsync(await EncryptSingleWithPQC3LayerAsync(content, recipientPublicKey)));
+
     private async Task<EncryptionResult> EncryptWithAESAsync(string subject, string body, List<SendAttachment>? attachments)
     {
         _logger.LogInformation("Encrypting with AES-GCM via server2.py");
@@ -1616,17 +2250,7 @@ public class EmailController : ControllerBase
         var subjectEnvelope = await EncryptWithAESGCMAsync(subject);
         var bodyEnvelope = await EncryptWithAESGCMAsync(body);
 
-        string? attachmentsJson = null;
-        if (attachments != null && attachments.Count > 0)
-        {
-            var encrypted = new List<object>(attachments.Count);
-            foreach (var a in attachments)
-            {
-                var envelope = await EncryptWithAESGCMAsync(a.ContentBase64);
-                encrypted.Add(new { fileName = a.FileName, contentType = a.ContentType, envelope });
-            }
-            attachmentsJson = JsonSerializer.Serialize(encrypted, _jsonOptions);
-        }
+        var attachmentsJson = await EncryptAttachmentsAsync(attachments, SealAttachmentChunkedAsync);
 
         return new EncryptionResult { SubjectEnvelope = subjectEnvelope, BodyEnvelope = bodyEnvelope, AttachmentsJson = attachmentsJson };
     }
@@ -1638,17 +2262,7 @@ public class EmailController : ControllerBase
         var subjectEnvelope = await EncryptSingleWithPQC2LayerAsync(subject, recipientPublicKey);
         var bodyEnvelope = await EncryptSingleWithPQC2LayerAsync(body, recipientPublicKey);
         
-        string? attachmentsJson = null;
-        if (attachments != null && attachments.Count > 0)
-        {
-            var encrypted = new List<object>(attachments.Count);
-            foreach (var a in attachments)
-            {
-                var envelope = await EncryptSingleWithPQC2LayerAsync(a.ContentBase64, recipientPublicKey);
-                encrypted.Add(new { fileName = a.FileName, contentType = a.ContentType, envelope });
-            }
-            attachmentsJson = JsonSerializer.Serialize(encrypted, _jsonOptions);
-        }
+        var attachmentsJson = await EncryptAttachmentsPQC2LayerAsync(attachments, recipientPublicKey);
         
         return new EncryptionResult { SubjectEnvelope = subjectEnvelope, BodyEnvelope = bodyEnvelope, AttachmentsJson = attachmentsJson };
     }
@@ -1661,73 +2275,57 @@ public class EmailController : ControllerBase
         var pqcSubject = await EncryptSingleWithPQC3LayerAsync(subject, recipientPublicKey);
         var pqcBody = await EncryptSingleWithPQC3LayerAsync(body, recipientPublicKey);
 
-        _logger.LogInformation("Phase 2: Preparing PQC envelopes for AES encryption");
-        var pqcSubjectForAES = PreparePqcEnvelopeForAES(pqcSubject);
-        var pqcBodyForAES = PreparePqcEnvelopeForAES(pqcBody);
-
-        _logger.LogInformation("Phase 3: AES encryption");
-        var aesSubject = await EncryptWithAESGCMAsync(pqcSubjectForAES);
-        var aesBody = await EncryptWithAESGCMAsync(pqcBodyForAES);
-
-        _logger.LogInformation("Phase 4: OTP encryption");
-        var finalSubject = await EncryptBodyAsync(aesSubject);
-        var finalBody = await EncryptBodyAsync(aesBody);
+        _logger.LogInformation("Phase 2: AES and OTP encryption");
+        var finalSubject = await SealLayersAsync(pqcSubject);
+        var finalBody = await SealLayersAsync(pqcBody);
 
         string? attachmentsJson = null;
         if (attachments != null && attachments.Count > 0)
         {
             _logger.LogInformation("Encrypting {Count} attachments with PQC 3-layer", attachments.Count);
-            var encrypted = new List<object>(attachments.Count);
-            foreach (var a in attachments)
-            {
-                var pqcEnvelope = await EncryptSingleWithPQC3LayerAsync(a.ContentBase64, recipientPublicKey);
-
-                var pqcEnvelopeForAES = pqcEnvelope;
-
-                var aesEnvelope = await EncryptWithAESGCMAsync(pqcEnvelopeForAES);
-
-                var finalEnvelope = await EncryptBodyAsync(aesEnvelope);
-
-                encrypted.Add(new { fileName = a.FileName, contentType = a.ContentType, envelope = finalEnvelope });
-            }
-            attachmentsJson = JsonSerializer.Serialize(encrypted, _jsonOptions);
+            attachmentsJson = await EncryptAttachmentsPQC3LayerAsync(attachments, recipientPublicKey);
         }
 
         return new EncryptionResult { SubjectEnvelope = finalSubject, BodyEnvelope = finalBody, AttachmentsJson = attachmentsJson };
     }
 
-    private string PreparePqcEnvelopeForAES(string pqcJsonEnvelope)
+    /// <summary>
+    /// AES-GCM and OTP over plaintext in one call to /api/layers/seal: the AES
+    /// service takes both keys from the KM and seals the nested envelope (OTP
+    /// outside, AES-GCM inside, plaintext compressed first) in one native pass,
+    /// with no JSON or base64 re-encoding between the layers.
+    /// </summary>
+    private async Task<string> SealLayersAsync(string plaintext)
     {
-        try
+        var data = Encoding.UTF8.GetBytes(plaintext);
+        return await RetryAsync(async () =>
         {
-            _logger.LogInformation("Preparing PQC JSON envelope for AES encryption");
-            
-            if (string.IsNullOrWhiteSpace(pqcJsonEnvelope))
+            using var request = new HttpRequestMessage(HttpMethod.Post, $"{AesBaseUrl}/api/layers/seal")
             {
-                _logger.LogWarning("Empty PQC envelope provided, returning as-is");
-                return pqcJsonEnvelope;
-            }
-            
-            using var testDoc = JsonDocument.Parse(pqcJsonEnvelope);
-            if (!testDoc.RootElement.TryGetProperty("encryptedBody", out _))
-            {
-                _logger.LogWarning("PQC envelope missing 'encryptedBody' property, returning as-is");
-                return pqcJsonEnvelope;
-            }
-            
-            var base64Encoded = Convert.ToBase64String(System.Text.Encoding.UTF8.GetBytes(pqcJsonEnvelope));
-            _logger.LogInformation("Successfully prepared PQC envelope for AES encryption (size: {Size} chars)", base64Encoded.Length);
-            return base64Encoded;
-        }
-        catch (JsonException ex)
+                Content = new ByteArrayContent(data)
+            };
+            request.Content.Headers.ContentType = new MediaTypeHeaderValue("application/octet-stream");
+            request.Headers.Add("X-Compression", OtpCompression);
+            using var response = await _http.SendAsync(request);
+            response.EnsureSuccessStatusCode();
+            var envelope = await response.Content.ReadAsByteArrayAsync();
+            if (!QuMailEnvelope.LooksLikeEnvelope(envelope))
+                throw new InvalidOperationException("Layer seal did not return an envelope");
+            return Convert.ToBase64String(envelope);
+        }, "AES+OTP layer seal");
+    }
+
+    // The PQC envelope inside layers sealed by SealLayersAsync, or null if a layer would not open
+    private async Task<string?> TryOpenLayersToPqcAsync(byte[] envelope)
+    {
+        try
         {
-            _logger.LogError(ex, "Invalid JSON in PQC envelope, using original");
-            return pqcJsonEnvelope;
+            return Encoding.UTF8.GetString(await OpenEnvelopeAsync(envelope));
         }
         catch (Exception ex)
         {
-            _logger.LogError(ex, "Failed to prepare PQC envelope for AES, using original");
-            return pqcJsonEnvelope;
+            _logger.LogWarning(ex, "Opening the OTP/AES layers failed");
+            return null;
         }
     }
 
@@ -1775,6 +2373,18 @@ public class EmailController : ControllerBase
 
     private async Task<string> EncryptWithAESGCMAsync(string plaintext)
     {
+        if (NativeCrypto.IsAvailable)
+        {
+            try
+            {
+                return await SealAesInProcessAsync(plaintext);
+            }
+            catch (Exception ex) when (ex is HttpRequestException or TaskCanceledException or InvalidOperationException)
+            {
+                _logger.LogWarning(ex, "In-process AES-GCM encryption failed, using the AES service");
+            }
+        }
+
         return await RetryAsync(async () =>
         {
             _logger.LogInformation("Starting AES-GCM encryption for plaintext: {Plaintext}", plaintext);
@@ -1820,6 +2430,39 @@ public class EmailController : ControllerBase
         }, "AES-GCM encryption");
     }
 
+    // Byte-for-byte what the AES service produces: a fresh KM key, the {"plaintext": ...} body it
+    // would have been posted, no AAD. The IV is a nonce only, so it comes from the local CSPRNG
+    // instead of a second KM request
+    private async Task<string> SealAesInProcessAsync(string plaintext)
+    {
+        var (keyId, key) = await _keyManager.NewKeyAsync(AesKeyBytes);
+        var pt = JsonSerializer.SerializeToUtf8Bytes(new { plaintext }, _aesRequestJsonOptions);
+        try
+        {
+            var iv = RandomNumberGenerator.GetBytes(AesIvBytes);
+            var ciphertext = new byte[pt.Length];
+            var tag = new byte[NativeCrypto.TagLength];
+            using (var ks = NativeCrypto.CreateGcmKey(key))
+                NativeCrypto.Seal(ks, iv, ReadOnlySpan<byte>.Empty, pt, ciphertext, tag);
+
+            var envelope = new AESEnvelope
+            {
+                KeyId = keyId,
+                IvHex = Convert.ToHexString(iv).ToLowerInvariant(),
+                CiphertextHex = Convert.ToHexString(ciphertext).ToLowerInvariant(),
+                TagHex = Convert.ToHexString(tag).ToLowerInvariant(),
+                AadHex = string.Empty,
+                Algorithm = "AES-256-GCM"
+            };
+            return JsonSerializer.Serialize(envelope, _jsonOptions);
+        }
+        finally
+        {
+            CryptographicOperations.ZeroMemory(key);
+            CryptographicOperations.ZeroMemory(pt);
+        }
+    }
+
     private async Task<string> EncryptSingleWithPQC2LayerAsync(string plaintext, string recipientPublicKey)
     {
         try
@@ -56,6 +56,12 @@ builder.Services.AddScoped<Level3PQCEmailService>();
 builder.Services.AddSingleton<Level3EnhancedPQC>();
 builder.Services.AddScoped<Level3HybridEncryption>();
 
+// Decrypted subjects/bodies/attachments for repeat inbox and message views
+builder.Services.AddSingleton(_ => DecryptedContentCache.FromEnvironment());
+
+// Key Manager access for the AES layer run in-process through libqmcrypto (NativeCrypto)
+builder.Services.AddSingleton(_ => KeyManagerClient.FromEnvironment());
+
 // Add Entity Framework
 builder.Services.AddDbContext<AuthDbContext>(options =>
     options.UseNpgsql(connectionString));
@@ -0,0 +1,229 @@
+using System.Security.Cryptography;
+using System.Text;
+
+namespace QuMail.EmailProtocol.Services;
+
+/// <summary>
+/// Hit/miss and occupancy counters of <see cref="DecryptedContentCache"/>.
+/// </summary>
+public sealed record DecryptedContentCacheStats(
+    long Hits,
+    long Misses,
+    long Evictions,
+    long Expirations,
+    int Entries,
+    long Bytes,
+    long BudgetBytes,
+    int Users);
+
+/// <summary>
+/// Plaintext of already-decrypted email fields, keyed by (owner, email id, field),
+/// so reloading an inbox or reopening a message does not run OTP/AES or hit the KM again.
+/// Stored ciphertexts never change, so an entry only leaves on eviction or expiry.
+///
+/// Bounded by a byte budget with LRU eviction and by a per-user share of that budget,
+/// so one large mailbox cannot push everybody else out. Entries expire a fixed time
+/// after they were added. Values are kept as UTF-8 bytes, and those buffers are wiped
+/// when an entry leaves. The string a hit returns is a fresh copy the cache does not track:
+/// it cannot be wiped and lives until the GC reclaims it, like any other response text.
+/// A lookup only matches the owner's own entries. Thread-safe.
+/// </summary>
+public sealed class DecryptedContentCache : IDisposable
+{
+    public const string FieldSubject = "subject";
+    public const string FieldBody = "body";
+    public static string FieldAttachment(int index) => "attachment:" + index;
+
+    private const int EntryOverhead = 96;   // node, key and bookkeeping, roughly
+
+    private sealed class Entry
+    {
+        public required (string Owner, Guid EmailId, string Field) Key;
+        public required byte[] Value;
+        public required DateTime ExpiresAt;
+        public LinkedListNode<Entry>? Node;         // in _lru
+        public LinkedListNode<Entry>? UserNode;     // in the owner's list
+        public long Size => Value.Length + EntryOverhead + 2 * (Key.Owner.Length + Key.Field.Length);
+    }
+
+    // One owner's entries, most recently used first, so evicting for an owner
+    // only walks what it evicts
+    private sealed class UserEntries
+    {
+        public readonly LinkedList<Entry> Lru = new();
+        public long Bytes;
+    }
+
+    private readonly object _lock = new object();
+    private readonly Dictionary<(string, Guid, string), Entry> _map = new();
+    private readonly LinkedList<Entry> _lru = new();            // most recently used first
+    private readonly Dictionary<string, UserEntries> _users = new(StringComparer.Ordinal);
+    private readonly long _budget;
+    private readonly long _userBudget;
+    private readonly TimeSpan _ttl;
+    private readonly Func<DateTime> _clock;
+    private readonly Timer? _sweeper;
+    private long _bytes, _hits, _misses, _evictions, _expirations;
+
+    /// <param name="budgetBytes">Total size of all entries.</param>
+    /// <param name="ttl">Lifetime of an entry from when it was added.</param>
+    /// <param name="userBudgetBytes">Share of one owner; 0 means a quarter of the budget.</param>
+    /// <param name="clock">UTC time source (tests); also disables the background sweep.</param>
+    public DecryptedContentCache(long budgetBytes, TimeSpan ttl, long userBudgetBytes = 0, Func<DateTime>? clock = null)
+    {
+        if (budgetBytes <= 0) throw new ArgumentOutOfRangeException(nameof(budgetBytes));
+        if (ttl <= TimeSpan.Zero) throw new ArgumentOutOfRangeException(nameof(ttl));
+        _budget = budgetBytes;
+        _userBudget = userBudgetBytes > 0 ? Math.Min(userBudgetBytes, budgetBytes) : Math.Max(budgetBytes / 4, 1);
+        _ttl = ttl;
+        _clock = clock ?? (() => DateTime.UtcNow);
+        if (clock == null)
+        {
+            // Wipe expired plaintext even if nobody asks for it again
+            var period = TimeSpan.FromTicks(Math.Max(ttl.Ticks / 4, TimeSpan.TicksPerSecond));
+            _sweeper = new Timer(_ => RemoveExpired(), null, period, period);
+        }
+    }
+
+    /// <summary>
+    /// DECRYPT_CACHE_MB (default 64), DECRYPT_CACHE_USER_MB (default a quarter of it)
+    /// and DECRYPT_CACHE_TTL_SECONDS (default 600).
+    /// </summary>
+    public static DecryptedContentCache FromEnvironment()
+    {
+        static long Env(string name, long fallback) =>
+            long.TryParse(Environment.GetEnvironmentVariable(name), out var v) && v > 0 ? v : fallback;
+
+        return new DecryptedContentCache(
+            Env("DECRYPT_CACHE_MB", 64) * 1024 * 1024,
+            TimeSpan.FromSeconds(Env("DECRYPT_CACHE_TTL_SECONDS", 600)),
+            Env("DECRYPT_CACHE_USER_MB", 0) * 1024 * 1024);
+    }
+
+    public bool TryGet(string owner, Guid emailId, string field, out string value)
+    {
+        lock (_lock)
+        {
+            if (_map.TryGetValue((owner, emailId, field), out var e))
+            {
+                if (e.ExpiresAt > _clock())
+                {
+                    _lru.Remove(e.Node!);
+                    _lru.AddFirst(e.Node!);
+                    var mine = _users[owner].Lru;
+                    mine.Remove(e.UserNode!);
+                    mine.AddFirst(e.UserNode!);
+                    _hits++;
+                    value = Encoding.UTF8.GetString(e.Value);
+                    return true;
+                }
+                Remove(e);
+                _expirations++;
+            }
+            _misses++;
+            value = string.Empty;
+            return false;
+        }
+    }
+
+    public void Set(string owner, Guid emailId, string field, string value)
+    {
+        var entry = new Entry
+        {
+            Key = (owner, emailId, field),
+            Value = Encoding.UTF8.GetBytes(value),
+            ExpiresAt = _clock() + _ttl
+        };
+        if (entry.Size > _userBudget)
+        {
+            CryptographicOperations.ZeroMemory(entry.Value);
+            return;
+        }
+
+        lock (_lock)
+        {
+            if (_map.TryGetValue(entry.Key, out var old)) Remove(old);
+
+            // The owner's least recently used entries go first, then anybody's
+            if (_users.TryGetValue(owner, out var mine))
+            {
+                while (mine.Bytes + entry.Size > _userBudget && mine.Lru.Last != null)
+                {
+                    Remove(mine.Lru.Last.Value);
+                    _evictions++;
+                }
+            }
+            while (_bytes + entry.Size > _budget && _lru.Last != null)
+            {
+                Remove(_lru.Last.Value);
+                _evictions++;
+            }
+
+            if (!_users.TryGetValue(owner, out mine)) _users[owner] = mine = new UserEntries();
+            entry.Node = _lru.AddFirst(entry);
+            entry.UserNode = mine.Lru.AddFirst(entry);
+            mine.Bytes += entry.Size;
+            _map[entry.Key] = entry;
+            _bytes += entry.Size;
+        }
+    }
+
+    /// <summary>Drops (and wipes) everything cached for one owner, e.g. on logout.</summary>
+    public void RemoveUser(string owner)
+    {
+        lock (_lock)
+        {
+            if (!_users.TryGetValue(owner, out var mine)) return;
+            while (mine.Lru.Last != null) Remove(mine.Lru.Last.Value);
+        }
+    }
+
+    public void RemoveExpired()
+    {
+        lock (_lock)
+        {
+            var now = _clock();
+            for (var n = _lru.First; n != null; )
+            {
+                var next = n.Next;
+                if (n.Value.ExpiresAt <= now)
+                {
+                    Remove(n.Value);
+                    _expirations++;
+                }
+                n = next;
+            }
+        }
+    }
+
+    public DecryptedContentCacheStats GetStats()
+    {
+        lock (_lock)
+        {
+            return new DecryptedContentCacheStats(_hits, _misses, _evictions, _expirations,
+                _map.Count, _bytes, _budget, _users.Count);
+        }
+    }
+
+    public void Dispose()
+    {
+        _sweeper?.Dispose();
+        lock (_lock)
+        {
+            while (_lru.Last != null) Remove(_lru.Last.Value);
+        }
+    }
+
+    // Caller holds the lock
+    private void Remove(Entry e)
+    {
+        _lru.Remove(e.Node!);
+        _map.Remove(e.Key);
+        _bytes -= e.Size;
+        var mine = _users[e.Key.Owner];
+        mine.Lru.Remove(e.UserNode!);
+        mine.Bytes -= e.Size;
+        if (mine.Lru.Count == 0) _users.Remove(e.Key.Owner);
+        CryptographicOperations.ZeroMemory(e.Value);
+    }
+}
@@ -0,0 +1,119 @@
+using System.Net;
+using System.Net.Http.Json;
+using System.Text.Json;
+
+namespace QuMail.EmailProtocol.Services;
+
+/// <summary>
+/// Key material straight from the Key Manager, for the layers the backend now runs
+/// in-process (<see cref="NativeCrypto"/>). Same routes the AES and OTP services use:
+/// GET /otp/keys?size=N for a fresh key (id in X-Key-Id), POST /otp/keys/batch and
+/// GET /otp/keys/{id} to look keys up again. Key responses may be raw bytes or JSON,
+/// as the services accept. Callers own, and wipe, the returned bytes.
+/// </summary>
+public sealed class KeyManagerClient
+{
+    private const int MaxBatchIds = 1000;   // KM limit per /otp/keys/batch request
+
+    private readonly HttpClient _http;
+
+    public KeyManagerClient(HttpClient http)
+    {
+        _http = http;
+    }
+
+    public static KeyManagerClient FromEnvironment()
+    {
+        var baseUrl = Environment.GetEnvironmentVariable("KM_URL") ?? "http://key-manager:2020";
+        return new KeyManagerClient(new HttpClient
+        {
+            BaseAddress = new Uri(baseUrl.TrimEnd('/') + "/"),
+            Timeout = TimeSpan.FromSeconds(5)
+        });
+    }
+
+    public async Task<(string KeyId, byte[] Key)> NewKeyAsync(int size, CancellationToken cancellationToken = default)
+    {
+        using var response = await _http.GetAsync($"otp/keys?size={size}", cancellationToken);
+        response.EnsureSuccessStatusCode();
+        var (key, bodyKeyId) = await ReadKeyAsync(response, cancellationToken);
+        var keyId = bodyKeyId ?? (response.Headers.TryGetValues("X-Key-Id", out var ids) ? ids.FirstOrDefault() : null);
+        if (string.IsNullOrEmpty(keyId))
+        {
+            Array.Clear(key);
+            throw new InvalidOperationException("Key Manager did not return a key id");
+        }
+        if (key.Length != size)
+        {
+            Array.Clear(key);
+            throw new InvalidOperationException($"Key Manager returned {key.Length} key bytes, expected {size}");
+        }
+        return (keyId, key);
+    }
+
+    /// <summary>Keys by id; ids the KM does not know are left out.</summary>
+    public async Task<Dictionary<string, byte[]>> GetKeysAsync(IEnumerable<string> keyIds, CancellationToken cancellationToken = default)
+    {
+        var ids = keyIds.Where(id => !string.IsNullOrEmpty(id)).Distinct().ToList();
+        var keys = new Dictionary<string, byte[]>();
+        for (int off = 0; off < ids.Count; off += MaxBatchIds)
+        {
+            var chunk = ids.Skip(off).Take(MaxBatchIds).ToList();
+            using var response = await _http.PostAsJsonAsync("otp/keys/batch", new { key_ids = chunk }, cancellationToken);
+            if (response.StatusCode is HttpStatusCode.NotFound or HttpStatusCode.MethodNotAllowed)
+            {
+                // KM without the batch route: one lookup per id
+                foreach (var id in chunk)
+                {
+                    var key = await GetKeyAsync(id, cancellationToken);
+                    if (key != null) keys[id] = key;
+                }
+                continue;
+            }
+            response.EnsureSuccessStatusCode();
+
+            using var doc = JsonDocument.Parse(await response.Content.ReadAsStreamAsync(cancellationToken));
+            if (!doc.RootElement.TryGetProperty("keys", out var found) || found.ValueKind != JsonValueKind.Object)
+                throw new InvalidOperationException("Key Manager batch lookup returned a malformed response");
+            foreach (var entry in found.EnumerateObject())
+                keys[entry.Name] = Convert.FromHexString(entry.Value.GetString() ?? string.Empty);
+        }
+        return keys;
+    }
+
+    public async Task<byte[]?> GetKeyAsync(string keyId, CancellationToken cancellationToken = default)
+    {
+        using var response = await _http.GetAsync($"otp/keys/{Uri.EscapeDataString(keyId)}", cancellationToken);
+        if (response.StatusCode == HttpStatusCode.NotFound) return null;
+        response.EnsureSuccessStatusCode();
+        return (await ReadKeyAsync(response, cancellationToken)).Key;
+    }
+
+    /// <summary>
+    /// The key in a KM response: the raw body, or a JSON body with key_hex or key
+    /// (base64) and, for a new key, key_id (null when absent) - the shapes
+    /// get_new_key_and_id / get_key_hex_by_id in qm_service.py accept.
+    /// </summary>
+    private static async Task<(byte[] Key, string? KeyId)> ReadKeyAsync(HttpResponseMessage response, CancellationToken cancellationToken)
+    {
+        var body = await response.Content.ReadAsByteArrayAsync(cancellationToken);
+        if (!string.Equals(response.Content.Headers.ContentType?.MediaType, "application/json", StringComparison.OrdinalIgnoreCase))
+            return (body, null);
+
+        try
+        {
+            using var doc = JsonDocument.Parse(body);
+            var root = doc.RootElement;
+            var keyId = root.TryGetProperty("key_id", out var id) && id.ValueKind == JsonValueKind.String ? id.GetString() : null;
+            if (root.TryGetProperty("key_hex", out var hex) && hex.ValueKind == JsonValueKind.String)
+                return (Convert.FromHexString(hex.GetString()!), keyId);
+            if (root.TryGetProperty("key", out var b64) && b64.ValueKind == JsonValueKind.String)
+                return (Convert.FromBase64String(b64.GetString()!), keyId);
+            throw new InvalidOperationException("Key Manager JSON response has no key_hex or key");
+        }
+        finally
+        {
+            Array.Clear(body);
+        }
+    }
+}
@@ -1,3 +1,9 @@
+using System.Buffers;
+using System.Buffers.Binary;
+using System.Runtime.CompilerServices;
+using System.Runtime.InteropServices;
+using System.Runtime.Intrinsics;
+using System.Security.Cryptography;
 using QuMail.EmailProtocol.Interfaces;
 
 namespace QuMail.EmailProtocol.Services;
@@ -9,19 +15,16 @@ public class Level1OneTimePadEngine : IOneTimePadEngine
         // Validate inputs
         if (plaintext == null || plaintext.Length == 0)
             throw new ArgumentException("Plaintext cannot be null or empty", nameof(plaintext));
-        
+
         if (key == null || key.Length == 0)
             throw new ArgumentException("Key cannot be null or empty", nameof(key));
-        
+
         if (plaintext.Length > key.Length)
             throw new ArgumentException("Key must be at least as long as plaintext", nameof(key));
 
         // Perform one-time pad encryption (XOR)
-        var encryptedData = new byte[plaintext.Length];
-        for (int i = 0; i < plaintext.Length; i++)
-        {
-            encryptedData[i] = (byte)(plaintext[i] ^ key[i]);
-        }
+        var encryptedData = GC.AllocateUninitializedArray<byte>(plaintext.Length);
+        Xor(plaintext, key, encryptedData);
 
         return new EncryptionResult
         {
@@ -36,20 +39,125 @@ public class Level1OneTimePadEngine : IOneTimePadEngine
         // Validate inputs
         if (ciphertext == null || ciphertext.Length == 0)
             throw new ArgumentException("Ciphertext cannot be null or empty", nameof(ciphertext));
-        
+
         if (key == null || key.Length == 0)
             throw new ArgumentException("Key cannot be null or empty", nameof(key));
-        
+
         if (ciphertext.Length > key.Length)
             throw new ArgumentException("Key must be at least as long as ciphertext", nameof(key));
 
         // Perform one-time pad decryption (XOR - same operation as encryption)
-        var decryptedData = new byte[ciphertext.Length];
-        for (int i = 0; i < ciphertext.Length; i++)
+        var decryptedData = GC.AllocateUninitializedArray<byte>(ciphertext.Length);
+        Xor(ciphertext, key, decryptedData);
+
+        return decryptedData;
+    }
+
+    /// <summary>
+    /// output[i] = input[i] ^ pad[i] for every byte of <paramref name="input"/>, 64/32/16 bytes
+    /// at a time with the widest vectors the CPU has. <paramref name="output"/> may be
+    /// <paramref name="input"/> (in place); the pad may be longer than the input.
+    /// </summary>
+    public static void Xor(ReadOnlySpan<byte> input, ReadOnlySpan<byte> pad, Span<byte> output)
+    {
+        if (pad.Length < input.Length)
+            throw new ArgumentException("Key must be at least as long as the data", nameof(pad));
+        if (output.Length < input.Length)
+            throw new ArgumentException("Output must be at least as long as the data", nameof(output));
+
+        ref byte src = ref MemoryMarshal.GetReference(input);
+        ref byte key = ref MemoryMarshal.GetReference(pad);
+        ref byte dst = ref MemoryMarshal.GetReference(output);
+        nuint length = (nuint)input.Length;
+        nuint i = 0;
+
+        if (Vector512.IsHardwareAccelerated)
+        {
+            for (; i + (nuint)Vector512<byte>.Count <= length; i += (nuint)Vector512<byte>.Count)
+                (Vector512.LoadUnsafe(ref src, i) ^ Vector512.LoadUnsafe(ref key, i)).StoreUnsafe(ref dst, i);
+        }
+        if (Vector256.IsHardwareAccelerated)
         {
-            decryptedData[i] = (byte)(ciphertext[i] ^ key[i]);
+            for (; i + (nuint)Vector256<byte>.Count <= length; i += (nuint)Vector256<byte>.Count)
+                (Vector256.LoadUnsafe(ref src, i) ^ Vector256.LoadUnsafe(ref key, i)).StoreUnsafe(ref dst, i);
         }
+        if (Vector128.IsHardwareAccelerated)
+        {
+            for (; i + (nuint)Vector128<byte>.Count <= length; i += (nuint)Vector128<byte>.Count)
+                (Vector128.LoadUnsafe(ref src, i) ^ Vector128.LoadUnsafe(ref key, i)).StoreUnsafe(ref dst, i);
+        }
+        for (; i < length; i++)
+            Unsafe.Add(ref dst, i) = (byte)(Unsafe.Add(ref src, i) ^ Unsafe.Add(ref key, i));
+    }
 
-        return decryptedData;
+    /// <summary>
+    /// Stretches <paramref name="seed"/> to fill <paramref name="destination"/> with the SHA-256 chain
+    /// the PQC layers have always used, so existing mail still decrypts: block r is
+    /// SHA-256(previous || r as little-endian int32), starting from the seed. A destination no longer
+    /// than the seed gets the seed's prefix. Like the original, it runs ceil(length / seed length)
+    /// rounds, so with a seed over 32 bytes the bytes past rounds * 32 stay zero. Streams block by
+    /// block; nothing is allocated. Runs in libqmcrypto (SHA-NI) when it is deployed.
+    /// </summary>
+    public static void ExpandKey(ReadOnlySpan<byte> seed, Span<byte> destination)
+    {
+        if (destination.Length <= seed.Length)
+        {
+            seed[..destination.Length].CopyTo(destination);
+            return;
+        }
+        if (seed.IsEmpty)
+            throw new ArgumentException("Cannot expand an empty seed", nameof(seed));
+
+        if (NativeCrypto.IsAvailable)
+        {
+            NativeCrypto.Sha256ChainExpand(seed, destination);
+            return;
+        }
+
+        const int HashSize = 32;   // SHA256.HashSizeInBytes
+        long rounds = ((long)destination.Length + seed.Length - 1) / seed.Length;
+        var filled = (int)Math.Min(destination.Length, rounds * HashSize);
+        destination[filled..].Clear();
+        destination = destination[..filled];
+
+        Span<byte> chained = stackalloc byte[HashSize + sizeof(int)];
+        Span<byte> last = stackalloc byte[HashSize];
+        byte[]? rented = null;
+        var first = seed.Length <= HashSize
+            ? chained[..(seed.Length + sizeof(int))]
+            : (rented = ArrayPool<byte>.Shared.Rent(seed.Length + sizeof(int))).AsSpan(0, seed.Length + sizeof(int));
+        try
+        {
+            seed.CopyTo(first);
+            var input = first;
+            int offset = 0;
+            for (int round = 0; offset < destination.Length; round++)
+            {
+                BinaryPrimitives.WriteInt32LittleEndian(input[^sizeof(int)..], round);
+                var remaining = destination.Length - offset;
+                if (remaining >= HashSize)
+                {
+                    SHA256.HashData(input, destination.Slice(offset, HashSize));
+                    destination.Slice(offset, HashSize).CopyTo(chained);
+                }
+                else
+                {
+                    SHA256.HashData(input, last);
+                    last[..remaining].CopyTo(destination[offset..]);
+                }
+                offset += Math.Min(HashSize, remaining);
+                input = chained;
+            }
+        }
+        finally
+        {
+            CryptographicOperations.ZeroMemory(chained);
+            CryptographicOperations.ZeroMemory(last);
+            if (rented != null)
+            {
+                CryptographicOperations.ZeroMemory(rented.AsSpan(0, seed.Length + sizeof(int)));
+                ArrayPool<byte>.Shared.Return(rented);
+            }
+        }
     }
 }
@@ -186,9 +186,8 @@ public class Level3EnhancedPQC
 
     private byte[] DeriveKey(byte[] secret, int keyLength)
     {
-        using var sha256 = SHA256.Create();
-        var hash = sha256.ComputeHash(secret);
-        return hash.Take(keyLength).ToArray();
+        var hash = SHA256.HashData(secret);
+        return keyLength >= hash.Length ? hash : hash[..keyLength];
     }
 
     #endregion
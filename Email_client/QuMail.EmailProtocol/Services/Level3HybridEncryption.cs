@@ -75,7 +75,7 @@ public class Level3HybridEncryption
             var pqcSharedSecret = Convert.FromBase64String(keyIdEncapsulation.SharedSecret);
 
             // Encrypt keyId with PQC shared secret using XOR
-            var encryptedKeyId = XorBytes(keyIdBytes, pqcSharedSecret.Take(keyIdBytes.Length).ToArray());
+            var encryptedKeyId = XorBytes(keyIdBytes, pqcSharedSecret);
 
             byte[] finalCiphertext;
             string encryptionLayers;
@@ -84,11 +84,11 @@ public class Level3HybridEncryption
             {
                 // Triple-layer: PQC + AES-256 + OTP
                 // Step 3: AES-256-GCM encryption with quantum key
-                var aesEncrypted = EncryptWithAES256(plaintextBytes, quantumKey.Data.Take(32).ToArray());
+                var aesEncrypted = EncryptWithAES256(plaintextBytes, quantumKey.Data.AsSpan(0, 32));
 
                 // Step 4: OTP XOR on top of AES ciphertext using remaining quantum key
                 var otpKeyOffset = 32; // Skip the 32 bytes used for AES
-                var otpKey = quantumKey.Data.Skip(otpKeyOffset).Take(aesEncrypted.Length).ToArray();
+                var otpKey = quantumKey.Data[otpKeyOffset..(otpKeyOffset + aesEncrypted.Length)];
                 var otpResult = _otpEngine.Encrypt(aesEncrypted, otpKey, keyId);
 
                 finalCiphertext = otpResult.EncryptedData;
@@ -97,7 +97,7 @@ public class Level3HybridEncryption
             else
             {
                 // Two-layer: PQC + OTP only
-                var otpResult = _otpEngine.Encrypt(plaintextBytes, quantumKey.Data.Take(plaintextBytes.Length).ToArray(), keyId);
+                var otpResult = _otpEngine.Encrypt(plaintextBytes, quantumKey.Data, keyId);
 
                 finalCiphertext = otpResult.EncryptedData;
                 encryptionLayers = $"{algorithm}+OTP";
@@ -157,7 +157,7 @@ public class Level3HybridEncryption
 
             // Step 2: Decrypt the keyId using PQC shared secret
             var encryptedKeyIdBytes = Convert.FromBase64String(encryptedKeyId);
-            var keyIdBytes = XorBytes(encryptedKeyIdBytes, sharedSecretBytes.Take(encryptedKeyIdBytes.Length).ToArray());
+            var keyIdBytes = XorBytes(encryptedKeyIdBytes, sharedSecretBytes);
             var keyId = Encoding.UTF8.GetString(keyIdBytes);
 
             // Step 3: Retrieve the quantum key from KeyManager using keyId
@@ -170,18 +170,18 @@ public class Level3HybridEncryption
                 // Triple-layer decryption (reverse order)
                 // Step 4: OTP XOR to remove OTP layer using quantum key
                 var otpKeyOffset = 32; // Skip the 32 bytes used for AES
-                var otpKey = quantumKey.Data.Skip(otpKeyOffset).Take(encryptedBytes.Length).ToArray();
+                var otpKey = quantumKey.Data[otpKeyOffset..(otpKeyOffset + encryptedBytes.Length)];
                 var aesEncrypted = _otpEngine.Decrypt(encryptedBytes, otpKey);
 
                 // Step 5: AES-256-GCM decryption using quantum key
-                var plaintext = DecryptWithAES256(aesEncrypted, quantumKey.Data.Take(32).ToArray());
+                var plaintext = DecryptWithAES256(aesEncrypted, quantumKey.Data.AsSpan(0, 32));
 
                 return Encoding.UTF8.GetString(plaintext);
             }
             else
             {
                 // Two-layer: PQC + OTP only
-                var decryptedBytes = _otpEngine.Decrypt(encryptedBytes, quantumKey.Data.Take(encryptedBytes.Length).ToArray());
+                var decryptedBytes = _otpEngine.Decrypt(encryptedBytes, quantumKey.Data);
 
                 return Encoding.UTF8.GetString(decryptedBytes);
             }
@@ -208,13 +208,10 @@ public class Level3HybridEncryption
     }
 
     // Helper method for XOR operation
-    private byte[] XorBytes(byte[] data, byte[] key)
+    private static byte[] XorBytes(byte[] data, byte[] key)
     {
         var result = new byte[data.Length];
-        for (int i = 0; i < data.Length; i++)
-        {
-            result[i] = (byte)(data[i] ^ key[i]);
-        }
+        Level1OneTimePadEngine.Xor(data, key, result);
         return result;
     }
 
@@ -224,26 +221,19 @@ public class Level3HybridEncryption
     /// Encrypts data using AES-256-GCM (Galois/Counter Mode)
     /// Provides both confidentiality and authenticity
     /// </summary>
-    private byte[] EncryptWithAES256(byte[] plaintext, byte[] key)
+    private byte[] EncryptWithAES256(byte[] plaintext, ReadOnlySpan<byte> key)
     {
         using var aes = new AesGcm(key, AesGcm.TagByteSizes.MaxSize);
 
-        // Generate random nonce (96 bits / 12 bytes for GCM)
-        var nonce = new byte[AesGcm.NonceByteSizes.MaxSize];
-        RandomNumberGenerator.Fill(nonce);
-
-        // Allocate space for ciphertext and tag
-        var ciphertext = new byte[plaintext.Length];
-        var tag = new byte[AesGcm.TagByteSizes.MaxSize];
+        var nonceSize = AesGcm.NonceByteSizes.MaxSize;
+        var tagSize = AesGcm.TagByteSizes.MaxSize;
 
-        // Encrypt
-        aes.Encrypt(nonce, plaintext, ciphertext, tag);
+        // Layout: [nonce][tag][ciphertext], each written in place
+        var result = new byte[nonceSize + tagSize + plaintext.Length];
+        var nonce = result.AsSpan(0, nonceSize);
+        RandomNumberGenerator.Fill(nonce);   // random 96-bit nonce
 
-        // Combine: [nonce][tag][ciphertext]
-        var result = new byte[nonce.Length + tag.Length + ciphertext.Length];
-        Buffer.BlockCopy(nonce, 0, result, 0, nonce.Length);
-        Buffer.BlockCopy(tag, 0, result, nonce.Length, tag.Length);
-        Buffer.BlockCopy(ciphertext, 0, result, nonce.Length + tag.Length, ciphertext.Length);
+        aes.Encrypt(nonce, plaintext, result.AsSpan(nonceSize + tagSize), result.AsSpan(nonceSize, tagSize));
 
         return result;
     }
@@ -251,25 +241,17 @@ public class Level3HybridEncryption
     /// <summary>
     /// Decrypts AES-256-GCM encrypted data
     /// </summary>
-    private byte[] DecryptWithAES256(byte[] encrypted, byte[] key)
+    private byte[] DecryptWithAES256(byte[] encrypted, ReadOnlySpan<byte> key)
     {
         using var aes = new AesGcm(key, AesGcm.TagByteSizes.MaxSize);
 
-        // Extract components
+        // Components are read in place from [nonce][tag][ciphertext]
         var nonceSize = AesGcm.NonceByteSizes.MaxSize;
         var tagSize = AesGcm.TagByteSizes.MaxSize;
+        var ciphertext = encrypted.AsSpan(nonceSize + tagSize);
 
-        var nonce = new byte[nonceSize];
-        var tag = new byte[tagSize];
-        var ciphertext = new byte[encrypted.Length - nonceSize - tagSize];
-
-        Buffer.BlockCopy(encrypted, 0, nonce, 0, nonceSize);
-        Buffer.BlockCopy(encrypted, nonceSize, tag, 0, tagSize);
-        Buffer.BlockCopy(encrypted, nonceSize + tagSize, ciphertext, 0, ciphertext.Length);
-
-        // Decrypt
         var plaintext = new byte[ciphertext.Length];
-        aes.Decrypt(nonce, ciphertext, tag, plaintext);
+        aes.Decrypt(encrypted.AsSpan(0, nonceSize), ciphertext, encrypted.AsSpan(nonceSize, tagSize), plaintext);
 
         return plaintext;
     }
@@ -288,7 +270,7 @@ public class Level3HybridEncryption
         // Expand if needed
         if (length <= hash.Length)
         {
-            return hash.Take(length).ToArray();
+            return hash[..length];
         }
 
         return ExpandKey(hash, length);
@@ -296,32 +278,8 @@ public class Level3HybridEncryption
 
     private byte[] ExpandKey(byte[] key, int requiredLength)
     {
-        if (requiredLength <= key.Length)
-        {
-            return key.Take(requiredLength).ToArray();
-        }
-
         var expanded = new byte[requiredLength];
-        var rounds = (requiredLength + key.Length - 1) / key.Length;
-
-        using (var sha256 = SHA256.Create())
-        {
-            var currentKey = key;
-            var offset = 0;
-
-            for (int round = 0; round < rounds; round++)
-            {
-                var input = currentKey.Concat(BitConverter.GetBytes(round)).ToArray();
-                var hash = sha256.ComputeHash(input);
-
-                var bytesToCopy = Math.Min(hash.Length, requiredLength - offset);
-                Buffer.BlockCopy(hash, 0, expanded, offset, bytesToCopy);
-                offset += bytesToCopy;
-
-                currentKey = hash;
-            }
-        }
-
+        Level1OneTimePadEngine.ExpandKey(key, expanded);
         return expanded;
     }
 
@@ -348,40 +306,41 @@ public class Level3HybridEncryption
 }
 
 /// <summary>
-/// HKDF-SHA256 for key derivation
+/// HKDF-SHA256 (RFC 5869) for key derivation, on libqmcrypto's SHA-NI engine when it is
+/// deployed and the framework's HKDF otherwise; both give the same bytes.
 /// </summary>
 public class HKDFSHA256
 {
-    private readonly byte[] _prk;
+    private readonly byte[] _ikm;
+    private readonly byte[] _salt;
+    private readonly byte[] _info;
     private readonly int _outputLength;
 
     public HKDFSHA256(byte[] ikm, int outputLength, byte[]? salt = null, byte[]? info = null)
     {
+        _ikm = ikm ?? throw new ArgumentNullException(nameof(ikm));
         _outputLength = outputLength;
-
-        // Extract
-        using var hmac = new HMACSHA256(salt ?? new byte[32]);
-        _prk = hmac.ComputeHash(ikm);
+        _salt = salt ?? Array.Empty<byte>();
+        _info = info ?? Array.Empty<byte>();
     }
 
+    public byte[] GetBytes() => GetBytes(_outputLength);
+
     public byte[] GetBytes(int length)
     {
         var output = new byte[length];
-        var iterations = (int)Math.Ceiling((double)length / 32);
-        var prev = Array.Empty<byte>();
-
-        using var hmac = new HMACSHA256(_prk);
-        for (int i = 1; i <= iterations; i++)
-        {
-            var input = prev.Concat(new[] { (byte)i }).ToArray();
-            prev = hmac.ComputeHash(input);
-
-            var copyLength = Math.Min(32, length - (i - 1) * 32);
-            Buffer.BlockCopy(prev, 0, output, (i - 1) * 32, copyLength);
-        }
-
+        Derive(_ikm, _salt, _info, output);
         return output;
     }
+
+    /// <summary>One-shot HKDF-SHA256 into <paramref name="output"/>; an empty salt is 32 zero bytes.</summary>
+    public static void Derive(ReadOnlySpan<byte> ikm, ReadOnlySpan<byte> salt, ReadOnlySpan<byte> info, Span<byte> output)
+    {
+        if (NativeCrypto.IsAvailable)
+            NativeCrypto.HkdfSha256(ikm, salt, info, output);
+        else
+            HKDF.DeriveKey(HashAlgorithmName.SHA256, ikm, output, salt, info);
+    }
 }
 
 /// <summary>
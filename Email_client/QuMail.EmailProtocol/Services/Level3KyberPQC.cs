@@ -154,11 +154,8 @@ public class Level3KyberPQC
     {
         // Use SHA-256 to derive a fixed-length key
         // In production, consider using HKDF for better key derivation
-        using var sha256 = SHA256.Create();
-        var hash = sha256.ComputeHash(secret);
-
-        // Return first keyLength bytes (32 bytes for SHA-256)
-        return hash.Take(keyLength).ToArray();
+        var hash = SHA256.HashData(secret);
+        return keyLength >= hash.Length ? hash : hash[..keyLength];
     }
 
     /// <summary>
@@ -64,10 +64,10 @@ public class Level3PQCEmailService
 
             // Step 4: Encrypt the keyId using PQC shared secret (so receiver can retrieve same key)
             var keyIdBytes = Encoding.UTF8.GetBytes(keyId);
-            var encryptedKeyId = XorBytes(keyIdBytes, pqcSharedSecret.Take(keyIdBytes.Length).ToArray());
+            var encryptedKeyId = XorBytes(keyIdBytes, pqcSharedSecret);
 
             // Step 5: Encrypt email body using quantum key from KeyManager
-            var encryptionResult = _otpEngine.Encrypt(plaintextBytes, quantumKey.Data.Take(plaintextBytes.Length).ToArray(), keyId);
+            var encryptionResult = _otpEngine.Encrypt(plaintextBytes, quantumKey.Data, keyId);
 
             // Step 6: Mark key as used
             await _keyManager.MarkKeyAsUsedAsync(keyId, plaintextBytes.Length);
@@ -113,7 +113,7 @@ public class Level3PQCEmailService
 
             // Step 2: Decrypt the keyId using PQC shared secret
             var encryptedKeyIdBytes = Convert.FromBase64String(encryptedKeyId);
-            var keyIdBytes = XorBytes(encryptedKeyIdBytes, pqcSharedSecret.Take(encryptedKeyIdBytes.Length).ToArray());
+            var keyIdBytes = XorBytes(encryptedKeyIdBytes, pqcSharedSecret);
             var keyId = Encoding.UTF8.GetString(keyIdBytes);
 
             // Step 3: Retrieve the quantum key from KeyManager using keyId
@@ -121,7 +121,7 @@ public class Level3PQCEmailService
             var quantumKey = await _keyManager.GetKeyAsync(keyId, encryptedBytes.Length);
 
             // Step 4: Decrypt using quantum key from KeyManager
-            var decryptedBytes = _otpEngine.Decrypt(encryptedBytes, quantumKey.Data.Take(encryptedBytes.Length).ToArray());
+            var decryptedBytes = _otpEngine.Decrypt(encryptedBytes, quantumKey.Data);
 
             // Step 5: Convert back to string
             return Encoding.UTF8.GetString(decryptedBytes);
@@ -139,13 +139,10 @@ public class Level3PQCEmailService
     }
 
     // Helper method for XOR operation
-    private byte[] XorBytes(byte[] data, byte[] key)
+    private static byte[] XorBytes(byte[] data, byte[] key)
     {
         var result = new byte[data.Length];
-        for (int i = 0; i < data.Length; i++)
-        {
-            result[i] = (byte)(data[i] ^ key[i]);
-        }
+        Level1OneTimePadEngine.Xor(data, key, result);
         return result;
     }
 
@@ -158,36 +155,8 @@ public class Level3PQCEmailService
     /// <returns>Expanded key of required length</returns>
     private byte[] ExpandKey(byte[] key, int requiredLength)
     {
-        if (requiredLength <= key.Length)
-        {
-            return key.Take(requiredLength).ToArray();
-        }
-
-        // Use a deterministic key expansion algorithm
-        // For production, consider using HKDF or similar KDF
         var expanded = new byte[requiredLength];
-        var rounds = (requiredLength + key.Length - 1) / key.Length;
-
-        using (var sha256 = System.Security.Cryptography.SHA256.Create())
-        {
-            var currentKey = key;
-            var offset = 0;
-
-            for (int round = 0; round < rounds; round++)
-            {
-                // Hash the current key with round number for uniqueness
-                var input = currentKey.Concat(BitConverter.GetBytes(round)).ToArray();
-                var hash = sha256.ComputeHash(input);
-
-                var bytesToCopy = Math.Min(hash.Length, requiredLength - offset);
-                Array.Copy(hash, 0, expanded, offset, bytesToCopy);
-                offset += bytesToCopy;
-
-                // Use hash as input for next round
-                currentKey = hash;
-            }
-        }
-
+        Level1OneTimePadEngine.ExpandKey(key, expanded);
         return expanded;
     }
 
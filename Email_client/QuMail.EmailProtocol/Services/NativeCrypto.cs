@@ -0,0 +1,203 @@
+using System.Runtime.InteropServices;
+
+namespace QuMail.EmailProtocol.Services;
+
+/// <summary>
+/// In-process AES-GCM, one-time pad and SHA-256/HMAC/HKDF over libqmcrypto (level2new/qm_crypto.h), the same
+/// C code the AES server runs, so a field is sealed or opened without a round trip to the
+/// AES service, a process spawn or hex/base64 hops. Buffers are passed as spans and pinned
+/// for the duration of the call; nothing is copied across the boundary.
+/// </summary>
+/// <remarks>
+/// The library is optional: <see cref="IsAvailable"/> is false when it is not deployed next
+/// to the app, reports another ABI version or NATIVE_CRYPTO=0 is set, and callers fall back
+/// to the HTTP services.
+/// </remarks>
+public static class NativeCrypto
+{
+    public const int AbiVersion = 2;
+    public const int TagLength = 16;
+    public const int Sha256Length = 32;
+
+    /// <summary>RFC 5869 limit for HKDF-SHA256 output (255 blocks).</summary>
+    public const int HkdfMaxOutputLength = 255 * Sha256Length;
+
+    private const string Lib = "qmcrypto";
+
+    private static readonly Lazy<bool> _available = new(() =>
+    {
+        if (Environment.GetEnvironmentVariable("NATIVE_CRYPTO") == "0") return false;
+        try
+        {
+            return qm_crypto_abi_version() == AbiVersion;
+        }
+        catch (Exception ex) when (ex is DllNotFoundException or EntryPointNotFoundException or BadImageFormatException)
+        {
+            return false;
+        }
+    });
+
+    public static bool IsAvailable => _available.Value;
+
+    /// <summary>Expanded AES key (16, 24 or 32 bytes) held in locked native memory.</summary>
+    public static GcmKey CreateGcmKey(ReadOnlySpan<byte> key)
+    {
+        var handle = qm_crypto_gcm_key_new(ref MemoryMarshal.GetReference(key), (nuint)key.Length);
+        if (handle.IsInvalid)
+        {
+            handle.Dispose();
+            throw new ArgumentException($"Invalid AES key length {key.Length}", nameof(key));
+        }
+        return handle;
+    }
+
+    /// <summary>Encrypts <paramref name="plaintext"/> into <paramref name="ciphertext"/> (same length).</summary>
+    public static void Seal(GcmKey key, ReadOnlySpan<byte> iv, ReadOnlySpan<byte> aad,
+                            ReadOnlySpan<byte> plaintext, Span<byte> ciphertext, Span<byte> tag)
+    {
+        CheckLengths(iv, plaintext.Length, ciphertext.Length, tag.Length);
+        var rc = qm_crypto_gcm_seal(key,
+            ref MemoryMarshal.GetReference(iv), (nuint)iv.Length,
+            ref MemoryMarshal.GetReference(aad), (nuint)aad.Length,
+            ref MemoryMarshal.GetReference(plaintext), (nuint)plaintext.Length,
+            ref MemoryMarshal.GetReference(ciphertext),
+            ref MemoryMarshal.GetReference(tag));
+        if (rc != 0) throw new InvalidOperationException("AES-GCM seal failed");
+    }
+
+    /// <summary>
+    /// Decrypts <paramref name="ciphertext"/> into <paramref name="plaintext"/> (same length).
+    /// False, with <paramref name="plaintext"/> untouched, when the tag does not verify.
+    /// </summary>
+    public static bool TryOpen(GcmKey key, ReadOnlySpan<byte> iv, ReadOnlySpan<byte> aad,
+                               ReadOnlySpan<byte> ciphertext, ReadOnlySpan<byte> tag, Span<byte> plaintext)
+    {
+        CheckLengths(iv, ciphertext.Length, plaintext.Length, tag.Length);
+        return qm_crypto_gcm_open(key,
+            ref MemoryMarshal.GetReference(iv), (nuint)iv.Length,
+            ref MemoryMarshal.GetReference(aad), (nuint)aad.Length,
+            ref MemoryMarshal.GetReference(ciphertext), (nuint)ciphertext.Length,
+            ref MemoryMarshal.GetReference(tag),
+            ref MemoryMarshal.GetReference(plaintext)) == 0;
+    }
+
+    /// <summary>output[i] = input[i] ^ pad[i]; <paramref name="output"/> may be <paramref name="input"/>.</summary>
+    public static void OtpXor(Span<byte> output, ReadOnlySpan<byte> input, ReadOnlySpan<byte> pad)
+    {
+        if (pad.Length < input.Length || output.Length < input.Length)
+            throw new ArgumentException("Pad and output must be at least as long as the input");
+        qm_crypto_otp_xor(ref MemoryMarshal.GetReference(output),
+            ref MemoryMarshal.GetReference(input),
+            ref MemoryMarshal.GetReference(pad), (nuint)input.Length);
+    }
+
+    /// <summary>SHA-256 on the SHA-NI engine when the CPU has one.</summary>
+    public static void Sha256(ReadOnlySpan<byte> data, Span<byte> digest)
+    {
+        if (digest.Length < Sha256Length) throw new ArgumentException($"Digest must be {Sha256Length} bytes", nameof(digest));
+        qm_crypto_sha256(ref MemoryMarshal.GetReference(data), (nuint)data.Length, ref MemoryMarshal.GetReference(digest));
+    }
+
+    /// <summary>
+    /// Hashes <paramref name="count"/> messages of <paramref name="messageLength"/> bytes packed back to
+    /// back in <paramref name="messages"/>, writing one 32-byte digest each to <paramref name="digests"/>.
+    /// Batches of eight run side by side on CPUs without SHA-NI.
+    /// </summary>
+    public static void Sha256Many(ReadOnlySpan<byte> messages, int messageLength, int count, Span<byte> digests)
+    {
+        ArgumentOutOfRangeException.ThrowIfNegative(messageLength);
+        ArgumentOutOfRangeException.ThrowIfNegative(count);
+        if (messages.Length < (long)messageLength * count || digests.Length < (long)Sha256Length * count)
+            throw new ArgumentException("Buffers are too short for the message count");
+        qm_crypto_sha256_many(ref MemoryMarshal.GetReference(messages), (nuint)messageLength, (nuint)count,
+            ref MemoryMarshal.GetReference(digests));
+    }
+
+    public static void HmacSha256(ReadOnlySpan<byte> key, ReadOnlySpan<byte> message, Span<byte> mac)
+    {
+        if (mac.Length < Sha256Length) throw new ArgumentException($"MAC must be {Sha256Length} bytes", nameof(mac));
+        qm_crypto_hmac_sha256(ref MemoryMarshal.GetReference(key), (nuint)key.Length,
+            ref MemoryMarshal.GetReference(message), (nuint)message.Length,
+            ref MemoryMarshal.GetReference(mac));
+    }
+
+    /// <summary>
+    /// RFC 5869 HKDF-SHA256 into <paramref name="output"/> (at most <see cref="HkdfMaxOutputLength"/>
+    /// bytes). An empty salt means 32 zero bytes, as in the RFC.
+    /// </summary>
+    public static void HkdfSha256(ReadOnlySpan<byte> ikm, ReadOnlySpan<byte> salt, ReadOnlySpan<byte> info, Span<byte> output)
+    {
+        if (output.Length > HkdfMaxOutputLength)
+            throw new ArgumentException($"HKDF-SHA256 output is limited to {HkdfMaxOutputLength} bytes", nameof(output));
+        var rc = qm_crypto_hkdf_sha256(
+            ref MemoryMarshal.GetReference(salt), (nuint)salt.Length,
+            ref MemoryMarshal.GetReference(ikm), (nuint)ikm.Length,
+            ref MemoryMarshal.GetReference(info), (nuint)info.Length,
+            ref MemoryMarshal.GetReference(output), (nuint)output.Length);
+        if (rc != 0) throw new InvalidOperationException("HKDF-SHA256 failed");
+    }
+
+    /// <summary>Native <see cref="Level1OneTimePadEngine.ExpandKey"/>; same output.</summary>
+    public static void Sha256ChainExpand(ReadOnlySpan<byte> seed, Span<byte> destination)
+    {
+        qm_crypto_sha256_chain_expand(ref MemoryMarshal.GetReference(seed), (nuint)seed.Length,
+            ref MemoryMarshal.GetReference(destination), (nuint)destination.Length);
+    }
+
+    private static void CheckLengths(ReadOnlySpan<byte> iv, int inputLength, int outputLength, int tagLength)
+    {
+        if (iv.IsEmpty) throw new ArgumentException("IV must not be empty", nameof(iv));
+        if (outputLength != inputLength) throw new ArgumentException("Output must be as long as the input");
+        if (tagLength != TagLength) throw new ArgumentException($"Tag must be {TagLength} bytes");
+    }
+
+    /// <summary>Owns a qm_crypto_gcm_key_t; the native side wipes the key schedule on release.</summary>
+    public sealed class GcmKey : SafeHandle
+    {
+        public GcmKey() : base(IntPtr.Zero, ownsHandle: true) { }
+
+        public override bool IsInvalid => handle == IntPtr.Zero;
+
+        protected override bool ReleaseHandle()
+        {
+            qm_crypto_gcm_key_free(handle);
+            return true;
+        }
+    }
+
+    [DllImport(Lib)]
+    private static extern int qm_crypto_abi_version();
+
+    [DllImport(Lib)]
+    private static extern GcmKey qm_crypto_gcm_key_new(ref byte key, nuint keyLen);
+
+    [DllImport(Lib)]
+    private static extern void qm_crypto_gcm_key_free(IntPtr key);
+
+    [DllImport(Lib)]
+    private static extern int qm_crypto_gcm_seal(GcmKey key, ref byte iv, nuint ivLen, ref byte aad, nuint aadLen,
+                                                 ref byte pt, nuint len, ref byte ct, ref byte tag);
+
+    [DllImport(Lib)]
+    private static extern int qm_crypto_gcm_open(GcmKey key, ref byte iv, nuint ivLen, ref byte aad, nuint aadLen,
+                                                 ref byte ct, nuint len, ref byte tag, ref byte pt);
+
+    [DllImport(Lib)]
+    private static extern void qm_crypto_otp_xor(ref byte output, ref byte input, ref byte pad, nuint len);
+
+    [DllImport(Lib)]
+    private static extern void qm_crypto_sha256(ref byte data, nuint len, ref byte digest);
+
+    [DllImport(Lib)]
+    private static extern void qm_crypto_sha256_many(ref byte messages, nuint len, nuint count, ref byte digests);
+
+    [DllImport(Lib)]
+    private static extern void qm_crypto_hmac_sha256(ref byte key, nuint keyLen, ref byte msg, nuint len, ref byte mac);
+
+    [DllImport(Lib)]
+    private static extern int qm_crypto_hkdf_sha256(ref byte salt, nuint saltLen, ref byte ikm, nuint ikmLen,
+                                                    ref byte info, nuint infoLen, ref byte output, nuint outputLen);
+
+    [DllImport(Lib)]
+    private static extern void qm_crypto_sha256_chain_expand(ref byte seed, nuint seedLen, ref byte output, nuint outputLen);
+}
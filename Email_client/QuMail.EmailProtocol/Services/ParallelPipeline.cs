@@ -0,0 +1,68 @@
+namespace QuMail.EmailProtocol.Services;
+
+/// <summary>
+/// Runs one async step per item with bounded concurrency and backpressure on the
+/// bytes in flight, e.g. encrypting the attachments of one message side by side.
+/// Items start in input order; results come back in input order.
+/// </summary>
+public static class ParallelPipeline
+{
+    /// <param name="size">Bytes an item holds while it is being worked on.</param>
+    /// <param name="maxConcurrency">Items in flight at once.</param>
+    /// <param name="maxInFlightBytes">Total size of the items in flight; an item larger
+    /// than this still runs, but alone.</param>
+    /// <remarks>
+    /// Each step runs on the thread pool, so synchronous CPU work (PQC wrapping) overlaps
+    /// too. The first failure stops items that have not started and is rethrown once the
+    /// running ones have finished.
+    /// </remarks>
+    public static async Task<TResult[]> RunAsync<T, TResult>(
+        IReadOnlyList<T> items,
+        Func<T, long> size,
+        Func<T, CancellationToken, Task<TResult>> step,
+        int maxConcurrency,
+        long maxInFlightBytes,
+        CancellationToken cancellationToken = default)
+    {
+        if (maxConcurrency < 1) throw new ArgumentOutOfRangeException(nameof(maxConcurrency));
+        if (maxInFlightBytes < 1) throw new ArgumentOutOfRangeException(nameof(maxInFlightBytes));
+
+        var results = new TResult[items.Count];
+        var running = new List<(Task Task, long Bytes)>();
+        long inFlight = 0;
+        using var cts = CancellationTokenSource.CreateLinkedTokenSource(cancellationToken);
+
+        async Task WaitForOneAsync()
+        {
+            var done = await Task.WhenAny(running.Select(r => r.Task));
+            var i = running.FindIndex(r => r.Task == done);
+            inFlight -= running[i].Bytes;
+            running.RemoveAt(i);
+            await done;                                  // rethrows the step's failure
+        }
+
+        try
+        {
+            for (int i = 0; i < items.Count; i++)
+            {
+                var item = items[i];
+                var bytes = Math.Max(size(item), 0);
+                while (running.Count > 0 && (running.Count >= maxConcurrency || inFlight + bytes > maxInFlightBytes))
+                    await WaitForOneAsync();
+
+                cts.Token.ThrowIfCancellationRequested();
+                var index = i;
+                inFlight += bytes;
+                running.Add((Task.Run(async () => results[index] = await step(item, cts.Token), cts.Token), bytes));
+            }
+            while (running.Count > 0) await WaitForOneAsync();
+        }
+        catch
+        {
+            cts.Cancel();
+            try { await Task.WhenAll(running.Select(r => r.Task)); } catch { /* the first failure wins */ }
+            throw;
+        }
+        return results;
+    }
+}
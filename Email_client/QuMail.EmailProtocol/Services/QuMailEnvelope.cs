@@ -0,0 +1,196 @@
+using System.Text;
+
+namespace QuMail.EmailProtocol.Services;
+
+/// <summary>
+/// Binary "QE" envelope shared with the native code and the relays
+/// (level2new/qm_envelope.h): "QE" | version | records of type, LEB128 length, value.
+/// Layers nest by encrypting a whole inner envelope (<see cref="FlagInner"/>),
+/// so each layer adds a few dozen bytes instead of re-encoding the previous one as text.
+/// Version 2 GCM layers authenticate the header as well as the AAD (<see cref="AuthenticatedData"/>);
+/// version 1 envelopes are still read.
+/// </summary>
+public sealed class QuMailEnvelope
+{
+    public const string ContentType = "application/vnd.qumail.envelope";
+
+    public const byte AlgAesGcm = 1;
+    public const byte AlgOtpXor = 2;
+    public const byte AlgAesGcmChunked = 3;
+    public const byte AlgPqcHybrid = 4;
+
+    public const byte FlagInner = 0x01;
+
+    /// <summary>What the plaintext was compressed with before this layer sealed it (qm_compress.h).</summary>
+    public const byte CompressionNone = 0;
+    public const byte CompressionDeflate = 1;
+    public const byte CompressionZstd = 2;
+
+    private const byte Version = 2;
+    private const byte Version1 = 1;
+    private const byte TAlg = 0x01, TFlags = 0x02, TKeyId = 0x03, TIv = 0x04, TAad = 0x05,
+                       TKemCt = 0x06, TCiphertext = 0x07, TTag = 0x08, TComp = 0x09, TExtMin = 0x80;
+
+    /// <summary>Wire version; parsed envelopes keep theirs so they re-encode unchanged.</summary>
+    public byte FormatVersion { get; private set; } = Version;
+    public byte Algorithm { get; set; }
+    public byte Flags { get; set; }
+    public byte Compression { get; set; }
+    public string? KeyId { get; set; }
+    public byte[] Iv { get; set; } = Array.Empty<byte>();
+    public byte[] Aad { get; set; } = Array.Empty<byte>();
+    public byte[] KemCiphertext { get; set; } = Array.Empty<byte>();
+    public byte[] Ciphertext { get; set; } = Array.Empty<byte>();
+    public byte[] Tag { get; set; } = Array.Empty<byte>();
+
+    public bool IsInner => (Flags & FlagInner) != 0;
+
+    public static bool LooksLikeEnvelope(ReadOnlySpan<byte> data) =>
+        data.Length >= 3 && data[0] == (byte)'Q' && data[1] == (byte)'E' && (data[2] == Version || data[2] == Version1);
+
+    /// <summary>
+    /// Form stored in text columns (subject, body, attachment JSON): the base64 of
+    /// the envelope, which always starts "UUU" ("QE" plus the version byte) and so
+    /// never collides with the JSON envelopes stored there.
+    /// </summary>
+    public string ToStoredText() => Convert.ToBase64String(Encode());
+
+    /// <summary>The envelope bytes of a <see cref="ToStoredText"/> value; false for anything else.</summary>
+    public static bool TryDecodeStored(string? text, out byte[] envelope)
+    {
+        envelope = Array.Empty<byte>();
+        if (text == null || text.Length < 4 || !text.StartsWith("UUU", StringComparison.Ordinal))
+            return false;
+        var buf = new byte[text.Length / 4 * 3];
+        if (!Convert.TryFromBase64String(text, buf, out var n) || !LooksLikeEnvelope(buf.AsSpan(0, n)))
+            return false;
+        envelope = n == buf.Length ? buf : buf[..n];
+        return true;
+    }
+
+    public byte[] Encode()
+    {
+        if (Algorithm == 0)
+            throw new InvalidOperationException("Envelope algorithm is not set");
+
+        var keyId = string.IsNullOrEmpty(KeyId) ? Array.Empty<byte>() : Encoding.UTF8.GetBytes(KeyId);
+        using var ms = new MemoryStream(Ciphertext.Length + keyId.Length + Iv.Length + Aad.Length + KemCiphertext.Length + Tag.Length + 32);
+        WriteHeader(ms, keyId);
+        WriteRecord(ms, TIv, Iv, optional: true);
+        WriteRecord(ms, TAad, Aad, optional: true);
+        WriteRecord(ms, TKemCt, KemCiphertext, optional: true);
+        WriteRecord(ms, TCiphertext, Ciphertext, optional: false);
+        WriteRecord(ms, TTag, Tag, optional: true);
+        return ms.ToArray();
+    }
+
+    /// <summary>
+    /// GCM additional data of this layer, as qm_envelope_auth_data() builds it: in version 2
+    /// the header ("QE", version, ALG, FLAGS, COMP and KEY_ID records) followed by <see cref="Aad"/>,
+    /// in version 1 <see cref="Aad"/> alone.
+    /// </summary>
+    public byte[] AuthenticatedData()
+    {
+        if (FormatVersion == Version1)
+            return (byte[])Aad.Clone();
+
+        var keyId = string.IsNullOrEmpty(KeyId) ? Array.Empty<byte>() : Encoding.UTF8.GetBytes(KeyId);
+        using var ms = new MemoryStream(keyId.Length + Aad.Length + 16);
+        WriteHeader(ms, keyId);
+        ms.Write(Aad, 0, Aad.Length);
+        return ms.ToArray();
+    }
+
+    /// <summary>Parses one layer; throws <see cref="FormatException"/> on anything the native parser rejects.</summary>
+    public static QuMailEnvelope Parse(ReadOnlySpan<byte> data)
+    {
+        if (!LooksLikeEnvelope(data))
+            throw new FormatException("Not a QE envelope");
+
+        var env = new QuMailEnvelope { FormatVersion = data[2] };
+        var seen = 0;
+        var p = 3;
+        while (p < data.Length)
+        {
+            var type = data[p++];
+            var len = ReadVarint(data, ref p);
+            if (len > (ulong)(data.Length - p))
+                throw new FormatException("Truncated envelope record");
+            var value = data.Slice(p, (int)len);
+            p += (int)len;
+
+            if (type >= TExtMin) continue;
+            if (type == 0 || type > TComp || (seen & (1 << type)) != 0)
+                throw new FormatException($"Bad envelope record type {type}");
+            seen |= 1 << type;
+
+            switch (type)
+            {
+                case TAlg:
+                case TFlags:
+                case TComp:
+                    if (value.Length != 1) throw new FormatException("Bad envelope record length");
+                    if (type == TAlg) env.Algorithm = value[0];
+                    else if (type == TFlags) env.Flags = value[0];
+                    else env.Compression = value[0];
+                    break;
+                case TKeyId: env.KeyId = Encoding.UTF8.GetString(value); break;
+                case TIv: env.Iv = value.ToArray(); break;
+                case TAad: env.Aad = value.ToArray(); break;
+                case TKemCt: env.KemCiphertext = value.ToArray(); break;
+                case TCiphertext: env.Ciphertext = value.ToArray(); break;
+                case TTag: env.Tag = value.ToArray(); break;
+            }
+        }
+
+        if ((seen & (1 << TAlg)) == 0 || (seen & (1 << TCiphertext)) == 0 || env.Algorithm == 0)
+            throw new FormatException("Envelope is missing algorithm or ciphertext");
+        return env;
+    }
+
+    public static bool TryParse(ReadOnlySpan<byte> data, out QuMailEnvelope? envelope)
+    {
+        try
+        {
+            envelope = Parse(data);
+            return true;
+        }
+        catch (FormatException)
+        {
+            envelope = null;
+            return false;
+        }
+    }
+
+    private void WriteHeader(Stream s, byte[] keyId)
+    {
+        s.WriteByte((byte)'Q'); s.WriteByte((byte)'E'); s.WriteByte(FormatVersion);
+        s.WriteByte(TAlg); s.WriteByte(1); s.WriteByte(Algorithm);
+        if (Flags != 0) { s.WriteByte(TFlags); s.WriteByte(1); s.WriteByte(Flags); }
+        if (Compression != 0) { s.WriteByte(TComp); s.WriteByte(1); s.WriteByte(Compression); }
+        WriteRecord(s, TKeyId, keyId, optional: true);
+    }
+
+    private static void WriteRecord(Stream s, byte type, byte[] value, bool optional)
+    {
+        if (optional && value.Length == 0) return;
+        s.WriteByte(type);
+        var n = (ulong)value.Length;
+        while (n >= 0x80) { s.WriteByte((byte)(n | 0x80)); n >>= 7; }
+        s.WriteByte((byte)n);
+        s.Write(value, 0, value.Length);
+    }
+
+    private static ulong ReadVarint(ReadOnlySpan<byte> data, ref int p)
+    {
+        ulong r = 0;
+        for (var shift = 0; shift < 64; shift += 7)
+        {
+            if (p >= data.Length) throw new FormatException("Truncated envelope length");
+            var b = data[p++];
+            r |= (ulong)(b & 0x7f) << shift;
+            if ((b & 0x80) == 0) return r;
+        }
+        throw new FormatException("Envelope length too long");
+    }
+}
@@ -90,7 +90,7 @@ public class SMTPCryptoWrapper : IDisposable
             var quantumKey = await _keyManager.GetKeyAsync(keyId, encryptedBytes.Length);
             
             // Decrypt using one-time pad
-            var decryptedBytes = _cryptoEngine.Decrypt(encryptedBytes, quantumKey.Data.Take(encryptedBytes.Length).ToArray());
+            var decryptedBytes = _cryptoEngine.Decrypt(encryptedBytes, quantumKey.Data);
             
             // Convert back to string
             var decryptedContent = System.Text.Encoding.UTF8.GetString(decryptedBytes);
@@ -200,7 +200,7 @@ public class SMTPCryptoWrapper : IDisposable
         var quantumKey = await _keyManager.GetKeyAsync(keyId, totalKeySize);
         
         // Encrypt body
-        var encryptedBody = _cryptoEngine.Encrypt(bodyBytes, quantumKey.Data.Take(bodyBytes.Length).ToArray(), keyId);
+        var encryptedBody = _cryptoEngine.Encrypt(bodyBytes, quantumKey.Data, keyId);
         
         // Encrypt attachments
         var encryptedAttachments = new List<EncryptedAttachment>();
@@ -208,7 +208,7 @@ public class SMTPCryptoWrapper : IDisposable
         
         foreach (var attachment in message.Attachments)
         {
-            var attachmentKey = quantumKey.Data.Skip(keyOffset).Take(attachment.Content.Length).ToArray();
+            var attachmentKey = quantumKey.Data[keyOffset..(keyOffset + attachment.Content.Length)];
             var encryptedAttachment = _cryptoEngine.Encrypt(attachment.Content, attachmentKey, keyId);
             
             encryptedAttachments.Add(new EncryptedAttachment
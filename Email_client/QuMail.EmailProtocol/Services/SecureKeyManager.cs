@@ -1,3 +1,4 @@
+using System.Collections.Concurrent;
 using System.Security.Cryptography;
 using System.Text;
 using Microsoft.Extensions.Logging;
@@ -13,11 +14,13 @@ namespace QuMail.EmailProtocol.Services;
 public class SecureKeyManager : IQuantumKeyManager
 {
     private readonly ILogger<SecureKeyManager> _logger;
-    private readonly Dictionary<string, QuantumKey> _secureKeys = new();
-    private readonly Dictionary<string, KeyExchange> _keyExchanges = new();
+    // Lock-free reads, striped writes. Each key id maps to one shared generation, so
+    // concurrent first requests for the same id wait for a single key (single flight)
+    // while requests for other ids never wait on it.
+    private readonly ConcurrentDictionary<string, Lazy<Task<QuantumKey>>> _secureKeys = new();
+    private readonly ConcurrentDictionary<string, KeyExchange> _keyExchanges = new();
 
-    // FIXED: Added thread-safety locks to prevent race conditions
-    private readonly object _secureKeysLock = new object();
+    // Guards key exchange state transitions only
     private readonly object _keyExchangesLock = new object();
 
     public SecureKeyManager(ILogger<SecureKeyManager> logger)
@@ -33,19 +36,17 @@ public class SecureKeyManager : IQuantumKeyManager
         // 3. Verify key hasn't expired
         // 4. Log key access for audit
 
-        // FIXED: Thread-safe key generation and retrieval
-        lock (_secureKeysLock)
+        var entry = _secureKeys.GetOrAdd(keyId, id => new Lazy<Task<QuantumKey>>(
+            () => Task.FromResult(GenerateSecureKey(id, requiredBytes)), LazyThreadSafetyMode.ExecutionAndPublication));
+        try
         {
-            if (!_secureKeys.TryGetValue(keyId, out var key))
-            {
-                // Generate a new secure key (synchronously inside lock)
-                key = GenerateSecureKeyAsync(keyId, requiredBytes).GetAwaiter().GetResult();
-                _secureKeys[keyId] = key;
-
-                _logger.LogInformation("Generated new secure key for KeyId: {KeyId}", keyId);
-            }
-
-            return key;
+            return await entry.Value;
+        }
+        catch
+        {
+            // Let the next request retry instead of caching the failure
+            _secureKeys.TryRemove(new KeyValuePair<string, Lazy<Task<QuantumKey>>>(keyId, entry));
+            throw;
         }
     }
 
@@ -56,7 +57,7 @@ public class SecureKeyManager : IQuantumKeyManager
         // 2. Check if key should be retired
         // 3. Log usage for audit trail
 
-        if (_secureKeys.TryGetValue(keyId, out var key))
+        if (_secureKeys.ContainsKey(keyId))
         {
             // Mark key as used (in real implementation, this would be more sophisticated)
             _logger.LogInformation("Marked key as used: KeyId={KeyId}, BytesUsed={BytesUsed}", keyId, bytesUsed);
@@ -132,19 +133,14 @@ public class SecureKeyManager : IQuantumKeyManager
             if (accept)
             {
                 // Generate shared secret key (simplified)
-                var sharedKey = GenerateSharedKeyAsync(keyExchange.PublicKey, recipientPublicKey).GetAwaiter().GetResult();
-
-                // FIXED: Use lock when updating _secureKeys
-                lock (_secureKeysLock)
+                var sharedKey = GenerateSharedKey(keyExchange.PublicKey, recipientPublicKey);
+                var quantumKey = new QuantumKey
                 {
-                    var quantumKey = new QuantumKey
-                    {
-                        Id = keyId,
-                        Data = sharedKey,
-                        Size = sharedKey.Length
-                    };
-                    _secureKeys[keyId] = quantumKey;
-                }
+                    Id = keyId,
+                    Data = sharedKey,
+                    Size = sharedKey.Length
+                };
+                _secureKeys[keyId] = new Lazy<Task<QuantumKey>>(Task.FromResult(quantumKey));
 
                 _logger.LogInformation("Key exchange completed successfully: {KeyId}", keyId);
             }
@@ -153,14 +149,12 @@ public class SecureKeyManager : IQuantumKeyManager
         }
     }
 
-    private async Task<QuantumKey> GenerateSecureKeyAsync(string keyId, int requiredBytes)
+    private QuantumKey GenerateSecureKey(string keyId, int requiredBytes)
     {
         // Generate cryptographically secure random key
-        var keyData = new byte[requiredBytes];
-        using (var rng = RandomNumberGenerator.Create())
-        {
-            rng.GetBytes(keyData);
-        }
+        var keyData = RandomNumberGenerator.GetBytes(requiredBytes);
+
+        _logger.LogInformation("Generated new secure key for KeyId: {KeyId}", keyId);
 
         return new QuantumKey
         {
@@ -170,7 +164,7 @@ public class SecureKeyManager : IQuantumKeyManager
         };
     }
 
-    private async Task<byte[]> GenerateSharedKeyAsync(string senderPublicKey, string recipientPublicKey)
+    private static byte[] GenerateSharedKey(string senderPublicKey, string recipientPublicKey)
     {
         // Simplified shared key generation
         // In a real implementation, this would use proper key exchange algorithms
@@ -47,6 +47,30 @@ def get_key_by_id(key_id):
     response.headers["Content-Type"] = "application/octet-stream"
     return response
 
+MAX_BATCH_IDS = 1000
+
+@app.post("/otp/keys/batch")
+def get_keys_by_ids():
+    """
+    Several keys in one round trip, for callers decrypting a page of messages.
+    Body {"key_ids": [...]} -> {"keys": {key_id: key_hex}, "missing": [...]}
+    """
+    body = request.get_json(silent=True) or {}
+    key_ids = body.get("key_ids")
+    if not isinstance(key_ids, list) or not all(isinstance(k, str) for k in key_ids):
+        return {"error": "key_ids must be a list of strings"}, 400
+    if len(key_ids) > MAX_BATCH_IDS:
+        return {"error": f"at most {MAX_BATCH_IDS} key_ids per request"}, 400
+
+    keys, missing = {}, []
+    for key_id in dict.fromkeys(key_ids):
+        key_hex = KEY_STORE.get(key_id)
+        if key_hex:
+            keys[key_id] = key_hex
+        else:
+            missing.append(key_id)
+    return {"keys": keys, "missing": missing}
+
 @app.get("/health")
 def health_check():
     """Health check endpoint for Docker/Kubernetes"""
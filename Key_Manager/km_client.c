@@ -1,70 +1,237 @@
 #include "km_client.h"
+#include "qm_stats.h"   /* -I../level2new */
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
 
-static int run_cmd(const char *cmd) {
-    return system(cmd);
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+typedef SOCKET km_sock_t;
+#define KM_BAD_SOCK  INVALID_SOCKET
+#define km_sock_close closesocket
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+typedef int km_sock_t;
+#define KM_BAD_SOCK  (-1)
+#define km_sock_close close
+#endif
+
+// km_client.c - talks to the KM over a plain HTTP/1.0 socket. Keys land in
+// memory and go straight to the caller; nothing is written to disk and no
+// shared file names are used, so any number of runs can share a directory.
+// Windows: link with -lws2_32.
+
+#define KM_RECV_CHUNK (16 * 1024)
+
+static void secure_zero(void *p, size_t n) {
+    volatile unsigned char *q = (volatile unsigned char*)p;
+    while (n--) *q++ = 0;
 }
 
-// Extract "X-Key-Id: VALUE" from a headers file
-static int extract_key_id(const char *headers_path, char *out, size_t outsz) {
-    FILE *f = fopen(headers_path, "rb");
-    if (!f) return 1;
-    char line[1024];
-    int found = 0;
-    while (fgets(line, sizeof(line), f)) {
-        if (_strnicmp(line, "X-Key-Id:", 9) == 0 || strncmp(line, "X-Key-Id:", 9) == 0) {
-            char *p = line + 9;
-            while (*p==' ' || *p=='\t') p++;
-            char *end = p + strlen(p);
-            while (end>p && (end[-1]=='\r' || end[-1]=='\n')) end--;
-            size_t len = (size_t)(end - p);
-            if (len >= outsz) len = outsz - 1;
-            memcpy(out, p, len);
-            out[len] = '\0';
-            found = 1; break;
+// Value of header `name` (case-insensitive) in hdr[0..hlen), trimmed; NULL if absent
+static const char *header_value(const char *hdr, size_t hlen, const char *name, size_t *vlen) {
+    size_t nl = strlen(name);
+    const char *p = hdr, *end = hdr + hlen;
+    while (p < end) {
+        const char *eol = (const char*)memchr(p, '\n', (size_t)(end - p));
+        if (!eol) eol = end;
+        if ((size_t)(eol - p) > nl && p[nl] == ':') {
+            size_t i = 0;
+            while (i < nl && tolower((unsigned char)p[i]) == tolower((unsigned char)name[i])) i++;
+            if (i == nl) {
+                const char *v = p + nl + 1, *ve = eol;
+                while (v < ve && (*v == ' ' || *v == '\t')) v++;
+                while (ve > v && (ve[-1] == '\r' || ve[-1] == ' ' || ve[-1] == '\t')) ve--;
+                *vlen = (size_t)(ve - v);
+                return v;
+            }
         }
+        p = eol + 1;
     }
-    fclose(f);
-    return found ? 0 : 1;
+    return NULL;
 }
 
-int km_fetch_new_key(size_t size, const char *key_out, const char *keyid_out) {
-    char cmd[1024];
-    snprintf(cmd, sizeof(cmd),
-        "curl -sSf -D headers.tmp -o \"%s\" \"http://127.0.0.1:2020/otp/keys?size=%lu\"",
-        key_out, (unsigned long)size);
-    if (run_cmd(cmd) != 0) return 1;
-
-    char keyid[256];
-    if (extract_key_id("headers.tmp", keyid, sizeof(keyid)) != 0) {
-        fprintf(stderr, "KM: failed to read Key-ID from headers.tmp\n");
+// Grows buf to hold need bytes. The old block may hold key bytes: wipe it
+// rather than leave it to realloc.
+static int grow(unsigned char **buf, size_t *cap, size_t len, size_t need) {
+    if (need <= *cap) return 0;
+    size_t ncap = *cap ? *cap : KM_RECV_CHUNK;
+    while (ncap < need) ncap *= 2;
+    unsigned char *nb = (unsigned char*)malloc(ncap);
+    if (!nb) return 1;
+    if (*buf) { memcpy(nb, *buf, len); secure_zero(*buf, len); free(*buf); }
+    *buf = nb; *cap = ncap;
+    return 0;
+}
+
+static km_sock_t km_connect(void) {
+    km_sock_t s = socket(AF_INET, SOCK_STREAM, 0);
+    if (s == KM_BAD_SOCK) return KM_BAD_SOCK;
+    struct sockaddr_in sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons(KM_PORT);
+    if (inet_pton(AF_INET, KM_HOST, &sa.sin_addr) != 1 ||
+        connect(s, (struct sockaddr*)&sa, sizeof(sa)) != 0) {
+        km_sock_close(s);
+        return KM_BAD_SOCK;
+    }
+    return s;
+}
+
+// GET path from the KM. On a 2xx answer *body is a malloc'd buffer holding
+// just the body, and the X-Key-Id header (if any) is copied into key_id.
+static int km_get(const char *path, unsigned char **body, size_t *body_len, char *key_id, size_t id_cap) {
+    unsigned char *buf = NULL;
+    size_t len = 0, cap = 0, hdr_len = 0, total = 0;
+    int status = 0, rc = 1;
+
+#ifdef _WIN32
+    WSADATA wsa;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) return 1;
+#endif
+    km_sock_t s = km_connect();
+    if (s == KM_BAD_SOCK) { fprintf(stderr, "KM: cannot connect to %s:%d\n", KM_HOST, KM_PORT); goto done; }
+
+    char req[512];
+    int n = snprintf(req, sizeof(req), "GET %s HTTP/1.0\r\nHost: %s:%d\r\n\r\n", path, KM_HOST, KM_PORT);
+    if (n <= 0 || (size_t)n >= sizeof(req)) goto done;
+    for (int off = 0; off < n; ) {
+        int w = (int)send(s, req + off, n - off, 0);
+        if (w <= 0) goto done;
+        off += w;
+    }
+
+    // HTTP/1.0: the KM closes after the body; stop early once Content-Length is in
+    for (;;) {
+        if (grow(&buf, &cap, len, len + KM_RECV_CHUNK) != 0) goto done;
+        int got = (int)recv(s, (char*)buf + len, (int)(cap - len), 0);
+        if (got < 0) goto done;
+        if (got == 0) break;
+        len += (size_t)got;
+        if (!hdr_len) {
+            unsigned char *e = NULL;
+            for (size_t i = 3; i < len && !e; ++i)
+                if (!memcmp(buf + i - 3, "\r\n\r\n", 4)) e = buf + i + 1;
+            if (!e) { if (len > 16 * 1024) goto done; continue; }
+            hdr_len = (size_t)(e - buf);
+            size_t vlen;
+            const char *v = header_value((const char*)buf, hdr_len, "Content-Length", &vlen);
+            if (v) {
+                total = hdr_len + (size_t)strtoull(v, NULL, 10);
+                if (grow(&buf, &cap, len, total + 1) != 0) goto done;
+            }
+        }
+        if (total && len >= total) break;
+    }
+    if (!hdr_len || sscanf((const char*)buf, "HTTP/%*d.%*d %d", &status) != 1) goto done;
+    if (status < 200 || status > 299) { fprintf(stderr, "KM: HTTP %d for %s\n", status, path); goto done; }
+    if (total && len < total) { fprintf(stderr, "KM: short response for %s\n", path); goto done; }
+
+    if (key_id) {
+        size_t vlen;
+        const char *v = header_value((const char*)buf, hdr_len, "X-Key-Id", &vlen);
+        if (v && vlen < id_cap) { memcpy(key_id, v, vlen); key_id[vlen] = '\0'; }
+    }
+    *body_len = (total ? total : len) - hdr_len;
+    memmove(buf, buf + hdr_len, *body_len);
+    secure_zero(buf + *body_len, len - *body_len);
+    *body = buf;
+    buf = NULL;
+    rc = 0;
+
+done:
+    if (buf) { secure_zero(buf, len); free(buf); }
+    if (s != KM_BAD_SOCK) km_sock_close(s);
+#ifdef _WIN32
+    WSACleanup();
+#endif
+    return rc;
+}
+
+// Strip CR/LF (ids read from key_id.txt) and allow only id characters, so
+// the id cannot reshape the request line.
+static int clean_key_id(const char *key_id, char out[KM_KEY_ID_MAX]) {
+    size_t n = 0;
+    for (; *key_id; ++key_id) {
+        unsigned char c = (unsigned char)*key_id;
+        if (c == '\r' || c == '\n') continue;
+        if (!isalnum(c) && c != '-' && c != '_' && c != '.') return 1;
+        if (n == KM_KEY_ID_MAX - 1) return 1;
+        out[n++] = (char)c;
+    }
+    out[n] = '\0';
+    return n ? 0 : 1;
+}
+
+// Writes data to path; used by the file-based wrappers only
+static int write_file(const char *path, const void *data, size_t len) {
+    FILE *f = fopen(path, "wb");
+    if (!f) { perror(path); return 1; }
+    int rc = fwrite(data, 1, len, f) != len;
+    if (fclose(f) != 0) rc = 1;
+    return rc;
+}
+
+int km_fetch_new_key_mem(size_t size, unsigned char **key, size_t *key_len, char key_id[KM_KEY_ID_MAX]) {
+    QM_STATS_BEGIN(QM_STAT_KM_FETCH);
+    char path[64];
+    snprintf(path, sizeof(path), "/otp/keys?size=%lu", (unsigned long)size);
+    key_id[0] = '\0';
+    if (km_get(path, key, key_len, key_id, KM_KEY_ID_MAX) != 0) return 1;
+    if (!key_id[0]) {
+        fprintf(stderr, "KM: response has no X-Key-Id\n");
+        km_key_free(*key, *key_len); *key = NULL;
+        return 1;
+    }
+    if (*key_len < size) {
+        fprintf(stderr, "KM: got %lu key bytes, asked for %lu\n", (unsigned long)*key_len, (unsigned long)size);
+        km_key_free(*key, *key_len); *key = NULL;
         return 1;
     }
-    FILE *f = fopen(keyid_out, "wb");
-    if (!f) { perror("key_id.txt fopen"); return 1; }
-    fprintf(f, "%s", keyid);
-    fclose(f);
-    remove("headers.tmp");
+    QM_STATS_END(QM_STAT_KM_FETCH, size);
     return 0;
 }
 
-int km_fetch_key_by_id(const char *key_id, const char *key_out) {
-    // strip trailing newlines/spaces if read from file
-    char idclean[256]; size_t n = 0;
-    while (*key_id && n < sizeof(idclean)-1) {
-        if (*key_id=='\r' || *key_id=='\n') { key_id++; continue; }
-        idclean[n++] = *key_id++;
-    }
-    idclean[n] = '\0';
+int km_fetch_key_by_id_mem(const char *key_id, unsigned char **key, size_t *key_len) {
+    char id[KM_KEY_ID_MAX];
+    if (clean_key_id(key_id, id) != 0) { fprintf(stderr, "KM: bad key id\n"); return 1; }
 
-    char cmd[1024];
-    snprintf(cmd, sizeof(cmd),
-        "curl -sSf -o \"%s\" \"http://127.0.0.1:2020/otp/keys/%s\"",
-        key_out, idclean);
-    if(run_cmd(cmd) != 0){
+    QM_STATS_BEGIN(QM_STAT_KM_FETCH);
+    char path[KM_KEY_ID_MAX + 16];
+    snprintf(path, sizeof(path), "/otp/keys/%s", id);
+    if (km_get(path, key, key_len, NULL, 0) != 0) {
         fprintf(stderr, "KM: HTTP fetch failed (bad key_id or KM Down)\n");
+        return 1;
     }
-    return 0; // Adding for now
+    QM_STATS_END(QM_STAT_KM_FETCH, *key_len);
+    return 0;
+}
+
+void km_key_free(unsigned char *key, size_t key_len) {
+    if (!key) return;
+    secure_zero(key, key_len);
+    free(key);
+}
+
+int km_fetch_new_key(size_t size, const char *key_out, const char *keyid_out) {
+    unsigned char *key = NULL; size_t key_len = 0;
+    char keyid[KM_KEY_ID_MAX];
+    if (km_fetch_new_key_mem(size, &key, &key_len, keyid) != 0) return 1;
+    int rc = write_file(key_out, key, key_len) || write_file(keyid_out, keyid, strlen(keyid));
+    km_key_free(key, key_len);
+    return rc;
+}
+
+int km_fetch_key_by_id(const char *key_id, const char *key_out) {
+    unsigned char *key = NULL; size_t key_len = 0;
+    if (km_fetch_key_by_id_mem(key_id, &key, &key_len) != 0) return 1;
+    int rc = write_file(key_out, key, key_len);
+    km_key_free(key, key_len);
+    return rc;
 }
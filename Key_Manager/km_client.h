@@ -2,6 +2,25 @@
 #define KM_CLIENT_H
 #include <stddef.h>
 
+// KM endpoint used by the C clients.
+#define KM_HOST "127.0.0.1"
+#define KM_PORT 2020
+
+// Key ids as the KM hands them out ("K-..."), NUL included.
+#define KM_KEY_ID_MAX 256
+
+// Ask KM for `size` random bytes, straight into memory: *key is malloc'd
+// (release it with km_key_free), key_id gets the X-Key-Id header.
+// No temporary files, so concurrent callers do not interfere.
+// Returns 0 on success, non-zero on error.
+int km_fetch_new_key_mem(size_t size, unsigned char **key, size_t *key_len, char key_id[KM_KEY_ID_MAX]);
+
+// Get the key bytes for key_id into memory (trailing CR/LF in key_id is ignored).
+int km_fetch_key_by_id_mem(const char *key_id, unsigned char **key, size_t *key_len);
+
+// Wipes and frees a key returned by the *_mem calls. NULL is a no-op.
+void km_key_free(unsigned char *key, size_t key_len);
+
 // Ask KM for `size` random bytes. Writes bytes to key_out_path,
 // and write the key id into keyid_out_path (text file).
 int km_fetch_new_key(size_t size, const char *key_out_path, const char *keyid_out_path);
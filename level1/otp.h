@@ -4,6 +4,7 @@
 #define OTP_H
 
 #include <stdio.h>
+#include <stddef.h>
 
 // XOR plaintext with key -> write ciphertext
 // Returns 0 on success, non-zero on error.
@@ -12,4 +13,8 @@ int one_time_pad(FILE *input, FILE *key_file, FILE *cipher_file);
 // XOR ciphertext with key -> write plaintext (same operation)
 int one_time_pad_decoder(FILE *key_file, FILE *cipher_file, FILE *output);
 
+// In-memory engine: out[i] = in[i] ^ key[i] for len bytes (out may alias in).
+// Same operation for encrypt and decrypt.
+void otp_xor(unsigned char *out, const unsigned char *in, const unsigned char *key, size_t len);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,27 @@
+#include <string.h>
+#include <stdint.h>
+#include "otp.h"
+#include "qm_stats.h"   /* -I../level2new */
+
+// otp_xor.c - buffer XOR used by every OTP path that has the data in memory.
+// Works a machine word at a time (memcpy keeps it alignment-safe and lets the
+// compiler vectorise the loop); the tail is done byte by byte.
+
+void otp_xor(unsigned char *out, const unsigned char *in, const unsigned char *key, size_t len){
+
+    QM_STATS_BEGIN(QM_STAT_OTP_XOR);
+    size_t i = 0;
+
+    for(; i + 32 <= len; i += 32){
+        uint64_t a[4], k[4];
+        memcpy(a, in + i, 32);
+        memcpy(k, key + i, 32);
+        a[0] ^= k[0]; a[1] ^= k[1]; a[2] ^= k[2]; a[3] ^= k[3];
+        memcpy(out + i, a, 32);
+    }
+
+    for(; i < len; i++){
+        out[i] = in[i] ^ key[i];
+    }
+    QM_STATS_END(QM_STAT_OTP_XOR, len);
+}
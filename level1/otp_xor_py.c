@@ -0,0 +1,74 @@
+/*
+ * otpxor: Python bindings for otp_xor(), used by the OTP relays when built.
+ *
+ *   gcc -O2 -shared -fPIC $(python3-config --includes) -I../level2new \
+ *       -o otpxor$(python3-config --extension-suffix) otp_xor_py.c otp_xor.c
+ *
+ * Both calls take any buffer-protocol object (bytes, bytearray, memoryview,
+ * mmap) without copying it in. The pad must be at least as long as the data
+ * and only its first len(data) bytes are used; a shorter pad is a ValueError
+ * rather than a silent wrap-around that would reuse key material.
+ * Large buffers are XORed without holding the GIL.
+ */
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include "otp.h"
+
+#define NOGIL_THRESHOLD 65536
+
+static int check_pad(const Py_buffer *data, const Py_buffer *key) {
+    if (key->len < data->len) {
+        PyErr_Format(PyExc_ValueError, "pad too short: %zd bytes for %zd bytes of data", key->len, data->len);
+        return -1;
+    }
+    return 0;
+}
+
+static void run_xor(unsigned char *out, const Py_buffer *data, const Py_buffer *key) {
+    if (data->len >= NOGIL_THRESHOLD) {
+        Py_BEGIN_ALLOW_THREADS
+        otp_xor(out, (const unsigned char *)data->buf, (const unsigned char *)key->buf, (size_t)data->len);
+        Py_END_ALLOW_THREADS
+    } else {
+        otp_xor(out, (const unsigned char *)data->buf, (const unsigned char *)key->buf, (size_t)data->len);
+    }
+}
+
+static PyObject *py_xor(PyObject *self, PyObject *args) {
+    (void)self;
+    Py_buffer data, key;
+    if (!PyArg_ParseTuple(args, "y*y*", &data, &key)) return NULL;
+    PyObject *out = NULL;
+    if (check_pad(&data, &key) == 0 && (out = PyBytes_FromStringAndSize(NULL, data.len)) != NULL)
+        run_xor((unsigned char *)PyBytes_AS_STRING(out), &data, &key);
+    PyBuffer_Release(&key);
+    PyBuffer_Release(&data);
+    return out;
+}
+
+static PyObject *py_xor_into(PyObject *self, PyObject *args) {
+    (void)self;
+    Py_buffer data, key;
+    if (!PyArg_ParseTuple(args, "w*y*", &data, &key)) return NULL;
+    int rc = check_pad(&data, &key);
+    if (rc == 0) run_xor((unsigned char *)data.buf, &data, &key);
+    PyBuffer_Release(&key);
+    PyBuffer_Release(&data);
+    if (rc != 0) return NULL;
+    Py_RETURN_NONE;
+}
+
+static PyMethodDef otpxor_methods[] = {
+    {"xor",      py_xor,      METH_VARARGS, "xor(data, pad) -> bytes: data ^ pad[:len(data)]"},
+    {"xor_into", py_xor_into, METH_VARARGS, "xor_into(buf, pad): buf ^= pad[:len(buf)] in place (writable buffer)"},
+    {NULL, NULL, 0, NULL}
+};
+
+static struct PyModuleDef otpxor_module = {
+    PyModuleDef_HEAD_INIT, "otpxor", "One-time-pad XOR engine (otp_xor.c)", -1, otpxor_methods,
+    NULL, NULL, NULL, NULL
+};
+
+PyMODINIT_FUNC PyInit_otpxor(void) {
+    return PyModule_Create(&otpxor_module);
+}
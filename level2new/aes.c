@@ -1,4 +1,7 @@
 #include "aes.h"
+#include "aes_backend.h"
+#include "qm_stats.h"
+#include "qm_secmem.h"
 #include <string.h>
 #include <stdlib.h>
 
@@ -78,6 +81,11 @@ void xor_bytes(uint8_t *dst, const uint8_t *a, const uint8_t *b, size_t len) {
     for (size_t i = 0; i < len; ++i) dst[i] = a[i] ^ b[i];
 }
 
+static void secure_zero(void *p, size_t n) {
+    volatile uint8_t *q = (volatile uint8_t*)p;
+    while (n--) *q++ = 0;
+}
+
 /* ===================== State conversions ===================== */
 
 void state_from_bytes(state_t s, const uint8_t in[16]) {
@@ -157,8 +165,12 @@ void inv_mix_columns(state_t s) {
     }
 }
 
-/* ===================== Key expansion (AES-128) ===================== */
+/* ===================== Key expansion ===================== */
 
+/* AES-128 keeps its original word-at-a-time schedule. It loads the round-key
+   words in host byte order, so on little-endian hosts it is not the FIPS-197
+   schedule; every AES-128 ciphertext stored so far depends on it, so it must
+   not change. AES-192/256 were added later and follow FIPS-197 exactly. */
 void key_expansion_128(const uint8_t key[16], uint8_t roundKeys[AES128_ROUND_KEYS_SIZE]) {
     /* roundKeys holds 11 round keys of 16 bytes each */
     memcpy(roundKeys, key, 16);
@@ -172,14 +184,70 @@ void key_expansion_128(const uint8_t key[16], uint8_t roundKeys[AES128_ROUND_KEY
     }
 }
 
+/* FIPS-197 schedule for Nk = 6 or 8 words, (rounds+1)*4 words in byte order */
+static void key_expansion_fips(const uint8_t *key, int nk, int rounds, uint8_t *roundKeys) {
+    memcpy(roundKeys, key, (size_t)(4 * nk));
+    for (int i = nk; i < 4 * (rounds + 1); ++i) {
+        const uint8_t *prev = roundKeys + 4*(i-1);
+        uint32_t temp = ((uint32_t)prev[0] << 24) | ((uint32_t)prev[1] << 16) |
+                        ((uint32_t)prev[2] <<  8) |  (uint32_t)prev[3];
+        if (i % nk == 0) {
+            temp = sub_word(rot_word(temp)) ^ ((uint32_t)Rcon[i/nk] << 24);
+        } else if (nk > 6 && i % nk == 4) {
+            temp = sub_word(temp);
+        }
+        const uint8_t *back = roundKeys + 4*(i-nk);
+        uint8_t *w = roundKeys + 4*i;
+        w[0] = (uint8_t)(back[0] ^ (temp >> 24));
+        w[1] = (uint8_t)(back[1] ^ (temp >> 16));
+        w[2] = (uint8_t)(back[2] ^ (temp >>  8));
+        w[3] = (uint8_t)(back[3] ^  temp);
+    }
+}
+
+void key_expansion_192(const uint8_t key[24], uint8_t roundKeys[AES192_ROUND_KEYS_SIZE]) {
+    key_expansion_fips(key, 6, AES192_ROUNDS, roundKeys);
+}
+
+void key_expansion_256(const uint8_t key[32], uint8_t roundKeys[AES256_ROUND_KEYS_SIZE]) {
+    key_expansion_fips(key, 8, AES256_ROUNDS, roundKeys);
+}
+
+int aes_key_init(aes_key_t *k, const uint8_t *key, size_t key_len) {
+    if (!k || !key) return -1;
+    QM_STATS_BEGIN(QM_STAT_KEY_EXPANSION);
+    switch (key_len) {
+    case 16: key_expansion_128(key, k->rk); k->rounds = AES128_ROUNDS; break;
+    case 24: key_expansion_192(key, k->rk); k->rounds = AES192_ROUNDS; break;
+    case 32: key_expansion_256(key, k->rk); k->rounds = AES256_ROUNDS; break;
+    default: return -1;
+    }
+    k->sk64_ready = aes_backend() == AES_BACKEND_BITSLICED;
+    if (k->sk64_ready) aes_ct64_keysched(k);
+    QM_STATS_END(QM_STAT_KEY_EXPANSION, key_len);
+    return 0;
+}
+
 /* ===================== Block cipher ===================== */
 
-void aes_encrypt_block_128(uint8_t out[16], const uint8_t in[16], const uint8_t roundKeys[AES128_ROUND_KEYS_SIZE]) {
+/* One body per direction; NR is a literal at every call site, so each
+   aes_*_block_{128,192,256} below is a fully unrolled specialization. */
+#if defined(__GNUC__) || defined(__clang__)
+#define AES_ALWAYS_INLINE static inline __attribute__((always_inline))
+#define AES_UNROLL _Pragma("GCC unroll 14")
+#else
+#define AES_ALWAYS_INLINE static __forceinline
+#define AES_UNROLL
+#endif
+
+AES_ALWAYS_INLINE void aes_encrypt_rounds(uint8_t out[16], const uint8_t in[16],
+                                          const uint8_t *roundKeys, const int NR) {
     state_t s;
     state_from_bytes(s, in);
 
     add_round_key(s, roundKeys +  0);
-    for (int round = 1; round <= 9; ++round) {
+    AES_UNROLL
+    for (int round = 1; round < NR; ++round) {
         sub_bytes(s);
         shift_rows(s);
         mix_columns(s);
@@ -187,17 +255,19 @@ void aes_encrypt_block_128(uint8_t out[16], const uint8_t in[16], const uint8_t
     }
     sub_bytes(s);
     shift_rows(s);
-    add_round_key(s, roundKeys + 160);
+    add_round_key(s, roundKeys + 16*NR);
 
     bytes_from_state(out, s);
 }
 
-void aes_decrypt_block_128(uint8_t out[16], const uint8_t in[16], const uint8_t roundKeys[AES128_ROUND_KEYS_SIZE]) {
+AES_ALWAYS_INLINE void aes_decrypt_rounds(uint8_t out[16], const uint8_t in[16],
+                                          const uint8_t *roundKeys, const int NR) {
     state_t s;
     state_from_bytes(s, in);
 
-    add_round_key(s, roundKeys + 160);
-    for (int round = 9; round >= 1; --round) {
+    add_round_key(s, roundKeys + 16*NR);
+    AES_UNROLL
+    for (int round = NR - 1; round >= 1; --round) {
         inv_shift_rows(s);
         inv_sub_bytes(s);
         add_round_key(s, roundKeys + 16*round);
@@ -210,19 +280,164 @@ void aes_decrypt_block_128(uint8_t out[16], const uint8_t in[16], const uint8_t
     bytes_from_state(out, s);
 }
 
+void aes_encrypt_block_128(uint8_t out[16], const uint8_t in[16], const uint8_t roundKeys[AES128_ROUND_KEYS_SIZE]) {
+    aes_encrypt_rounds(out, in, roundKeys, AES128_ROUNDS);
+}
+void aes_encrypt_block_192(uint8_t out[16], const uint8_t in[16], const uint8_t roundKeys[AES192_ROUND_KEYS_SIZE]) {
+    aes_encrypt_rounds(out, in, roundKeys, AES192_ROUNDS);
+}
+void aes_encrypt_block_256(uint8_t out[16], const uint8_t in[16], const uint8_t roundKeys[AES256_ROUND_KEYS_SIZE]) {
+    aes_encrypt_rounds(out, in, roundKeys, AES256_ROUNDS);
+}
+
+void aes_decrypt_block_128(uint8_t out[16], const uint8_t in[16], const uint8_t roundKeys[AES128_ROUND_KEYS_SIZE]) {
+    aes_decrypt_rounds(out, in, roundKeys, AES128_ROUNDS);
+}
+void aes_decrypt_block_192(uint8_t out[16], const uint8_t in[16], const uint8_t roundKeys[AES192_ROUND_KEYS_SIZE]) {
+    aes_decrypt_rounds(out, in, roundKeys, AES192_ROUNDS);
+}
+void aes_decrypt_block_256(uint8_t out[16], const uint8_t in[16], const uint8_t roundKeys[AES256_ROUND_KEYS_SIZE]) {
+    aes_decrypt_rounds(out, in, roundKeys, AES256_ROUNDS);
+}
+
+/* ===================== Backend dispatch ===================== */
+
+/* Read on every multi-block call from any thread; relaxed atomics are
+   enough since nothing else is published through it. */
+static aes_backend_t g_backend = AES_BACKEND_AUTO;
+
+static int backend_usable(aes_backend_t b) {
+    switch (b) {
+    case AES_BACKEND_PORTABLE:
+    case AES_BACKEND_BITSLICED: return 1;
+#ifdef AES_HAVE_AESNI
+    case AES_BACKEND_AESNI:     return aes_ni_available();
+#endif
+    default:                    return 0;
+    }
+}
+
+aes_backend_t aes_backend(void) {
+    aes_backend_t cur = __atomic_load_n(&g_backend, __ATOMIC_RELAXED);
+    if (cur == AES_BACKEND_AUTO) {
+        aes_backend_t b = AES_BACKEND_BITSLICED;
+#ifdef AES_HAVE_AESNI
+        if (aes_ni_available()) b = AES_BACKEND_AESNI;
+#endif
+        const char *env = getenv("QUMAIL_AES_BACKEND");
+        if (env) {
+            if      (strcmp(env, "portable")  == 0) b = AES_BACKEND_PORTABLE;
+            else if (strcmp(env, "bitsliced") == 0) b = AES_BACKEND_BITSLICED;
+            else if (strcmp(env, "aesni") == 0 && backend_usable(AES_BACKEND_AESNI)) b = AES_BACKEND_AESNI;
+        }
+        __atomic_store_n(&g_backend, b, __ATOMIC_RELAXED);  /* racing first calls agree */
+        cur = b;
+    }
+    return cur;
+}
+
+int aes_set_backend(aes_backend_t b) {
+    if (b != AES_BACKEND_AUTO && !backend_usable(b)) return -1;
+    __atomic_store_n(&g_backend, b, __ATOMIC_RELAXED);
+    return 0;
+}
+
+const char *aes_backend_name(aes_backend_t b) {
+    switch (b) {
+    case AES_BACKEND_PORTABLE:  return "portable";
+    case AES_BACKEND_BITSLICED: return "bitsliced";
+    case AES_BACKEND_AESNI:     return "aesni";
+    default:                    return "auto";
+    }
+}
+
+/* ===================== Any key size ===================== */
+
+/* The key-size switch is hoisted out of the loop so each pass runs one
+   specialization back to back. */
+static void portable_encrypt_blocks(const aes_key_t *k, uint8_t *out, const uint8_t *in, size_t nblocks) {
+    switch (k->rounds) {
+    case AES128_ROUNDS: for (size_t b = 0; b < nblocks; ++b) aes_encrypt_block_128(out + 16*b, in + 16*b, k->rk); break;
+    case AES192_ROUNDS: for (size_t b = 0; b < nblocks; ++b) aes_encrypt_block_192(out + 16*b, in + 16*b, k->rk); break;
+    default:            for (size_t b = 0; b < nblocks; ++b) aes_encrypt_block_256(out + 16*b, in + 16*b, k->rk); break;
+    }
+}
+
+static void portable_decrypt_blocks(const aes_key_t *k, uint8_t *out, const uint8_t *in, size_t nblocks) {
+    switch (k->rounds) {
+    case AES128_ROUNDS: for (size_t b = 0; b < nblocks; ++b) aes_decrypt_block_128(out + 16*b, in + 16*b, k->rk); break;
+    case AES192_ROUNDS: for (size_t b = 0; b < nblocks; ++b) aes_decrypt_block_192(out + 16*b, in + 16*b, k->rk); break;
+    default:            for (size_t b = 0; b < nblocks; ++b) aes_decrypt_block_256(out + 16*b, in + 16*b, k->rk); break;
+    }
+}
+
+/* Key initialised before a switch to the bitsliced backend: schedule a
+   private copy rather than writing to a key other threads may be using. */
+static void ct64_encrypt_blocks_unscheduled(const aes_key_t *k, uint8_t *out, const uint8_t *in, size_t nblocks) {
+    aes_key_t tmp;
+    memcpy(tmp.rk, k->rk, sizeof(tmp.rk));
+    tmp.rounds = k->rounds;
+    aes_ct64_keysched(&tmp);
+    aes_ct64_encrypt_blocks(&tmp, out, in, nblocks);
+    secure_zero(&tmp, sizeof(tmp));
+}
+
+/* Independent blocks (ECB-style) on the active backend. in == out is fine. */
+void aes_encrypt_blocks(const aes_key_t *k, uint8_t *out, const uint8_t *in, size_t nblocks) {
+    QM_STATS_BEGIN(QM_STAT_AES_BLOCKS);
+    switch (aes_backend()) {
+#ifdef AES_HAVE_AESNI
+    case AES_BACKEND_AESNI:     aes_ni_encrypt_blocks(k, out, in, nblocks); break;
+#endif
+    case AES_BACKEND_BITSLICED:
+        if (k->sk64_ready) aes_ct64_encrypt_blocks(k, out, in, nblocks);
+        else               ct64_encrypt_blocks_unscheduled(k, out, in, nblocks);
+        break;
+    default:                    portable_encrypt_blocks(k, out, in, nblocks); break;
+    }
+    QM_STATS_END(QM_STAT_AES_BLOCKS, 16 * nblocks);
+}
+
+/* There is no bitsliced inverse cipher yet: without AES-NI, decryption (CBC
+   only; CTR/GCM never decrypt blocks) stays on the portable code. */
+void aes_decrypt_blocks(const aes_key_t *k, uint8_t *out, const uint8_t *in, size_t nblocks) {
+    QM_STATS_BEGIN(QM_STAT_AES_BLOCKS);
+#ifdef AES_HAVE_AESNI
+    if (aes_backend() == AES_BACKEND_AESNI) {
+        aes_ni_decrypt_blocks(k, out, in, nblocks);
+        QM_STATS_END(QM_STAT_AES_BLOCKS, 16 * nblocks);
+        return;
+    }
+#endif
+    portable_decrypt_blocks(k, out, in, nblocks);
+    QM_STATS_END(QM_STAT_AES_BLOCKS, 16 * nblocks);
+}
+
+void aes_encrypt_block(const aes_key_t *k, uint8_t out[16], const uint8_t in[16]) {
+    aes_encrypt_blocks(k, out, in, 1);
+}
+
+void aes_decrypt_block(const aes_key_t *k, uint8_t out[16], const uint8_t in[16]) {
+    aes_decrypt_blocks(k, out, in, 1);
+}
+
 /* ===================== PKCS#7 ===================== */
 
-int pkcs7_pad(const uint8_t *in, size_t in_len, uint8_t **out, size_t *out_len) {
+int pkcs7_pad_al(const qm_alloc_t *al, const uint8_t *in, size_t in_len, uint8_t **out, size_t *out_len) {
     size_t pad = AES_BLOCK_SIZE - (in_len % AES_BLOCK_SIZE);
     if (pad == 0) pad = AES_BLOCK_SIZE;
     *out_len = in_len + pad;
-    *out = (uint8_t*)malloc(*out_len);
+    *out = (uint8_t*)qm_alloc(al, *out_len, QM_ALLOC_SECRET);
     if (!*out) return -1;
     memcpy(*out, in, in_len);
     memset(*out + in_len, (int)pad, pad);
     return 0;
 }
 
+int pkcs7_pad(const uint8_t *in, size_t in_len, uint8_t **out, size_t *out_len) {
+    return pkcs7_pad_al(NULL, in, in_len, out, out_len);
+}
+
 int pkcs7_unpad(uint8_t *buf, size_t *len) {
     if (*len == 0 || (*len % AES_BLOCK_SIZE) != 0) return -1;
     uint8_t pad = buf[*len - 1];
@@ -236,62 +451,146 @@ int pkcs7_unpad(uint8_t *buf, size_t *len) {
 
 /* ===================== CBC mode ===================== */
 
-int aes128_cbc_encrypt(const uint8_t *pt, size_t pt_len,
-                       const uint8_t key[16], const uint8_t iv[16],
+/* The PKCS#7 padding only touches the last block, so it is built on the
+   stack rather than in a padded copy of the whole plaintext. The expanded
+   key lives in a locked qm_secmem slot. */
+int aes_cbc_encrypt_al(const qm_alloc_t *al, const uint8_t *pt, size_t pt_len,
+                       const uint8_t *key, size_t key_len, const uint8_t iv[16],
                        uint8_t **ct, size_t *ct_len)
 {
-    uint8_t *padded = NULL;
-    size_t padded_len = 0;
-    if (pkcs7_pad(pt, pt_len, &padded, &padded_len) != 0) return -1;
-
-    *ct = (uint8_t*)malloc(padded_len);
-    if (!*ct) { free(padded); return -1; }
+    QM_STATS_BEGIN(QM_STAT_CBC_ENCRYPT);
+    aes_key_t *ks = qm_secmem_key_new(key, key_len);
+    if (!ks) return -1;
+
+    size_t full = pt_len - pt_len % 16;
+    size_t padded_len = full + 16;
+    *ct = (uint8_t*)qm_alloc(al, padded_len, 0);
+    if (!*ct) { qm_secmem_key_free(ks); return -1; }
     *ct_len = padded_len;
 
-    uint8_t rk[AES128_ROUND_KEYS_SIZE];
-    key_expansion_128(key, rk);
-
-    uint8_t prev[16];
+    uint8_t prev[16], block[16];
     memcpy(prev, iv, 16);
 
-    for (size_t off = 0; off < padded_len; off += 16) {
-        uint8_t block[16];
-        xor_bytes(block, padded + off, prev, 16);
-        aes_encrypt_block_128(*ct + off, block, rk);
+    for (size_t off = 0; off < full; off += 16) {
+        xor_bytes(block, pt + off, prev, 16);
+        aes_encrypt_block(ks, *ct + off, block);
         memcpy(prev, *ct + off, 16);
     }
-    free(padded);
+    uint8_t last[16];
+    size_t rem = pt_len - full;
+    memcpy(last, pt + full, rem);
+    memset(last + rem, (int)(16 - rem), 16 - rem);
+    xor_bytes(block, last, prev, 16);
+    aes_encrypt_block(ks, *ct + full, block);
+    secure_zero(last, sizeof(last));
+    secure_zero(block, sizeof(block));
+    qm_secmem_key_free(ks);
+    QM_STATS_END(QM_STAT_CBC_ENCRYPT, pt_len);
     return 0;
 }
 
-int aes128_cbc_decrypt(const uint8_t *ct, size_t ct_len,
-                       const uint8_t key[16], const uint8_t iv[16],
+int aes_cbc_encrypt(const uint8_t *pt, size_t pt_len,
+                    const uint8_t *key, size_t key_len, const uint8_t iv[16],
+                    uint8_t **ct, size_t *ct_len)
+{
+    return aes_cbc_encrypt_al(NULL, pt, pt_len, key, key_len, iv, ct, ct_len);
+}
+
+/* P_i = D(C_i) XOR C_{i-1}: every block decrypt is independent, so decrypt a
+   batch with one multi-block call, then XOR against the ciphertext shifted by
+   one block. Batching keeps both passes in L1. */
+void aes_cbc_decrypt_blocks(const aes_key_t *k, const uint8_t iv[16],
+                            const uint8_t *ct, size_t nblocks, uint8_t *pt)
+{
+    const uint8_t *prev = iv;
+    for (size_t b = 0; b < nblocks; b += AES_CBC_BATCH_BLOCKS) {
+        size_t n = (nblocks - b < AES_CBC_BATCH_BLOCKS) ? (nblocks - b) : AES_CBC_BATCH_BLOCKS;
+        uint8_t *out = pt + 16*b;
+        const uint8_t *in = ct + 16*b;
+        aes_decrypt_blocks(k, out, in, n);
+        xor_bytes(out, out, prev, 16);
+        if (n > 1) xor_bytes(out + 16, out + 16, in, 16*(n-1));
+        prev = in + 16*(n-1);
+    }
+}
+
+int aes_cbc_decrypt_al(const qm_alloc_t *al, const uint8_t *ct, size_t ct_len,
+                       const uint8_t *key, size_t key_len, const uint8_t iv[16],
                        uint8_t **pt, size_t *pt_len)
 {
     if (ct_len == 0 || (ct_len % 16) != 0) return -1;
 
-    *pt = (uint8_t*)malloc(ct_len);
-    if (!*pt) return -1;
-    *pt_len = ct_len;
-
-    uint8_t rk[AES128_ROUND_KEYS_SIZE];
-    key_expansion_128(key, rk);
+    QM_STATS_BEGIN(QM_STAT_CBC_DECRYPT);
+    aes_key_t *ks = qm_secmem_key_new(key, key_len);
+    if (!ks) return -1;
 
-    uint8_t prev[16];
-    memcpy(prev, iv, 16);
+    *pt = (uint8_t*)qm_alloc(al, ct_len, QM_ALLOC_SECRET);
+    if (!*pt) { qm_secmem_key_free(ks); return -1; }
+    *pt_len = ct_len;
 
-    for (size_t off = 0; off < ct_len; off += 16) {
-        uint8_t dec[16];
-        aes_decrypt_block_128(dec, ct + off, rk);
-        xor_bytes(*pt + off, dec, prev, 16);
-        memcpy(prev, ct + off, 16);
-    }
+    aes_cbc_decrypt_blocks(ks, iv, ct, ct_len / 16, *pt);
+    qm_secmem_key_free(ks);
 
     if (pkcs7_unpad(*pt, pt_len) != 0) {
-        free(*pt);
+        qm_release(al, *pt, ct_len, QM_ALLOC_SECRET);
         *pt = NULL;
         *pt_len = 0;
         return -1;
     }
+    QM_STATS_END(QM_STAT_CBC_DECRYPT, ct_len);
     return 0;
 }
+
+int aes_cbc_decrypt(const uint8_t *ct, size_t ct_len,
+                    const uint8_t *key, size_t key_len, const uint8_t iv[16],
+                    uint8_t **pt, size_t *pt_len)
+{
+    return aes_cbc_decrypt_al(NULL, ct, ct_len, key, key_len, iv, pt, pt_len);
+}
+
+int aes128_cbc_encrypt(const uint8_t *pt, size_t pt_len,
+                       const uint8_t key[16], const uint8_t iv[16],
+                       uint8_t **ct, size_t *ct_len)
+{
+    return aes_cbc_encrypt(pt, pt_len, key, 16, iv, ct, ct_len);
+}
+
+int aes128_cbc_decrypt(const uint8_t *ct, size_t ct_len,
+                       const uint8_t key[16], const uint8_t iv[16],
+                       uint8_t **pt, size_t *pt_len)
+{
+    return aes_cbc_decrypt(ct, ct_len, key, 16, iv, pt, pt_len);
+}
+
+/* ===================== CTR mode ===================== */
+
+/* Big-endian increment of the low 32 bits only (GCM's inc32) */
+static void ctr_inc32(uint8_t y[16]) {
+    uint32_t n = ((uint32_t)y[12]<<24) | ((uint32_t)y[13]<<16) | ((uint32_t)y[14]<<8) | (uint32_t)y[15];
+    n = n + 1;
+    y[12] = (uint8_t)(n>>24); y[13]=(uint8_t)(n>>16); y[14]=(uint8_t)(n>>8); y[15]=(uint8_t)n;
+}
+
+void aes_ctr32_xor(const aes_key_t *k, uint8_t counter[16],
+                   const uint8_t *in, size_t in_len, uint8_t *out)
+{
+    /* Build a batch of counter blocks, encrypt them with one multi-block
+       call, then XOR: this is what lets AES-NI/bitsliced run 8 at a time. */
+    QM_STATS_BEGIN(QM_STAT_CTR);
+    uint8_t ks[16 * AES_CTR_BATCH_BLOCKS];
+    size_t off = 0;
+    while (off < in_len) {
+        size_t left = in_len - off;
+        size_t nb = (left + 15) / 16;
+        if (nb > AES_CTR_BATCH_BLOCKS) nb = AES_CTR_BATCH_BLOCKS;
+        for (size_t b = 0; b < nb; ++b) {
+            memcpy(ks + 16*b, counter, 16);
+            ctr_inc32(counter);
+        }
+        aes_encrypt_blocks(k, ks, ks, nb);
+        size_t n = (left < 16*nb) ? left : 16*nb;
+        xor_bytes(out + off, in + off, ks, n);
+        off += n;
+    }
+    QM_STATS_END(QM_STAT_CTR, in_len);
+}
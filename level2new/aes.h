@@ -3,9 +3,20 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include "qm_alloc.h"
 
 #define AES_BLOCK_SIZE 16
 #define AES128_ROUND_KEYS_SIZE 176  /* 11 * 16 */
+#define AES192_ROUND_KEYS_SIZE 208  /* 13 * 16 */
+#define AES256_ROUND_KEYS_SIZE 240  /* 15 * 16 */
+#define AES_MAX_ROUND_KEYS_SIZE AES256_ROUND_KEYS_SIZE
+
+#define AES_CBC_BATCH_BLOCKS 64  /* blocks per multi-block call in CBC decrypt */
+#define AES_CTR_BATCH_BLOCKS 32  /* counter blocks per multi-block call in CTR */
+
+#define AES128_ROUNDS 10
+#define AES192_ROUNDS 12
+#define AES256_ROUNDS 14
 
 #ifdef __cplusplus
 extern "C" {
@@ -14,6 +25,26 @@ extern "C" {
 /* --- Core types --- */
 typedef uint8_t state_t[4][4];
 
+/* Expanded key for any supported size; rounds selects the specialization.
+   sk64 is the same schedule in the bitsliced layout (see aes_ct64.c), built
+   only when the bitsliced backend is active at aes_key_init. */
+typedef struct {
+    uint8_t  rk[AES_MAX_ROUND_KEYS_SIZE];
+    int      rounds;  /* 10, 12 or 14 */
+    int      sk64_ready;
+    uint64_t sk64[(AES256_ROUNDS + 1) * 8];
+} aes_key_t;
+
+/* Engines behind the multi-block calls. AUTO picks AES-NI when the CPU has
+   it and the constant-time bitsliced engine otherwise; QUMAIL_AES_BACKEND
+   (portable|bitsliced|aesni) overrides the default. */
+typedef enum {
+    AES_BACKEND_AUTO = 0,
+    AES_BACKEND_PORTABLE,   /* byte-wise reference; S-box lookups, not constant-time */
+    AES_BACKEND_BITSLICED,  /* constant-time, 8 blocks per pass */
+    AES_BACKEND_AESNI       /* x86 AES instructions */
+} aes_backend_t;
+
 /* --- Low-level helpers (bytes/words) --- */
 uint32_t sub_word(uint32_t w);
 uint32_t rot_word(uint32_t w);
@@ -36,15 +67,58 @@ void bytes_from_state(uint8_t out[16], const state_t s);
 
 /* --- Key expansion --- */
 void key_expansion_128(const uint8_t key[16], uint8_t roundKeys[AES128_ROUND_KEYS_SIZE]);
+void key_expansion_192(const uint8_t key[24], uint8_t roundKeys[AES192_ROUND_KEYS_SIZE]);
+void key_expansion_256(const uint8_t key[32], uint8_t roundKeys[AES256_ROUND_KEYS_SIZE]);
+int  aes_key_init(aes_key_t *k, const uint8_t *key, size_t key_len); /* 16, 24 or 32 */
 
-/* --- One-block cipher --- */
+/* --- One-block cipher (fixed round count per key size) --- */
 void aes_encrypt_block_128(uint8_t out[16], const uint8_t in[16], const uint8_t roundKeys[AES128_ROUND_KEYS_SIZE]);
 void aes_decrypt_block_128(uint8_t out[16], const uint8_t in[16], const uint8_t roundKeys[AES128_ROUND_KEYS_SIZE]);
+void aes_encrypt_block_192(uint8_t out[16], const uint8_t in[16], const uint8_t roundKeys[AES192_ROUND_KEYS_SIZE]);
+void aes_decrypt_block_192(uint8_t out[16], const uint8_t in[16], const uint8_t roundKeys[AES192_ROUND_KEYS_SIZE]);
+void aes_encrypt_block_256(uint8_t out[16], const uint8_t in[16], const uint8_t roundKeys[AES256_ROUND_KEYS_SIZE]);
+void aes_decrypt_block_256(uint8_t out[16], const uint8_t in[16], const uint8_t roundKeys[AES256_ROUND_KEYS_SIZE]);
+
+/* --- One-block cipher (any key size, active backend) --- */
+void aes_encrypt_block(const aes_key_t *k, uint8_t out[16], const uint8_t in[16]);
+void aes_decrypt_block(const aes_key_t *k, uint8_t out[16], const uint8_t in[16]);
+
+/* --- Backend selection --- */
+aes_backend_t aes_backend(void);
+int           aes_set_backend(aes_backend_t b);  /* -1 if not available here */
+const char   *aes_backend_name(aes_backend_t b);
+
+/* --- Multi-block (independent blocks, in == out allowed) --- */
+void aes_encrypt_blocks(const aes_key_t *k, uint8_t *out, const uint8_t *in, size_t nblocks);
+void aes_decrypt_blocks(const aes_key_t *k, uint8_t *out, const uint8_t *in, size_t nblocks);
 
 /* --- Modes & padding (CBC, PKCS#7) --- */
 int  pkcs7_pad(const uint8_t *in, size_t in_len, uint8_t **out, size_t *out_len);
 int  pkcs7_unpad(uint8_t *buf, size_t *len); /* in-place */
 
+/* key_len is 16, 24 or 32 */
+int  aes_cbc_encrypt(const uint8_t *pt, size_t pt_len,
+                     const uint8_t *key, size_t key_len, const uint8_t iv[16],
+                     uint8_t **ct, size_t *ct_len);
+
+int  aes_cbc_decrypt(const uint8_t *ct, size_t ct_len,
+                     const uint8_t *key, size_t key_len, const uint8_t iv[16],
+                     uint8_t **pt, size_t *pt_len);
+
+/* Same, with outputs from al (NULL = malloc); release them with qm_release().
+   Plaintext and padded copies are QM_ALLOC_SECRET. */
+int  pkcs7_pad_al(const qm_alloc_t *al, const uint8_t *in, size_t in_len, uint8_t **out, size_t *out_len);
+int  aes_cbc_encrypt_al(const qm_alloc_t *al, const uint8_t *pt, size_t pt_len,
+                        const uint8_t *key, size_t key_len, const uint8_t iv[16],
+                        uint8_t **ct, size_t *ct_len);
+int  aes_cbc_decrypt_al(const qm_alloc_t *al, const uint8_t *ct, size_t ct_len,
+                        const uint8_t *key, size_t key_len, const uint8_t iv[16],
+                        uint8_t **pt, size_t *pt_len);
+
+/* Raw CBC decrypt of whole blocks, no unpadding. pt must not alias ct. */
+void aes_cbc_decrypt_blocks(const aes_key_t *k, const uint8_t iv[16],
+                            const uint8_t *ct, size_t nblocks, uint8_t *pt);
+
 int  aes128_cbc_encrypt(const uint8_t *pt, size_t pt_len,
                         const uint8_t key[16], const uint8_t iv[16],
                         uint8_t **ct, size_t *ct_len);
@@ -53,6 +127,10 @@ int  aes128_cbc_decrypt(const uint8_t *ct, size_t ct_len,
                         const uint8_t key[16], const uint8_t iv[16],
                         uint8_t **pt, size_t *pt_len);
 
+/* --- CTR with a 32-bit big-endian counter (GCM GCTR); advances counter --- */
+void aes_ctr32_xor(const aes_key_t *k, uint8_t counter[16],
+                   const uint8_t *in, size_t in_len, uint8_t *out);
+
 /* --- Aliases for your earlier names (so code compiles if you used them) --- */
 #define byes_from_state bytes_from_state
 #define aes_encrytion aes_encrypt_block_128
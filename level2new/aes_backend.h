@@ -0,0 +1,26 @@
+#ifndef AES_BACKEND_H
+#define AES_BACKEND_H
+
+/* Internal: engines behind aes_encrypt_blocks()/aes_decrypt_blocks().
+   Not part of the public aes.h API. */
+
+#include <stdint.h>
+#include <stddef.h>
+#include "aes.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define AES_HAVE_AESNI 1
+#endif
+
+/* Bitsliced, constant-time (aes_ct64.c) */
+void aes_ct64_keysched(aes_key_t *k);
+void aes_ct64_encrypt_blocks(const aes_key_t *k, uint8_t *out, const uint8_t *in, size_t nblocks);
+
+#ifdef AES_HAVE_AESNI
+/* AES-NI (aes_ni.c) */
+int  aes_ni_available(void);
+void aes_ni_encrypt_blocks(const aes_key_t *k, uint8_t *out, const uint8_t *in, size_t nblocks);
+void aes_ni_decrypt_blocks(const aes_key_t *k, uint8_t *out, const uint8_t *in, size_t nblocks);
+#endif
+
+#endif /* AES_BACKEND_H */
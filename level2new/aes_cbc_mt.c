@@ -0,0 +1,128 @@
+#include "aes_cbc_mt.h"
+#include "qm_secmem.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+typedef struct {
+    const aes_key_t *k;
+    const uint8_t   *iv;   /* IV or the ciphertext block just before ct */
+    const uint8_t   *ct;
+    uint8_t         *pt;
+    size_t           nblocks;
+} cbc_slice_t;
+
+#ifdef _WIN32
+static DWORD WINAPI cbc_slice_run(LPVOID arg) {
+#else
+static void *cbc_slice_run(void *arg) {
+#endif
+    cbc_slice_t *sl = (cbc_slice_t*)arg;
+    aes_cbc_decrypt_blocks(sl->k, sl->iv, sl->ct, sl->nblocks, sl->pt);
+    return 0;
+}
+
+static int online_cpus(void) {
+#ifdef _WIN32
+    SYSTEM_INFO si; GetSystemInfo(&si);
+    return (int)si.dwNumberOfProcessors;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+#endif
+}
+
+int aes_cbc_decrypt_mt(const aes_key_t *k, const uint8_t iv[16],
+                       const uint8_t *ct, size_t ct_len, uint8_t *pt, int nthreads)
+{
+    if (ct_len % 16) return -1;
+    size_t nblocks = ct_len / 16;
+
+    if (nthreads <= 0) nthreads = online_cpus();
+    if (nthreads > AES_CBC_MT_MAX_THREADS) nthreads = AES_CBC_MT_MAX_THREADS;
+    /* Each thread gets at least half the threshold so spawn cost stays small */
+    size_t max_by_size = ct_len / (AES_CBC_MT_MIN_BYTES / 2);
+    if ((size_t)nthreads > max_by_size) nthreads = (int)max_by_size;
+
+    if (ct_len < AES_CBC_MT_MIN_BYTES || nthreads <= 1) {
+        aes_cbc_decrypt_blocks(k, iv, ct, nblocks, pt);
+        return 0;
+    }
+
+    /* Slice boundaries on batch multiples so every multi-block call is full */
+    cbc_slice_t sl[AES_CBC_MT_MAX_THREADS];
+    size_t per = (nblocks + (size_t)nthreads - 1) / (size_t)nthreads;
+    per = (per + AES_CBC_BATCH_BLOCKS - 1) / AES_CBC_BATCH_BLOCKS * AES_CBC_BATCH_BLOCKS;
+
+    int used = 0;
+    for (size_t b = 0; b < nblocks && used < nthreads; b += per, ++used) {
+        sl[used].k       = k;
+        sl[used].iv      = b ? ct + 16*(b - 1) : iv;
+        sl[used].ct      = ct + 16*b;
+        sl[used].pt      = pt + 16*b;
+        sl[used].nblocks = (nblocks - b < per) ? (nblocks - b) : per;
+    }
+
+    /* Slice 0 runs on the calling thread */
+#ifdef _WIN32
+    HANDLE th[AES_CBC_MT_MAX_THREADS];
+    for (int i = 1; i < used; ++i) {
+        th[i] = CreateThread(NULL, 0, cbc_slice_run, &sl[i], 0, NULL);
+        if (!th[i]) cbc_slice_run(&sl[i]);
+    }
+    cbc_slice_run(&sl[0]);
+    for (int i = 1; i < used; ++i) {
+        if (th[i]) { WaitForSingleObject(th[i], INFINITE); CloseHandle(th[i]); }
+    }
+#else
+    pthread_t th[AES_CBC_MT_MAX_THREADS];
+    int ok[AES_CBC_MT_MAX_THREADS] = {0};
+    for (int i = 1; i < used; ++i) {
+        ok[i] = pthread_create(&th[i], NULL, cbc_slice_run, &sl[i]) == 0;
+        if (!ok[i]) cbc_slice_run(&sl[i]);
+    }
+    cbc_slice_run(&sl[0]);
+    for (int i = 1; i < used; ++i) {
+        if (ok[i]) pthread_join(th[i], NULL);
+    }
+#endif
+    return 0;
+}
+
+int aes_cbc_decrypt_parallel_al(const qm_alloc_t *al, const uint8_t *ct, size_t ct_len,
+                                const uint8_t *key, size_t key_len, const uint8_t iv[16],
+                                uint8_t **pt, size_t *pt_len, int nthreads)
+{
+    if (ct_len == 0 || (ct_len % 16) != 0) return -1;
+
+    aes_key_t *ks = qm_secmem_key_new(key, key_len);
+    if (!ks) return -1;
+
+    *pt = (uint8_t*)qm_alloc(al, ct_len, QM_ALLOC_SECRET);
+    if (!*pt) { qm_secmem_key_free(ks); return -1; }
+    *pt_len = ct_len;
+
+    aes_cbc_decrypt_mt(ks, iv, ct, ct_len, *pt, nthreads);
+    qm_secmem_key_free(ks);
+
+    if (pkcs7_unpad(*pt, pt_len) != 0) {
+        qm_release(al, *pt, ct_len, QM_ALLOC_SECRET);
+        *pt = NULL;
+        *pt_len = 0;
+        return -1;
+    }
+    return 0;
+}
+
+int aes_cbc_decrypt_parallel(const uint8_t *ct, size_t ct_len,
+                             const uint8_t *key, size_t key_len, const uint8_t iv[16],
+                             uint8_t **pt, size_t *pt_len, int nthreads)
+{
+    return aes_cbc_decrypt_parallel_al(NULL, ct, ct_len, key, key_len, iv, pt, pt_len, nthreads);
+}
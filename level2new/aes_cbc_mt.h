@@ -0,0 +1,42 @@
+#ifndef AES_CBC_MT_H
+#define AES_CBC_MT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "aes.h"
+
+/*
+ * Multi-threaded CBC decryption. CBC decrypt has no serial dependency
+ * (P_i = D(C_i) XOR C_{i-1}), so the ciphertext is split into contiguous
+ * block ranges and each thread runs aes_cbc_decrypt_blocks() on its range,
+ * using the last ciphertext block before the range as its IV.
+ *
+ *   gcc -O2 -o aes_cbc_demo aes.c aes_ct64.c aes_ni.c aes_cbc_mt.c qm_arena.c qm_secmem.c main.c -lpthread
+ */
+
+#define AES_CBC_MT_MIN_BYTES   (256u * 1024u)  /* below this, stay on the calling thread */
+#define AES_CBC_MT_MAX_THREADS 64
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Raw CBC decrypt of ct_len bytes (multiple of 16), no unpadding.
+   nthreads <= 0 picks the online CPU count. pt must not alias ct.
+   Returns 0 on success, -1 on bad length. */
+int aes_cbc_decrypt_mt(const aes_key_t *k, const uint8_t iv[16],
+                       const uint8_t *ct, size_t ct_len, uint8_t *pt, int nthreads);
+
+/* Same contract as aes_cbc_decrypt() (malloc'd output, PKCS#7 removed). */
+int aes_cbc_decrypt_parallel(const uint8_t *ct, size_t ct_len,
+                             const uint8_t *key, size_t key_len, const uint8_t iv[16],
+                             uint8_t **pt, size_t *pt_len, int nthreads);
+int aes_cbc_decrypt_parallel_al(const qm_alloc_t *al, const uint8_t *ct, size_t ct_len,
+                                const uint8_t *key, size_t key_len, const uint8_t iv[16],
+                                uint8_t **pt, size_t *pt_len, int nthreads);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* AES_CBC_MT_H */
@@ -0,0 +1,233 @@
+#include "aes.h"
+#include "aes_backend.h"
+#include <string.h>
+
+/*
+ * Constant-time bitsliced AES (encryption only), after the BearSSL "ct64"
+ * design. Four blocks are spread over eight 64-bit words, one word per bit
+ * position of every state byte, so SubBytes is a fixed Boolean circuit
+ * (Boyar-Peralta) and no table is ever indexed with secret data. Two such
+ * states are carried through each round side by side, i.e. 8 blocks per call.
+ *
+ * Round keys come from the byte schedule in aes_key_t, so the bitsliced
+ * engine encrypts exactly like the table-free portable code for all sizes
+ * (including the historic AES-128 schedule).
+ */
+
+/* ===================== Bit layout ===================== */
+
+#define SWAPN(cl, ch, s, x, y) do { \
+        uint64_t a_ = (x), b_ = (y); \
+        (x) = (a_ & (uint64_t)(cl)) | ((b_ & (uint64_t)(cl)) << (s)); \
+        (y) = ((a_ & (uint64_t)(ch)) >> (s)) | (b_ & (uint64_t)(ch)); \
+    } while (0)
+
+#define SWAP2(x, y) SWAPN(0x5555555555555555ULL, 0xAAAAAAAAAAAAAAAAULL, 1, x, y)
+#define SWAP4(x, y) SWAPN(0x3333333333333333ULL, 0xCCCCCCCCCCCCCCCCULL, 2, x, y)
+#define SWAP8(x, y) SWAPN(0x0F0F0F0F0F0F0F0FULL, 0xF0F0F0F0F0F0F0F0ULL, 4, x, y)
+
+/* Transpose 8x8 bit matrices: byte-sliced <-> bit-sliced (an involution) */
+static void ct64_ortho(uint64_t q[8]) {
+    SWAP2(q[0], q[1]); SWAP2(q[2], q[3]); SWAP2(q[4], q[5]); SWAP2(q[6], q[7]);
+    SWAP4(q[0], q[2]); SWAP4(q[1], q[3]); SWAP4(q[4], q[6]); SWAP4(q[5], q[7]);
+    SWAP8(q[0], q[4]); SWAP8(q[1], q[5]); SWAP8(q[2], q[6]); SWAP8(q[3], q[7]);
+}
+
+static void ct64_interleave_in(uint64_t *q0, uint64_t *q1, const uint32_t w[4]) {
+    uint64_t x0 = w[0], x1 = w[1], x2 = w[2], x3 = w[3];
+    x0 |= (x0 << 16); x1 |= (x1 << 16); x2 |= (x2 << 16); x3 |= (x3 << 16);
+    x0 &= 0x0000FFFF0000FFFFULL; x1 &= 0x0000FFFF0000FFFFULL;
+    x2 &= 0x0000FFFF0000FFFFULL; x3 &= 0x0000FFFF0000FFFFULL;
+    x0 |= (x0 << 8); x1 |= (x1 << 8); x2 |= (x2 << 8); x3 |= (x3 << 8);
+    x0 &= 0x00FF00FF00FF00FFULL; x1 &= 0x00FF00FF00FF00FFULL;
+    x2 &= 0x00FF00FF00FF00FFULL; x3 &= 0x00FF00FF00FF00FFULL;
+    *q0 = x0 | (x2 << 8);
+    *q1 = x1 | (x3 << 8);
+}
+
+static void ct64_interleave_out(uint32_t w[4], uint64_t q0, uint64_t q1) {
+    uint64_t x0 = q0 & 0x00FF00FF00FF00FFULL;
+    uint64_t x1 = q1 & 0x00FF00FF00FF00FFULL;
+    uint64_t x2 = (q0 >> 8) & 0x00FF00FF00FF00FFULL;
+    uint64_t x3 = (q1 >> 8) & 0x00FF00FF00FF00FFULL;
+    x0 |= (x0 >> 8); x1 |= (x1 >> 8); x2 |= (x2 >> 8); x3 |= (x3 >> 8);
+    x0 &= 0x0000FFFF0000FFFFULL; x1 &= 0x0000FFFF0000FFFFULL;
+    x2 &= 0x0000FFFF0000FFFFULL; x3 &= 0x0000FFFF0000FFFFULL;
+    w[0] = (uint32_t)x0 | (uint32_t)(x0 >> 16);
+    w[1] = (uint32_t)x1 | (uint32_t)(x1 >> 16);
+    w[2] = (uint32_t)x2 | (uint32_t)(x2 >> 16);
+    w[3] = (uint32_t)x3 | (uint32_t)(x3 >> 16);
+}
+
+static uint32_t load32le(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+static void store32le(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8); p[2] = (uint8_t)(v >> 16); p[3] = (uint8_t)(v >> 24);
+}
+
+/* Up to 4 blocks -> one bitsliced state (missing blocks are zero) */
+static void ct64_load(uint64_t q[8], const uint8_t *in, size_t nblocks) {
+    uint32_t w[16] = {0};
+    for (size_t i = 0; i < 4 * nblocks; ++i) w[i] = load32le(in + 4*i);
+    for (int i = 0; i < 4; ++i) ct64_interleave_in(&q[i], &q[i + 4], w + 4*i);
+    ct64_ortho(q);
+}
+
+static void ct64_store(uint8_t *out, uint64_t q[8], size_t nblocks) {
+    uint32_t w[16];
+    ct64_ortho(q);
+    for (int i = 0; i < 4; ++i) ct64_interleave_out(w + 4*i, q[i], q[i + 4]);
+    for (size_t i = 0; i < 4 * nblocks; ++i) store32le(out + 4*i, w[i]);
+}
+
+/* ===================== Round functions ===================== */
+
+/* SubBytes on all 32 bytes of a state: Boyar-Peralta circuit, 113 gates */
+static void ct64_sbox(uint64_t q[8]) {
+    uint64_t x0, x1, x2, x3, x4, x5, x6, x7;
+    uint64_t y1, y2, y3, y4, y5, y6, y7, y8, y9, y10, y11, y12, y13, y14, y15, y16, y17, y18, y19, y20, y21;
+    uint64_t z0, z1, z2, z3, z4, z5, z6, z7, z8, z9, z10, z11, z12, z13, z14, z15, z16, z17;
+    uint64_t t0, t1, t2, t3, t4, t5, t6, t7, t8, t9, t10, t11, t12, t13, t14, t15, t16, t17, t18, t19;
+    uint64_t t20, t21, t22, t23, t24, t25, t26, t27, t28, t29, t30, t31, t32, t33, t34, t35, t36, t37, t38, t39;
+    uint64_t t40, t41, t42, t43, t44, t45, t46, t47, t48, t49, t50, t51, t52, t53, t54, t55, t56, t57, t58, t59;
+    uint64_t t60, t61, t62, t63, t64, t65, t66, t67;
+    uint64_t s0, s1, s2, s3, s4, s5, s6, s7;
+
+    x0 = q[7]; x1 = q[6]; x2 = q[5]; x3 = q[4];
+    x4 = q[3]; x5 = q[2]; x6 = q[1]; x7 = q[0];
+
+    /* Top linear transformation */
+    y14 = x3 ^ x5;  y13 = x0 ^ x6;  y9 = x0 ^ x3;   y8 = x0 ^ x5;
+    t0 = x1 ^ x2;   y1 = t0 ^ x7;   y4 = y1 ^ x3;   y12 = y13 ^ y14;
+    y2 = y1 ^ x0;   y5 = y1 ^ x6;   y3 = y5 ^ y8;   t1 = x4 ^ y12;
+    y15 = t1 ^ x5;  y20 = t1 ^ x1;  y6 = y15 ^ x7;  y10 = y15 ^ t0;
+    y11 = y20 ^ y9; y7 = x7 ^ y11;  y17 = y10 ^ y11; y19 = y10 ^ y8;
+    y16 = t0 ^ y11; y21 = y13 ^ y16; y18 = x0 ^ y16;
+
+    /* Non-linear section */
+    t2 = y12 & y15; t3 = y3 & y6;   t4 = t3 ^ t2;   t5 = y4 & x7;
+    t6 = t5 ^ t2;   t7 = y13 & y16; t8 = y5 & y1;   t9 = t8 ^ t7;
+    t10 = y2 & y7;  t11 = t10 ^ t7; t12 = y9 & y11; t13 = y14 & y17;
+    t14 = t13 ^ t12; t15 = y8 & y10; t16 = t15 ^ t12; t17 = t4 ^ t14;
+    t18 = t6 ^ t16; t19 = t9 ^ t14; t20 = t11 ^ t16; t21 = t17 ^ y20;
+    t22 = t18 ^ y19; t23 = t19 ^ y21; t24 = t20 ^ y18;
+
+    t25 = t21 ^ t22; t26 = t21 & t23; t27 = t24 ^ t26; t28 = t25 & t27;
+    t29 = t28 ^ t22; t30 = t23 ^ t24; t31 = t22 ^ t26; t32 = t31 & t30;
+    t33 = t32 ^ t24; t34 = t23 ^ t33; t35 = t27 ^ t33; t36 = t24 & t35;
+    t37 = t36 ^ t34; t38 = t27 ^ t36; t39 = t29 & t38; t40 = t25 ^ t39;
+
+    t41 = t40 ^ t37; t42 = t29 ^ t33; t43 = t29 ^ t40; t44 = t33 ^ t37;
+    t45 = t42 ^ t41;
+    z0 = t44 & y15;  z1 = t37 & y6;   z2 = t33 & x7;   z3 = t43 & y16;
+    z4 = t40 & y1;   z5 = t29 & y7;   z6 = t42 & y11;  z7 = t45 & y17;
+    z8 = t41 & y10;  z9 = t44 & y12;  z10 = t37 & y3;  z11 = t33 & y4;
+    z12 = t43 & y13; z13 = t40 & y5;  z14 = t29 & y2;  z15 = t42 & y9;
+    z16 = t45 & y14; z17 = t41 & y8;
+
+    /* Bottom linear transformation */
+    t46 = z15 ^ z16; t47 = z10 ^ z11; t48 = z5 ^ z13;  t49 = z9 ^ z10;
+    t50 = z2 ^ z12;  t51 = z2 ^ z5;   t52 = z7 ^ z8;   t53 = z0 ^ z3;
+    t54 = z6 ^ z7;   t55 = z16 ^ z17; t56 = z12 ^ t48; t57 = t50 ^ t53;
+    t58 = z4 ^ t46;  t59 = z3 ^ t54;  t60 = t46 ^ t57; t61 = z14 ^ t57;
+    t62 = t52 ^ t58; t63 = t49 ^ t58; t64 = z4 ^ t59;  t65 = t61 ^ t62;
+    t66 = z1 ^ t63;
+    s0 = t59 ^ t63;  s6 = t56 ^ ~t62; s7 = t48 ^ ~t60; t67 = t64 ^ t65;
+    s3 = t53 ^ t66;  s4 = t51 ^ t66;  s5 = t47 ^ t65;  s1 = t64 ^ ~s3;
+    s2 = t55 ^ ~t67;
+
+    q[7] = s0; q[6] = s1; q[5] = s2; q[4] = s3;
+    q[3] = s4; q[2] = s5; q[1] = s6; q[0] = s7;
+}
+
+static void ct64_shift_rows(uint64_t q[8]) {
+    for (int i = 0; i < 8; ++i) {
+        uint64_t x = q[i];
+        q[i] = (x & 0x000000000000FFFFULL)
+             | ((x & 0x00000000FFF00000ULL) >> 4)
+             | ((x & 0x00000000000F0000ULL) << 12)
+             | ((x & 0x0000FF0000000000ULL) >> 8)
+             | ((x & 0x000000FF00000000ULL) << 8)
+             | ((x & 0xF000000000000000ULL) >> 12)
+             | ((x & 0x0FFF000000000000ULL) << 4);
+    }
+}
+
+static inline uint64_t rotr32(uint64_t x) {
+    return (x << 32) | (x >> 32);
+}
+
+static void ct64_mix_columns(uint64_t q[8]) {
+    uint64_t q0 = q[0], q1 = q[1], q2 = q[2], q3 = q[3];
+    uint64_t q4 = q[4], q5 = q[5], q6 = q[6], q7 = q[7];
+    uint64_t r0 = (q0 >> 16) | (q0 << 48), r1 = (q1 >> 16) | (q1 << 48);
+    uint64_t r2 = (q2 >> 16) | (q2 << 48), r3 = (q3 >> 16) | (q3 << 48);
+    uint64_t r4 = (q4 >> 16) | (q4 << 48), r5 = (q5 >> 16) | (q5 << 48);
+    uint64_t r6 = (q6 >> 16) | (q6 << 48), r7 = (q7 >> 16) | (q7 << 48);
+
+    q[0] = q7 ^ r7 ^ r0 ^ rotr32(q0 ^ r0);
+    q[1] = q0 ^ r0 ^ q7 ^ r7 ^ r1 ^ rotr32(q1 ^ r1);
+    q[2] = q1 ^ r1 ^ r2 ^ rotr32(q2 ^ r2);
+    q[3] = q2 ^ r2 ^ q7 ^ r7 ^ r3 ^ rotr32(q3 ^ r3);
+    q[4] = q3 ^ r3 ^ q7 ^ r7 ^ r4 ^ rotr32(q4 ^ r4);
+    q[5] = q4 ^ r4 ^ r5 ^ rotr32(q5 ^ r5);
+    q[6] = q5 ^ r5 ^ r6 ^ rotr32(q6 ^ r6);
+    q[7] = q6 ^ r6 ^ r7 ^ rotr32(q7 ^ r7);
+}
+
+static inline void ct64_add_round_key(uint64_t q[8], const uint64_t sk[8]) {
+    for (int i = 0; i < 8; ++i) q[i] ^= sk[i];
+}
+
+/* ===================== Key schedule ===================== */
+
+/* Each byte round key is replicated into all four block slots and pushed
+   through the same layout transform as the data. */
+void aes_ct64_keysched(aes_key_t *k) {
+    uint8_t rep[64];
+    for (int r = 0; r <= k->rounds; ++r) {
+        for (int i = 0; i < 4; ++i) memcpy(rep + 16*i, k->rk + 16*r, 16);
+        ct64_load(k->sk64 + 8*r, rep, 4);
+    }
+    /* round key copies: do not leave them on the stack */
+    volatile uint8_t *v = rep;
+    for (size_t i = 0; i < sizeof(rep); ++i) v[i] = 0;
+}
+
+/* ===================== Encrypt ===================== */
+
+/* Two states (8 blocks) per round step so both dependency chains overlap;
+   b may be NULL when four blocks or fewer are left. */
+static void ct64_encrypt(const aes_key_t *k, uint64_t a[8], uint64_t *b) {
+    const uint64_t *sk = k->sk64;
+    ct64_add_round_key(a, sk);
+    if (b) ct64_add_round_key(b, sk);
+    for (int r = 1; r < k->rounds; ++r) {
+        ct64_sbox(a);           if (b) ct64_sbox(b);
+        ct64_shift_rows(a);     if (b) ct64_shift_rows(b);
+        ct64_mix_columns(a);    if (b) ct64_mix_columns(b);
+        ct64_add_round_key(a, sk + 8*r);
+        if (b) ct64_add_round_key(b, sk + 8*r);
+    }
+    ct64_sbox(a);           if (b) ct64_sbox(b);
+    ct64_shift_rows(a);     if (b) ct64_shift_rows(b);
+    ct64_add_round_key(a, sk + 8*k->rounds);
+    if (b) ct64_add_round_key(b, sk + 8*k->rounds);
+}
+
+void aes_ct64_encrypt_blocks(const aes_key_t *k, uint8_t *out, const uint8_t *in, size_t nblocks) {
+    uint64_t a[8], b[8];
+    while (nblocks) {
+        size_t na = nblocks < 4 ? nblocks : 4;
+        size_t nb = nblocks - na < 4 ? nblocks - na : 4;
+        ct64_load(a, in, na);
+        if (nb) ct64_load(b, in + 16*na, nb);
+        ct64_encrypt(k, a, nb ? b : NULL);
+        ct64_store(out, a, na);
+        if (nb) ct64_store(out + 16*na, b, nb);
+        in += 16*(na + nb);
+        out += 16*(na + nb);
+        nblocks -= na + nb;
+    }
+}
@@ -1,9 +1,16 @@
 #include "aes.h"
 #include "aes_gcm.h"
+#include "qm_stats.h"
+#include "qm_secmem.h"
 #include <string.h>
 #include <stdlib.h>
 
-/* ---------- Helpers: big-endian put, consttime cmp, inc32(Y) ---------- */
+/* ---------- Helpers: wipe, big-endian put, consttime cmp, inc32(Y) ---------- */
+static void secure_zero(void *p, size_t n) {
+    volatile uint8_t *q = (volatile uint8_t*)p;
+    while (n--) *q++ = 0;
+}
+
 static void be_store64(uint8_t out[8], uint64_t v) {
     for (int i = 7; i >= 0; --i) { out[i] = (uint8_t)(v & 0xFF); v >>= 8; }
 }
@@ -38,12 +45,21 @@ static void gcm_mult(uint8_t X[16], const uint8_t Y[16]) {
     memcpy(X, Z, 16);
 }
 
+/* Y = (Y ^ X_i) * H over whole blocks */
+static void ghash_blocks(uint8_t Y[16], const uint8_t H[16], const uint8_t *X, size_t nblocks) {
+    for (size_t b = 0; b < nblocks; ++b, X += 16) {
+        for (int i = 0; i < 16; ++i) Y[i] ^= X[i];
+        gcm_mult(Y, H);
+    }
+}
+
 /* GHASH over A (AAD) and C (ciphertext) with H */
-static void ghash(const uint8_t H[16],
+void aes_gcm_ghash(const uint8_t H[16],
                   const uint8_t *A, size_t Alen,
                   const uint8_t *C, size_t Clen,
                   uint8_t S[16])
 {
+    QM_STATS_BEGIN(QM_STAT_GHASH);
     uint8_t Y[16] = {0};
     uint8_t Hcopy[16]; memcpy(Hcopy, H, 16);
 
@@ -76,25 +92,17 @@ static void ghash(const uint8_t H[16],
     gcm_mult(Y, Ht);
 
     memcpy(S, Y, 16);
+    QM_STATS_END(QM_STAT_GHASH, Alen + Clen);
 }
 
 /* GCTR: out = AES-CTR starting from ICB, processing input Len bytes */
-static void gctr(const uint8_t key[16], const uint8_t ICB[16],
+static void gctr(const aes_key_t *ks, const uint8_t ICB[16],
                  const uint8_t *in, size_t in_len, uint8_t *out) {
     if (in_len == 0) return;
+    QM_STATS_BEGIN(QM_STAT_GCTR);
     uint8_t counter[16]; memcpy(counter, ICB, 16);
-
-    uint8_t rk[AES128_ROUND_KEYS_SIZE];
-    key_expansion_128(key, rk);
-
-    size_t off = 0;
-    while (off < in_len) {
-        uint8_t Ek[16]; aes_encrypt_block_128(Ek, counter, rk);
-        size_t n = (in_len - off >= 16) ? 16 : (in_len - off);
-        for (size_t i = 0; i < n; ++i) out[off + i] = in[off + i] ^ Ek[i];
-        off += n;
-        inc32(counter);
-    }
+    aes_ctr32_xor(ks, counter, in, in_len, out);
+    QM_STATS_END(QM_STAT_GCTR, in_len);
 }
 
 /* J0 derivation:
@@ -108,86 +116,242 @@ static void derive_J0(const uint8_t H[16],
         memcpy(J0, iv, 12);
         J0[12]=0; J0[13]=0; J0[14]=0; J0[15]=1;
     } else {
-        ghash(H, NULL, 0, iv, iv_len, J0);
+        aes_gcm_ghash(H, NULL, 0, iv, iv_len, J0);
     }
 }
 
-int aes128_gcm_encrypt(const uint8_t *pt, size_t pt_len,
-                       const uint8_t *aad, size_t aad_len,
-                       const uint8_t key[16],
+int aes_gcm_encrypt_ks(const aes_key_t *ks,
                        const uint8_t *iv, size_t iv_len,
-                       uint8_t **ct, size_t *ct_len,
-                       uint8_t tag[16])
+                       const uint8_t *aad, size_t aad_len,
+                       const uint8_t *pt, size_t len,
+                       uint8_t *ct, uint8_t tag[16])
 {
-    if (!pt && pt_len) return -1;
+    if ((!pt || !ct) && len) return -1;
     if (!iv || iv_len == 0) return -1;
 
-    *ct = (uint8_t*)malloc(pt_len);
-    if (!*ct && pt_len) return -1;
-    *ct_len = pt_len;
-
+    QM_STATS_BEGIN(QM_STAT_GCM_ENCRYPT);
     /* H = E_k(0^128) */
-    uint8_t rk[AES128_ROUND_KEYS_SIZE];
-    key_expansion_128(key, rk);
-
     uint8_t H[16] = {0}, zero[16] = {0};
-    aes_encrypt_block_128(H, zero, rk);
+    aes_encrypt_block(ks, H, zero);
 
     /* J0 */
     uint8_t J0[16]; derive_J0(H, iv, iv_len, J0);
 
     /* C = GCTR_k(inc32(J0), P) */
     uint8_t ICB[16]; memcpy(ICB, J0, 16); inc32(ICB);
-    if (pt_len) gctr(key, ICB, pt, pt_len, *ct);
+    if (len) gctr(ks, ICB, pt, len, ct);
 
     /* S = GHASH_H(A, C) */
-    uint8_t S[16]; ghash(H, aad, aad_len, *ct, pt_len, S);
+    uint8_t S[16]; aes_gcm_ghash(H, aad, aad_len, ct, len, S);
 
     /* T = MSB_128( GCTR_k(J0, S) ) == E_k(J0) XOR S */
-    uint8_t EkJ0[16]; aes_encrypt_block_128(EkJ0, J0, rk);
+    uint8_t EkJ0[16]; aes_encrypt_block(ks, EkJ0, J0);
     for (int i = 0; i < 16; ++i) tag[i] = (uint8_t)(EkJ0[i] ^ S[i]);
 
+    /* The hash subkey is as good as the key for forging tags */
+    secure_zero(H, sizeof(H));
+    secure_zero(EkJ0, sizeof(EkJ0));
+    QM_STATS_END(QM_STAT_GCM_ENCRYPT, len);
     return 0;
 }
 
-int aes128_gcm_decrypt(const uint8_t *ct, size_t ct_len,
-                       const uint8_t *aad, size_t aad_len,
-                       const uint8_t key[16],
+int aes_gcm_decrypt_ks(const aes_key_t *ks,
                        const uint8_t *iv, size_t iv_len,
-                       const uint8_t tag[16],
-                       uint8_t **pt, size_t *pt_len)
+                       const uint8_t *aad, size_t aad_len,
+                       const uint8_t *ct, size_t len,
+                       const uint8_t tag[16], uint8_t *pt)
 {
+    if ((!pt || !ct) && len) return -1;
     if (!iv || iv_len == 0) return -1;
 
-    *pt = (uint8_t*)malloc(ct_len);
-    if (!*pt && ct_len) return -1;
-    *pt_len = ct_len;
-
+    QM_STATS_BEGIN(QM_STAT_GCM_DECRYPT);
     /* H = E_k(0^128) */
-    uint8_t rk[AES128_ROUND_KEYS_SIZE];
-    key_expansion_128(key, rk);
-
     uint8_t H[16] = {0}, zero[16] = {0};
-    aes_encrypt_block_128(H, zero, rk);
+    aes_encrypt_block(ks, H, zero);
 
     /* J0 */
     uint8_t J0[16]; derive_J0(H, iv, iv_len, J0);
 
     /* Compute expected tag using C (per spec) */
-    uint8_t S[16]; ghash(H, aad, aad_len, ct, ct_len, S);
-    uint8_t EkJ0[16]; aes_encrypt_block_128(EkJ0, J0, rk);
+    uint8_t S[16]; aes_gcm_ghash(H, aad, aad_len, ct, len, S);
+    uint8_t EkJ0[16]; aes_encrypt_block(ks, EkJ0, J0);
     uint8_t tag_exp[16];
     for (int i = 0; i < 16; ++i) tag_exp[i] = (uint8_t)(EkJ0[i] ^ S[i]);
+    secure_zero(H, sizeof(H));
+    secure_zero(EkJ0, sizeof(EkJ0));
 
     /* Constant-time compare */
-    if (!consttime_eq16(tag, tag_exp)) {
-        free(*pt); *pt = NULL; *pt_len = 0;
-        return -1; /* auth fail */
-    }
+    if (!consttime_eq16(tag, tag_exp)) return -1; /* auth fail */
 
     /* P = GCTR_k(inc32(J0), C) */
     uint8_t ICB[16]; memcpy(ICB, J0, 16); inc32(ICB);
-    if (ct_len) gctr(key, ICB, ct, ct_len, *pt);
+    if (len) gctr(ks, ICB, ct, len, pt);
+
+    QM_STATS_END(QM_STAT_GCM_DECRYPT, len);
+    return 0;
+}
+
+/* ===================== Incremental encryption ===================== */
+
+int aes_gcm_enc_init(aes_gcm_ctx_t *c, const aes_key_t *ks,
+                     const uint8_t *iv, size_t iv_len,
+                     const uint8_t *aad, size_t aad_len)
+{
+    if (!c || !ks || !iv || iv_len == 0 || (!aad && aad_len)) return -1;
+    memset(c, 0, sizeof(*c));
+    c->ks = ks;
+    uint8_t zero[16] = {0};
+    aes_encrypt_block(ks, c->H, zero);
+    derive_J0(c->H, iv, iv_len, c->J0);
+    memcpy(c->ctr, c->J0, 16); inc32(c->ctr);
+
+    /* AAD is complete up front: absorb it now, zero-padding the last block */
+    ghash_blocks(c->Y, c->H, aad, aad_len / 16);
+    if (aad_len % 16) {
+        uint8_t blk[16] = {0};
+        memcpy(blk, aad + aad_len / 16 * 16, aad_len % 16);
+        ghash_blocks(c->Y, c->H, blk, 1);
+    }
+    c->aad_len = aad_len;
+    return 0;
+}
+
+void aes_gcm_enc_update(aes_gcm_ctx_t *c, const uint8_t *in, size_t len, uint8_t *out) {
+    QM_STATS_BEGIN(QM_STAT_GCM_ENCRYPT);
+    c->ct_len += len;
+
+    /* finish the pending partial block */
+    while (c->used && len) {
+        uint8_t x = (uint8_t)(*in++ ^ c->stream[c->used]);
+        *out++ = x;
+        c->block[c->used++] = x;
+        len--;
+        if (c->used == 16) { ghash_blocks(c->Y, c->H, c->block, 1); c->used = 0; }
+    }
+
+    /* whole blocks go through the batched CTR path */
+    size_t whole = len / 16 * 16;
+    if (whole) {
+        gctr(c->ks, c->ctr, in, whole, out);
+        for (size_t b = 0; b < whole / 16; ++b) inc32(c->ctr);
+        ghash_blocks(c->Y, c->H, out, whole / 16);
+        in += whole; out += whole; len -= whole;
+    }
+
+    /* start a new partial block */
+    if (len) {
+        aes_encrypt_block(c->ks, c->stream, c->ctr);
+        inc32(c->ctr);
+        for (size_t i = 0; i < len; ++i) {
+            out[i] = (uint8_t)(in[i] ^ c->stream[i]);
+            c->block[i] = out[i];
+        }
+        c->used = len;
+    }
+    QM_STATS_END(QM_STAT_GCM_ENCRYPT, whole);
+}
+
+void aes_gcm_enc_final(aes_gcm_ctx_t *c, uint8_t tag[16]) {
+    if (c->used) {
+        memset(c->block + c->used, 0, 16 - c->used);
+        ghash_blocks(c->Y, c->H, c->block, 1);
+    }
+    uint8_t lenblk[16];
+    be_store64(lenblk, c->aad_len * 8);
+    be_store64(lenblk + 8, c->ct_len * 8);
+    ghash_blocks(c->Y, c->H, lenblk, 1);
 
+    uint8_t EkJ0[16]; aes_encrypt_block(c->ks, EkJ0, c->J0);
+    for (int i = 0; i < 16; ++i) tag[i] = (uint8_t)(EkJ0[i] ^ c->Y[i]);
+    memset(c->stream, 0, sizeof(c->stream));
+}
+
+int aes_gcm_encrypt_al(const qm_alloc_t *al,
+                       const uint8_t *pt, size_t pt_len,
+                       const uint8_t *aad, size_t aad_len,
+                       const uint8_t *key, size_t key_len,
+                       const uint8_t *iv, size_t iv_len,
+                       uint8_t **ct, size_t *ct_len,
+                       uint8_t tag[16])
+{
+    if (!pt && pt_len) return -1;
+    if (!iv || iv_len == 0) return -1;
+
+    /* One key schedule for H, GCTR and the tag block, in a locked slot */
+    aes_key_t *ks = qm_secmem_key_new(key, key_len);
+    if (!ks) return -1;
+
+    *ct = (uint8_t*)qm_alloc(al, pt_len, 0);
+    if (!*ct) { qm_secmem_key_free(ks); return -1; }
+    *ct_len = pt_len;
+
+    int rc = aes_gcm_encrypt_ks(ks, iv, iv_len, aad, aad_len, pt, pt_len, *ct, tag);
+    qm_secmem_key_free(ks);
+    return rc;
+}
+
+int aes_gcm_decrypt_al(const qm_alloc_t *al,
+                       const uint8_t *ct, size_t ct_len,
+                       const uint8_t *aad, size_t aad_len,
+                       const uint8_t *key, size_t key_len,
+                       const uint8_t *iv, size_t iv_len,
+                       const uint8_t tag[16],
+                       uint8_t **pt, size_t *pt_len)
+{
+    if (!iv || iv_len == 0) return -1;
+
+    aes_key_t *ks = qm_secmem_key_new(key, key_len);
+    if (!ks) return -1;
+
+    *pt = (uint8_t*)qm_alloc(al, ct_len, QM_ALLOC_SECRET);
+    if (!*pt) { qm_secmem_key_free(ks); return -1; }
+    *pt_len = ct_len;
+
+    int rc = aes_gcm_decrypt_ks(ks, iv, iv_len, aad, aad_len, ct, ct_len, tag, *pt);
+    qm_secmem_key_free(ks);
+    if (rc != 0) {
+        qm_release(al, *pt, ct_len, QM_ALLOC_SECRET); *pt = NULL; *pt_len = 0;
+        return -1; /* auth fail */
+    }
     return 0;
 }
+
+int aes_gcm_encrypt(const uint8_t *pt, size_t pt_len,
+                    const uint8_t *aad, size_t aad_len,
+                    const uint8_t *key, size_t key_len,
+                    const uint8_t *iv, size_t iv_len,
+                    uint8_t **ct, size_t *ct_len,
+                    uint8_t tag[16])
+{
+    return aes_gcm_encrypt_al(NULL, pt, pt_len, aad, aad_len, key, key_len, iv, iv_len, ct, ct_len, tag);
+}
+
+int aes_gcm_decrypt(const uint8_t *ct, size_t ct_len,
+                    const uint8_t *aad, size_t aad_len,
+                    const uint8_t *key, size_t key_len,
+                    const uint8_t *iv, size_t iv_len,
+                    const uint8_t tag[16],
+                    uint8_t **pt, size_t *pt_len)
+{
+    return aes_gcm_decrypt_al(NULL, ct, ct_len, aad, aad_len, key, key_len, iv, iv_len, tag, pt, pt_len);
+}
+
+int aes128_gcm_encrypt(const uint8_t *pt, size_t pt_len,
+                       const uint8_t *aad, size_t aad_len,
+                       const uint8_t key[16],
+                       const uint8_t *iv, size_t iv_len,
+                       uint8_t **ct, size_t *ct_len,
+                       uint8_t tag[16])
+{
+    return aes_gcm_encrypt(pt, pt_len, aad, aad_len, key, 16, iv, iv_len, ct, ct_len, tag);
+}
+
+int aes128_gcm_decrypt(const uint8_t *ct, size_t ct_len,
+                       const uint8_t *aad, size_t aad_len,
+                       const uint8_t key[16],
+                       const uint8_t *iv, size_t iv_len,
+                       const uint8_t tag[16],
+                       uint8_t **pt, size_t *pt_len)
+{
+    return aes_gcm_decrypt(ct, ct_len, aad, aad_len, key, 16, iv, iv_len, tag, pt, pt_len);
+}
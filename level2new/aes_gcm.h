@@ -3,11 +3,76 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include "aes.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/* AES-GCM with 128-bit tag; key_len is 16, 24 or 32 */
+int aes_gcm_encrypt(const uint8_t *pt, size_t pt_len,
+                    const uint8_t *aad, size_t aad_len,
+                    const uint8_t *key, size_t key_len,
+                    const uint8_t *iv, size_t iv_len,
+                    uint8_t **ct, size_t *ct_len,
+                    uint8_t tag[16]);
+
+int aes_gcm_decrypt(const uint8_t *ct, size_t ct_len,
+                    const uint8_t *aad, size_t aad_len,
+                    const uint8_t *key, size_t key_len,
+                    const uint8_t *iv, size_t iv_len,
+                    const uint8_t tag[16],
+                    uint8_t **pt, size_t *pt_len);
+
+/* Same, with outputs from al (NULL = malloc); see qm_alloc.h. */
+int aes_gcm_encrypt_al(const qm_alloc_t *al,
+                       const uint8_t *pt, size_t pt_len,
+                       const uint8_t *aad, size_t aad_len,
+                       const uint8_t *key, size_t key_len,
+                       const uint8_t *iv, size_t iv_len,
+                       uint8_t **ct, size_t *ct_len,
+                       uint8_t tag[16]);
+
+int aes_gcm_decrypt_al(const qm_alloc_t *al,
+                       const uint8_t *ct, size_t ct_len,
+                       const uint8_t *aad, size_t aad_len,
+                       const uint8_t *key, size_t key_len,
+                       const uint8_t *iv, size_t iv_len,
+                       const uint8_t tag[16],
+                       uint8_t **pt, size_t *pt_len);
+
+/* Same, with an already expanded key and caller buffers of len bytes
+   (ct may alias pt). Decrypt writes pt only after the tag verifies. */
+int aes_gcm_encrypt_ks(const aes_key_t *ks,
+                       const uint8_t *iv, size_t iv_len,
+                       const uint8_t *aad, size_t aad_len,
+                       const uint8_t *pt, size_t len,
+                       uint8_t *ct, uint8_t tag[16]);
+
+int aes_gcm_decrypt_ks(const aes_key_t *ks,
+                       const uint8_t *iv, size_t iv_len,
+                       const uint8_t *aad, size_t aad_len,
+                       const uint8_t *ct, size_t len,
+                       const uint8_t tag[16], uint8_t *pt);
+
+/* Incremental encryption for callers that produce the plaintext piecewise
+   (layered envelopes): init, any number of updates of any length (out may
+   alias in), then final. ks must outlive the context. */
+typedef struct {
+    const aes_key_t *ks;
+    uint8_t  H[16], J0[16], ctr[16], Y[16];
+    uint8_t  stream[16];          /* keystream of the current partial block */
+    uint8_t  block[16];           /* ciphertext not yet absorbed into GHASH */
+    size_t   used;                /* bytes of stream/block in use, 0..15 */
+    uint64_t aad_len, ct_len;
+} aes_gcm_ctx_t;
+
+int  aes_gcm_enc_init(aes_gcm_ctx_t *c, const aes_key_t *ks,
+                      const uint8_t *iv, size_t iv_len,
+                      const uint8_t *aad, size_t aad_len);
+void aes_gcm_enc_update(aes_gcm_ctx_t *c, const uint8_t *in, size_t len, uint8_t *out);
+void aes_gcm_enc_final(aes_gcm_ctx_t *c, uint8_t tag[16]);
+
 /* AES-128-GCM with 128-bit tag */
 int aes128_gcm_encrypt(const uint8_t *pt, size_t pt_len,
                        const uint8_t *aad, size_t aad_len,
@@ -23,6 +88,12 @@ int aes128_gcm_decrypt(const uint8_t *ct, size_t ct_len,
                        const uint8_t tag[16],
                        uint8_t **pt, size_t *pt_len);
 
+/* GHASH_H(A, C) including the length block (exposed for benchmarks) */
+void aes_gcm_ghash(const uint8_t H[16],
+                   const uint8_t *A, size_t Alen,
+                   const uint8_t *C, size_t Clen,
+                   uint8_t S[16]);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,318 @@
+#define _FILE_OFFSET_BITS 64
+#include "aes_gcm_chunked.h"
+#include "aes_gcm.h"
+#include "qm_secmem.h"
+#include <string.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#define fseeko _fseeki64
+typedef __int64 off_t;
+#else
+#include <sys/types.h>
+#endif
+
+/* ---------- Helpers: nonce, wipe, contexts, full reads ---------- */
+static void chunk_nonce(const gcm_chunked_t *c, uint64_t index, int final, uint8_t nonce[12]) {
+    memcpy(nonce, c->header + 8, GCM_CHUNKED_PREFIX_SIZE);
+    nonce[7]  = (uint8_t)(index >> 24);
+    nonce[8]  = (uint8_t)(index >> 16);
+    nonce[9]  = (uint8_t)(index >> 8);
+    nonce[10] = (uint8_t)index;
+    nonce[11] = final ? 1 : 0;
+}
+
+static void secure_zero(void *p, size_t n) {
+    volatile uint8_t *q = (volatile uint8_t*)p;
+    while (n--) *q++ = 0;
+}
+
+/* Contexts hold the expanded key: keep them in locked memory */
+static gcm_chunked_t *ctx_new(void) { return (gcm_chunked_t*)qm_secmem_alloc(sizeof(gcm_chunked_t)); }
+static void ctx_free(gcm_chunked_t *c) { qm_secmem_free(c, sizeof(*c)); }
+
+/* Reads up to n bytes; sets *eof when the stream ends right after them, so
+   a full chunk at the end of the input is still recognised as final. */
+static size_t read_chunk(FILE *in, uint8_t *buf, size_t n, int *eof) {
+    size_t got = fread(buf, 1, n, in);
+    if (got < n) { *eof = 1; return got; }
+    int ch = fgetc(in);
+    if (ch == EOF) *eof = 1;
+    else { ungetc(ch, in); *eof = 0; }
+    return got;
+}
+
+/* ===================== Setup ===================== */
+
+int gcm_chunked_init(gcm_chunked_t *c, const uint8_t *key, size_t key_len,
+                     unsigned chunk_log2, const uint8_t prefix[GCM_CHUNKED_PREFIX_SIZE])
+{
+    if (!c || !prefix) return -1;
+    if (chunk_log2 < GCM_CHUNKED_MIN_LOG2 || chunk_log2 > GCM_CHUNKED_MAX_LOG2) return -1;
+    if (aes_key_init(&c->key, key, key_len) != 0) return -1;
+
+    memset(c->header, 0, sizeof(c->header));
+    memcpy(c->header, GCM_CHUNKED_MAGIC, 4);
+    c->header[4] = GCM_CHUNKED_VERSION;
+    c->header[5] = GCM_CHUNKED_ALG_AES_GCM;
+    c->header[6] = (uint8_t)chunk_log2;
+    memcpy(c->header + 8, prefix, GCM_CHUNKED_PREFIX_SIZE);
+    c->chunk_size = (size_t)1 << chunk_log2;
+    return 0;
+}
+
+int gcm_chunked_init_header(gcm_chunked_t *c, const uint8_t *key, size_t key_len,
+                            const uint8_t header[GCM_CHUNKED_HEADER_SIZE])
+{
+    if (!c || !header) return -1;
+    if (memcmp(header, GCM_CHUNKED_MAGIC, 4) != 0 ||
+        header[4] != GCM_CHUNKED_VERSION || header[5] != GCM_CHUNKED_ALG_AES_GCM ||
+        header[7] != 0 || header[15] != 0) return -1;
+    if (gcm_chunked_init(c, key, key_len, header[6], header + 8) != 0) return -1;
+    return 0;
+}
+
+/* ===================== Chunks ===================== */
+
+int gcm_chunked_seal_chunk(const gcm_chunked_t *c, uint64_t index, int final,
+                           const uint8_t *pt, size_t len, uint8_t *out)
+{
+    if (index >= GCM_CHUNKED_MAX_CHUNKS || len > c->chunk_size) return -1;
+    if (!final && len != c->chunk_size) return -1;
+    uint8_t nonce[12];
+    chunk_nonce(c, index, final, nonce);
+    return aes_gcm_encrypt_ks(&c->key, nonce, 12, c->header, GCM_CHUNKED_HEADER_SIZE,
+                              pt, len, out, out + len);
+}
+
+int gcm_chunked_open_chunk(const gcm_chunked_t *c, uint64_t index, int final,
+                           const uint8_t *in, size_t in_len, uint8_t *pt)
+{
+    if (index >= GCM_CHUNKED_MAX_CHUNKS || in_len < GCM_CHUNKED_TAG_SIZE) return -1;
+    size_t len = in_len - GCM_CHUNKED_TAG_SIZE;
+    if (len > c->chunk_size || (!final && len != c->chunk_size)) return -1;
+    uint8_t nonce[12];
+    chunk_nonce(c, index, final, nonce);
+    return aes_gcm_decrypt_ks(&c->key, nonce, 12, c->header, GCM_CHUNKED_HEADER_SIZE,
+                              in, len, in + len, pt);
+}
+
+/* ===================== Layout ===================== */
+
+uint64_t gcm_chunked_sealed_size(uint64_t pt_len, unsigned chunk_log2) {
+    uint64_t n = pt_len ? ((pt_len - 1) >> chunk_log2) + 1 : 1;
+    return GCM_CHUNKED_HEADER_SIZE + pt_len + n * GCM_CHUNKED_TAG_SIZE;
+}
+
+int gcm_chunked_layout(const gcm_chunked_t *c, uint64_t sealed_len,
+                       uint64_t *nchunks, uint64_t *pt_len)
+{
+    if (sealed_len < GCM_CHUNKED_HEADER_SIZE + GCM_CHUNKED_TAG_SIZE) return -1;
+    uint64_t body = sealed_len - GCM_CHUNKED_HEADER_SIZE;
+    uint64_t stride = (uint64_t)c->chunk_size + GCM_CHUNKED_TAG_SIZE;
+    uint64_t n = (body + stride - 1) / stride;
+    uint64_t last = body - (n - 1) * stride;               /* last chunk incl. tag */
+    if (last < GCM_CHUNKED_TAG_SIZE || (last == GCM_CHUNKED_TAG_SIZE && n > 1)) return -1;
+    if (n > GCM_CHUNKED_MAX_CHUNKS) return -1;
+    *nchunks = n;
+    *pt_len = (n - 1) * c->chunk_size + (last - GCM_CHUNKED_TAG_SIZE);
+    return 0;
+}
+
+/* ===================== Whole buffer ===================== */
+
+int gcm_chunked_encrypt_al(const qm_alloc_t *al, const uint8_t *pt, size_t pt_len,
+                           const uint8_t *key, size_t key_len,
+                           const uint8_t prefix[GCM_CHUNKED_PREFIX_SIZE], unsigned chunk_log2,
+                           uint8_t **out, size_t *out_len)
+{
+    if (!pt && pt_len) return -1;
+    uint64_t total = gcm_chunked_sealed_size(pt_len, chunk_log2);
+    if ((total - GCM_CHUNKED_HEADER_SIZE - pt_len) / GCM_CHUNKED_TAG_SIZE > GCM_CHUNKED_MAX_CHUNKS) return -1;
+    gcm_chunked_t *c = ctx_new();
+    if (!c || gcm_chunked_init(c, key, key_len, chunk_log2, prefix) != 0) { ctx_free(c); return -1; }
+
+    *out = (uint8_t*)qm_alloc(al, (size_t)total, 0);
+    if (!*out) { ctx_free(c); return -1; }
+    *out_len = (size_t)total;
+    memcpy(*out, c->header, GCM_CHUNKED_HEADER_SIZE);
+
+    uint8_t *dst = *out + GCM_CHUNKED_HEADER_SIZE;
+    size_t off = 0;
+    uint64_t i = 0;
+    do {
+        size_t n = pt_len - off < c->chunk_size ? pt_len - off : c->chunk_size;
+        int final = off + n == pt_len;
+        gcm_chunked_seal_chunk(c, i++, final, pt + off, n, dst);
+        dst += n + GCM_CHUNKED_TAG_SIZE;
+        off += n;
+    } while (off < pt_len);
+
+    ctx_free(c);
+    return 0;
+}
+
+int gcm_chunked_encrypt(const uint8_t *pt, size_t pt_len,
+                        const uint8_t *key, size_t key_len,
+                        const uint8_t prefix[GCM_CHUNKED_PREFIX_SIZE], unsigned chunk_log2,
+                        uint8_t **out, size_t *out_len)
+{
+    return gcm_chunked_encrypt_al(NULL, pt, pt_len, key, key_len, prefix, chunk_log2, out, out_len);
+}
+
+int gcm_chunked_decrypt_al(const qm_alloc_t *al, const uint8_t *in, size_t in_len,
+                           const uint8_t *key, size_t key_len,
+                           uint8_t **pt, size_t *pt_len)
+{
+    gcm_chunked_t *c;
+    uint64_t n, len;
+    if (!in || in_len < GCM_CHUNKED_HEADER_SIZE || !(c = ctx_new())) return -1;
+    if (gcm_chunked_init_header(c, key, key_len, in) != 0 ||
+        gcm_chunked_layout(c, in_len, &n, &len) != 0) { ctx_free(c); return -1; }
+
+    *pt = (uint8_t*)qm_alloc(al, (size_t)len, QM_ALLOC_SECRET);
+    if (!*pt) { ctx_free(c); return -1; }
+    *pt_len = (size_t)len;
+
+    const uint8_t *src = in + GCM_CHUNKED_HEADER_SIZE;
+    size_t stride = c->chunk_size + GCM_CHUNKED_TAG_SIZE;
+    for (uint64_t i = 0; i < n; ++i) {
+        int final = i == n - 1;
+        size_t clen = final ? (size_t)(len - i * c->chunk_size) : c->chunk_size;
+        if (gcm_chunked_open_chunk(c, i, final, src + i * stride, clen + GCM_CHUNKED_TAG_SIZE,
+                                   *pt + i * c->chunk_size) != 0) {
+            secure_zero(*pt, (size_t)len);
+            qm_release(al, *pt, (size_t)len, QM_ALLOC_SECRET); *pt = NULL; *pt_len = 0;
+            ctx_free(c);
+            return -1;
+        }
+    }
+    ctx_free(c);
+    return 0;
+}
+
+int gcm_chunked_decrypt(const uint8_t *in, size_t in_len,
+                        const uint8_t *key, size_t key_len,
+                        uint8_t **pt, size_t *pt_len)
+{
+    return gcm_chunked_decrypt_al(NULL, in, in_len, key, key_len, pt, pt_len);
+}
+
+int gcm_chunked_decrypt_range(const uint8_t *in, size_t in_len,
+                              const uint8_t *key, size_t key_len,
+                              uint64_t off, size_t len, uint8_t *out)
+{
+    gcm_chunked_t *c;
+    uint64_t n, total;
+    if (!in || in_len < GCM_CHUNKED_HEADER_SIZE || !(c = ctx_new())) return -1;
+    int rc = -1;
+    uint8_t *tmp = NULL;
+    if (gcm_chunked_init_header(c, key, key_len, in) != 0 ||
+        gcm_chunked_layout(c, in_len, &n, &total) != 0 || off > total || len > total - off) goto done;
+    rc = 0;
+    if (len == 0) goto done;
+
+    tmp = (uint8_t*)malloc(c->chunk_size);
+    if (!tmp) { rc = -1; goto done; }
+
+    const uint8_t *src = in + GCM_CHUNKED_HEADER_SIZE;
+    size_t stride = c->chunk_size + GCM_CHUNKED_TAG_SIZE;
+    uint64_t end = off + len;
+    for (uint64_t i = off / c->chunk_size; i <= (end - 1) / c->chunk_size; ++i) {
+        uint64_t cstart = i * c->chunk_size;
+        int final = i == n - 1;
+        size_t clen = final ? (size_t)(total - cstart) : c->chunk_size;
+        uint64_t a = off > cstart ? off : cstart;
+        uint64_t b = end < cstart + clen ? end : cstart + clen;
+        /* Chunks wholly inside the range decrypt straight into out */
+        int whole = a == cstart && b == cstart + clen;
+        uint8_t *dst = whole ? out + (cstart - off) : tmp;
+        if (gcm_chunked_open_chunk(c, i, final, src + i * stride, clen + GCM_CHUNKED_TAG_SIZE, dst) != 0) {
+            secure_zero(out, len);
+            rc = -1;
+            break;
+        }
+        if (!whole) memcpy(out + (a - off), tmp + (a - cstart), (size_t)(b - a));
+    }
+
+done:
+    if (tmp) { secure_zero(tmp, c->chunk_size); free(tmp); }
+    ctx_free(c);
+    return rc;
+}
+
+/* ===================== Streams ===================== */
+
+int gcm_chunked_encrypt_stream(FILE *in, FILE *out,
+                               const uint8_t *key, size_t key_len,
+                               const uint8_t prefix[GCM_CHUNKED_PREFIX_SIZE], unsigned chunk_log2)
+{
+    gcm_chunked_t *c;
+    if (!in || !out || !(c = ctx_new())) return -1;
+    if (gcm_chunked_init(c, key, key_len, chunk_log2, prefix) != 0) { ctx_free(c); return -1; }
+    uint8_t *buf = (uint8_t*)malloc(c->chunk_size + GCM_CHUNKED_TAG_SIZE);
+    int rc = -1;
+    if (!buf || fwrite(c->header, 1, GCM_CHUNKED_HEADER_SIZE, out) != GCM_CHUNKED_HEADER_SIZE) goto done;
+
+    for (uint64_t i = 0;; ++i) {
+        int final;
+        size_t n = read_chunk(in, buf, c->chunk_size, &final);
+        if (ferror(in)) goto done;
+        if (gcm_chunked_seal_chunk(c, i, final, buf, n, buf) != 0) goto done;
+        if (fwrite(buf, 1, n + GCM_CHUNKED_TAG_SIZE, out) != n + GCM_CHUNKED_TAG_SIZE) goto done;
+        if (final) break;
+    }
+    rc = fflush(out) == 0 ? 0 : -1;
+
+done:
+    if (buf) { secure_zero(buf, c->chunk_size + GCM_CHUNKED_TAG_SIZE); free(buf); }
+    ctx_free(c);
+    return rc;
+}
+
+int gcm_chunked_decrypt_stream(FILE *in, FILE *out,
+                               const uint8_t *key, size_t key_len,
+                               uint64_t off, uint64_t len)
+{
+    gcm_chunked_t *c;
+    uint8_t header[GCM_CHUNKED_HEADER_SIZE];
+    if (!in || !out || fread(header, 1, sizeof(header), in) != sizeof(header) || !(c = ctx_new())) return -1;
+    if (gcm_chunked_init_header(c, key, key_len, header) != 0) { ctx_free(c); return -1; }
+
+    size_t stride = c->chunk_size + GCM_CHUNKED_TAG_SIZE;
+    uint8_t *buf = (uint8_t*)malloc(stride);
+    int rc = -1;
+    if (!buf) goto done;
+
+    uint64_t end = len > UINT64_MAX - off ? UINT64_MAX : off + len;
+    uint64_t i = off / c->chunk_size;
+    if (len == 0) { rc = 0; goto done; }
+
+    /* Skip the chunks before the range: seek if we can, read over them if not */
+    if (i && fseeko(in, (off_t)(i * stride), SEEK_CUR) != 0) {
+        for (uint64_t s = 0; s < i; ++s)
+            if (fread(buf, 1, stride, in) != stride) goto done;
+    }
+
+    for (;; ++i) {
+        int final;
+        size_t got = read_chunk(in, buf, stride, &final);
+        if (ferror(in) || got < GCM_CHUNKED_TAG_SIZE) goto done;
+        if (final && got == GCM_CHUNKED_TAG_SIZE && i > 0) goto done;  /* only chunk 0 may be empty */
+        size_t clen = got - GCM_CHUNKED_TAG_SIZE;
+        if (gcm_chunked_open_chunk(c, i, final, buf, got, buf) != 0) goto done;
+
+        uint64_t cstart = i * c->chunk_size;
+        uint64_t a = off > cstart ? off : cstart;
+        uint64_t b = end < cstart + clen ? end : cstart + clen;
+        if (b > a && fwrite(buf + (a - cstart), 1, (size_t)(b - a), out) != (size_t)(b - a)) goto done;
+        if (b >= end) { rc = 0; break; }
+        if (final) { rc = len == UINT64_MAX ? 0 : -1; break; }   /* range past the end */
+    }
+    if (rc == 0 && fflush(out) != 0) rc = -1;
+
+done:
+    if (buf) { secure_zero(buf, stride); free(buf); }
+    ctx_free(c);
+    return rc;
+}
@@ -0,0 +1,121 @@
+#ifndef AES_GCM_CHUNKED_H
+#define AES_GCM_CHUNKED_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include "aes.h"
+
+/*
+ * Chunked, seekable AES-GCM container for attachments ("QMC1").
+ *
+ *   header  (16 bytes, authenticated as AAD of every chunk)
+ *     0  magic "QMC1"
+ *     4  version (1)
+ *     5  algorithm (1 = AES-GCM)
+ *     6  log2(chunk size), 10..24 (16 = 64 KiB)
+ *     7  reserved (0)
+ *     8  nonce prefix (7 bytes, fresh per container)
+ *    15  reserved (0)
+ *   chunk i = GCM(ct_i) || tag_i, every chunk full-size except the last
+ *
+ * Chunk nonce = prefix(7) || be32(i) || final, where final is 1 only on the
+ * last chunk (the STREAM construction): reordering fails on the index,
+ * truncation fails because the new last chunk was sealed with final = 0.
+ * An empty plaintext is one empty final chunk.
+ *
+ * Chunks are independent, so a reader can decrypt any range or run chunks in
+ * parallel with the *_chunk functions; the stream functions keep one chunk
+ * in memory. Output produced before a stream function fails must be
+ * discarded (the missing-final-chunk check can only happen at the end).
+ */
+
+#define GCM_CHUNKED_MAGIC        "QMC1"
+#define GCM_CHUNKED_VERSION      1
+#define GCM_CHUNKED_ALG_AES_GCM  1
+#define GCM_CHUNKED_HEADER_SIZE  16
+#define GCM_CHUNKED_PREFIX_SIZE  7
+#define GCM_CHUNKED_TAG_SIZE     16
+#define GCM_CHUNKED_DEFAULT_LOG2 16
+#define GCM_CHUNKED_MIN_LOG2     10
+#define GCM_CHUNKED_MAX_LOG2     24
+#define GCM_CHUNKED_MAX_CHUNKS   ((uint64_t)1 << 32)   /* 32-bit index in the nonce */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    aes_key_t key;
+    uint8_t   header[GCM_CHUNKED_HEADER_SIZE];
+    size_t    chunk_size;
+} gcm_chunked_t;
+
+/* Writer: builds the header from chunk_log2 and a fresh nonce prefix. */
+int gcm_chunked_init(gcm_chunked_t *c, const uint8_t *key, size_t key_len,
+                     unsigned chunk_log2, const uint8_t prefix[GCM_CHUNKED_PREFIX_SIZE]);
+
+/* Reader: validates a received header. Returns -1 on a bad key or header. */
+int gcm_chunked_init_header(gcm_chunked_t *c, const uint8_t *key, size_t key_len,
+                            const uint8_t header[GCM_CHUNKED_HEADER_SIZE]);
+
+/* Seal chunk `index`: out gets len + 16 bytes (ct || tag). len <= chunk_size,
+   and only the final chunk may be short. */
+int gcm_chunked_seal_chunk(const gcm_chunked_t *c, uint64_t index, int final,
+                           const uint8_t *pt, size_t len, uint8_t *out);
+
+/* Open chunk `index` (in_len = ct + tag). pt gets in_len - 16 bytes.
+   Returns -1 on authentication failure. */
+int gcm_chunked_open_chunk(const gcm_chunked_t *c, uint64_t index, int final,
+                           const uint8_t *in, size_t in_len, uint8_t *pt);
+
+/* Total container size for pt_len bytes. */
+uint64_t gcm_chunked_sealed_size(uint64_t pt_len, unsigned chunk_log2);
+
+/* Chunk count and plaintext length implied by a container of sealed_len
+   bytes (header included). Returns -1 if no valid container has that size. */
+int gcm_chunked_layout(const gcm_chunked_t *c, uint64_t sealed_len,
+                       uint64_t *nchunks, uint64_t *pt_len);
+
+/* Whole-buffer helpers (malloc'd output, like aes_gcm_encrypt). */
+int gcm_chunked_encrypt(const uint8_t *pt, size_t pt_len,
+                        const uint8_t *key, size_t key_len,
+                        const uint8_t prefix[GCM_CHUNKED_PREFIX_SIZE], unsigned chunk_log2,
+                        uint8_t **out, size_t *out_len);
+
+int gcm_chunked_decrypt(const uint8_t *in, size_t in_len,
+                        const uint8_t *key, size_t key_len,
+                        uint8_t **pt, size_t *pt_len);
+
+/* Same, with outputs from al (NULL = malloc); see qm_alloc.h. */
+int gcm_chunked_encrypt_al(const qm_alloc_t *al, const uint8_t *pt, size_t pt_len,
+                           const uint8_t *key, size_t key_len,
+                           const uint8_t prefix[GCM_CHUNKED_PREFIX_SIZE], unsigned chunk_log2,
+                           uint8_t **out, size_t *out_len);
+
+int gcm_chunked_decrypt_al(const qm_alloc_t *al, const uint8_t *in, size_t in_len,
+                           const uint8_t *key, size_t key_len,
+                           uint8_t **pt, size_t *pt_len);
+
+/* Decrypt plaintext bytes [off, off+len) into out, touching only the chunks
+   that cover the range. The range must lie within the plaintext. */
+int gcm_chunked_decrypt_range(const uint8_t *in, size_t in_len,
+                              const uint8_t *key, size_t key_len,
+                              uint64_t off, size_t len, uint8_t *out);
+
+/* Constant-memory stream versions. The decrypt stream writes plaintext
+   bytes [off, off+len) (len = UINT64_MAX for "to the end"); it seeks past
+   earlier chunks when `in` is seekable and reads over them otherwise. */
+int gcm_chunked_encrypt_stream(FILE *in, FILE *out,
+                               const uint8_t *key, size_t key_len,
+                               const uint8_t prefix[GCM_CHUNKED_PREFIX_SIZE], unsigned chunk_log2);
+
+int gcm_chunked_decrypt_stream(FILE *in, FILE *out,
+                               const uint8_t *key, size_t key_len,
+                               uint64_t off, uint64_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* AES_GCM_CHUNKED_H */
@@ -0,0 +1,75 @@
+#include "aes.h"
+#include "aes_backend.h"
+
+#ifdef AES_HAVE_AESNI
+#include <wmmintrin.h>
+#include <emmintrin.h>
+
+/*
+ * AES-NI engine. It runs the round keys from aes_key_t unchanged, so output
+ * is identical to the portable code for every key size, including the
+ * historic AES-128 schedule. Eight blocks are kept in flight to cover the
+ * aesenc latency. Compiled with target attributes; only called after
+ * aes_ni_available() said yes.
+ */
+
+#define AESNI_TARGET __attribute__((target("aes,sse2")))
+
+int aes_ni_available(void) {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("aes");
+}
+
+AESNI_TARGET
+void aes_ni_encrypt_blocks(const aes_key_t *k, uint8_t *out, const uint8_t *in, size_t nblocks) {
+    const int nr = k->rounds;
+    __m128i rk[AES256_ROUNDS + 1];
+    for (int r = 0; r <= nr; ++r) rk[r] = _mm_loadu_si128((const __m128i*)(k->rk + 16*r));
+
+    while (nblocks >= 8) {
+        __m128i b[8];
+        for (int i = 0; i < 8; ++i) b[i] = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(in + 16*i)), rk[0]);
+        for (int r = 1; r < nr; ++r)
+            for (int i = 0; i < 8; ++i) b[i] = _mm_aesenc_si128(b[i], rk[r]);
+        for (int i = 0; i < 8; ++i) _mm_storeu_si128((__m128i*)(out + 16*i), _mm_aesenclast_si128(b[i], rk[nr]));
+        in += 128; out += 128; nblocks -= 8;
+    }
+    while (nblocks--) {
+        __m128i b = _mm_xor_si128(_mm_loadu_si128((const __m128i*)in), rk[0]);
+        for (int r = 1; r < nr; ++r) b = _mm_aesenc_si128(b, rk[r]);
+        _mm_storeu_si128((__m128i*)out, _mm_aesenclast_si128(b, rk[nr]));
+        in += 16; out += 16;
+    }
+}
+
+/* Equivalent inverse cipher: reversed schedule with InvMixColumns applied to
+   the inner round keys. Derived per call; it is 13 aesimc at most. */
+AESNI_TARGET
+void aes_ni_decrypt_blocks(const aes_key_t *k, uint8_t *out, const uint8_t *in, size_t nblocks) {
+    const int nr = k->rounds;
+    __m128i dk[AES256_ROUNDS + 1];
+    dk[0]  = _mm_loadu_si128((const __m128i*)(k->rk + 16*nr));
+    dk[nr] = _mm_loadu_si128((const __m128i*)(k->rk));
+    for (int r = 1; r < nr; ++r)
+        dk[r] = _mm_aesimc_si128(_mm_loadu_si128((const __m128i*)(k->rk + 16*(nr - r))));
+
+    while (nblocks >= 8) {
+        __m128i b[8];
+        for (int i = 0; i < 8; ++i) b[i] = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(in + 16*i)), dk[0]);
+        for (int r = 1; r < nr; ++r)
+            for (int i = 0; i < 8; ++i) b[i] = _mm_aesdec_si128(b[i], dk[r]);
+        for (int i = 0; i < 8; ++i) _mm_storeu_si128((__m128i*)(out + 16*i), _mm_aesdeclast_si128(b[i], dk[nr]));
+        in += 128; out += 128; nblocks -= 8;
+    }
+    while (nblocks--) {
+        __m128i b = _mm_xor_si128(_mm_loadu_si128((const __m128i*)in), dk[0]);
+        for (int r = 1; r < nr; ++r) b = _mm_aesdec_si128(b, dk[r]);
+        _mm_storeu_si128((__m128i*)out, _mm_aesdeclast_si128(b, dk[nr]));
+        in += 16; out += 16;
+    }
+}
+
+#else
+/* Keep ISO C happy: a translation unit must not be empty */
+typedef int aes_ni_unavailable_t;
+#endif /* AES_HAVE_AESNI */
@@ -1,13 +1,14 @@
 # aes_server.py - AES-GCM encryption service
 from flask import Flask, request, jsonify
-import requests, subprocess, binascii, os
+from concurrent.futures import ThreadPoolExecutor
+import requests, subprocess, os, base64
+import qm_envelope, qm_compress, qm_service
+from qm_service import stage, KM, MAX_PLAINTEXT, b2h, h2b, get_new_key_and_id, get_key_hex_by_id, get_key_hexes_by_ids
 
-KM = os.getenv("KM_URL", "http://127.0.0.1:2020")
 AES_BIN = os.getenv("AES_GCM_BIN", os.path.abspath("./aes_gcm_demo"))  # .exe on Windows
 
 app = Flask(__name__)
-
-def b2h(b): return binascii.hexlify(b).decode()
+qm_service.init_app(app)
 
 def get_iv_hex():
     # IV doesn't need an id; 12B recommended
@@ -22,99 +23,53 @@ def get_iv_hex():
         pass
     return b2h(r.content)
 
-def get_new_key_and_id(bytes_needed=16):
-    """
-    Fetch a fresh key and its key_id from KM.
-    Supported KM responses:
-      - RAW body (key bytes) + header X-Key-Id
-      - JSON: {"key_hex":"..","key_id":".."}  OR {"key":"<base64>","key_id":".."}
-    """
-    r = requests.get(f"{KM}/otp/keys", params={"size": bytes_needed}, timeout=5)
-    r.raise_for_status()
-
-    # Prefer header
-    key_id = r.headers.get("X-Key-Id")
-
-    # Try JSON
-    key_hex = None
-    if "application/json" in r.headers.get("Content-Type", ""):
-        j = r.json()
-        key_id = j.get("key_id") or key_id
-        key_hex = j.get("key_hex")
-        if not key_hex and "key" in j:  # base64?
-            key_hex = b2h(binascii.a2b_base64(j["key"]))
-    # Fallback raw
-    if not key_hex:
-        key_hex = b2h(r.content)
-
-    if not key_id:
-        # If KM didn't send a header, synthesize one (temporary)
-        key_id = "K-unknown-" + os.urandom(4).hex()
-
-    return key_hex, key_id
+def gcm_open(key_hex, iv_hex, ct_hex, tag_hex, aad_hex=""):
+    """Plaintext bytes, or None if the tag does not verify."""
+    # Use --dec-stdin mode to avoid "Argument list too long" error for large attachments
+    args = [AES_BIN, key_hex, iv_hex, "--dec-stdin", tag_hex]
+    if aad_hex: args += ["--aad", aad_hex]
 
-def get_key_hex_by_id(key_id):
-    """
-    Resolve key bytes by key_id from KM. Tries common patterns:
-      - GET /otp/keys/<key_id>
-      - GET /otp/keys?id=<key_id>
-      - GET /otp/key?id=<key_id>
-    Accepts raw or JSON {key_hex}/base64.
-    """
-    paths = [
-        f"{KM}/otp/keys/{key_id}",
-        f"{KM}/otp/keys?id={key_id}",
-        f"{KM}/otp/key?id={key_id}",
-    ]
-    for url in paths:
-        try:
-            r = requests.get(url, timeout=5)
-            if r.status_code == 404:
-                continue
-            r.raise_for_status()
-            if "application/json" in r.headers.get("Content-Type", ""):
-                j = r.json()
-                if "key_hex" in j: return j["key_hex"]
-                if "key" in j:     return b2h(binascii.a2b_base64(j["key"]))
-            return b2h(r.content)
-        except Exception:
-            continue
-    raise RuntimeError("Key not found in KM for key_id=" + key_id)
+    # Pass ciphertext hex via stdin instead of command-line argument
+    proc = subprocess.run(args, input=ct_hex.encode('utf-8'), capture_output=True)
+    return proc.stdout if proc.returncode == 0 else None
 
 @app.post("/api/gcm/encrypt")
 def encrypt_gcm():
     pt = request.get_data()
     aad_hex = request.headers.get("X-AAD-HEX", "")
 
-    key_hex, key_id = get_new_key_and_id(16)
-    iv_hex = get_iv_hex()
+    with stage("km"):
+        key_hex, key_id = get_new_key_and_id(16)
+        iv_hex = get_iv_hex()
 
     args = [AES_BIN, key_hex, iv_hex]
     if aad_hex: args += ["--aad", aad_hex]
     try:
-        proc = subprocess.run(args, input=pt, capture_output=True, check=True)
+        with stage("crypto"):
+            proc = subprocess.run(args, input=pt, capture_output=True, check=True)
     except subprocess.CalledProcessError as e:
         return jsonify({"error": "crypto_failed", "detail": e.stderr.decode()}), 500
 
-    lines = proc.stdout.decode().strip().splitlines()
-    def after(label):
-        for i, s in enumerate(lines):
-            if s.strip().startswith(label): return lines[i+1].strip()
-        return ""
+    with stage("encode"):
+        lines = proc.stdout.decode().strip().splitlines()
+        def after(label):
+            for i, s in enumerate(lines):
+                if s.strip().startswith(label): return lines[i+1].strip()
+            return ""
 
-    ct_hex  = after("CIPHERTEXT_HEX:")
-    tag_hex = after("TAG_HEX:")
-    if not ct_hex or not tag_hex:
-        return jsonify({"error": "parse_failed", "stdout": lines}), 500
+        ct_hex  = after("CIPHERTEXT_HEX:")
+        tag_hex = after("TAG_HEX:")
+        if not ct_hex or not tag_hex:
+            return jsonify({"error": "parse_failed", "stdout": lines}), 500
 
-    # IMPORTANT: return key_id so client can store/use it for decryption
-    return jsonify({
-        "key_id": key_id,
-        "iv_hex": iv_hex,
-        "ciphertext_hex": ct_hex,
-        "tag_hex": tag_hex,
-        "aad_hex": aad_hex
-    })
+        # IMPORTANT: return key_id so client can store/use it for decryption
+        return jsonify({
+            "key_id": key_id,
+            "iv_hex": iv_hex,
+            "ciphertext_hex": ct_hex,
+            "tag_hex": tag_hex,
+            "aad_hex": aad_hex
+        })
 
 @app.post("/api/gcm/decrypt")
 def decrypt_gcm():
@@ -127,22 +82,260 @@ def decrypt_gcm():
 
     # Fetch the SAME key via key_id
     try:
-        key_hex = get_key_hex_by_id(key_id)
+        with stage("km"):
+            key_hex = get_key_hex_by_id(key_id)
     except Exception as e:
         return jsonify({"error": "key_lookup_failed", "detail": str(e)}), 404
 
-    # Use --dec-stdin mode to avoid "Argument list too long" error for large attachments
-    args = [AES_BIN, key_hex, iv_hex, "--dec-stdin", tag_hex]
-    if aad_hex: args += ["--aad", aad_hex]
+    with stage("crypto"):
+        pt = gcm_open(key_hex, iv_hex, ct_hex, tag_hex, aad_hex)
+    if pt is None:
+        return jsonify({"error": "auth_failed"}), 400
 
-    # Pass ciphertext hex via stdin instead of command-line argument
-    proc = subprocess.run(args, input=ct_hex.encode('utf-8'), capture_output=True)
+    # plaintext bytes out
+    return pt, 200, {"Content-Type": "application/octet-stream"}
+
+# Batch decrypts fan out over this pool; each item is its own aes_gcm_demo process
+DECRYPT_POOL = ThreadPoolExecutor(max_workers=int(os.getenv("DECRYPT_WORKERS", os.cpu_count() or 4)))
+MAX_BATCH = 500
+
+@app.post("/api/gcm/decrypt-batch")
+def decrypt_gcm_batch():
+    """
+    Decrypt a page of envelopes with one KM lookup for all their key ids.
+    Body {"items": [{"key_id", "iv_hex", "ciphertext_hex", "tag_hex", "aad_hex"?}, ...]}
+    -> {"results": [{"plaintext_b64": ...} | {"error": ...}, ...]} in request order.
+    """
+    body = request.get_json(silent=True) or {}
+    items = body.get("items")
+    if not isinstance(items, list) or len(items) > MAX_BATCH:
+        return jsonify({"error": f"items must be a list of at most {MAX_BATCH}"}), 400
+    fields = ("key_id", "iv_hex", "ciphertext_hex", "tag_hex")
+    if not all(isinstance(it, dict) and all(f in it for f in fields) for it in items):
+        return jsonify({"error": "Missing required fields"}), 400
+
+    try:
+        with stage("km"):
+            keys = get_key_hexes_by_ids(it["key_id"] for it in items)
+    except Exception as e:
+        return jsonify({"error": "key_lookup_failed", "detail": str(e)}), 502
+
+    def one(it):
+        key_hex = keys.get(it["key_id"])
+        if not key_hex:
+            return {"error": "key_not_found"}
+        pt = gcm_open(key_hex, it["iv_hex"], it["ciphertext_hex"], it["tag_hex"], it.get("aad_hex") or "")
+        if pt is None:
+            return {"error": "auth_failed"}
+        return {"plaintext_b64": base64.b64encode(pt).decode('ascii')}
+
+    with stage("crypto"):
+        results = list(DECRYPT_POOL.map(one, items))
+    return jsonify({"results": results}), 200
+
+def chunked_plaintext_len(container):
+    """Plaintext length a QMC1 container of this size holds (gcm_chunked_layout), None if none does."""
+    if len(container) < 32 or container[:4] != b"QMC1" or not 10 <= container[6] <= 24:
+        return None
+    chunk = 1 << container[6]
+    body, stride = len(container) - 16, chunk + 16
+    n = -(-body // stride)
+    last = body - (n - 1) * stride                 # last chunk incl. tag
+    if last < 16 or (last == 16 and n > 1):
+        return None
+    return (n - 1) * chunk + last - 16
+
+@app.post("/api/gcm/encrypt-chunked")
+def encrypt_gcm_chunked():
+    """
+    Attachment path: returns the binary QMC1 container (64 KiB chunks, each
+    sealed separately) instead of hex inside JSON; the key id is in X-Key-Id.
+    """
+    pt = request.get_data()
+
+    with stage("km"):
+        key_hex, key_id = get_new_key_and_id(16)
+        iv_hex = get_iv_hex()          # first 7 bytes become the container's nonce prefix
+
+    with stage("crypto"):
+        proc = subprocess.run([AES_BIN, key_hex, iv_hex, "--seal-chunked"], input=pt, capture_output=True)
+    if proc.returncode != 0:
+        return jsonify({"error": "crypto_failed", "detail": proc.stderr.decode()}), 500
+
+    return proc.stdout, 200, {"Content-Type": "application/octet-stream", "X-Key-Id": key_id}
+
+@app.post("/api/gcm/decrypt-chunked")
+def decrypt_gcm_chunked():
+    """
+    Body is a QMC1 container; key id from ?key_id= or X-Key-Id. An optional
+    "Range: bytes=START-[END]" over the plaintext only decrypts the chunks
+    that cover it. An END past the end of the plaintext is clamped to it and
+    a START past it is 416, as from the relay.
+    """
+    key_id = request.args.get("key_id") or request.headers.get("X-Key-Id")
+    if not key_id:
+        return jsonify({"error": "missing_key_id"}), 400
+
+    ranged = False
+    rng = request.headers.get("Range", "")
+    if rng.startswith("bytes="):
+        try:
+            start_s, _, end_s = rng[6:].partition("-")
+            start = int(start_s)
+            length = int(end_s) - start + 1 if end_s else None
+        except ValueError:
+            return jsonify({"error": "bad_range"}), 416
+        if length is not None and length <= 0:
+            return jsonify({"error": "bad_range"}), 416
+        ranged = True
+
+    container = request.get_data()
+    args_range = []
+    if ranged:
+        pt_len = chunked_plaintext_len(container)
+        if pt_len is None:
+            return jsonify({"error": "auth_failed"}), 400
+        if start >= pt_len:
+            return jsonify({"error": "bad_range"}), 416
+        # The opener fails a range past the last chunk, so stop at the end
+        length = pt_len - start if length is None else min(length, pt_len - start)
+        args_range = ["--range", str(start), str(length)]
+
+    try:
+        with stage("km"):
+            key_hex = get_key_hex_by_id(key_id)
+    except Exception as e:
+        return jsonify({"error": "key_lookup_failed", "detail": str(e)}), 404
+
+    # The IV argument is unused when opening: the nonce prefix is in the header
+    args = [AES_BIN, key_hex, "00" * 12, "--open-chunked"] + args_range
+    with stage("crypto"):
+        proc = subprocess.run(args, input=container, capture_output=True)
     if proc.returncode != 0:
         return jsonify({"error": "auth_failed"}), 400
 
-    # plaintext bytes out
+    if ranged:
+        end = start + len(proc.stdout) - 1
+        return proc.stdout, 206, {"Content-Type": "application/octet-stream",
+                                  "Content-Range": f"bytes {start}-{end}/{pt_len}"}
     return proc.stdout, 200, {"Content-Type": "application/octet-stream"}
 
+@app.post("/api/gcm/encrypt-env")
+def encrypt_gcm_env():
+    """
+    Binary layer: the body is the plaintext (an inner layer's envelope with
+    ?inner=1) and the response is one QE envelope carrying key id, IV, AAD,
+    ciphertext and tag, so nesting layers adds constant overhead.
+    """
+    pt = request.get_data()
+    aad_hex = request.headers.get("X-AAD-HEX", "")
+
+    with stage("km"):
+        key_hex, key_id = get_new_key_and_id(16)
+        iv_hex = get_iv_hex()
+
+    args = [AES_BIN, key_hex, iv_hex, "--seal-env", key_id]
+    if request.args.get("inner") == "1": args.append("--inner")
+    if aad_hex: args += ["--aad", aad_hex]
+    with stage("crypto"):
+        proc = subprocess.run(args, input=pt, capture_output=True)
+    if proc.returncode != 0:
+        return jsonify({"error": "crypto_failed", "detail": proc.stderr.decode()}), 500
+
+    return proc.stdout, 200, {"Content-Type": qm_envelope.CONTENT_TYPE, "X-Key-Id": key_id}
+
+@app.post("/api/gcm/decrypt-env")
+def decrypt_gcm_env():
+    """
+    Body is an AES-GCM QE envelope; the key id, IV and AAD come from it. An
+    inner envelope is returned with the envelope content type so the client
+    knows to hand it to the next layer.
+    """
+    env = request.get_data()
+    try:
+        hdr = qm_envelope.parse(env)
+    except ValueError as e:
+        return jsonify({"error": "bad_envelope", "detail": str(e)}), 400
+    if hdr["alg"] != qm_envelope.ALG_AES_GCM or not hdr["key_id"]:
+        return jsonify({"error": "bad_envelope", "detail": "not an AES-GCM layer with a key id"}), 400
+
+    try:
+        with stage("km"):
+            key_hex = get_key_hex_by_id(hdr["key_id"])
+    except Exception as e:
+        return jsonify({"error": "key_lookup_failed", "detail": str(e)}), 404
+
+    # The IV argument is unused when opening: the IV is in the envelope
+    with stage("crypto"):
+        proc = subprocess.run([AES_BIN, key_hex, "00" * 12, "--open-env"], input=env, capture_output=True)
+    if proc.returncode != 0:
+        return jsonify({"error": "auth_failed"}), 400
+
+    pt = proc.stdout
+    if hdr["comp"]:
+        try:
+            with stage("compress"):
+                pt = qm_compress.decompress(hdr["comp"], pt, MAX_PLAINTEXT)
+        except ValueError as e:
+            return jsonify({"error": "decryption_failed", "detail": str(e)}), 400
+
+    inner = hdr["flags"] & qm_envelope.FLAG_INNER
+    return pt, 200, {"Content-Type": qm_envelope.CONTENT_TYPE if inner else "application/octet-stream"}
+
+@app.post("/api/layers/seal")
+def seal_layers():
+    """
+    PQC + AES-GCM + OTP in one native pass instead of a round trip per layer.
+    The body is the plaintext; the response is the nested QE envelope that
+    /api/otp/decrypt-env and then /api/gcm/decrypt-env open as before.
+    The PQC layer is optional: the client does the Kyber encapsulation and
+    sends the derived key, its IV and the KEM ciphertext as
+    X-PQC-Key / X-PQC-IV / X-KEM-CT (hex), plus X-PQC-Key-Id.
+    X-Compression: auto|deflate|zstd compresses the plaintext first, which
+    shrinks the pad; the innermost layer records it.
+    """
+    pt = request.get_data()
+    try:
+        comp = qm_compress.from_name(request.headers.get("X-Compression", "none"))
+    except ValueError:
+        return jsonify({"error": "unsupported_compression"}), 400
+    aad_hex = request.headers.get("X-AAD-HEX", "")
+    pqc = [request.headers.get(h, "") for h in ("X-PQC-Key", "X-PQC-IV", "X-KEM-CT")]
+    pqc_key_id = request.headers.get("X-PQC-Key-Id", "")
+    if any(pqc) and not all(pqc):
+        return jsonify({"error": "bad_request", "detail": "X-PQC-Key, X-PQC-IV and X-KEM-CT go together"}), 400
+    if comp:
+        with stage("compress"):
+            comp, pt = qm_compress.compress(comp, pt)
+
+    with stage("km"):
+        key_hex, key_id = get_new_key_and_id(16)
+        iv_hex = get_iv_hex()
+
+    inner_len = len(pt)
+    if all(pqc):
+        inner_len = qm_envelope.size(len(pt), key_id=pqc_key_id, iv_len=len(pqc[1]) // 2,
+                                     kem_ct_len=len(pqc[2]) // 2, tag_len=16, comp=comp)
+    pad_len = qm_envelope.size(inner_len, key_id=key_id, iv_len=len(iv_hex) // 2, aad_len=len(aad_hex) // 2,
+                               tag_len=16, flags=qm_envelope.FLAG_INNER if all(pqc) else 0,
+                               comp=0 if all(pqc) else comp)
+    with stage("km"):
+        pad_hex, otp_key_id = get_new_key_and_id(pad_len)
+
+    args = [AES_BIN, key_hex, iv_hex, "--multiseal", key_id, otp_key_id, str(pad_len)]
+    if aad_hex: args += ["--aad", aad_hex]
+    if all(pqc):
+        args += ["--pqc", *pqc]
+        if pqc_key_id: args += ["--pqc-key-id", pqc_key_id]
+    if comp: args += ["--comp", str(comp)]
+    with stage("crypto"):
+        proc = subprocess.run(args, input=h2b(pad_hex) + pt, capture_output=True)
+    if proc.returncode != 0:
+        return jsonify({"error": "crypto_failed", "detail": proc.stderr.decode()}), 500
+
+    return proc.stdout, 200, {"Content-Type": qm_envelope.CONTENT_TYPE,
+                              "X-Key-Id": otp_key_id, "X-GCM-Key-Id": key_id}
+
 @app.get("/health")
 def health_check():
     """Health check endpoint for Docker/Kubernetes"""
@@ -0,0 +1,295 @@
+/*
+ * bench_crypto.c - micro-benchmarks for the native crypto hot paths.
+ *
+ * Covers single-block AES, key expansion, CBC enc/dec, GCM enc/dec, GHASH and
+ * the Level 1 OTP XOR engine, for message sizes 64 B .. 64 MB, on every AES
+ * backend that is usable on this machine (portable, bitsliced, aesni), then
+ * hex and base64url encode/decode on every codec path (scalar, ssse3, avx2).
+ * Reports p50/p99 latency per call, GB/s and cycles/byte (TSC on x86).
+ *
+ *   gcc -O2 -o bench_crypto bench_crypto.c aes.c aes_ct64.c aes_ni.c aes_gcm.c qm_codec.c qm_secmem.c -I. ../level1/otp_xor.c
+ *   ./bench_crypto [--json] [--backend NAME] [--op NAME] [--max-size BYTES] [--min-time SEC]
+ */
+#include "aes.h"
+#include "aes_gcm.h"
+#include "qm_codec.h"
+#include "../level1/otp.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_HAVE_TSC 1
+#endif
+
+#define MAX_SAMPLES 100000
+#define MIN_SAMPLES 3
+
+/* ===================== Timing ===================== */
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static uint64_t cycles(void) {
+#ifdef BENCH_HAVE_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+/* ===================== Operations ===================== */
+
+typedef struct {
+    uint8_t   *in, *out;
+    size_t     len;
+    aes_key_t  ks;
+    uint8_t    key[32];
+    uint8_t    iv[16];
+    uint8_t    tag[16];
+    uint8_t   *ct;       /* prepared ciphertext for the decrypt ops */
+    size_t     ct_len;
+    char      *text;     /* encoded form of in for the codec ops */
+    size_t     text_len;
+    volatile uint8_t sink;
+} bench_ctx_t;
+
+typedef void (*bench_fn)(bench_ctx_t *c);
+
+static void op_aes_block(bench_ctx_t *c) {
+    aes_encrypt_block(&c->ks, c->out, c->in);
+}
+static void op_key_expansion(bench_ctx_t *c) {
+    aes_key_init(&c->ks, c->key, c->len);
+}
+static void op_cbc_enc(bench_ctx_t *c) {
+    uint8_t *ct = NULL; size_t ct_len = 0;
+    aes_cbc_encrypt(c->in, c->len, c->key, 16, c->iv, &ct, &ct_len);
+    c->sink ^= ct[0]; free(ct);
+}
+static void op_cbc_dec(bench_ctx_t *c) {
+    uint8_t *pt = NULL; size_t pt_len = 0;
+    aes_cbc_decrypt(c->ct, c->ct_len, c->key, 16, c->iv, &pt, &pt_len);
+    c->sink ^= pt ? pt[0] : 0; free(pt);
+}
+static void op_gcm_enc(bench_ctx_t *c) {
+    uint8_t *ct = NULL; size_t ct_len = 0;
+    aes_gcm_encrypt(c->in, c->len, NULL, 0, c->key, 16, c->iv, 12, &ct, &ct_len, c->tag);
+    c->sink ^= c->tag[0]; free(ct);
+}
+static void op_gcm_dec(bench_ctx_t *c) {
+    uint8_t *pt = NULL; size_t pt_len = 0;
+    aes_gcm_decrypt(c->ct, c->ct_len, NULL, 0, c->key, 16, c->iv, 12, c->tag, &pt, &pt_len);
+    c->sink ^= pt_len ? pt[0] : 0; free(pt);
+}
+static void op_ghash(bench_ctx_t *c) {
+    uint8_t S[16];
+    aes_gcm_ghash(c->key, NULL, 0, c->in, c->len, S);
+    c->sink ^= S[0];
+}
+static void op_otp_xor(bench_ctx_t *c) {
+    otp_xor(c->out, c->in, c->out, c->len);
+}
+
+static void op_hex_enc(bench_ctx_t *c) {
+    qm_hex_encode(c->in, c->len, c->text);
+}
+static void op_hex_dec(bench_ctx_t *c) {
+    qm_hex_decode(c->text, 2 * c->len, c->out);
+}
+static void op_b64_enc(bench_ctx_t *c) {
+    c->text_len = qm_base64_encode(c->in, c->len, c->text, QM_B64_URL);
+}
+static void op_b64_dec(bench_ctx_t *c) {
+    size_t n = 0;
+    qm_base64_decode(c->text, c->text_len, c->out, &n, QM_B64_URL);
+}
+
+typedef enum { PREP_NONE, PREP_CBC, PREP_GCM, PREP_HEX, PREP_B64 } prep_t;
+
+typedef struct {
+    const char *name;
+    bench_fn    fn;
+    int         uses_backend;  /* 0: result is the same on every backend */
+    int         sized;         /* 0: fixed size (block / key length) */
+    int         per_key_size;  /* 1: one row per AES key length */
+    prep_t      prep;
+} bench_op_t;
+
+static const bench_op_t OPS[] = {
+    { "aes_block",     op_aes_block,     1, 0, 0, PREP_NONE },
+    { "key_expansion", op_key_expansion, 0, 0, 1, PREP_NONE },
+    { "cbc_enc",       op_cbc_enc,       1, 1, 0, PREP_NONE },
+    { "cbc_dec",       op_cbc_dec,       1, 1, 0, PREP_CBC  },
+    { "gcm_enc",       op_gcm_enc,       1, 1, 0, PREP_NONE },
+    { "gcm_dec",       op_gcm_dec,       1, 1, 0, PREP_GCM  },
+    { "ghash",         op_ghash,         0, 1, 0, PREP_NONE },
+    { "otp_xor",       op_otp_xor,       0, 1, 0, PREP_NONE },
+};
+
+/* Run once per codec path; size is the binary length. */
+static const bench_op_t CODEC_OPS[] = {
+    { "hex_enc",       op_hex_enc,       1, 1, 0, PREP_NONE },
+    { "hex_dec",       op_hex_dec,       1, 1, 0, PREP_HEX  },
+    { "b64url_enc",    op_b64_enc,       1, 1, 0, PREP_NONE },
+    { "b64url_dec",    op_b64_dec,       1, 1, 0, PREP_B64  },
+};
+
+/* ===================== Runner ===================== */
+
+typedef struct {
+    int    json;
+    double min_time_ns;
+    size_t max_size;
+    const char *only_backend;
+    const char *only_op;
+} bench_opts_t;
+
+static int first_record = 1;
+
+static void report(const bench_opts_t *o, const char *backend, const char *op, size_t size,
+                   double *lat, int n, double total_ns, uint64_t total_cyc) {
+    qsort(lat, (size_t)n, sizeof(double), cmp_double);
+    double p50 = lat[n / 2];
+    double p99 = lat[(n * 99) / 100 < n ? (n * 99) / 100 : n - 1];
+    double bytes = (double)size * n;
+    double gbps = bytes / total_ns;                 /* bytes/ns == GB/s */
+    double cpb = total_cyc ? (double)total_cyc / bytes : -1.0;
+
+    if (o->json) {
+        printf("%s\n  {\"backend\": \"%s\", \"op\": \"%s\", \"size\": %zu, \"samples\": %d, "
+               "\"p50_ns\": %.1f, \"p99_ns\": %.1f, \"gb_per_s\": %.4f, ",
+               first_record ? "[" : ",", backend, op, size, n, p50, p99, gbps);
+        if (cpb >= 0) printf("\"cycles_per_byte\": %.2f}", cpb);
+        else          printf("\"cycles_per_byte\": null}");
+    } else {
+        if (first_record)
+            printf("%-10s %-14s %10s %8s %12s %12s %9s %9s\n",
+                   "backend", "op", "size", "samples", "p50_ns", "p99_ns", "GB/s", "cyc/B");
+        printf("%-10s %-14s %10zu %8d %12.1f %12.1f %9.4f ", backend, op, size, n, p50, p99, gbps);
+        if (cpb >= 0) printf("%9.2f\n", cpb); else printf("%9s\n", "-");
+    }
+    first_record = 0;
+}
+
+static void prepare(bench_ctx_t *c, prep_t prep) {
+    free(c->ct); c->ct = NULL; c->ct_len = 0;
+    if (prep == PREP_CBC)
+        aes_cbc_encrypt(c->in, c->len, c->key, 16, c->iv, &c->ct, &c->ct_len);
+    else if (prep == PREP_GCM)
+        aes_gcm_encrypt(c->in, c->len, NULL, 0, c->key, 16, c->iv, 12, &c->ct, &c->ct_len, c->tag);
+    else if (prep == PREP_HEX)
+        qm_hex_encode(c->in, c->len, c->text);
+    else if (prep == PREP_B64)
+        c->text_len = qm_base64_encode(c->in, c->len, c->text, QM_B64_URL);
+}
+
+static void run_one(const bench_opts_t *o, bench_ctx_t *c, const bench_op_t *op,
+                    const char *backend, size_t size, double *lat) {
+    c->len = size;
+    prepare(c, op->prep);
+    op->fn(c);  /* warm-up */
+
+    int n = 0;
+    double start = now_ns(), total = 0;
+    uint64_t cyc = 0;
+    while (n < MAX_SAMPLES && (n < MIN_SAMPLES || total < o->min_time_ns)) {
+        uint64_t c0 = cycles();
+        double t0 = now_ns();
+        op->fn(c);
+        double t1 = now_ns();
+        cyc += cycles() - c0;
+        lat[n++] = t1 - t0;
+        total = t1 - start;
+    }
+    double sum = 0;
+    for (int i = 0; i < n; ++i) sum += lat[i];
+    report(o, backend, op->name, size, lat, n, sum, cyc);
+}
+
+static void run_backend(const bench_opts_t *o, bench_ctx_t *c, aes_backend_t b, int first, double *lat) {
+    const char *bname = aes_backend_name(b);
+    for (size_t i = 0; i < sizeof(OPS) / sizeof(OPS[0]); ++i) {
+        const bench_op_t *op = &OPS[i];
+        if (o->only_op && strcmp(o->only_op, op->name) != 0) continue;
+        if (!op->uses_backend && !first) continue;
+        const char *label = op->uses_backend ? bname : "-";
+
+        if (op->per_key_size) {
+            for (size_t kl = 16; kl <= 32; kl += 8) run_one(o, c, op, label, kl, lat);
+            aes_key_init(&c->ks, c->key, 16);
+        } else if (!op->sized) {
+            run_one(o, c, op, label, AES_BLOCK_SIZE, lat);
+        } else {
+            for (size_t sz = 64; sz <= o->max_size; sz *= 4) run_one(o, c, op, label, sz, lat);
+        }
+    }
+}
+
+static void run_codec(const bench_opts_t *o, bench_ctx_t *c, qm_codec_impl_t impl, double *lat) {
+    for (size_t i = 0; i < sizeof(CODEC_OPS) / sizeof(CODEC_OPS[0]); ++i) {
+        const bench_op_t *op = &CODEC_OPS[i];
+        if (o->only_op && strcmp(o->only_op, op->name) != 0) continue;
+        for (size_t sz = 64; sz <= o->max_size; sz *= 4) run_one(o, c, op, qm_codec_impl_name(impl), sz, lat);
+    }
+}
+
+int main(int argc, char **argv) {
+    bench_opts_t o = { 0, 0.2e9, (size_t)64 << 20, NULL, NULL };
+    for (int i = 1; i < argc; ++i) {
+        if      (strcmp(argv[i], "--json") == 0) o.json = 1;
+        else if (strcmp(argv[i], "--backend") == 0 && i+1 < argc) o.only_backend = argv[++i];
+        else if (strcmp(argv[i], "--op") == 0 && i+1 < argc) o.only_op = argv[++i];
+        else if (strcmp(argv[i], "--max-size") == 0 && i+1 < argc) o.max_size = (size_t)strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--min-time") == 0 && i+1 < argc) o.min_time_ns = atof(argv[++i]) * 1e9;
+        else {
+            fprintf(stderr, "Usage: %s [--json] [--backend portable|bitsliced|aesni|scalar|ssse3|avx2] [--op NAME]"
+                            " [--max-size BYTES] [--min-time SEC]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (o.max_size < 64) o.max_size = 64;
+
+    bench_ctx_t c;
+    memset(&c, 0, sizeof(c));
+    c.in  = (uint8_t*)malloc(o.max_size);
+    c.out = (uint8_t*)malloc(o.max_size);
+    c.text = (char*)malloc(2 * o.max_size);
+    double *lat = (double*)malloc(sizeof(double) * MAX_SAMPLES);
+    if (!c.in || !c.out || !c.text || !lat) { fprintf(stderr, "Out of memory\n"); return 1; }
+    for (size_t i = 0; i < o.max_size; ++i) { c.in[i] = (uint8_t)(i * 131u); c.out[i] = (uint8_t)(i * 7u); }
+    for (int i = 0; i < 32; ++i) c.key[i] = (uint8_t)i;
+    for (int i = 0; i < 16; ++i) c.iv[i] = (uint8_t)(0xA0 + i);
+    aes_key_init(&c.ks, c.key, 16);
+
+    static const aes_backend_t all[] = { AES_BACKEND_PORTABLE, AES_BACKEND_BITSLICED, AES_BACKEND_AESNI };
+    int first = 1;
+    for (size_t i = 0; i < sizeof(all) / sizeof(all[0]); ++i) {
+        if (o.only_backend && strcmp(o.only_backend, aes_backend_name(all[i])) != 0) continue;
+        if (aes_set_backend(all[i]) != 0) continue;  /* not compiled / no CPU support */
+        aes_key_init(&c.ks, c.key, 16);              /* per-backend schedule */
+        run_backend(&o, &c, all[i], first, lat);
+        first = 0;
+    }
+
+    static const qm_codec_impl_t codecs[] = { QM_CODEC_SCALAR, QM_CODEC_SSSE3, QM_CODEC_AVX2 };
+    for (size_t i = 0; i < sizeof(codecs) / sizeof(codecs[0]); ++i) {
+        if (o.only_backend && strcmp(o.only_backend, qm_codec_impl_name(codecs[i])) != 0) continue;
+        if (qm_codec_set_impl(codecs[i]) != 0) continue;
+        run_codec(&o, &c, codecs[i], lat);
+    }
+    if (o.json) printf(first_record ? "[]\n" : "\n]\n");
+
+    free(c.in); free(c.out); free(c.ct); free(c.text); free(lat);
+    return 0;
+}
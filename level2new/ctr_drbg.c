@@ -0,0 +1,167 @@
+#include "ctr_drbg.h"
+#include <string.h>
+#include <stdio.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <bcrypt.h>
+#define DRBG_THREAD_LOCAL __declspec(thread)
+#else
+#define DRBG_THREAD_LOCAL _Thread_local
+#endif
+
+/* ---------- Helpers: V += 1 (128-bit big-endian), wipe ---------- */
+static void ctr_inc128(uint8_t v[16]) {
+    for (int i = 15; i >= 0; --i) {
+        if (++v[i] != 0) break;
+    }
+}
+
+static void secure_zero(void *p, size_t n) {
+    volatile uint8_t *q = (volatile uint8_t*)p;
+    while (n--) *q++ = 0;
+}
+
+/* Fill nblocks counter blocks (V+1, V+2, ...) into out and encrypt them in
+   place. Writing counters straight into the destination keeps generate()
+   free of intermediate buffers for all full blocks. */
+static void ctr_drbg_blocks(ctr_drbg_t *d, uint8_t *out, size_t nblocks) {
+    for (size_t b = 0; b < nblocks; ++b) {
+        ctr_inc128(d->V);
+        memcpy(out + 16*b, d->V, 16);
+    }
+    aes_encrypt_blocks(&d->key, out, out, nblocks);
+}
+
+/* CTR_DRBG_Update(provided_data): 3 blocks -> new Key || V */
+static void ctr_drbg_update(ctr_drbg_t *d, const uint8_t provided[CTR_DRBG_SEED_LEN]) {
+    uint8_t tmp[CTR_DRBG_SEED_LEN];
+    ctr_drbg_blocks(d, tmp, CTR_DRBG_SEED_LEN / 16);
+    if (provided) xor_bytes(tmp, tmp, provided, CTR_DRBG_SEED_LEN);
+    aes_key_init(&d->key, tmp, 32);
+    memcpy(d->V, tmp + 32, 16);
+    secure_zero(tmp, sizeof(tmp));
+}
+
+/* Zero-pad short personalization/additional input to seedlen */
+static int pad_input(uint8_t out[CTR_DRBG_SEED_LEN], const uint8_t *in, size_t in_len) {
+    if (in_len > CTR_DRBG_SEED_LEN || (!in && in_len)) return -1;
+    memset(out, 0, CTR_DRBG_SEED_LEN);
+    if (in_len) memcpy(out, in, in_len);
+    return 0;
+}
+
+/* ===================== Public API ===================== */
+
+int ctr_drbg_instantiate(ctr_drbg_t *d, const uint8_t entropy[CTR_DRBG_SEED_LEN],
+                         const uint8_t *pers, size_t pers_len)
+{
+    uint8_t seed[CTR_DRBG_SEED_LEN];
+    if (!d || !entropy || pad_input(seed, pers, pers_len) != 0) return -1;
+    xor_bytes(seed, seed, entropy, CTR_DRBG_SEED_LEN);
+
+    static const uint8_t zero_key[32] = {0};
+    aes_key_init(&d->key, zero_key, 32);
+    memset(d->V, 0, 16);
+    ctr_drbg_update(d, seed);
+    d->reseed_ctr = 1;
+
+    secure_zero(seed, sizeof(seed));
+    return 0;
+}
+
+int ctr_drbg_reseed(ctr_drbg_t *d, const uint8_t entropy[CTR_DRBG_SEED_LEN],
+                    const uint8_t *add, size_t add_len)
+{
+    uint8_t seed[CTR_DRBG_SEED_LEN];
+    if (!d || !entropy || pad_input(seed, add, add_len) != 0) return -1;
+    xor_bytes(seed, seed, entropy, CTR_DRBG_SEED_LEN);
+    ctr_drbg_update(d, seed);
+    d->reseed_ctr = 1;
+    secure_zero(seed, sizeof(seed));
+    return 0;
+}
+
+int ctr_drbg_generate(ctr_drbg_t *d, uint8_t *out, size_t out_len,
+                      const uint8_t *add, size_t add_len)
+{
+    if (!d || (!out && out_len)) return -1;
+    if (d->reseed_ctr >= CTR_DRBG_RESEED_INTERVAL) return -2;
+
+    uint8_t add_pad[CTR_DRBG_SEED_LEN];
+    if (pad_input(add_pad, add, add_len) != 0) return -1;
+    if (add) ctr_drbg_update(d, add_pad);
+
+    /* Full batches and remaining full blocks go straight to the caller */
+    size_t full = out_len / 16;
+    size_t off = 0;
+    while (full >= CTR_DRBG_BATCH_BLOCKS) {
+        ctr_drbg_blocks(d, out + off, CTR_DRBG_BATCH_BLOCKS);
+        off  += 16 * CTR_DRBG_BATCH_BLOCKS;
+        full -= CTR_DRBG_BATCH_BLOCKS;
+    }
+    if (full) {
+        ctr_drbg_blocks(d, out + off, full);
+        off += 16 * full;
+    }
+    if (off < out_len) {
+        uint8_t last[16];
+        ctr_drbg_blocks(d, last, 1);
+        memcpy(out + off, last, out_len - off);
+        secure_zero(last, sizeof(last));
+    }
+
+    ctr_drbg_update(d, add_pad);
+    d->reseed_ctr++;
+    return 0;
+}
+
+void ctr_drbg_zeroize(ctr_drbg_t *d) {
+    if (d) secure_zero(d, sizeof(*d));
+}
+
+size_t ctr_drbg_ctx_size(void) {
+    return sizeof(ctr_drbg_t);
+}
+
+/* ===================== Thread-local instance ===================== */
+
+static int os_entropy(uint8_t *out, size_t len) {
+#ifdef _WIN32
+    return BCryptGenRandom(NULL, out, (ULONG)len, BCRYPT_USE_SYSTEM_PREFERRED_RNG) == 0 ? 0 : -1;
+#else
+    FILE *f = fopen("/dev/urandom", "rb");
+    if (!f) return -1;
+    size_t got = fread(out, 1, len, f);
+    fclose(f);
+    return got == len ? 0 : -1;
+#endif
+}
+
+static DRBG_THREAD_LOCAL ctr_drbg_t tl_drbg;
+static DRBG_THREAD_LOCAL int tl_seeded;
+
+ctr_drbg_t *ctr_drbg_thread_local(void) {
+    if (!tl_seeded) {
+        uint8_t entropy[CTR_DRBG_SEED_LEN];
+        if (os_entropy(entropy, sizeof(entropy)) != 0) return NULL;
+        ctr_drbg_instantiate(&tl_drbg, entropy, NULL, 0);
+        secure_zero(entropy, sizeof(entropy));
+        tl_seeded = 1;
+    }
+    return &tl_drbg;
+}
+
+int ctr_drbg_random_bytes(uint8_t *out, size_t out_len) {
+    ctr_drbg_t *d = ctr_drbg_thread_local();
+    if (!d) return -1;
+    int rc = ctr_drbg_generate(d, out, out_len, NULL, 0);
+    if (rc == -2) {
+        uint8_t entropy[CTR_DRBG_SEED_LEN];
+        if (os_entropy(entropy, sizeof(entropy)) != 0) return -1;
+        ctr_drbg_reseed(d, entropy, NULL, 0);
+        secure_zero(entropy, sizeof(entropy));
+        rc = ctr_drbg_generate(d, out, out_len, NULL, 0);
+    }
+    return rc;
+}
@@ -0,0 +1,56 @@
+#ifndef CTR_DRBG_H
+#define CTR_DRBG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "aes.h"
+
+/*
+ * AES-256 CTR_DRBG (NIST SP 800-90A, no derivation function).
+ * Drop-in native replacement for crypto/crystal/aes256_ctr_drbg.py:
+ * same seed length, same update/generate sequence, same output stream.
+ *
+ * Shared library for the Python client:
+ *   gcc -O2 -shared -fPIC -o libctr_drbg.so ctr_drbg.c aes.c aes_ct64.c aes_ni.c qm_secmem.c
+ */
+
+#define CTR_DRBG_SEED_LEN        48                     /* keylen 32 + outlen 16 */
+#define CTR_DRBG_RESEED_INTERVAL ((uint64_t)1 << 48)
+#define CTR_DRBG_BATCH_BLOCKS    8                      /* counter blocks per AES batch */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    aes_key_t key;                        /* expanded AES-256 Key */
+    uint8_t  V[AES_BLOCK_SIZE];
+    uint64_t reseed_ctr;
+} ctr_drbg_t;
+
+/* Returns 0 on success, -1 on bad lengths. Personalization/additional input
+   may be shorter than CTR_DRBG_SEED_LEN (zero-padded), never longer. */
+int  ctr_drbg_instantiate(ctr_drbg_t *d, const uint8_t entropy[CTR_DRBG_SEED_LEN],
+                          const uint8_t *pers, size_t pers_len);
+int  ctr_drbg_reseed(ctr_drbg_t *d, const uint8_t entropy[CTR_DRBG_SEED_LEN],
+                     const uint8_t *add, size_t add_len);
+
+/* Writes out_len bytes straight into out. Returns 0, -1 on bad input,
+   -2 when the reseed interval is exhausted. */
+int  ctr_drbg_generate(ctr_drbg_t *d, uint8_t *out, size_t out_len,
+                       const uint8_t *add, size_t add_len);
+
+void ctr_drbg_zeroize(ctr_drbg_t *d);
+
+/* For FFI callers that allocate the context themselves (ctypes). */
+size_t ctr_drbg_ctx_size(void);
+
+/* --- Per-thread instance, lazily seeded from OS entropy --- */
+ctr_drbg_t *ctr_drbg_thread_local(void);
+int  ctr_drbg_random_bytes(uint8_t *out, size_t out_len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CTR_DRBG_H */
@@ -0,0 +1,958 @@
+/*
+ * loadgen.c - load generator for the relay pipeline (relay + KM + crypto binary).
+ *
+ * Drives /api/gcm/encrypt|decrypt (aes_server.py) and /api/otp/encrypt|decrypt
+ * (otp_server.py) with a configurable message-size distribution, attachment
+ * mix and concurrency, either closed-loop (N workers back to back) or
+ * open-loop (fixed or Poisson arrival rate; latency is measured from the
+ * scheduled send time, so a stalled server cannot hide its queueing delay).
+ *
+ * Reports throughput, latency percentiles and a histogram per endpoint, and
+ * splits the mean request time into stages: km / crypto / encode as timed by
+ * the relay (Server-Timing header), client-side request building and parsing,
+ * and "other" (network, HTTP, framework, queueing).
+ *
+ * A stand-in KM (GET /otp/keys?size=N, GET /otp/keys/<id>, /health) can run
+ * in-process so the relays do not need the real Key Manager. The relays use
+ * KM_URL=http://127.0.0.1:2020 by default, which is the stand-in's default.
+ *
+ * POSIX only:
+ *   gcc -O2 -o loadgen loadgen.c ctr_drbg.c aes.c aes_ct64.c aes_ni.c qm_secmem.c -lpthread -lm
+ *
+ *   ./loadgen --standin-km 2020 --mix gcm:3,otp:1 --concurrency 16 --duration 30
+ *   ./loadgen --rate 200 --poisson --sizes 1k:70,4k-64k:25,256k:5 --attach 0.2:256k-4m
+ *   ./loadgen --km-only 2020                 (serve only the stand-in KM)
+ */
+#define _GNU_SOURCE
+#include "ctr_drbg.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+#include <time.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#define MAX_WORKERS     1024
+#define MAX_SIZE_BINS   32
+#define MAX_HDR_BYTES   (64 * 1024)
+#define KM_RING_SLOTS   65536             /* stand-in KM keeps the newest N keys */
+#define KM_MAX_KEY      (64u << 20)
+
+/* ===================== Small helpers ===================== */
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void sleep_until(uint64_t t_ns) {
+    struct timespec ts = { (time_t)(t_ns / 1000000000ull), (long)(t_ns % 1000000000ull) };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {}
+}
+
+/* xorshift64*: per-worker, only drives sizes/mix/arrivals */
+static uint64_t rng_next(uint64_t *s) {
+    uint64_t x = *s;
+    x ^= x >> 12; x ^= x << 25; x ^= x >> 27;
+    *s = x;
+    return x * 0x2545F4914F6CDD1Dull;
+}
+static double rng_unit(uint64_t *s) { return (double)(rng_next(s) >> 11) * (1.0 / 9007199254740992.0); }
+
+typedef struct { char *p; size_t len, cap; } buf_t;
+
+static int buf_reserve(buf_t *b, size_t extra) {
+    if (b->len + extra + 1 <= b->cap) return 0;
+    size_t cap = b->cap ? b->cap : 4096;
+    while (cap < b->len + extra + 1) cap *= 2;
+    char *p = (char*)realloc(b->p, cap);
+    if (!p) return -1;
+    b->p = p; b->cap = cap;
+    return 0;
+}
+static int buf_append(buf_t *b, const void *d, size_t n) {
+    if (buf_reserve(b, n) != 0) return -1;
+    memcpy(b->p + b->len, d, n);
+    b->len += n; b->p[b->len] = '\0';
+    return 0;
+}
+static int buf_printf(buf_t *b, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(NULL, 0, fmt, ap);
+    va_end(ap);
+    if (n < 0 || buf_reserve(b, (size_t)n) != 0) return -1;
+    va_start(ap, fmt);
+    vsnprintf(b->p + b->len, (size_t)n + 1, fmt, ap);
+    va_end(ap);
+    b->len += (size_t)n;
+    return 0;
+}
+
+static int send_all(int fd, const void *d, size_t n) {
+    const char *p = (const char*)d;
+    while (n) {
+        ssize_t w = send(fd, p, n, MSG_NOSIGNAL);
+        if (w < 0) { if (errno == EINTR) continue; return -1; }
+        p += w; n -= (size_t)w;
+    }
+    return 0;
+}
+
+/* recv into b; returns bytes read, 0 on EOF, -1 on error */
+static ssize_t recv_more(int fd, buf_t *b) {
+    if (buf_reserve(b, 64 * 1024) != 0) return -1;
+    ssize_t r;
+    do { r = recv(fd, b->p + b->len, b->cap - b->len - 1, 0); } while (r < 0 && errno == EINTR);
+    if (r > 0) { b->len += (size_t)r; b->p[b->len] = '\0'; }
+    return r;
+}
+
+/* "64", "16k", "4m" -> bytes */
+static int parse_size(const char *s, char **end, size_t *out) {
+    double v = strtod(s, end);
+    if (*end == s || v < 0) return -1;
+    switch (**end) {
+        case 'k': case 'K': v *= 1024.0; (*end)++; break;
+        case 'm': case 'M': v *= 1024.0 * 1024.0; (*end)++; break;
+        case 'g': case 'G': v *= 1024.0 * 1024.0 * 1024.0; (*end)++; break;
+        default: break;
+    }
+    *out = (size_t)v;
+    return 0;
+}
+
+static int parse_hostport(const char *s, char *host, size_t host_cap, int *port) {
+    const char *c = strrchr(s, ':');
+    if (!c || (size_t)(c - s) >= host_cap) return -1;
+    memcpy(host, s, (size_t)(c - s));
+    host[c - s] = '\0';
+    *port = atoi(c + 1);
+    return *port > 0 ? 0 : -1;
+}
+
+/* ===================== Size distribution ===================== */
+
+/* "SIZE[:WEIGHT],..." where SIZE is a byte count or a uniform range "A-B" */
+typedef struct {
+    size_t lo[MAX_SIZE_BINS], hi[MAX_SIZE_BINS];
+    double cum[MAX_SIZE_BINS];
+    int    n;
+} size_dist_t;
+
+static int size_dist_parse(size_dist_t *d, const char *spec) {
+    double total = 0;
+    const char *p = spec;
+    d->n = 0;
+    while (*p) {
+        if (d->n == MAX_SIZE_BINS) return -1;
+        char *e;
+        size_t lo, hi;
+        if (parse_size(p, &e, &lo) != 0) return -1;
+        hi = lo;
+        if (*e == '-' && parse_size(e + 1, &e, &hi) != 0) return -1;
+        if (hi < lo) return -1;
+        double w = 1.0;
+        if (*e == ':') {
+            const char *ws = e + 1;
+            w = strtod(ws, &e);
+            if (e == ws || w <= 0) return -1;
+        }
+        total += w;
+        d->lo[d->n] = lo; d->hi[d->n] = hi; d->cum[d->n] = total;
+        d->n++;
+        if (*e == ',') e++;
+        else if (*e) return -1;
+        p = e;
+    }
+    if (d->n == 0) return -1;
+    for (int i = 0; i < d->n; ++i) d->cum[i] /= total;
+    return 0;
+}
+
+static size_t size_dist_sample(const size_dist_t *d, uint64_t *rng) {
+    double u = rng_unit(rng);
+    int i = 0;
+    while (i < d->n - 1 && u > d->cum[i]) i++;
+    if (d->hi[i] == d->lo[i]) return d->lo[i];
+    return d->lo[i] + (size_t)(rng_next(rng) % (d->hi[i] - d->lo[i] + 1));
+}
+
+static size_t size_dist_max(const size_dist_t *d) {
+    size_t m = 0;
+    for (int i = 0; i < d->n; ++i) if (d->hi[i] > m) m = d->hi[i];
+    return m;
+}
+
+/* ===================== Statistics ===================== */
+
+/* Log-linear latency histogram in microseconds: exact below 16 us, then 8
+   sub-buckets per power of two (<= 12.5% relative error). */
+#define HIST_SUB     8
+#define HIST_LINEAR  16
+#define HIST_BUCKETS (HIST_LINEAR + (40 - 4) * HIST_SUB)
+
+static int hist_index(uint64_t us) {
+    if (us < HIST_LINEAR) return (int)us;
+    int exp = 63 - __builtin_clzll(us);
+    if (exp >= 40) return HIST_BUCKETS - 1;
+    int sub = (int)((us >> (exp - 3)) & (HIST_SUB - 1));
+    return HIST_LINEAR + (exp - 4) * HIST_SUB + sub;
+}
+
+static uint64_t hist_lower(int idx) {
+    if (idx < HIST_LINEAR) return (uint64_t)idx;
+    int exp = (idx - HIST_LINEAR) / HIST_SUB + 4;
+    int sub = (idx - HIST_LINEAR) % HIST_SUB;
+    return ((uint64_t)(HIST_SUB + sub)) << (exp - 3);
+}
+
+enum { ST_KM, ST_CRYPTO, ST_ENCODE, ST_CLIENT, ST_COUNT };
+static const char *STAGE_NAMES[ST_COUNT] = { "km", "crypto", "encode", "client" };
+
+enum { EP_GCM_ENC, EP_GCM_DEC, EP_OTP_ENC, EP_OTP_DEC, EP_MESSAGE, EP_COUNT };
+static const char *EP_NAMES[EP_COUNT] = {
+    "gcm_encrypt", "gcm_decrypt", "otp_encrypt", "otp_decrypt", "message"
+};
+
+typedef struct {
+    uint64_t n, errors, bytes, max_us;
+    uint64_t hist[HIST_BUCKETS];
+    double   total_ms;
+    double   stage_ms[ST_COUNT];
+} ep_stats_t;
+
+static void ep_record(ep_stats_t *s, uint64_t lat_ns, size_t bytes, const double stage_ms[ST_COUNT]) {
+    uint64_t us = lat_ns / 1000;
+    s->n++;
+    s->bytes += bytes;
+    s->hist[hist_index(us)]++;
+    if (us > s->max_us) s->max_us = us;
+    s->total_ms += (double)lat_ns / 1e6;
+    if (stage_ms) for (int i = 0; i < ST_COUNT; ++i) s->stage_ms[i] += stage_ms[i];
+}
+
+static void ep_merge(ep_stats_t *dst, const ep_stats_t *src) {
+    dst->n += src->n; dst->errors += src->errors; dst->bytes += src->bytes;
+    if (src->max_us > dst->max_us) dst->max_us = src->max_us;
+    for (int i = 0; i < HIST_BUCKETS; ++i) dst->hist[i] += src->hist[i];
+    dst->total_ms += src->total_ms;
+    for (int i = 0; i < ST_COUNT; ++i) dst->stage_ms[i] += src->stage_ms[i];
+}
+
+static double ep_percentile_ms(const ep_stats_t *s, double q) {
+    if (!s->n) return 0;
+    uint64_t want = (uint64_t)ceil(q * (double)s->n), seen = 0;
+    if (want == 0) want = 1;
+    for (int i = 0; i < HIST_BUCKETS; ++i) {
+        seen += s->hist[i];
+        if (seen >= want) return (double)hist_lower(i) / 1000.0;
+    }
+    return (double)s->max_us / 1000.0;
+}
+
+/* ===================== HTTP/1.1 client ===================== */
+
+typedef struct {
+    char host[128];
+    int  port;
+    int  fd;
+} http_conn_t;
+
+typedef struct {
+    buf_t       raw;         /* headers + body as received */
+    int         status;
+    size_t      hdr_len;
+    const char *body;
+    size_t      body_len;
+} http_resp_t;
+
+static int http_connect(http_conn_t *c) {
+    struct addrinfo hints, *res = NULL;
+    char port[16];
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    snprintf(port, sizeof(port), "%d", c->port);
+    if (getaddrinfo(c->host, port, &hints, &res) != 0) return -1;
+    int fd = -1;
+    for (struct addrinfo *a = res; a; a = a->ai_next) {
+        fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (fd < 0) continue;
+        if (connect(fd, a->ai_addr, a->ai_addrlen) == 0) break;
+        close(fd); fd = -1;
+    }
+    freeaddrinfo(res);
+    if (fd < 0) return -1;
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    c->fd = fd;
+    return 0;
+}
+
+static void http_close(http_conn_t *c) {
+    if (c->fd >= 0) close(c->fd);
+    c->fd = -1;
+}
+
+/* Case-insensitive header lookup within the received header block */
+static const char *http_header(const http_resp_t *r, const char *name, size_t *vlen) {
+    size_t nl = strlen(name);
+    const char *p = r->raw.p, *end = r->raw.p + r->hdr_len;
+    while (p < end) {
+        const char *eol = memchr(p, '\n', (size_t)(end - p));
+        if (!eol) break;
+        if ((size_t)(eol - p) > nl && strncasecmp(p, name, nl) == 0 && p[nl] == ':') {
+            const char *v = p + nl + 1;
+            while (v < eol && (*v == ' ' || *v == '\t')) v++;
+            const char *ve = eol;
+            while (ve > v && (ve[-1] == '\r' || ve[-1] == ' ')) ve--;
+            *vlen = (size_t)(ve - v);
+            return v;
+        }
+        p = eol + 1;
+    }
+    return NULL;
+}
+
+static int http_read_response(http_conn_t *c, http_resp_t *r) {
+    r->raw.len = 0;
+    for (;;) {
+        char *e = r->raw.len ? memmem(r->raw.p, r->raw.len, "\r\n\r\n", 4) : NULL;
+        if (e) { r->hdr_len = (size_t)(e - r->raw.p) + 4; break; }
+        if (r->raw.len > MAX_HDR_BYTES || recv_more(c->fd, &r->raw) <= 0) return -1;
+    }
+    int minor = 1;
+    if (sscanf(r->raw.p, "HTTP/1.%d %d", &minor, &r->status) != 2) return -1;
+
+    size_t vlen;
+    const char *v = http_header(r, "Connection", &vlen);
+    int keep = minor >= 1;
+    if (v && vlen >= 5 && strncasecmp(v, "close", 5) == 0) keep = 0;
+    if (v && vlen >= 10 && strncasecmp(v, "keep-alive", 10) == 0) keep = 1;
+    if (http_header(r, "Transfer-Encoding", &vlen)) return -1;  /* relays never chunk */
+
+    v = http_header(r, "Content-Length", &vlen);
+    if (v) {
+        size_t want = r->hdr_len + (size_t)strtoull(v, NULL, 10);
+        while (r->raw.len < want)
+            if (recv_more(c->fd, &r->raw) <= 0) return -1;
+    } else {
+        ssize_t n;
+        while ((n = recv_more(c->fd, &r->raw)) > 0) {}
+        if (n < 0) return -1;
+        keep = 0;
+    }
+    r->body = r->raw.p + r->hdr_len;
+    r->body_len = r->raw.len - r->hdr_len;
+    if (!keep) http_close(c);
+    return 0;
+}
+
+/* One request on a kept-alive connection; a stale connection is retried once */
+static int http_request(http_conn_t *c, buf_t *hdr, const char *method, const char *path,
+                        const char *ctype, const void *body, size_t body_len, http_resp_t *r) {
+    hdr->len = 0;
+    buf_printf(hdr, "%s %s HTTP/1.1\r\nHost: %s:%d\r\nContent-Type: %s\r\n"
+                    "Content-Length: %zu\r\nConnection: keep-alive\r\n\r\n",
+               method, path, c->host, c->port, ctype, body_len);
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        int reused = c->fd >= 0;
+        if (!reused && http_connect(c) != 0) return -1;
+        if (send_all(c->fd, hdr->p, hdr->len) == 0 &&
+            send_all(c->fd, body, body_len) == 0 &&
+            http_read_response(c, r) == 0)
+            return 0;
+        http_close(c);
+        if (!reused) return -1;
+    }
+    return -1;
+}
+
+/* Adds the relay's Server-Timing stages (ms) into stage_ms */
+static void add_server_timing(const http_resp_t *r, double stage_ms[ST_COUNT]) {
+    size_t vlen;
+    const char *v = http_header(r, "Server-Timing", &vlen);
+    if (!v) return;
+    const char *end = v + vlen;
+    while (v < end) {
+        const char *comma = memchr(v, ',', (size_t)(end - v));
+        if (!comma) comma = end;
+        while (v < comma && *v == ' ') v++;
+        const char *semi = memchr(v, ';', (size_t)(comma - v));
+        const char *dur = semi ? memmem(semi, (size_t)(comma - semi), "dur=", 4) : NULL;
+        if (dur) {
+            for (int i = 0; i < ST_CLIENT; ++i) {
+                size_t nl = strlen(STAGE_NAMES[i]);
+                if ((size_t)(semi - v) == nl && memcmp(v, STAGE_NAMES[i], nl) == 0)
+                    stage_ms[i] += strtod(dur + 4, NULL);
+            }
+        }
+        v = comma + 1;
+    }
+}
+
+/* Finds "key": "value" in a flat JSON object (values used here never contain escapes) */
+static int json_field(const char *j, size_t n, const char *key, const char **val, size_t *vlen) {
+    char pat[64];
+    int pl = snprintf(pat, sizeof(pat), "\"%s\"", key);
+    const char *end = j + n, *p = memmem(j, n, pat, (size_t)pl);
+    if (!p) return -1;
+    p += pl;
+    while (p < end && (*p == ' ' || *p == ':' || *p == '\n' || *p == '\r' || *p == '\t')) p++;
+    if (p >= end || *p != '"') return -1;
+    p++;
+    const char *q = memchr(p, '"', (size_t)(end - p));
+    if (!q) return -1;
+    *val = p; *vlen = (size_t)(q - p);
+    return 0;
+}
+
+/* ===================== Configuration ===================== */
+
+typedef struct {
+    http_conn_t gcm, otp;          /* targets (fd unused here, copied per worker) */
+    double      w_gcm, w_otp;
+    int         concurrency;
+    double      duration_s;
+    double      rate;              /* messages/s, 0 = closed loop */
+    int         poisson;
+    size_dist_t sizes;
+    double      attach_prob;
+    size_dist_t attach_sizes;
+    int         roundtrip;
+    int         json;
+    int         km_port;           /* stand-in KM, 0 = none */
+    int         km_only;
+    uint64_t    km_delay_us;
+} lg_config_t;
+
+static lg_config_t cfg;
+
+/* ===================== Stand-in KM ===================== */
+
+typedef struct { uint64_t id; uint8_t *key; size_t len; } km_slot_t;
+
+static km_slot_t      *km_ring;
+static pthread_mutex_t km_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t        km_next_id = 1;
+static uint64_t        km_requests, km_service_ns, km_misses;
+
+static int km_reply(int fd, int status, const char *ctype, const char *extra_hdr,
+                    const void *body, size_t len) {
+    char hdr[256];
+    int n = snprintf(hdr, sizeof(hdr),
+                     "HTTP/1.1 %d %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\n%s\r\n",
+                     status, status == 200 ? "OK" : status == 404 ? "Not Found" : "Bad Request",
+                     ctype, len, extra_hdr ? extra_hdr : "");
+    if (send_all(fd, hdr, (size_t)n) != 0) return -1;
+    return send_all(fd, body, len);
+}
+
+static int km_mint(int fd, size_t size) {
+    if (size == 0 || size > KM_MAX_KEY) {
+        static const char err[] = "{\"error\":\"bad size\"}";
+        return km_reply(fd, 400, "application/json", NULL, err, sizeof(err) - 1);
+    }
+    uint8_t *key = (uint8_t*)malloc(size);
+    if (!key || ctr_drbg_random_bytes(key, size) != 0) { free(key); return -1; }
+
+    pthread_mutex_lock(&km_lock);
+    uint64_t id = km_next_id++;
+    km_slot_t *s = &km_ring[id % KM_RING_SLOTS];
+    free(s->key);
+    s->id = id; s->key = key; s->len = size;
+    pthread_mutex_unlock(&km_lock);
+
+    char hdr[64];
+    snprintf(hdr, sizeof(hdr), "X-Key-Id: K-%llu\r\n", (unsigned long long)id);
+    return km_reply(fd, 200, "application/octet-stream", hdr, key, size);
+}
+
+static int km_lookup(int fd, const char *id_str) {
+    uint64_t id = 0;
+    if (strncmp(id_str, "K-", 2) == 0) id = strtoull(id_str + 2, NULL, 10);
+    uint8_t *copy = NULL;
+    size_t len = 0;
+
+    pthread_mutex_lock(&km_lock);
+    km_slot_t *s = &km_ring[id % KM_RING_SLOTS];
+    if (id && s->id == id && (copy = (uint8_t*)malloc(s->len)) != NULL) {
+        memcpy(copy, s->key, s->len);
+        len = s->len;
+    }
+    pthread_mutex_unlock(&km_lock);
+
+    if (!copy) {
+        static const char err[] = "{\"error\":\"unknown key_id\"}";
+        __atomic_add_fetch(&km_misses, 1, __ATOMIC_RELAXED);
+        return km_reply(fd, 404, "application/json", NULL, err, sizeof(err) - 1);
+    }
+    int rc = km_reply(fd, 200, "application/octet-stream", NULL, copy, len);
+    free(copy);
+    return rc;
+}
+
+static int km_route(int fd, char *path) {
+    char *q = strchr(path, '?');
+    if (q) *q++ = '\0';
+    const char *id = q ? strstr(q, "id=") : NULL;
+
+    if (strcmp(path, "/health") == 0) {
+        static const char ok[] = "{\"status\":\"healthy\",\"service\":\"loadgen-standin-km\"}";
+        return km_reply(fd, 200, "application/json", NULL, ok, sizeof(ok) - 1);
+    }
+    if (strncmp(path, "/otp/keys/", 10) == 0) return km_lookup(fd, path + 10);
+    if ((strcmp(path, "/otp/keys") == 0 || strcmp(path, "/otp/key") == 0) && id)
+        return km_lookup(fd, id + 3);
+    if (strcmp(path, "/otp/keys") == 0) {
+        const char *sz = q ? strstr(q, "size=") : NULL;
+        return km_mint(fd, sz ? (size_t)strtoull(sz + 5, NULL, 10) : 32);
+    }
+    static const char nf[] = "{\"error\":\"not found\"}";
+    return km_reply(fd, 404, "application/json", NULL, nf, sizeof(nf) - 1);
+}
+
+static void *km_conn_thread(void *arg) {
+    int fd = (int)(intptr_t)arg;
+    buf_t in = {0};
+    for (;;) {
+        char *e;
+        while (!(e = in.len ? memmem(in.p, in.len, "\r\n\r\n", 4) : NULL))
+            if (in.len > MAX_HDR_BYTES || recv_more(fd, &in) <= 0) goto done;
+        uint64_t t0 = now_ns();
+        size_t req_len = (size_t)(e - in.p) + 4;
+        char method[8], path[1024];
+        if (sscanf(in.p, "%7s %1023s", method, path) != 2) break;
+        if (cfg.km_delay_us) usleep((useconds_t)cfg.km_delay_us);
+        if (km_route(fd, path) != 0) break;
+        __atomic_add_fetch(&km_requests, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&km_service_ns, now_ns() - t0, __ATOMIC_RELAXED);
+        memmove(in.p, in.p + req_len, in.len - req_len);
+        in.len -= req_len;
+    }
+done:
+    free(in.p);
+    close(fd);
+    return NULL;
+}
+
+static void *km_accept_thread(void *arg) {
+    int lfd = (int)(intptr_t)arg;
+    for (;;) {
+        int fd = accept(lfd, NULL, NULL);
+        if (fd < 0) { if (errno == EINTR) continue; break; }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        pthread_t t;
+        if (pthread_create(&t, NULL, km_conn_thread, (void*)(intptr_t)fd) != 0) close(fd);
+        else pthread_detach(t);
+    }
+    return NULL;
+}
+
+static int km_start(int port) {
+    km_ring = (km_slot_t*)calloc(KM_RING_SLOTS, sizeof(km_slot_t));
+    int lfd = socket(AF_INET, SOCK_STREAM, 0);
+    if (!km_ring || lfd < 0) return -1;
+    int one = 1;
+    setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in a;
+    memset(&a, 0, sizeof(a));
+    a.sin_family = AF_INET;
+    a.sin_addr.s_addr = htonl(INADDR_ANY);
+    a.sin_port = htons((uint16_t)port);
+    if (bind(lfd, (struct sockaddr*)&a, sizeof(a)) != 0 || listen(lfd, 512) != 0) {
+        perror("stand-in KM");
+        close(lfd);
+        return -1;
+    }
+    pthread_t t;
+    if (pthread_create(&t, NULL, km_accept_thread, (void*)(intptr_t)lfd) != 0) return -1;
+    pthread_detach(t);
+    return 0;
+}
+
+/* ===================== Workers ===================== */
+
+typedef struct {
+    int         id;
+    pthread_t   thread;
+    uint64_t    rng;
+    http_conn_t gcm, otp;
+    buf_t       hdr, req;
+    http_resp_t resp;
+    uint8_t    *payload;           /* random bytes for GCM bodies */
+    char       *text;              /* ASCII text for OTP bodies */
+    size_t      payload_cap;
+    ep_stats_t  ep[EP_COUNT];
+} worker_t;
+
+static uint64_t        run_start, run_end;
+static pthread_mutex_t sched_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t        sched_next_ns;
+static uint64_t        sched_rng = 0x9E3779B97F4A7C15ull;
+
+/* Open loop: hands out the next intended send time */
+static uint64_t sched_next(void) {
+    pthread_mutex_lock(&sched_lock);
+    uint64_t t = sched_next_ns;
+    double gap = 1e9 / cfg.rate;
+    if (cfg.poisson) gap *= -log(1.0 - rng_unit(&sched_rng));
+    sched_next_ns += (uint64_t)gap;
+    pthread_mutex_unlock(&sched_lock);
+    return t;
+}
+
+/* Finishes one relay call: status check, stage accounting, stats */
+static int finish_call(worker_t *w, int ep, uint64_t t0, size_t bytes, double client_ms, double msg_stage[ST_COUNT]) {
+    uint64_t t1 = now_ns();
+    if (w->resp.status != 200) { w->ep[ep].errors++; return -1; }
+    double st[ST_COUNT] = {0};
+    add_server_timing(&w->resp, st);
+    st[ST_CLIENT] = client_ms;
+    ep_record(&w->ep[ep], t1 - t0, bytes, st);
+    for (int i = 0; i < ST_COUNT; ++i) msg_stage[i] += st[i];
+    return 0;
+}
+
+static double ms_since(uint64_t t) { return (double)(now_ns() - t) / 1e6; }
+
+static int run_gcm(worker_t *w, size_t len, double msg_stage[ST_COUNT]) {
+    uint64_t t0 = now_ns();
+    if (http_request(&w->gcm, &w->hdr, "POST", "/api/gcm/encrypt", "application/octet-stream",
+                     w->payload, len, &w->resp) != 0) { w->ep[EP_GCM_ENC].errors++; return -1; }
+    if (finish_call(w, EP_GCM_ENC, t0, len, 0, msg_stage) != 0) return -1;
+    if (!cfg.roundtrip) return 0;
+
+    /* Client side: pull fields out of the encrypt response, build the decrypt body */
+    uint64_t tc = now_ns();
+    static const char *fields[] = { "key_id", "iv_hex", "ciphertext_hex", "tag_hex", "aad_hex" };
+    w->req.len = 0;
+    buf_append(&w->req, "{", 1);
+    for (int i = 0; i < 5; ++i) {
+        const char *v; size_t vl;
+        if (json_field(w->resp.body, w->resp.body_len, fields[i], &v, &vl) != 0) {
+            if (i == 4) { v = ""; vl = 0; }
+            else { w->ep[EP_GCM_DEC].errors++; return -1; }
+        }
+        buf_printf(&w->req, "%s\"%s\":\"", i ? "," : "", fields[i]);
+        buf_append(&w->req, v, vl);
+        buf_append(&w->req, "\"", 1);
+    }
+    buf_append(&w->req, "}", 1);
+    double client_ms = ms_since(tc);
+
+    t0 = now_ns();
+    if (http_request(&w->gcm, &w->hdr, "POST", "/api/gcm/decrypt", "application/json",
+                     w->req.p, w->req.len, &w->resp) != 0) { w->ep[EP_GCM_DEC].errors++; return -1; }
+    tc = now_ns();
+    int ok = w->resp.status == 200 && w->resp.body_len == len && memcmp(w->resp.body, w->payload, len) == 0;
+    client_ms += ms_since(tc);
+    if (w->resp.status == 200 && !ok) { w->ep[EP_GCM_DEC].errors++; return -1; }
+    return finish_call(w, EP_GCM_DEC, t0, len, client_ms, msg_stage);
+}
+
+static int run_otp(worker_t *w, size_t len, double msg_stage[ST_COUNT]) {
+    uint64_t tc = now_ns();
+    w->req.len = 0;
+    buf_append(&w->req, "{\"text\":\"", 9);
+    buf_append(&w->req, w->text, len);
+    buf_append(&w->req, "\"}", 2);
+    double client_ms = ms_since(tc);
+
+    uint64_t t0 = now_ns();
+    if (http_request(&w->otp, &w->hdr, "POST", "/api/otp/encrypt", "application/json",
+                     w->req.p, w->req.len, &w->resp) != 0) { w->ep[EP_OTP_ENC].errors++; return -1; }
+    if (finish_call(w, EP_OTP_ENC, t0, len, client_ms, msg_stage) != 0) return -1;
+    if (!cfg.roundtrip) return 0;
+
+    tc = now_ns();
+    const char *kid, *ct; size_t kl, cl;
+    if (json_field(w->resp.body, w->resp.body_len, "key_id", &kid, &kl) != 0 ||
+        json_field(w->resp.body, w->resp.body_len, "ciphertext_b64url", &ct, &cl) != 0) {
+        w->ep[EP_OTP_DEC].errors++; return -1;
+    }
+    w->req.len = 0;
+    buf_append(&w->req, "{\"key_id\":\"", 11);
+    buf_append(&w->req, kid, kl);
+    buf_append(&w->req, "\",\"ciphertext_b64url\":\"", 23);
+    buf_append(&w->req, ct, cl);
+    buf_append(&w->req, "\"}", 2);
+    client_ms = ms_since(tc);
+
+    t0 = now_ns();
+    if (http_request(&w->otp, &w->hdr, "POST", "/api/otp/decrypt", "application/json",
+                     w->req.p, w->req.len, &w->resp) != 0) { w->ep[EP_OTP_DEC].errors++; return -1; }
+    tc = now_ns();
+    const char *txt; size_t tl;
+    int ok = w->resp.status == 200 &&
+             json_field(w->resp.body, w->resp.body_len, "text", &txt, &tl) == 0 &&
+             tl == len && memcmp(txt, w->text, len) == 0;
+    client_ms += ms_since(tc);
+    if (w->resp.status == 200 && !ok) { w->ep[EP_OTP_DEC].errors++; return -1; }
+    return finish_call(w, EP_OTP_DEC, t0, len, client_ms, msg_stage);
+}
+
+/* One message: body via the mixed relay, plus an optional GCM attachment */
+static void run_message(worker_t *w, uint64_t t_start) {
+    double st[ST_COUNT] = {0};
+    size_t len = size_dist_sample(&cfg.sizes, &w->rng), total = len;
+    int rc = rng_unit(&w->rng) * (cfg.w_gcm + cfg.w_otp) < cfg.w_gcm ? run_gcm(w, len, st)
+                                                                     : run_otp(w, len, st);
+    if (rc == 0 && cfg.attach_prob > 0 && rng_unit(&w->rng) < cfg.attach_prob) {
+        size_t alen = size_dist_sample(&cfg.attach_sizes, &w->rng);
+        rc = run_gcm(w, alen, st);
+        total += alen;
+    }
+    if (rc != 0) { w->ep[EP_MESSAGE].errors++; return; }
+    ep_record(&w->ep[EP_MESSAGE], now_ns() - t_start, total, st);
+}
+
+static void *worker_main(void *arg) {
+    worker_t *w = (worker_t*)arg;
+    for (;;) {
+        uint64_t t;
+        if (cfg.rate > 0) {
+            t = sched_next();
+            if (t >= run_end) break;
+            sleep_until(t);
+        } else {
+            t = now_ns();
+            if (t >= run_end) break;
+        }
+        uint64_t errs = w->ep[EP_MESSAGE].errors;
+        run_message(w, t);
+        if (w->ep[EP_MESSAGE].errors != errs && cfg.rate <= 0) usleep(10000);  /* don't spin on a dead relay */
+    }
+    http_close(&w->gcm);
+    http_close(&w->otp);
+    return NULL;
+}
+
+/* ===================== Report ===================== */
+
+static void print_histogram(const ep_stats_t *s) {
+    uint64_t rows[41] = {0}, peak = 0;
+    int lo = 41, hi = -1;
+    for (int i = 0; i < HIST_BUCKETS; ++i) {
+        if (!s->hist[i]) continue;
+        uint64_t v = hist_lower(i);
+        int r = v ? 64 - __builtin_clzll(v) : 0;   /* row r holds [2^(r-1), 2^r) us */
+        rows[r] += s->hist[i];
+        if (r < lo) lo = r;
+        if (r > hi) hi = r;
+    }
+    for (int r = lo; r <= hi; ++r) if (rows[r] > peak) peak = rows[r];
+    printf("\nlatency histogram (message, ms):\n");
+    for (int r = lo; r <= hi; ++r) {
+        double a = r ? (double)(1ull << (r - 1)) / 1000.0 : 0, b = (double)(1ull << r) / 1000.0;
+        int bar = peak ? (int)((rows[r] * 50 + peak - 1) / peak) : 0;
+        printf("  [%9.3f, %9.3f)  %-50.*s %llu\n", a, b, bar,
+               "##################################################", (unsigned long long)rows[r]);
+    }
+}
+
+static void report(const ep_stats_t *ep, double elapsed_s) {
+    static const double Q[] = { 0.50, 0.90, 0.99, 0.999 };
+    if (cfg.json) {
+        printf("{\n  \"mode\": \"%s\", \"concurrency\": %d, \"duration_s\": %.3f, \"target_rate\": %.1f,\n",
+               cfg.rate > 0 ? "open" : "closed", cfg.concurrency, elapsed_s, cfg.rate);
+        printf("  \"endpoints\": [");
+        for (int e = 0, first = 1; e < EP_COUNT; ++e) {
+            const ep_stats_t *s = &ep[e];
+            if (!s->n && !s->errors) continue;
+            printf("%s\n    {\"endpoint\": \"%s\", \"requests\": %llu, \"errors\": %llu, "
+                   "\"req_per_s\": %.2f, \"mb_per_s\": %.3f, \"p50_ms\": %.3f, \"p90_ms\": %.3f, "
+                   "\"p99_ms\": %.3f, \"p999_ms\": %.3f, \"max_ms\": %.3f, \"mean_ms\": %.3f, \"stages_ms\": {",
+                   first ? "" : ",", EP_NAMES[e], (unsigned long long)s->n, (unsigned long long)s->errors,
+                   (double)s->n / elapsed_s, (double)s->bytes / elapsed_s / 1e6,
+                   ep_percentile_ms(s, Q[0]), ep_percentile_ms(s, Q[1]), ep_percentile_ms(s, Q[2]),
+                   ep_percentile_ms(s, Q[3]), (double)s->max_us / 1000.0,
+                   s->n ? s->total_ms / (double)s->n : 0.0);
+            double staged = 0;
+            for (int i = 0; i < ST_COUNT; ++i) {
+                double m = s->n ? s->stage_ms[i] / (double)s->n : 0.0;
+                staged += m;
+                printf("\"%s\": %.3f, ", STAGE_NAMES[i], m);
+            }
+            printf("\"other\": %.3f}}", (s->n ? s->total_ms / (double)s->n : 0.0) - staged);
+            first = 0;
+        }
+        printf("\n  ]");
+        if (cfg.km_port)
+            printf(",\n  \"standin_km\": {\"requests\": %llu, \"misses\": %llu, \"mean_ms\": %.3f}",
+                   (unsigned long long)km_requests, (unsigned long long)km_misses,
+                   km_requests ? (double)km_service_ns / (double)km_requests / 1e6 : 0.0);
+        printf("\n}\n");
+        return;
+    }
+
+    printf("\n%-12s %9s %7s %9s %9s %9s %9s %9s %9s %9s\n", "endpoint", "requests", "errors",
+           "req/s", "MB/s", "p50_ms", "p90_ms", "p99_ms", "p99.9_ms", "max_ms");
+    for (int e = 0; e < EP_COUNT; ++e) {
+        const ep_stats_t *s = &ep[e];
+        if (!s->n && !s->errors) continue;
+        printf("%-12s %9llu %7llu %9.2f %9.3f %9.3f %9.3f %9.3f %9.3f %9.3f\n", EP_NAMES[e],
+               (unsigned long long)s->n, (unsigned long long)s->errors,
+               (double)s->n / elapsed_s, (double)s->bytes / elapsed_s / 1e6,
+               ep_percentile_ms(s, Q[0]), ep_percentile_ms(s, Q[1]), ep_percentile_ms(s, Q[2]),
+               ep_percentile_ms(s, Q[3]), (double)s->max_us / 1000.0);
+    }
+
+    printf("\nstage breakdown (mean ms per request; km/crypto/encode from the relay's Server-Timing):\n");
+    printf("%-12s %9s %9s %9s %9s %9s %9s\n", "endpoint", "km", "crypto", "encode", "client", "other", "total");
+    for (int e = 0; e < EP_COUNT; ++e) {
+        const ep_stats_t *s = &ep[e];
+        if (!s->n) continue;
+        double staged = 0, total = s->total_ms / (double)s->n;
+        printf("%-12s", EP_NAMES[e]);
+        for (int i = 0; i < ST_COUNT; ++i) {
+            double m = s->stage_ms[i] / (double)s->n;
+            staged += m;
+            printf(" %9.3f", m);
+        }
+        printf(" %9.3f %9.3f\n", total - staged, total);
+    }
+    if (cfg.km_port)
+        printf("\nstand-in KM: %llu requests, %llu unknown key ids, %.3f ms mean service time\n",
+               (unsigned long long)km_requests, (unsigned long long)km_misses,
+               km_requests ? (double)km_service_ns / (double)km_requests / 1e6 : 0.0);
+    if (ep[EP_MESSAGE].n) print_histogram(&ep[EP_MESSAGE]);
+}
+
+/* ===================== Main ===================== */
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  --gcm HOST:PORT         aes_server relay (default 127.0.0.1:2022)\n"
+        "  --otp HOST:PORT         otp_server relay (default 127.0.0.1:2021)\n"
+        "  --mix gcm:W,otp:W       message body routing weights (default gcm:1)\n"
+        "  --concurrency N         workers / connections per relay (default 8)\n"
+        "  --duration SEC          run time (default 10)\n"
+        "  --rate R                open loop at R messages/s (default: closed loop)\n"
+        "  --poisson               exponential inter-arrival times in open loop\n"
+        "  --sizes SPEC            body sizes, SIZE[-MAX][:WEIGHT],... (default 2k)\n"
+        "  --attach P:SPEC         attach a GCM attachment to a fraction P of messages\n"
+        "  --encrypt-only          skip the decrypt half of each round trip\n"
+        "  --standin-km PORT       run the stand-in KM in-process for this run\n"
+        "  --km-only PORT          run only the stand-in KM until killed\n"
+        "  --km-delay-us N         added latency per stand-in KM request\n"
+        "  --json                  machine-readable report\n", prog);
+}
+
+static int parse_mix(const char *s) {
+    cfg.w_gcm = cfg.w_otp = 0;
+    while (*s) {
+        double *w = strncmp(s, "gcm", 3) == 0 ? &cfg.w_gcm : strncmp(s, "otp", 3) == 0 ? &cfg.w_otp : NULL;
+        if (!w) return -1;
+        s += 3;
+        *w = 1.0;
+        if (*s == ':') { char *e; *w = strtod(s + 1, &e); s = e; }
+        if (*s == ',') s++;
+        else if (*s) return -1;
+    }
+    return cfg.w_gcm + cfg.w_otp > 0 ? 0 : -1;
+}
+
+int main(int argc, char **argv) {
+    strcpy(cfg.gcm.host, "127.0.0.1"); cfg.gcm.port = 2022; cfg.gcm.fd = -1;
+    strcpy(cfg.otp.host, "127.0.0.1"); cfg.otp.port = 2021; cfg.otp.fd = -1;
+    cfg.w_gcm = 1; cfg.concurrency = 8; cfg.duration_s = 10; cfg.roundtrip = 1;
+    size_dist_parse(&cfg.sizes, "2k");
+
+    for (int i = 1; i < argc; ++i) {
+        const char *a = argv[i], *v = i + 1 < argc ? argv[i + 1] : NULL;
+        int bad = 0;
+        if      (!strcmp(a, "--json")) cfg.json = 1;
+        else if (!strcmp(a, "--poisson")) cfg.poisson = 1;
+        else if (!strcmp(a, "--encrypt-only")) cfg.roundtrip = 0;
+        else if (!v) bad = 1;
+        else if (!strcmp(a, "--gcm")) bad = parse_hostport(v, cfg.gcm.host, sizeof(cfg.gcm.host), &cfg.gcm.port), i++;
+        else if (!strcmp(a, "--otp")) bad = parse_hostport(v, cfg.otp.host, sizeof(cfg.otp.host), &cfg.otp.port), i++;
+        else if (!strcmp(a, "--mix")) bad = parse_mix(v), i++;
+        else if (!strcmp(a, "--concurrency")) cfg.concurrency = atoi(v), i++;
+        else if (!strcmp(a, "--duration")) cfg.duration_s = atof(v), i++;
+        else if (!strcmp(a, "--rate")) cfg.rate = atof(v), i++;
+        else if (!strcmp(a, "--sizes")) bad = size_dist_parse(&cfg.sizes, v), i++;
+        else if (!strcmp(a, "--attach")) {
+            char *e;
+            cfg.attach_prob = strtod(v, &e);
+            bad = *e != ':' || cfg.attach_prob < 0 || cfg.attach_prob > 1 ||
+                  size_dist_parse(&cfg.attach_sizes, e + 1) != 0;
+            i++;
+        }
+        else if (!strcmp(a, "--standin-km")) cfg.km_port = atoi(v), i++;
+        else if (!strcmp(a, "--km-only")) cfg.km_port = atoi(v), cfg.km_only = 1, i++;
+        else if (!strcmp(a, "--km-delay-us")) cfg.km_delay_us = strtoull(v, NULL, 10), i++;
+        else bad = 1;
+        if (bad) { usage(argv[0]); return 1; }
+    }
+    if (cfg.concurrency < 1 || cfg.concurrency > MAX_WORKERS || cfg.duration_s <= 0) { usage(argv[0]); return 1; }
+    signal(SIGPIPE, SIG_IGN);
+
+    if (cfg.km_port && km_start(cfg.km_port) != 0) return 1;
+    if (cfg.km_only) {
+        fprintf(stderr, "stand-in KM listening on :%d\n", cfg.km_port);
+        for (;;) pause();
+    }
+
+    size_t max_len = size_dist_max(&cfg.sizes);
+    if (cfg.attach_prob > 0 && size_dist_max(&cfg.attach_sizes) > max_len) max_len = size_dist_max(&cfg.attach_sizes);
+
+    worker_t *workers = (worker_t*)calloc((size_t)cfg.concurrency, sizeof(worker_t));
+    if (!workers) { fprintf(stderr, "Out of memory\n"); return 1; }
+    for (int i = 0; i < cfg.concurrency; ++i) {
+        worker_t *w = &workers[i];
+        w->id = i;
+        w->rng = 0x853C49E6748FEA9Bull ^ ((uint64_t)(i + 1) * 0x9E3779B97F4A7C15ull);
+        w->gcm = cfg.gcm; w->otp = cfg.otp;
+        w->payload_cap = max_len ? max_len : 1;
+        w->payload = (uint8_t*)malloc(w->payload_cap);
+        w->text = (char*)malloc(w->payload_cap);
+        if (!w->payload || !w->text) { fprintf(stderr, "Out of memory\n"); return 1; }
+        for (size_t j = 0; j < w->payload_cap; ++j) {
+            uint64_t r = rng_next(&w->rng);
+            w->payload[j] = (uint8_t)r;
+            w->text[j] = (char)('a' + (r >> 32) % 26);
+        }
+    }
+
+    if (!cfg.json)
+        fprintf(stderr, "loadgen: %s loop, %d workers, %.1f s, mix gcm:%g otp:%g, attach %.2f%s\n",
+                cfg.rate > 0 ? "open" : "closed", cfg.concurrency, cfg.duration_s,
+                cfg.w_gcm, cfg.w_otp, cfg.attach_prob, cfg.km_port ? ", stand-in KM" : "");
+
+    run_start = now_ns();
+    run_end = run_start + (uint64_t)(cfg.duration_s * 1e9);
+    sched_next_ns = run_start;
+    for (int i = 0; i < cfg.concurrency; ++i)
+        if (pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]) != 0) {
+            fprintf(stderr, "pthread_create failed\n");
+            return 1;
+        }
+
+    ep_stats_t total[EP_COUNT];
+    memset(total, 0, sizeof(total));
+    for (int i = 0; i < cfg.concurrency; ++i) {
+        pthread_join(workers[i].thread, NULL);
+        for (int e = 0; e < EP_COUNT; ++e) ep_merge(&total[e], &workers[i].ep[e]);
+        free(workers[i].payload); free(workers[i].text);
+        free(workers[i].hdr.p); free(workers[i].req.p); free(workers[i].resp.raw.p);
+    }
+    double elapsed = (double)(now_ns() - run_start) / 1e9;
+    report(total, elapsed);
+    free(workers);
+    return 0;
+}
@@ -1,9 +1,24 @@
 #include "aes.h"
+#include "aes_cbc_mt.h"
+#include "qm_arena.h"
+#include "qm_secmem.h"
 #include <stdio.h>
 #include <string.h>
 #include <ctype.h>
 #include <stdlib.h>
 
+/* All buffers of a run come from this arena; finish() frees them and wipes
+   the plaintext regions. The raw key sits in a locked secmem slot. */
+static qm_arena_t       *arena;
+static const qm_alloc_t *al;
+static uint8_t          *key;
+
+static int finish(int rc) {
+    qm_arena_destroy(arena);
+    qm_secmem_free(key, 32);
+    return rc;
+}
+
 /* Parse hex string (even length) into bytes */
 static int hex2bin(const char *hex, uint8_t *out, size_t out_cap) {
     size_t n = strlen(hex);
@@ -24,46 +39,115 @@ static void bin2hex(const uint8_t *buf, size_t len) {
     printf("\n");
 }
 
-/* Slurp all of stdin into a malloc'd buffer (binary-safe) */
+/* Slurp all of stdin into an arena buffer (binary-safe). The buffer is the
+   arena's newest allocation, so doubling it usually extends in place. */
 static int read_all_stdin(uint8_t **out, size_t *out_len) {
     const size_t CHUNK = 4096;
     size_t cap = CHUNK, len = 0;
-    uint8_t *buf = (uint8_t*)malloc(cap);
+    uint8_t *buf = (uint8_t*)qm_alloc(al, cap, QM_ALLOC_SECRET);
     if (!buf) return -1;
 
     for (;;) {
         if (len + CHUNK > cap) {
             size_t ncap = cap * 2;
-            uint8_t *nbuf = (uint8_t*)realloc(buf, ncap);
-            if (!nbuf) { free(buf); return -1; }
+            uint8_t *nbuf = (uint8_t*)qm_resize(al, buf, cap, ncap, QM_ALLOC_SECRET);
+            if (!nbuf) return -1;
             buf = nbuf; cap = ncap;
         }
         size_t got = fread(buf + len, 1, CHUNK, stdin);
         len += got;
         if (got < CHUNK) {
             if (feof(stdin)) break;
-            free(buf); return -1;
+            return -1;
         }
     }
     *out = buf; *out_len = len;
     return 0;
 }
 
+static int hex_nibble(int c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+/* Decode the ciphertext of a saved demo run (our own output format) in place.
+   Accepts either bare hex or the full "CIPHERTEXT_HEX:\n<hex>\n..." output;
+   whitespace is skipped and decoding stops at the next label. */
+static int legacy_ct_from_text(uint8_t *buf, size_t len, size_t *ct_len) {
+    size_t i = 0, n = 0;
+    static const char label[] = "CIPHERTEXT_HEX:";
+    if (len >= sizeof(label) - 1 && memcmp(buf, label, sizeof(label) - 1) == 0)
+        i = sizeof(label) - 1;
+    int hi = -1;
+    for (; i < len; ++i) {
+        int c = buf[i];
+        if (isspace(c)) continue;
+        int v = hex_nibble(c);
+        if (v < 0) {
+            if (isalpha(c) && hi < 0) break;  /* PLAINTEXT_RECOVERED: etc. */
+            return -1;
+        }
+        if (hi < 0) { hi = v; continue; }
+        buf[n++] = (uint8_t)((hi << 4) | v);
+        hi = -1;
+    }
+    if (hi >= 0) return -1;
+    *ct_len = n;
+    return 0;
+}
+
+/* Re-decrypt an archived CBC ciphertext using the multi-threaded path */
+static int decrypt_legacy(const uint8_t *key, size_t key_len, const uint8_t iv[16], int nthreads) {
+    uint8_t *buf = NULL, *pt = NULL;
+    size_t buf_len = 0, ct_len = 0, pt_len = 0;
+    if (read_all_stdin(&buf, &buf_len) != 0) {
+        fprintf(stderr, "Failed to read ciphertext from stdin.\n");
+        return 1;
+    }
+    if (legacy_ct_from_text(buf, buf_len, &ct_len) != 0) {
+        fprintf(stderr, "Bad ciphertext hex.\n");
+        return 1;
+    }
+    if (aes_cbc_decrypt_parallel_al(al, buf, ct_len, key, key_len, iv, &pt, &pt_len, nthreads) != 0) {
+        fprintf(stderr, "Decryption failed.\n");
+        return 1;
+    }
+    fwrite(pt, 1, pt_len, stdout);
+    return 0;
+}
+
 int main(int argc, char **argv) {
-    if (argc != 3) {
-        fprintf(stderr, "Usage: %s <hex-16-byte-key> <hex-16-byte-iv>\n", argv[0]);
+    int dec_mode = 0, nthreads = 0, bad_args = 0;
+    for (int i = 3; i < argc; ++i) {
+        if (strcmp(argv[i], "--dec") == 0) dec_mode = 1;
+        else if (strcmp(argv[i], "--threads") == 0 && i+1 < argc) nthreads = atoi(argv[++i]);
+        else bad_args = 1;
+    }
+    if (argc < 3 || bad_args) {
+        fprintf(stderr, "Usage: %s <hex-key> <hex-16-byte-iv>\n", argv[0]);
+        fprintf(stderr, "       %s <hex-key> <hex-16-byte-iv> --dec [--threads N] < ciphertext\n", argv[0]);
+        fprintf(stderr, "Key is 16, 24 or 32 bytes (AES-128/192/256).\n");
         fprintf(stderr, "Example key: 000102030405060708090a0b0c0d0e0f\n");
         fprintf(stderr, "Example  iv: 0f0e0d0c0b0a09080706050403020100\n");
         return 1;
     }
 
-    uint8_t key[16], iv[16];
-    int klen = hex2bin(argv[1], key, sizeof(key));
+    uint8_t iv[16];
+    if (!(key = (uint8_t*)qm_secmem_alloc(32)) || !(arena = qm_arena_create(0, 0))) {
+        fprintf(stderr, "Out of memory.\n");
+        return finish(1);
+    }
+    int klen = hex2bin(argv[1], key, 32);
     int ivlen = hex2bin(argv[2], iv, sizeof(iv));
-    if (klen != 16 || ivlen != 16) {
-        fprintf(stderr, "Key/IV must be exactly 16 bytes (32 hex chars).\n");
-        return 1;
+    if ((klen != 16 && klen != 24 && klen != 32) || ivlen != 16) {
+        fprintf(stderr, "Key must be 16/24/32 bytes and IV exactly 16 bytes.\n");
+        return finish(1);
     }
+    al = qm_arena_allocator(arena);
+
+    if (dec_mode) return finish(decrypt_legacy(key, (size_t)klen, iv, nthreads));
 
     /* Read plaintext (email body) from stdin */
     uint8_t *pt = NULL, *ct = NULL, *dec = NULL;
@@ -71,21 +155,19 @@ int main(int argc, char **argv) {
 
     if (read_all_stdin(&pt, &pt_len) != 0) {
         fprintf(stderr, "Failed to read plaintext from stdin.\n");
-        return 1;
+        return finish(1);
     }
 
     /* Encrypt */
-    if (aes128_cbc_encrypt(pt, pt_len, key, iv, &ct, &ct_len) != 0) {
+    if (aes_cbc_encrypt_al(al, pt, pt_len, key, (size_t)klen, iv, &ct, &ct_len) != 0) {
         fprintf(stderr, "Encryption failed.\n");
-        free(pt);
-        return 1;
+        return finish(1);
     }
 
     /* Decrypt (for demo/verification) */
-    if (aes128_cbc_decrypt(ct, ct_len, key, iv, &dec, &dec_len) != 0) {
+    if (aes_cbc_decrypt_al(al, ct, ct_len, key, (size_t)klen, iv, &dec, &dec_len) != 0) {
         fprintf(stderr, "Decryption failed.\n");
-        free(pt); free(ct);
-        return 1;
+        return finish(1);
     }
 
     /* Output */
@@ -96,6 +178,5 @@ int main(int argc, char **argv) {
     fwrite(dec, 1, dec_len, stdout);
     printf("\n");
 
-    free(pt); free(ct); free(dec);
-    return 0;
+    return finish(0);
 }
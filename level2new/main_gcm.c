@@ -1,46 +1,73 @@
 #include "aes.h"
 #include "aes_gcm.h"
+#include "aes_gcm_chunked.h"
+#include "qm_envelope.h"
+#include "qm_multiseal.h"
+#include "qm_codec.h"
+#include "qm_stats.h"
+#include "qm_arena.h"
+#include "qm_secmem.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+/* Everything one run allocates comes from this arena: no frees on the
+   error paths, and finish() wipes pad, key and plaintext regions. The raw
+   keys (GCM, then PQC) sit in one locked secmem slot. */
+static qm_arena_t       *arena;
+static const qm_alloc_t *al;
+static uint8_t          *keys;
+
+static int finish(int rc) {
+    qm_arena_destroy(arena);
+    qm_secmem_free(keys, 64);
+    return rc;
+}
 
 static int hex2bin_dyn(const char *hex, uint8_t **out, size_t *out_len) {
     size_t n = strlen(hex);
     if (n % 2) return -1;
     *out_len = n / 2;
-    *out = (uint8_t*)malloc(*out_len);
+    *out = (uint8_t*)qm_alloc(al, *out_len, 0);
     if (!*out) return -1;
-    for (size_t i = 0; i < *out_len; ++i) {
-        unsigned int v;
-        if (sscanf(hex + 2*i, "%2x", &v) != 1) { free(*out); return -1; }
-        (*out)[i] = (uint8_t)v;
-    }
-    return 0;
+    return qm_hex_decode(hex, n, *out);
 }
 static int hex2bin_fixed(const char *hex, uint8_t *out, size_t need) {
     size_t n = strlen(hex);
     if (n != need*2) return -1;
-    for (size_t i = 0; i < need; ++i) {
-        unsigned int v; if (sscanf(hex + 2*i, "%2x", &v) != 1) return -1;
-        out[i] = (uint8_t)v;
-    }
-    return 0;
+    return qm_hex_decode(hex, n, out);
 }
 static void bin2hex_line(const uint8_t *buf, size_t len) {
-    for (size_t i = 0; i < len; ++i) printf("%02x", buf[i]);
+    char line[2 * 32768];
+    while (len) {
+        size_t n = len < sizeof(line) / 2 ? len : sizeof(line) / 2;
+        qm_hex_encode(buf, n, line);
+        fwrite(line, 1, 2 * n, stdout);
+        buf += n; len -= n;
+    }
     printf("\n");
 }
+/* Slurp stdin; the buffer is the arena's newest allocation, so doubling
+   it usually extends in place instead of copying. */
 static int read_all_stdin(uint8_t **out, size_t *out_len) {
     const size_t CH = 4096;
     size_t cap = CH, len = 0;
-    uint8_t *buf = (uint8_t*)malloc(cap);
+    uint8_t *buf = (uint8_t*)qm_alloc(al, cap, QM_ALLOC_SECRET);
     if (!buf) return -1;
     for (;;) {
-        if (len + CH > cap) { cap *= 2; uint8_t *nb = (uint8_t*)realloc(buf, cap); if (!nb){free(buf);return -1;} buf=nb; }
+        if (len + CH > cap) {
+            uint8_t *nb = (uint8_t*)qm_resize(al, buf, cap, cap * 2, QM_ALLOC_SECRET);
+            if (!nb) return -1;
+            buf = nb; cap *= 2;
+        }
         size_t got = fread(buf+len,1,CH,stdin);
         len += got;
-        if (got < CH) { if (feof(stdin)) break; free(buf); return -1; }
+        if (got < CH) { if (feof(stdin)) break; return -1; }
     }
     *out = buf; *out_len = len; return 0;
 }
@@ -49,84 +76,200 @@ int main(int argc, char **argv) {
     if (argc < 3) {
         fprintf(stderr,
             "Usage:\n"
-            "  Encrypt: %s <hex-16B-key> <hex-iv> [--aad HEX] < plaintext\n"
-            "  Decrypt: %s <hex-16B-key> <hex-iv> --dec <HEXCT> <HEXTAG> [--aad HEX]\n"
-            "  Decrypt (stdin): %s <hex-16B-key> <hex-iv> --dec-stdin <HEXTAG> [--aad HEX] < ciphertext_hex\n",
-            argv[0], argv[0], argv[0]);
+            "  Encrypt: %s <hex-key> <hex-iv> [--aad HEX] < plaintext\n"
+            "  Decrypt: %s <hex-key> <hex-iv> --dec <HEXCT> <HEXTAG> [--aad HEX]\n"
+            "  Decrypt (stdin): %s <hex-key> <hex-iv> --dec-stdin <HEXTAG> [--aad HEX] < ciphertext_hex\n"
+            "  Chunked seal: %s <hex-key> <hex-iv> --seal-chunked [--chunk-log2 N] < plaintext > container\n"
+            "  Chunked open: %s <hex-key> <hex-iv> --open-chunked [--range OFF LEN] < container\n"
+            "  Envelope seal: %s <hex-key> <hex-iv> --seal-env <KEY-ID> [--inner] [--aad HEX] < plaintext > envelope\n"
+            "  Envelope open: %s <hex-key> <hex-iv> --open-env < envelope\n"
+            "  Layered seal: %s <hex-key> <hex-iv> --multiseal <GCM-KEY-ID> <OTP-KEY-ID> <PAD-LEN> [--aad HEX]\n"
+            "                [--pqc <hex-key> <hex-iv> <hex-kem-ct>] [--pqc-key-id ID] [--comp ID] < pad+plaintext > envelope\n"
+            "  <hex-key> is 16, 24 or 32 bytes (AES-128/192/256)\n",
+            argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0]);
         return 1;
     }
 
-    uint8_t key[16];
-    if (hex2bin_fixed(argv[1], key, 16) != 0) { fprintf(stderr,"Bad key\n"); return 1; }
+    if (!(arena = qm_arena_create(0, 0)) || !(keys = (uint8_t*)qm_secmem_alloc(64))) {
+        fprintf(stderr,"Out of memory\n"); return finish(1);
+    }
+    al = qm_arena_allocator(arena);
+
+    uint8_t *key = keys; size_t key_len = strlen(argv[1]) / 2;
+    if ((key_len != 16 && key_len != 24 && key_len != 32) ||
+        hex2bin_fixed(argv[1], key, key_len) != 0) { fprintf(stderr,"Bad key\n"); return finish(1); }
 
     uint8_t *iv=NULL; size_t iv_len=0;
-    if (hex2bin_dyn(argv[2], &iv, &iv_len) != 0) { fprintf(stderr,"Bad IV\n"); return 1; }
+    if (hex2bin_dyn(argv[2], &iv, &iv_len) != 0) { fprintf(stderr,"Bad IV\n"); return finish(1); }
 
     /* parse optional flags */
     const char *aad_hex = NULL;
     int decrypt_mode = 0;
     int decrypt_stdin_mode = 0;
     const char *ct_hex = NULL, *tag_hex = NULL;
+    int chunked_mode = 0;  /* 1 = seal, 2 = open */
+    unsigned chunk_log2 = GCM_CHUNKED_DEFAULT_LOG2;
+    unsigned long long range_off = 0, range_len = UINT64_MAX;
+    int env_mode = 0;      /* 1 = seal, 2 = open */
+    const char *env_key_id = NULL;
+    uint8_t env_flags = 0;
+    int multiseal_mode = 0;
+    qm_multiseal_t ms;
+    memset(&ms, 0, sizeof(ms));
+    unsigned long long pad_len = 0;
+    const char *pqc_key_hex = NULL, *pqc_iv_hex = NULL, *kem_ct_hex = NULL;
 
     for (int i = 3; i < argc; ++i) {
         if (strcmp(argv[i], "--aad") == 0 && i+1 < argc) { aad_hex = argv[++i]; }
         else if (strcmp(argv[i], "--dec") == 0 && i+2 < argc) { decrypt_mode = 1; ct_hex = argv[++i]; tag_hex = argv[++i]; }
         else if (strcmp(argv[i], "--dec-stdin") == 0 && i+1 < argc) { decrypt_stdin_mode = 1; tag_hex = argv[++i]; }
+        else if (strcmp(argv[i], "--seal-chunked") == 0) { chunked_mode = 1; }
+        else if (strcmp(argv[i], "--open-chunked") == 0) { chunked_mode = 2; }
+        else if (strcmp(argv[i], "--chunk-log2") == 0 && i+1 < argc) { chunk_log2 = (unsigned)atoi(argv[++i]); }
+        else if (strcmp(argv[i], "--range") == 0 && i+2 < argc) { range_off = strtoull(argv[++i], NULL, 10); range_len = strtoull(argv[++i], NULL, 10); }
+        else if (strcmp(argv[i], "--seal-env") == 0 && i+1 < argc) { env_mode = 1; env_key_id = argv[++i]; }
+        else if (strcmp(argv[i], "--open-env") == 0) { env_mode = 2; }
+        else if (strcmp(argv[i], "--inner") == 0) { env_flags |= QM_ENV_F_INNER; }
+        else if (strcmp(argv[i], "--multiseal") == 0 && i+3 < argc) {
+            multiseal_mode = 1; ms.gcm_key_id = argv[++i]; ms.otp_key_id = argv[++i]; pad_len = strtoull(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--pqc") == 0 && i+3 < argc) { pqc_key_hex = argv[++i]; pqc_iv_hex = argv[++i]; kem_ct_hex = argv[++i]; }
+        else if (strcmp(argv[i], "--pqc-key-id") == 0 && i+1 < argc) { ms.pqc_key_id = argv[++i]; }
+        else if (strcmp(argv[i], "--comp") == 0 && i+1 < argc) { ms.comp = (uint8_t)atoi(argv[++i]); }  /* plaintext already compressed */
+    }
+
+    if (chunked_mode) {
+        /* Binary QMC1 container; the first 7 IV bytes become the nonce prefix */
+#ifdef _WIN32
+        _setmode(_fileno(stdin), _O_BINARY);
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+        if (chunked_mode == 1 && iv_len < GCM_CHUNKED_PREFIX_SIZE) { fprintf(stderr,"IV must be at least 7 bytes\n"); return finish(1); }
+        int rc = chunked_mode == 1
+            ? gcm_chunked_encrypt_stream(stdin, stdout, key, key_len, iv, chunk_log2)
+            : gcm_chunked_decrypt_stream(stdin, stdout, key, key_len, range_off, range_len);
+        if (rc != 0) {
+            fprintf(stderr, chunked_mode == 1 ? "Encrypt failed\n" : "Auth failed (bad tag, truncated container or bad range)\n");
+            return finish(chunked_mode == 1 ? 1 : 2);
+        }
+        if (getenv("QUMAIL_STATS")) qm_stats_dump_prometheus(stderr);
+        return finish(0);
     }
 
     uint8_t *aad = NULL; size_t aad_len = 0;
     if (aad_hex) {
-        if (hex2bin_dyn(aad_hex, &aad, &aad_len) != 0) { fprintf(stderr,"Bad AAD\n"); return 1; }
+        if (hex2bin_dyn(aad_hex, &aad, &aad_len) != 0) { fprintf(stderr,"Bad AAD\n"); return finish(1); }
+    }
+
+    if (multiseal_mode) {
+        /* stdin is the OTP pad (PAD-LEN bytes, 0 for no OTP layer) followed by
+           the plaintext; out comes the whole nested envelope in one pass */
+#ifdef _WIN32
+        _setmode(_fileno(stdin), _O_BINARY);
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+        uint8_t *pqc_key = keys + 32; size_t pqc_key_len = 0;
+        uint8_t *pqc_iv = NULL, *kem_ct = NULL; size_t pqc_iv_len = 0, kem_ct_len = 0;
+        if (pqc_key_hex) {
+            pqc_key_len = strlen(pqc_key_hex) / 2;
+            if ((pqc_key_len != 16 && pqc_key_len != 24 && pqc_key_len != 32) ||
+                hex2bin_fixed(pqc_key_hex, pqc_key, pqc_key_len) != 0 ||
+                hex2bin_dyn(pqc_iv_hex, &pqc_iv, &pqc_iv_len) != 0 ||
+                hex2bin_dyn(kem_ct_hex, &kem_ct, &kem_ct_len) != 0) {
+                fprintf(stderr,"Bad PQC key, IV or KEM ciphertext\n"); return finish(1);
+            }
+            ms.pqc_key = pqc_key; ms.pqc_key_len = pqc_key_len;
+            ms.pqc_iv = pqc_iv;   ms.pqc_iv_len = pqc_iv_len;
+            ms.kem_ct = kem_ct;   ms.kem_ct_len = kem_ct_len;
+        }
+        ms.gcm_key = key; ms.gcm_key_len = key_len;
+        ms.gcm_iv = iv;   ms.gcm_iv_len = iv_len;
+        ms.aad = aad;     ms.aad_len = aad_len;
+
+        uint8_t *in=NULL; size_t in_len=0;
+        if (read_all_stdin(&in, &in_len) != 0 || in_len < pad_len) {
+            fprintf(stderr,"Failed to read pad and plaintext\n"); return finish(1);
+        }
+        if (pad_len) { ms.otp_pad = in; ms.otp_pad_len = (size_t)pad_len; }
+
+        uint8_t *out=NULL; size_t out_len=0;
+        int rc = qm_multiseal_al(al, &ms, in + pad_len, in_len - (size_t)pad_len, &out, &out_len);
+        if (rc != 0 && pad_len && pad_len < qm_multiseal_pad_len(&ms, in_len - (size_t)pad_len))
+            fprintf(stderr,"Pad too short: need %zu bytes\n", qm_multiseal_pad_len(&ms, in_len - (size_t)pad_len));
+        else if (rc != 0)
+            fprintf(stderr,"Encrypt failed\n");
+        if (rc != 0) return finish(1);
+        fwrite(out, 1, out_len, stdout);
+        if (getenv("QUMAIL_STATS")) qm_stats_dump_prometheus(stderr);
+        return finish(0);
+    }
+
+    if (env_mode) {
+        /* Binary QE envelope in or out; when opening, IV and AAD come from the envelope */
+#ifdef _WIN32
+        _setmode(_fileno(stdin), _O_BINARY);
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+        uint8_t *in=NULL; size_t in_len=0;
+        if (read_all_stdin(&in, &in_len) != 0) { fprintf(stderr,"Failed to read input\n"); return finish(1); }
+
+        uint8_t *out=NULL; size_t out_len=0;
+        int rc = env_mode == 1
+            ? qm_envelope_gcm_seal_al(al, key, key_len, env_key_id, iv, iv_len, aad, aad_len, in, in_len, env_flags, &out, &out_len)
+            : qm_envelope_gcm_open_al(al, key, key_len, in, in_len, &out, &out_len, NULL);
+        if (rc != 0) {
+            fprintf(stderr, env_mode == 1 ? "Encrypt failed\n" : "Auth failed (bad tag or malformed envelope)\n");
+            return finish(env_mode == 1 ? 1 : 2);
+        }
+        fwrite(out, 1, out_len, stdout);
+        if (getenv("QUMAIL_STATS")) qm_stats_dump_prometheus(stderr);
+        return finish(0);
     }
 
     int rc = 0;
     if (!decrypt_mode && !decrypt_stdin_mode) {
         uint8_t *pt=NULL; size_t pt_len=0;
-        if (read_all_stdin(&pt, &pt_len) != 0) { fprintf(stderr,"Failed to read PT\n"); return 1; }
+        if (read_all_stdin(&pt, &pt_len) != 0) { fprintf(stderr,"Failed to read PT\n"); return finish(1); }
 
         uint8_t *ct=NULL; size_t ct_len=0; uint8_t tag[16];
-        rc = aes128_gcm_encrypt(pt, pt_len, aad, aad_len, key, iv, iv_len, &ct, &ct_len, tag);
-        if (rc != 0) { fprintf(stderr,"Encrypt failed\n"); free(pt); return 1; }
+        rc = aes_gcm_encrypt_al(al, pt, pt_len, aad, aad_len, key, key_len, iv, iv_len, &ct, &ct_len, tag);
+        if (rc != 0) { fprintf(stderr,"Encrypt failed\n"); return finish(1); }
 
         printf("CIPHERTEXT_HEX:\n"); bin2hex_line(ct, ct_len);
         printf("TAG_HEX:\n");        bin2hex_line(tag, 16);
-
-        free(pt); free(ct);
     } else if (decrypt_stdin_mode) {
         // Read ciphertext hex from stdin
         uint8_t *ct_hex_buf=NULL; size_t ct_hex_len=0;
-        if (read_all_stdin(&ct_hex_buf, &ct_hex_len) != 0) { fprintf(stderr,"Failed to read CT from stdin\n"); return 1; }
+        if (read_all_stdin(&ct_hex_buf, &ct_hex_len) != 0) { fprintf(stderr,"Failed to read CT from stdin\n"); return finish(1); }
         // Trim whitespace/newlines
         while (ct_hex_len > 0 && isspace(ct_hex_buf[ct_hex_len-1])) ct_hex_len--;
         ct_hex_buf[ct_hex_len] = '\0';
 
         uint8_t *ct=NULL; size_t ct_len=0;
-        if (hex2bin_dyn((char*)ct_hex_buf, &ct, &ct_len) != 0) { fprintf(stderr,"Bad CT from stdin\n"); free(ct_hex_buf); return 1; }
-        free(ct_hex_buf);
+        if (hex2bin_dyn((char*)ct_hex_buf, &ct, &ct_len) != 0) { fprintf(stderr,"Bad CT from stdin\n"); return finish(1); }
 
         uint8_t tag[16];
-        if (hex2bin_fixed(tag_hex, tag, 16) != 0) { fprintf(stderr,"Bad TAG\n"); free(ct); return 1; }
+        if (hex2bin_fixed(tag_hex, tag, 16) != 0) { fprintf(stderr,"Bad TAG\n"); return finish(1); }
 
         uint8_t *pt=NULL; size_t pt_len=0;
-        rc = aes128_gcm_decrypt(ct, ct_len, aad, aad_len, key, iv, iv_len, tag, &pt, &pt_len);
-        if (rc != 0) { fprintf(stderr,"Auth failed (bad tag)\n"); free(ct); return 2; }
+        rc = aes_gcm_decrypt_al(al, ct, ct_len, aad, aad_len, key, key_len, iv, iv_len, tag, &pt, &pt_len);
+        if (rc != 0) { fprintf(stderr,"Auth failed (bad tag)\n"); return finish(2); }
 
         fwrite(pt, 1, pt_len, stdout);
-        free(pt); free(ct);
     } else {
         uint8_t *ct=NULL; size_t ct_len=0;
-        if (hex2bin_dyn(ct_hex, &ct, &ct_len) != 0) { fprintf(stderr,"Bad CT\n"); return 1; }
+        if (hex2bin_dyn(ct_hex, &ct, &ct_len) != 0) { fprintf(stderr,"Bad CT\n"); return finish(1); }
         uint8_t tag[16];
-        if (hex2bin_fixed(tag_hex, tag, 16) != 0) { fprintf(stderr,"Bad TAG\n"); free(ct); return 1; }
+        if (hex2bin_fixed(tag_hex, tag, 16) != 0) { fprintf(stderr,"Bad TAG\n"); return finish(1); }
 
         uint8_t *pt=NULL; size_t pt_len=0;
-        rc = aes128_gcm_decrypt(ct, ct_len, aad, aad_len, key, iv, iv_len, tag, &pt, &pt_len);
-        if (rc != 0) { fprintf(stderr,"Auth failed (bad tag)\n"); free(ct); return 2; }
+        rc = aes_gcm_decrypt_al(al, ct, ct_len, aad, aad_len, key, key_len, iv, iv_len, tag, &pt, &pt_len);
+        if (rc != 0) { fprintf(stderr,"Auth failed (bad tag)\n"); return finish(2); }
 
         fwrite(pt, 1, pt_len, stdout); printf("\n");
-        free(pt); free(ct);
     }
 
-    free(aad); free(iv);
-    return 0;
+    /* Stage totals for this run, e.g. QUMAIL_STATS=1 with a -DQM_STATS build */
+    if (getenv("QUMAIL_STATS")) qm_stats_dump_prometheus(stderr);
+    return finish(0);
 }
@@ -1,71 +1,35 @@
 # otp_server.py - Pure OTP encryption service
 from flask import Flask, request, jsonify
-import requests, binascii, os, base64
-
-KM = os.getenv("KM_URL", "http://127.0.0.1:2020")
+from concurrent.futures import ThreadPoolExecutor
+import requests, os, base64, threading
+import qm_envelope, qm_compress, qm_service
+from qm_service import stage, KM, MAX_PLAINTEXT, b2h, h2b, get_new_key_and_id, get_key_hex_by_id, get_key_hexes_by_ids
 
 app = Flask(__name__)
+qm_service.init_app(app)
 
-def b2h(b): return binascii.hexlify(b).decode()
+try:
+    import qmcodec          # SIMD hex/base64 codec (qm_codec_py.c); stdlib fallback when not built
+except ImportError:
+    qmcodec = None
 
-def get_new_key_and_id(bytes_needed=16):
-    """
-    Fetch a fresh key and its key_id from KM.
-    Supported KM responses:
-      - RAW body (key bytes) + header X-Key-Id
-      - JSON: {"key_hex":"..","key_id":".."}  OR {"key":"<base64>","key_id":".."}
-    """
-    r = requests.get(f"{KM}/otp/keys", params={"size": bytes_needed}, timeout=5)
-    r.raise_for_status()
-
-    # Prefer header
-    key_id = r.headers.get("X-Key-Id")
-
-    # Try JSON
-    key_hex = None
-    if "application/json" in r.headers.get("Content-Type", ""):
-        j = r.json()
-        key_id = j.get("key_id") or key_id
-        key_hex = j.get("key_hex")
-        if not key_hex and "key" in j:  # base64?
-            key_hex = b2h(binascii.a2b_base64(j["key"]))
-    # Fallback raw
-    if not key_hex:
-        key_hex = b2h(r.content)
-
-    if not key_id:
-        # If KM didn't send a header, synthesize one (temporary)
-        key_id = "K-unknown-" + os.urandom(4).hex()
-
-    return key_hex, key_id
-
-def get_key_hex_by_id(key_id):
-    """
-    Resolve key bytes by key_id from KM. Tries common patterns:
-      - GET /otp/keys/<key_id>
-      - GET /otp/keys?id=<key_id>
-      - GET /otp/key?id=<key_id>
-    Accepts raw or JSON {key_hex}/base64.
-    """
-    paths = [
-        f"{KM}/otp/keys/{key_id}",
-        f"{KM}/otp/keys?id={key_id}",
-        f"{KM}/otp/key?id={key_id}",
-    ]
-    for url in paths:
-        try:
-            r = requests.get(url, timeout=5)
-            if r.status_code == 404:
-                continue
-            r.raise_for_status()
-            if "application/json" in r.headers.get("Content-Type", ""):
-                j = r.json()
-                if "key_hex" in j: return j["key_hex"]
-                if "key" in j:     return b2h(binascii.a2b_base64(j["key"]))
-            return b2h(r.content)
-        except Exception:
-            continue
-    raise RuntimeError("Key not found in KM for key_id=" + key_id)
+try:
+    import otpxor           # native OTP XOR (level1/otp_xor_py.c); big-int fallback when not built
+except ImportError:
+    otpxor = None
+
+def b64url_encode(b):
+    if qmcodec: return qmcodec.b64encode(b, url=True)
+    return base64.urlsafe_b64encode(b).decode('ascii').rstrip('=')
+
+def b64url_decode(s):
+    """Unpadded or padded base64url."""
+    if qmcodec: return qmcodec.b64decode(s, url=True)
+    return base64.urlsafe_b64decode(s + '=' * (-len(s) % 4))
+
+def compression_param(value):
+    """qm_compress id for a request's compression name (absent = none); ValueError if unknown."""
+    return qm_compress.from_name(value) if value else qm_compress.NONE
 
 @app.post("/api/otp/encrypt")
 def encrypt_otp():
@@ -75,25 +39,37 @@ def encrypt_otp():
         if not body or "text" not in body:
             return jsonify({"error": "Missing text field"}), 400
 
-        plaintext = body["text"]
+        try:
+            comp = compression_param(body.get("compression"))
+        except ValueError:
+            return jsonify({"error": "unsupported_compression"}), 400
+
+        plaintext_bytes = body["text"].encode('utf-8')
+        if comp:
+            # Before the pad is sized: every byte saved is key material kept
+            with stage("compress"):
+                comp, plaintext_bytes = qm_compress.compress(comp, plaintext_bytes)
 
         # Get a new key for OTP encryption
-        key_hex, key_id = get_new_key_and_id(len(plaintext.encode('utf-8')))
-        key_bytes = binascii.unhexlify(key_hex)
-        plaintext_bytes = plaintext.encode('utf-8')
+        with stage("km"):
+            key_hex, key_id = get_new_key_and_id(len(plaintext_bytes))
+        key_bytes = h2b(key_hex)
 
         # XOR encryption (OTP)
-        ciphertext_bytes = bytearray()
-        for i, byte in enumerate(plaintext_bytes):
-            ciphertext_bytes.append(byte ^ key_bytes[i % len(key_bytes)])
+        with stage("crypto"):
+            ciphertext_bytes = xor_pad(plaintext_bytes, key_bytes)
 
         # Convert to base64url
-        ciphertext_b64url = base64.urlsafe_b64encode(ciphertext_bytes).decode('ascii').rstrip('=')
+        with stage("encode"):
+            ciphertext_b64url = b64url_encode(ciphertext_bytes)
 
-        return jsonify({
+        resp = {
             "key_id": key_id,
             "ciphertext_b64url": ciphertext_b64url
-        })
+        }
+        if comp:
+            resp["compression"] = qm_compress.name(comp)
+        return jsonify(resp)
     except Exception as e:
         return jsonify({"error": "encryption_failed", "detail": str(e)}), 500
 
@@ -107,22 +83,28 @@ def decrypt_otp():
 
         key_id = body["key_id"]
         ciphertext_b64url = body["ciphertext_b64url"]
+        try:
+            comp = compression_param(body.get("compression"))
+        except ValueError:
+            return jsonify({"error": "unsupported_compression"}), 400
+        if comp == qm_compress.AUTO:
+            return jsonify({"error": "unsupported_compression"}), 400
 
         # Convert from base64url
-        # Add padding if needed
-        missing_padding = len(ciphertext_b64url) % 4
-        if missing_padding:
-            ciphertext_b64url += '=' * (4 - missing_padding)
-        ciphertext_bytes = base64.urlsafe_b64decode(ciphertext_b64url)
+        with stage("encode"):
+            ciphertext_bytes = b64url_decode(ciphertext_b64url)
 
         # Get the key
-        key_hex = get_key_hex_by_id(key_id)
-        key_bytes = binascii.unhexlify(key_hex)
+        with stage("km"):
+            key_hex = get_key_hex_by_id(key_id)
+        key_bytes = h2b(key_hex)
 
         # XOR decryption (OTP)
-        plaintext_bytes = bytearray()
-        for i, byte in enumerate(ciphertext_bytes):
-            plaintext_bytes.append(byte ^ key_bytes[i % len(key_bytes)])
+        with stage("crypto"):
+            plaintext_bytes = xor_pad(ciphertext_bytes, key_bytes)
+        if comp:
+            with stage("compress"):
+                plaintext_bytes = qm_compress.decompress(comp, plaintext_bytes, MAX_PLAINTEXT)
 
         return jsonify({
             "text": plaintext_bytes.decode('utf-8')
@@ -130,6 +112,131 @@ def decrypt_otp():
     except Exception as e:
         return jsonify({"error": "decryption_failed", "detail": str(e)}), 500
 
+# Batch decrypts fan out over this pool; otpxor drops the GIL for large pads
+DECRYPT_POOL = ThreadPoolExecutor(max_workers=int(os.getenv("DECRYPT_WORKERS", os.cpu_count() or 4)))
+MAX_BATCH = 500
+MAX_BATCH_PLAINTEXT = int(os.getenv("MAX_BATCH_PLAINTEXT", 64 << 20))   # decompressed bytes per batch
+
+@app.post("/api/otp/decrypt-batch")
+def decrypt_otp_batch():
+    """
+    Decrypt a page of envelopes with one KM lookup for all their key ids.
+    Body {"items": [{"key_id", "ciphertext_b64url"[, "compression"]}, ...]}
+    -> {"results": [{"text": ...} | {"error": ...}, ...]} in request order.
+    Each item decompresses to at most MAX_PLAINTEXT; once the items together
+    pass MAX_BATCH_PLAINTEXT the rest are skipped and the batch gets a 413.
+    """
+    body = request.get_json(silent=True) or {}
+    items = body.get("items")
+    if not isinstance(items, list) or len(items) > MAX_BATCH:
+        return jsonify({"error": f"items must be a list of at most {MAX_BATCH}"}), 400
+    if not all(isinstance(it, dict) and "key_id" in it and "ciphertext_b64url" in it for it in items):
+        return jsonify({"error": "Missing required fields"}), 400
+
+    try:
+        with stage("km"):
+            keys = get_key_hexes_by_ids(it["key_id"] for it in items)
+    except Exception as e:
+        return jsonify({"error": "key_lookup_failed", "detail": str(e)}), 502
+
+    budget = [MAX_BATCH_PLAINTEXT]
+    budget_lock = threading.Lock()
+    over_budget = threading.Event()
+
+    def one(it):
+        if over_budget.is_set():
+            return None
+        key_hex = keys.get(it["key_id"])
+        if not key_hex:
+            return {"error": "key_not_found"}
+        try:
+            comp = compression_param(it.get("compression"))
+            if comp == qm_compress.AUTO:
+                raise ValueError("unsupported compression 'auto'")
+            pt = xor_pad(b64url_decode(it["ciphertext_b64url"]), h2b(key_hex))
+            if comp:
+                pt = qm_compress.decompress(comp, pt, MAX_PLAINTEXT)
+                with budget_lock:
+                    budget[0] -= len(pt)
+                    if budget[0] < 0:
+                        over_budget.set()
+                        return None
+            return {"text": pt.decode('utf-8')}
+        except Exception as e:
+            return {"error": "decryption_failed", "detail": str(e)}
+
+    with stage("crypto"):
+        results = list(DECRYPT_POOL.map(one, items))
+    if over_budget.is_set():
+        return jsonify({"error": "batch_too_large",
+                        "detail": f"items decompress to more than {MAX_BATCH_PLAINTEXT} bytes"}), 413
+    return jsonify({"results": results}), 200
+
+def xor_pad(data, key):
+    """data ^ key[:len(data)]; the pad must be at least as long as the data."""
+    if otpxor:
+        return otpxor.xor(data, key)
+    if len(key) < len(data):
+        raise ValueError("key shorter than data")
+    n = len(data)
+    if n == 0:
+        return b""
+    return (int.from_bytes(data, "big") ^ int.from_bytes(key[:n], "big")).to_bytes(n, "big")
+
+@app.post("/api/otp/encrypt-env")
+def encrypt_otp_env():
+    """
+    Binary layer: the body is raw bytes (an inner layer's envelope with
+    ?inner=1), the response one QE envelope (alg OTP-XOR, key id, ciphertext).
+    ?compression=auto|deflate|zstd compresses the body before the pad is
+    sized and records it in the envelope.
+    """
+    data = request.get_data()
+    try:
+        comp = compression_param(request.args.get("compression"))
+    except ValueError:
+        return jsonify({"error": "unsupported_compression"}), 400
+    if comp:
+        with stage("compress"):
+            comp, data = qm_compress.compress(comp, data)
+    try:
+        with stage("km"):
+            key_hex, key_id = get_new_key_and_id(max(len(data), 1))
+        with stage("crypto"):
+            ct = xor_pad(data, h2b(key_hex))
+    except Exception as e:
+        return jsonify({"error": "encryption_failed", "detail": str(e)}), 500
+
+    flags = qm_envelope.FLAG_INNER if request.args.get("inner") == "1" else 0
+    with stage("encode"):
+        env = qm_envelope.encode(qm_envelope.ALG_OTP_XOR, ct, key_id=key_id, flags=flags, comp=comp)
+    return env, 200, {"Content-Type": qm_envelope.CONTENT_TYPE, "X-Key-Id": key_id}
+
+@app.post("/api/otp/decrypt-env")
+def decrypt_otp_env():
+    """Body is an OTP-XOR QE envelope; returns the payload (an envelope if it was nested)."""
+    try:
+        with stage("encode"):
+            hdr = qm_envelope.parse(request.get_data())
+    except ValueError as e:
+        return jsonify({"error": "bad_envelope", "detail": str(e)}), 400
+    if hdr["alg"] != qm_envelope.ALG_OTP_XOR or not hdr["key_id"]:
+        return jsonify({"error": "bad_envelope", "detail": "not an OTP layer with a key id"}), 400
+
+    try:
+        with stage("km"):
+            key_hex = get_key_hex_by_id(hdr["key_id"])
+        with stage("crypto"):
+            pt = xor_pad(hdr["ciphertext"], h2b(key_hex))
+        if hdr["comp"]:
+            with stage("compress"):
+                pt = qm_compress.decompress(hdr["comp"], pt, MAX_PLAINTEXT)
+    except Exception as e:
+        return jsonify({"error": "decryption_failed", "detail": str(e)}), 500
+
+    inner = hdr["flags"] & qm_envelope.FLAG_INNER
+    return pt, 200, {"Content-Type": qm_envelope.CONTENT_TYPE if inner else "application/octet-stream"}
+
 @app.get("/health")
 def health_check():
     """Health check endpoint for Docker/Kubernetes"""
@@ -0,0 +1,52 @@
+#ifndef QM_ALLOC_H
+#define QM_ALLOC_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Allocator handle taken by the *_al crypto entry points (pkcs7_pad_al,
+ * aes_cbc_*_al, aes_gcm_*_al, gcm_chunked_*_al, qm_envelope_*_al,
+ * qm_multiseal_al). A NULL handle means malloc/free, which is what the
+ * original functions without the suffix pass, so existing callers are
+ * unchanged.
+ *
+ * QM_ALLOC_SECRET marks memory that will hold plaintext or key material:
+ * a qm_arena wipes such regions on reset and a qm_pool wipes them when
+ * they are returned. With NULL it is a plain free, as before.
+ *
+ * Header-only on purpose: the crypto sources only dispatch through the
+ * handle and gain no link dependency. Arenas and pools live in qm_arena.c.
+ */
+
+#define QM_ALLOC_SECRET 0x1u
+
+typedef struct qm_alloc {
+    void *(*alloc)(void *ctx, size_t n, unsigned flags);
+    /* Returns a block of n bytes holding the first min(old, n) bytes of p */
+    void *(*resize)(void *ctx, void *p, size_t old, size_t n, unsigned flags);
+    void  (*release)(void *ctx, void *p, size_t n, unsigned flags);
+    void  *ctx;
+} qm_alloc_t;
+
+/* Zero-size requests still return a unique pointer, as the callers expect. */
+static inline void *qm_alloc(const qm_alloc_t *al, size_t n, unsigned flags) {
+    if (!al) return malloc(n ? n : 1);
+    return al->alloc(al->ctx, n ? n : 1, flags);
+}
+
+static inline void *qm_resize(const qm_alloc_t *al, void *p, size_t old, size_t n, unsigned flags) {
+    if (!al) return realloc(p, n ? n : 1);
+    return al->resize(al->ctx, p, old, n ? n : 1, flags);
+}
+
+/* n is the size passed to qm_alloc; NULL p is a no-op. */
+static inline void qm_release(const qm_alloc_t *al, void *p, size_t n, unsigned flags) {
+    if (!p) return;
+    if (!al) { free(p); return; }
+    al->release(al->ctx, p, n ? n : 1, flags);
+}
+
+#endif /* QM_ALLOC_H */
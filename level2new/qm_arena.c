@@ -0,0 +1,318 @@
+#include "qm_arena.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#define ARENA_ALIGN         16
+#define ARENA_DEFAULT_BLOCK (64u * 1024u)
+#define ARENA_DEFAULT_KEEP  (4u * 1024u * 1024u)
+
+#define POOL_MIN_SHIFT      6                  /* 64 B */
+#define POOL_MAX_SHIFT      24                 /* 16 MiB */
+#define POOL_CLASSES        (POOL_MAX_SHIFT - POOL_MIN_SHIFT + 1)
+#define POOL_DIRECT         0xFFu              /* class tag of malloc'd oversize buffers */
+#define POOL_HDR            16                 /* keeps payloads 16-byte aligned */
+#define POOL_DEFAULT_CACHE  (64u * 1024u * 1024u)
+
+/* ---------- Helpers: wipe, alignment ---------- */
+static void secure_zero(void *p, size_t n) {
+    volatile uint8_t *q = (volatile uint8_t*)p;
+    while (n--) *q++ = 0;
+}
+
+static size_t align_up(size_t n) {
+    return (n + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+/* ===================== Arena ===================== */
+
+typedef struct arena_block {
+    struct arena_block *next;
+    size_t size;                /* usable bytes after the header */
+    size_t used;
+    size_t secret_end;          /* [0, secret_end) has held secret data */
+} arena_block_t;
+
+#define BLOCK_HDR align_up(sizeof(arena_block_t))
+
+static uint8_t *block_data(arena_block_t *b) { return (uint8_t*)b + BLOCK_HDR; }
+
+struct qm_arena {
+    qm_alloc_t        handle;
+    arena_block_t    *blocks;   /* in use, newest (the bump block) first */
+    arena_block_t    *spare;    /* kept from earlier requests, ascending size */
+    size_t            block_size, retain;
+    uint8_t          *last;     /* newest allocation, for in-place resize */
+    qm_arena_stats_t  st;
+};
+
+static void *arena_alloc_cb(void *ctx, size_t n, unsigned flags) {
+    return qm_arena_alloc((qm_arena_t*)ctx, n, flags);
+}
+static void *arena_resize_cb(void *ctx, void *p, size_t old, size_t n, unsigned flags) {
+    return qm_arena_resize((qm_arena_t*)ctx, p, old, n, flags);
+}
+static void arena_release_cb(void *ctx, void *p, size_t n, unsigned flags) {
+    qm_arena_t *a = (qm_arena_t*)ctx;
+    if (flags & QM_ALLOC_SECRET) secure_zero(p, n);
+    /* Only the newest allocation can be given back (bump allocator) */
+    arena_block_t *b = a->blocks;
+    if (b && (uint8_t*)p == a->last) {
+        size_t off = (size_t)((uint8_t*)p - block_data(b));
+        a->st.used -= b->used - off;
+        b->used = off;
+        a->last = NULL;
+    }
+}
+
+qm_arena_t *qm_arena_create(size_t block_size, size_t retain) {
+    qm_arena_t *a = (qm_arena_t*)calloc(1, sizeof(*a));
+    if (!a) return NULL;
+    a->block_size = align_up(block_size ? block_size : ARENA_DEFAULT_BLOCK);
+    a->retain = retain ? retain : ARENA_DEFAULT_KEEP;
+    if (a->retain < a->block_size) a->retain = a->block_size;
+    a->handle.alloc = arena_alloc_cb;
+    a->handle.resize = arena_resize_cb;
+    a->handle.release = arena_release_cb;
+    a->handle.ctx = a;
+    return a;
+}
+
+static void spare_insert(qm_arena_t *a, arena_block_t *b) {
+    arena_block_t **p = &a->spare;
+    while (*p && (*p)->size < b->size) p = &(*p)->next;
+    b->next = *p;
+    *p = b;
+}
+
+/* Smallest kept block that fits, else a fresh one of at least block_size */
+static arena_block_t *block_get(qm_arena_t *a, size_t need) {
+    for (arena_block_t **p = &a->spare; *p; p = &(*p)->next) {
+        if ((*p)->size >= need) {
+            arena_block_t *b = *p;
+            *p = b->next;
+            return b;
+        }
+    }
+    size_t size = need > a->block_size ? need : a->block_size;
+    arena_block_t *b = (arena_block_t*)malloc(BLOCK_HDR + size);
+    if (!b) return NULL;
+    b->size = size;
+    b->used = b->secret_end = 0;
+    a->st.reserved += size;
+    a->st.heap_allocs++;
+    return b;
+}
+
+void *qm_arena_alloc(qm_arena_t *a, size_t n, unsigned flags) {
+    size_t need = align_up(n ? n : 1);
+    if (need < n) return NULL;                          /* overflow */
+    arena_block_t *b = a->blocks;
+    if (!b || b->size - b->used < need) {
+        if (!(b = block_get(a, need))) return NULL;
+        b->next = a->blocks;
+        a->blocks = b;
+    }
+    uint8_t *p = block_data(b) + b->used;
+    b->used += need;
+    if (flags & QM_ALLOC_SECRET) b->secret_end = b->used;
+    a->st.used += need;
+    a->last = p;
+    return p;
+}
+
+void *qm_arena_resize(qm_arena_t *a, void *p, size_t old, size_t n, unsigned flags) {
+    if (!p) return qm_arena_alloc(a, n, flags);
+    arena_block_t *b = a->blocks;
+    if ((uint8_t*)p == a->last && b) {
+        size_t off = (size_t)((uint8_t*)p - block_data(b));
+        size_t need = align_up(n ? n : 1);
+        if (need >= n && off + need <= b->size) {
+            a->st.used += off + need;
+            a->st.used -= b->used;
+            b->used = off + need;
+            if ((flags & QM_ALLOC_SECRET) && b->secret_end < b->used) b->secret_end = b->used;
+            return p;
+        }
+    }
+    uint8_t *q = (uint8_t*)qm_arena_alloc(a, n, flags);
+    if (q) memcpy(q, p, old < n ? old : n);
+    return q;
+}
+
+void qm_arena_reset(qm_arena_t *a) {
+    if (a->st.used > a->st.peak) a->st.peak = a->st.used;
+    a->st.used = 0;
+    a->st.resets++;
+    a->last = NULL;
+
+    while (a->blocks) {
+        arena_block_t *b = a->blocks;
+        a->blocks = b->next;
+        secure_zero(block_data(b), b->secret_end);
+        b->used = b->secret_end = 0;
+        spare_insert(a, b);
+    }
+    /* Keep the smallest blocks up to retain bytes; a one-off huge request
+       does not pin its memory. */
+    size_t kept = 0;
+    for (arena_block_t **p = &a->spare; *p; ) {
+        if (kept + (*p)->size <= a->retain) { kept += (*p)->size; p = &(*p)->next; continue; }
+        arena_block_t *b = *p;
+        *p = b->next;
+        a->st.reserved -= b->size;
+        free(b);
+    }
+}
+
+void qm_arena_destroy(qm_arena_t *a) {
+    if (!a) return;
+    qm_arena_reset(a);
+    while (a->spare) {
+        arena_block_t *b = a->spare;
+        a->spare = b->next;
+        free(b);
+    }
+    free(a);
+}
+
+const qm_alloc_t *qm_arena_allocator(qm_arena_t *a) { return &a->handle; }
+
+void qm_arena_stats(const qm_arena_t *a, qm_arena_stats_t *s) {
+    *s = a->st;
+    if (s->used > s->peak) s->peak = s->used;
+}
+
+/* ===================== Size-class pool ===================== */
+
+typedef struct pool_item { struct pool_item *next; } pool_item_t;
+
+struct qm_pool {
+    qm_alloc_t   handle;
+    pool_item_t *free[POOL_CLASSES];
+    size_t       cached, max_cached;
+#ifdef _WIN32
+    SRWLOCK      lock;
+#else
+    pthread_mutex_t lock;
+#endif
+};
+
+#ifdef _WIN32
+#define POOL_LOCK(p)   AcquireSRWLockExclusive(&(p)->lock)
+#define POOL_UNLOCK(p) ReleaseSRWLockExclusive(&(p)->lock)
+#else
+#define POOL_LOCK(p)   pthread_mutex_lock(&(p)->lock)
+#define POOL_UNLOCK(p) pthread_mutex_unlock(&(p)->lock)
+#endif
+
+static unsigned size_class(size_t n) {
+    if (n > ((size_t)1 << POOL_MAX_SHIFT)) return POOL_DIRECT;
+    unsigned c = 0;
+    while (((size_t)1 << (c + POOL_MIN_SHIFT)) < n) c++;
+    return c;
+}
+
+static size_t class_size(unsigned c) { return (size_t)1 << (c + POOL_MIN_SHIFT); }
+
+static void *pool_alloc_cb(void *ctx, size_t n, unsigned flags) {
+    return qm_pool_alloc((qm_pool_t*)ctx, n, flags);
+}
+static void *pool_resize_cb(void *ctx, void *p, size_t old, size_t n, unsigned flags) {
+    return qm_pool_resize((qm_pool_t*)ctx, p, old, n, flags);
+}
+static void pool_release_cb(void *ctx, void *p, size_t n, unsigned flags) {
+    qm_pool_release((qm_pool_t*)ctx, p, n, flags);
+}
+
+qm_pool_t *qm_pool_create(size_t max_cached) {
+    qm_pool_t *p = (qm_pool_t*)calloc(1, sizeof(*p));
+    if (!p) return NULL;
+    p->max_cached = max_cached ? max_cached : POOL_DEFAULT_CACHE;
+#ifdef _WIN32
+    InitializeSRWLock(&p->lock);
+#else
+    pthread_mutex_init(&p->lock, NULL);
+#endif
+    p->handle.alloc = pool_alloc_cb;
+    p->handle.resize = pool_resize_cb;
+    p->handle.release = pool_release_cb;
+    p->handle.ctx = p;
+    return p;
+}
+
+void qm_pool_destroy(qm_pool_t *p) {
+    if (!p) return;
+    for (unsigned c = 0; c < POOL_CLASSES; ++c) {
+        while (p->free[c]) {
+            pool_item_t *it = p->free[c];
+            p->free[c] = it->next;
+            free(it);
+        }
+    }
+#ifndef _WIN32
+    pthread_mutex_destroy(&p->lock);
+#endif
+    free(p);
+}
+
+void *qm_pool_alloc(qm_pool_t *p, size_t n, unsigned flags) {
+    (void)flags;
+    unsigned c = size_class(n ? n : 1);
+    uint8_t *raw = NULL;
+    if (c == POOL_DIRECT) {
+        if (n > SIZE_MAX - POOL_HDR) return NULL;
+        raw = (uint8_t*)malloc(POOL_HDR + n);
+    } else {
+        POOL_LOCK(p);
+        pool_item_t *it = p->free[c];
+        if (it) { p->free[c] = it->next; p->cached -= class_size(c); }
+        POOL_UNLOCK(p);
+        raw = it ? (uint8_t*)it : (uint8_t*)malloc(POOL_HDR + class_size(c));
+    }
+    if (!raw) return NULL;
+    memcpy(raw + sizeof(pool_item_t*), &c, sizeof(c));  /* tag sits after the link slot */
+    return raw + POOL_HDR;
+}
+
+static unsigned tag_of(const void *ptr) {
+    unsigned c;
+    memcpy(&c, (const uint8_t*)ptr - POOL_HDR + sizeof(pool_item_t*), sizeof(c));
+    return c;
+}
+
+void qm_pool_release(qm_pool_t *p, void *ptr, size_t n, unsigned flags) {
+    if (!ptr) return;
+    unsigned c = tag_of(ptr);
+    if (flags & QM_ALLOC_SECRET) secure_zero(ptr, n);
+    uint8_t *raw = (uint8_t*)ptr - POOL_HDR;
+    if (c == POOL_DIRECT) { free(raw); return; }
+    POOL_LOCK(p);
+    if (p->cached + class_size(c) <= p->max_cached) {
+        pool_item_t *it = (pool_item_t*)raw;
+        it->next = p->free[c];
+        p->free[c] = it;
+        p->cached += class_size(c);
+        raw = NULL;
+    }
+    POOL_UNLOCK(p);
+    free(raw);
+}
+
+void *qm_pool_resize(qm_pool_t *p, void *ptr, size_t old, size_t n, unsigned flags) {
+    if (!ptr) return qm_pool_alloc(p, n, flags);
+    unsigned c = tag_of(ptr);
+    if (c != POOL_DIRECT && n <= class_size(c)) return ptr;
+    void *q = qm_pool_alloc(p, n, flags);
+    if (!q) return NULL;
+    memcpy(q, ptr, old < n ? old : n);
+    qm_pool_release(p, ptr, old, flags);
+    return q;
+}
+
+const qm_alloc_t *qm_pool_allocator(qm_pool_t *p) { return &p->handle; }
@@ -0,0 +1,64 @@
+#ifndef QM_ARENA_H
+#define QM_ARENA_H
+
+#include "qm_alloc.h"
+
+/*
+ * Per-request arena and size-class pool behind the qm_alloc_t handle.
+ *
+ * qm_arena_t is a bump allocator for everything that dies with one message:
+ * hex-decoded inputs, padded copies, ciphertext, plaintext, response
+ * bodies. Allocation is a pointer bump in the current block; release is a
+ * no-op (the newest allocation is rewound, so resize-after-alloc loops like
+ * reading stdin grow in place). qm_arena_reset() wipes every block range
+ * that held a QM_ALLOC_SECRET allocation, then keeps up to retain bytes of
+ * blocks for the next request, so a steady stream of similar requests
+ * touches the heap only while the arena warms up.
+ *
+ * An arena is not thread-safe; hand it between threads together with the
+ * request it belongs to.
+ *
+ * qm_pool_t serves buffers that outlive a request (connection receive
+ * buffers, a request's raw bytes handed from the reader to the worker):
+ * power-of-two size classes from 64 B to 16 MiB with a free list each,
+ * capped at max_cached bytes in total. Larger requests go straight to
+ * malloc. Secret buffers are wiped when released. Pools are thread-safe.
+ */
+
+typedef struct qm_arena qm_arena_t;
+typedef struct qm_pool  qm_pool_t;
+
+typedef struct {
+    size_t   used;          /* bytes handed out since the last reset */
+    size_t   reserved;      /* bytes in blocks owned by the arena */
+    size_t   peak;          /* largest used seen at a reset */
+    uint64_t heap_allocs;   /* malloc calls for blocks, ever */
+    uint64_t resets;
+} qm_arena_stats_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* block_size 0 = 64 KiB; retain 0 = 4 MiB kept across resets. */
+qm_arena_t       *qm_arena_create(size_t block_size, size_t retain);
+void              qm_arena_destroy(qm_arena_t *a);       /* wipes secret ranges */
+void             *qm_arena_alloc(qm_arena_t *a, size_t n, unsigned flags);
+void             *qm_arena_resize(qm_arena_t *a, void *p, size_t old, size_t n, unsigned flags);
+void              qm_arena_reset(qm_arena_t *a);
+const qm_alloc_t *qm_arena_allocator(qm_arena_t *a);
+void              qm_arena_stats(const qm_arena_t *a, qm_arena_stats_t *s);
+
+/* max_cached 0 = 64 MiB. */
+qm_pool_t        *qm_pool_create(size_t max_cached);
+void              qm_pool_destroy(qm_pool_t *p);
+void             *qm_pool_alloc(qm_pool_t *p, size_t n, unsigned flags);
+void             *qm_pool_resize(qm_pool_t *p, void *ptr, size_t old, size_t n, unsigned flags);
+void              qm_pool_release(qm_pool_t *p, void *ptr, size_t n, unsigned flags);
+const qm_alloc_t *qm_pool_allocator(qm_pool_t *p);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* QM_ARENA_H */
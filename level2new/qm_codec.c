@@ -0,0 +1,476 @@
+#include "qm_codec.h"
+#include "qm_stats.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define QM_CODEC_HAVE_X86 1
+#include <immintrin.h>
+#define SSSE3_TARGET __attribute__((target("ssse3")))
+#define AVX2_TARGET  __attribute__((target("avx2")))
+#endif
+
+/*
+ * The SIMD loops handle whole blocks in the middle of the input and leave
+ * the rest (and base64 padding) to the scalar code, so validation rules
+ * live in one place. Base64 follows Mula & Lemire: pshufb/multiply-shift
+ * reshuffles, with range compares instead of nibble tables for decoding so
+ * the same code serves both alphabets.
+ */
+
+static const char HEX_DIGITS[] = "0123456789abcdef";
+static const char B64_STD[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+static const char B64_URL[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+/* ---------- Scalar ---------- */
+
+static int hex_value(unsigned char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    c |= 0x20;
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+static int b64_value(unsigned char c, int url) {
+    if (c >= 'A' && c <= 'Z') return c - 'A';
+    if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+    if (c >= '0' && c <= '9') return c - '0' + 52;
+    if (c == (url ? '-' : '+')) return 62;
+    if (c == (url ? '_' : '/')) return 63;
+    return -1;
+}
+
+static void hex_encode_scalar(const uint8_t *in, size_t n, char *out) {
+    for (size_t i = 0; i < n; ++i) {
+        out[2*i]     = HEX_DIGITS[in[i] >> 4];
+        out[2*i + 1] = HEX_DIGITS[in[i] & 15];
+    }
+}
+
+static int hex_decode_scalar(const char *in, size_t n, uint8_t *out) {
+    for (size_t i = 0; i < n / 2; ++i) {
+        int hi = hex_value((unsigned char)in[2*i]), lo = hex_value((unsigned char)in[2*i + 1]);
+        if (hi < 0 || lo < 0) return -1;
+        out[i] = (uint8_t)(hi << 4 | lo);
+    }
+    return 0;
+}
+
+/* Whole 3-byte groups only; the caller writes the final partial group. */
+static void b64_encode_scalar(const uint8_t *in, size_t n, char *out, const char *abc) {
+    for (size_t i = 0; i + 3 <= n; i += 3, out += 4) {
+        uint32_t v = (uint32_t)in[i] << 16 | (uint32_t)in[i+1] << 8 | in[i+2];
+        out[0] = abc[v >> 18]; out[1] = abc[(v >> 12) & 63];
+        out[2] = abc[(v >> 6) & 63]; out[3] = abc[v & 63];
+    }
+}
+
+/* Whole 4-char quanta only (n % 4 == 0). */
+static int b64_decode_scalar(const char *in, size_t n, uint8_t *out, int url) {
+    for (size_t i = 0; i < n; i += 4, out += 3) {
+        int a = b64_value((unsigned char)in[i], url),   b = b64_value((unsigned char)in[i+1], url);
+        int c = b64_value((unsigned char)in[i+2], url), d = b64_value((unsigned char)in[i+3], url);
+        if ((a | b | c | d) < 0) return -1;
+        uint32_t v = (uint32_t)a << 18 | (uint32_t)b << 12 | (uint32_t)c << 6 | (uint32_t)d;
+        out[0] = (uint8_t)(v >> 16); out[1] = (uint8_t)(v >> 8); out[2] = (uint8_t)v;
+    }
+    return 0;
+}
+
+/* ---------- SSSE3 ---------- */
+#ifdef QM_CODEC_HAVE_X86
+
+SSSE3_TARGET
+static size_t hex_encode_ssse3(const uint8_t *in, size_t n, char *out) {
+    const __m128i lut = _mm_loadu_si128((const __m128i*)HEX_DIGITS);
+    const __m128i m4  = _mm_set1_epi8(0x0f);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v  = _mm_loadu_si128((const __m128i*)(in + i));
+        __m128i hi = _mm_shuffle_epi8(lut, _mm_and_si128(_mm_srli_epi16(v, 4), m4));
+        __m128i lo = _mm_shuffle_epi8(lut, _mm_and_si128(v, m4));
+        _mm_storeu_si128((__m128i*)(out + 2*i),      _mm_unpacklo_epi8(hi, lo));
+        _mm_storeu_si128((__m128i*)(out + 2*i + 16), _mm_unpackhi_epi8(hi, lo));
+    }
+    return i;
+}
+
+/* Nibble values of 16 hex chars; *ok gets 0 if any char is not a hex digit. */
+SSSE3_TARGET
+static inline __m128i hex_nibbles_ssse3(__m128i v, int *ok) {
+    __m128i d   = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+    __m128i isd = _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(9)), d);
+    __m128i l   = _mm_sub_epi8(_mm_or_si128(v, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+    __m128i isl = _mm_cmpeq_epi8(_mm_min_epu8(l, _mm_set1_epi8(5)), l);
+    if (_mm_movemask_epi8(_mm_or_si128(isd, isl)) != 0xffff) *ok = 0;
+    return _mm_or_si128(_mm_and_si128(isd, d), _mm_and_si128(isl, _mm_add_epi8(l, _mm_set1_epi8(10))));
+}
+
+SSSE3_TARGET
+static size_t hex_decode_ssse3(const char *in, size_t n, uint8_t *out, int *ok) {
+    const __m128i w = _mm_set1_epi16(0x0110);     /* hi * 16 + lo */
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m128i a = hex_nibbles_ssse3(_mm_loadu_si128((const __m128i*)(in + i)), ok);
+        __m128i b = hex_nibbles_ssse3(_mm_loadu_si128((const __m128i*)(in + i + 16)), ok);
+        if (!*ok) return i;
+        _mm_storeu_si128((__m128i*)(out + i/2),
+                         _mm_packus_epi16(_mm_maddubs_epi16(a, w), _mm_maddubs_epi16(b, w)));
+    }
+    return i;
+}
+
+/* 12 input bytes (in the low 12 of v) -> 16 six-bit indices */
+SSSE3_TARGET
+static inline __m128i b64_enc_reshuffle(__m128i v) {
+    v = _mm_shuffle_epi8(v, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+    __m128i t0 = _mm_mulhi_epu16(_mm_and_si128(v, _mm_set1_epi32(0x0fc0fc00)), _mm_set1_epi32(0x04000040));
+    __m128i t1 = _mm_mullo_epi16(_mm_and_si128(v, _mm_set1_epi32(0x003f03f0)), _mm_set1_epi32(0x01000010));
+    return _mm_or_si128(t0, t1);
+}
+
+SSSE3_TARGET
+static inline __m128i b64_enc_translate(__m128i idx, int url) {
+    __m128i r = _mm_subs_epu8(idx, _mm_set1_epi8(51));
+    r = _mm_or_si128(r, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), idx), _mm_set1_epi8(13)));
+    const __m128i shift = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                        '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                        (url ? '-' : '+') - 62, (url ? '_' : '/') - 63, 'A', 0, 0);
+    return _mm_add_epi8(_mm_shuffle_epi8(shift, r), idx);
+}
+
+SSSE3_TARGET
+static size_t b64_encode_ssse3(const uint8_t *in, size_t n, char *out, int url) {
+    size_t i = 0, o = 0;
+    for (; i + 16 <= n; i += 12, o += 16) {
+        __m128i idx = b64_enc_reshuffle(_mm_loadu_si128((const __m128i*)(in + i)));
+        _mm_storeu_si128((__m128i*)(out + o), b64_enc_translate(idx, url));
+    }
+    return i;
+}
+
+/* Unsigned lo <= v <= hi per byte */
+SSSE3_TARGET
+static inline __m128i in_range_ssse3(__m128i v, char lo, char hi) {
+    __m128i d = _mm_sub_epi8(v, _mm_set1_epi8(lo));
+    return _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8((char)(hi - lo))), d);
+}
+
+/* 16 chars -> 16 six-bit values; *ok gets 0 on any char outside the alphabet. */
+SSSE3_TARGET
+static inline __m128i b64_dec_translate(__m128i v, int url, int *ok) {
+    const char c62 = url ? '-' : '+', c63 = url ? '_' : '/';
+    __m128i up  = in_range_ssse3(v, 'A', 'Z');
+    __m128i low = in_range_ssse3(v, 'a', 'z');
+    __m128i dig = in_range_ssse3(v, '0', '9');
+    __m128i s62 = _mm_cmpeq_epi8(v, _mm_set1_epi8(c62));
+    __m128i s63 = _mm_cmpeq_epi8(v, _mm_set1_epi8(c63));
+    __m128i any = _mm_or_si128(_mm_or_si128(up, low), _mm_or_si128(dig, _mm_or_si128(s62, s63)));
+    if (_mm_movemask_epi8(any) != 0xffff) *ok = 0;
+    __m128i sh = _mm_and_si128(up, _mm_set1_epi8(-'A'));
+    sh = _mm_or_si128(sh, _mm_and_si128(low, _mm_set1_epi8(26 - 'a')));
+    sh = _mm_or_si128(sh, _mm_and_si128(dig, _mm_set1_epi8(52 - '0')));
+    sh = _mm_or_si128(sh, _mm_and_si128(s62, _mm_set1_epi8((char)(62 - c62))));
+    sh = _mm_or_si128(sh, _mm_and_si128(s63, _mm_set1_epi8((char)(63 - c63))));
+    return _mm_add_epi8(v, sh);
+}
+
+/* 16 six-bit values -> 12 bytes in the low lanes */
+SSSE3_TARGET
+static inline __m128i b64_dec_pack(__m128i idx) {
+    __m128i t = _mm_maddubs_epi16(idx, _mm_set1_epi32(0x01400140));
+    t = _mm_madd_epi16(t, _mm_set1_epi32(0x00011000));
+    return _mm_shuffle_epi8(t, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+}
+
+/* Each block stores 16 bytes for 12, so stop while 8+ chars (4+ bytes) remain. */
+SSSE3_TARGET
+static size_t b64_decode_ssse3(const char *in, size_t n, uint8_t *out, int url, int *ok) {
+    size_t i = 0, o = 0;
+    for (; i + 24 <= n; i += 16, o += 12) {
+        __m128i idx = b64_dec_translate(_mm_loadu_si128((const __m128i*)(in + i)), url, ok);
+        if (!*ok) return i;
+        _mm_storeu_si128((__m128i*)(out + o), b64_dec_pack(idx));
+    }
+    return i;
+}
+
+/* ---------- AVX2 (same steps, two lanes) ---------- */
+
+AVX2_TARGET
+static size_t hex_encode_avx2(const uint8_t *in, size_t n, char *out) {
+    const __m256i lut = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)HEX_DIGITS));
+    const __m256i m4  = _mm256_set1_epi8(0x0f);
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i v  = _mm256_loadu_si256((const __m256i*)(in + i));
+        __m256i hi = _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(v, 4), m4));
+        __m256i lo = _mm256_shuffle_epi8(lut, _mm256_and_si256(v, m4));
+        __m256i a  = _mm256_unpacklo_epi8(hi, lo), b = _mm256_unpackhi_epi8(hi, lo);
+        _mm256_storeu_si256((__m256i*)(out + 2*i),      _mm256_permute2x128_si256(a, b, 0x20));
+        _mm256_storeu_si256((__m256i*)(out + 2*i + 32), _mm256_permute2x128_si256(a, b, 0x31));
+    }
+    return i;
+}
+
+AVX2_TARGET
+static inline __m256i hex_nibbles_avx2(__m256i v, int *ok) {
+    __m256i d   = _mm256_sub_epi8(v, _mm256_set1_epi8('0'));
+    __m256i isd = _mm256_cmpeq_epi8(_mm256_min_epu8(d, _mm256_set1_epi8(9)), d);
+    __m256i l   = _mm256_sub_epi8(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+    __m256i isl = _mm256_cmpeq_epi8(_mm256_min_epu8(l, _mm256_set1_epi8(5)), l);
+    if (_mm256_movemask_epi8(_mm256_or_si256(isd, isl)) != -1) *ok = 0;
+    return _mm256_or_si256(_mm256_and_si256(isd, d), _mm256_and_si256(isl, _mm256_add_epi8(l, _mm256_set1_epi8(10))));
+}
+
+AVX2_TARGET
+static size_t hex_decode_avx2(const char *in, size_t n, uint8_t *out, int *ok) {
+    const __m256i w = _mm256_set1_epi16(0x0110);
+    size_t i = 0;
+    for (; i + 64 <= n; i += 64) {
+        __m256i a = hex_nibbles_avx2(_mm256_loadu_si256((const __m256i*)(in + i)), ok);
+        __m256i b = hex_nibbles_avx2(_mm256_loadu_si256((const __m256i*)(in + i + 32)), ok);
+        if (!*ok) return i;
+        __m256i p = _mm256_packus_epi16(_mm256_maddubs_epi16(a, w), _mm256_maddubs_epi16(b, w));
+        _mm256_storeu_si256((__m256i*)(out + i/2), _mm256_permute4x64_epi64(p, 0xd8));
+    }
+    return i;
+}
+
+AVX2_TARGET
+static inline __m256i b64_enc_reshuffle_avx2(__m256i v) {
+    v = _mm256_shuffle_epi8(v, _mm256_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1,
+                                               10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+    __m256i t0 = _mm256_mulhi_epu16(_mm256_and_si256(v, _mm256_set1_epi32(0x0fc0fc00)), _mm256_set1_epi32(0x04000040));
+    __m256i t1 = _mm256_mullo_epi16(_mm256_and_si256(v, _mm256_set1_epi32(0x003f03f0)), _mm256_set1_epi32(0x01000010));
+    return _mm256_or_si256(t0, t1);
+}
+
+AVX2_TARGET
+static inline __m256i b64_enc_translate_avx2(__m256i idx, int url) {
+    __m256i r = _mm256_subs_epu8(idx, _mm256_set1_epi8(51));
+    r = _mm256_or_si256(r, _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(26), idx), _mm256_set1_epi8(13)));
+    const __m256i shift = _mm256_broadcastsi128_si256(
+        _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                      '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                      (url ? '-' : '+') - 62, (url ? '_' : '/') - 63, 'A', 0, 0));
+    return _mm256_add_epi8(_mm256_shuffle_epi8(shift, r), idx);
+}
+
+/* 24 bytes per step: 12 into each lane (two overlapping 16-byte loads). */
+AVX2_TARGET
+static size_t b64_encode_avx2(const uint8_t *in, size_t n, char *out, int url) {
+    size_t i = 0, o = 0;
+    for (; i + 28 <= n; i += 24, o += 32) {
+        __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(in + i))),
+                                            _mm_loadu_si128((const __m128i*)(in + i + 12)), 1);
+        _mm256_storeu_si256((__m256i*)(out + o), b64_enc_translate_avx2(b64_enc_reshuffle_avx2(v), url));
+    }
+    return i;
+}
+
+AVX2_TARGET
+static inline __m256i in_range_avx2(__m256i v, char lo, char hi) {
+    __m256i d = _mm256_sub_epi8(v, _mm256_set1_epi8(lo));
+    return _mm256_cmpeq_epi8(_mm256_min_epu8(d, _mm256_set1_epi8((char)(hi - lo))), d);
+}
+
+AVX2_TARGET
+static inline __m256i b64_dec_translate_avx2(__m256i v, int url, int *ok) {
+    const char c62 = url ? '-' : '+', c63 = url ? '_' : '/';
+    __m256i up  = in_range_avx2(v, 'A', 'Z');
+    __m256i low = in_range_avx2(v, 'a', 'z');
+    __m256i dig = in_range_avx2(v, '0', '9');
+    __m256i s62 = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(c62));
+    __m256i s63 = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(c63));
+    __m256i any = _mm256_or_si256(_mm256_or_si256(up, low), _mm256_or_si256(dig, _mm256_or_si256(s62, s63)));
+    if (_mm256_movemask_epi8(any) != -1) *ok = 0;
+    __m256i sh = _mm256_and_si256(up, _mm256_set1_epi8(-'A'));
+    sh = _mm256_or_si256(sh, _mm256_and_si256(low, _mm256_set1_epi8(26 - 'a')));
+    sh = _mm256_or_si256(sh, _mm256_and_si256(dig, _mm256_set1_epi8(52 - '0')));
+    sh = _mm256_or_si256(sh, _mm256_and_si256(s62, _mm256_set1_epi8((char)(62 - c62))));
+    sh = _mm256_or_si256(sh, _mm256_and_si256(s63, _mm256_set1_epi8((char)(63 - c63))));
+    return _mm256_add_epi8(v, sh);
+}
+
+/* 32 chars -> 24 bytes; the 32-byte store needs 12+ chars (8+ bytes) left over. */
+AVX2_TARGET
+static size_t b64_decode_avx2(const char *in, size_t n, uint8_t *out, int url, int *ok) {
+    const __m256i shuf = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                          2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    const __m256i perm = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7);
+    size_t i = 0, o = 0;
+    for (; i + 44 <= n; i += 32, o += 24) {
+        __m256i idx = b64_dec_translate_avx2(_mm256_loadu_si256((const __m256i*)(in + i)), url, ok);
+        if (!*ok) return i;
+        __m256i t = _mm256_maddubs_epi16(idx, _mm256_set1_epi32(0x01400140));
+        t = _mm256_madd_epi16(t, _mm256_set1_epi32(0x00011000));
+        t = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(t, shuf), perm);
+        _mm256_storeu_si256((__m256i*)(out + o), t);
+    }
+    return i;
+}
+
+#endif /* QM_CODEC_HAVE_X86 */
+
+/* ===================== Dispatch ===================== */
+
+/* Shared by every thread that encodes; accessed with relaxed atomics (as aes.c's g_backend) */
+static qm_codec_impl_t g_impl = QM_CODEC_AUTO;
+
+static int impl_usable(qm_codec_impl_t impl) {
+    switch (impl) {
+    case QM_CODEC_SCALAR: return 1;
+#ifdef QM_CODEC_HAVE_X86
+    case QM_CODEC_SSSE3:  __builtin_cpu_init(); return __builtin_cpu_supports("ssse3");
+    case QM_CODEC_AVX2:   __builtin_cpu_init(); return __builtin_cpu_supports("avx2");
+#endif
+    default:              return 0;
+    }
+}
+
+qm_codec_impl_t qm_codec_impl(void) {
+    qm_codec_impl_t cur = __atomic_load_n(&g_impl, __ATOMIC_RELAXED);
+    if (cur == QM_CODEC_AUTO) {
+        qm_codec_impl_t impl = QM_CODEC_SCALAR;
+        if (impl_usable(QM_CODEC_AVX2)) impl = QM_CODEC_AVX2;
+        else if (impl_usable(QM_CODEC_SSSE3)) impl = QM_CODEC_SSSE3;
+        const char *env = getenv("QUMAIL_CODEC");
+        if (env) {
+            if      (strcmp(env, "scalar") == 0) impl = QM_CODEC_SCALAR;
+            else if (strcmp(env, "ssse3") == 0 && impl_usable(QM_CODEC_SSSE3)) impl = QM_CODEC_SSSE3;
+            else if (strcmp(env, "avx2") == 0 && impl_usable(QM_CODEC_AVX2)) impl = QM_CODEC_AVX2;
+        }
+        __atomic_store_n(&g_impl, impl, __ATOMIC_RELAXED);  /* racing first calls agree */
+        cur = impl;
+    }
+    return cur;
+}
+
+int qm_codec_set_impl(qm_codec_impl_t impl) {
+    if (impl != QM_CODEC_AUTO && !impl_usable(impl)) return -1;
+    __atomic_store_n(&g_impl, impl, __ATOMIC_RELAXED);
+    return 0;
+}
+
+const char *qm_codec_impl_name(qm_codec_impl_t impl) {
+    switch (impl) {
+    case QM_CODEC_SCALAR: return "scalar";
+    case QM_CODEC_SSSE3:  return "ssse3";
+    case QM_CODEC_AVX2:   return "avx2";
+    default:              return "auto";
+    }
+}
+
+/* ===================== Hex ===================== */
+
+void qm_hex_encode(const uint8_t *in, size_t n, char *out) {
+    QM_STATS_BEGIN(QM_STAT_HEX_ENCODE);
+    size_t i = 0;
+#ifdef QM_CODEC_HAVE_X86
+    switch (qm_codec_impl()) {
+    case QM_CODEC_AVX2:  i = hex_encode_avx2(in, n, out); break;
+    case QM_CODEC_SSSE3: i = hex_encode_ssse3(in, n, out); break;
+    default: break;
+    }
+#endif
+    hex_encode_scalar(in + i, n - i, out + 2*i);
+    QM_STATS_END(QM_STAT_HEX_ENCODE, n);
+}
+
+int qm_hex_decode(const char *in, size_t n, uint8_t *out) {
+    if (n % 2) return -1;
+    QM_STATS_BEGIN(QM_STAT_HEX_DECODE);
+    size_t i = 0;
+    int ok = 1;
+#ifdef QM_CODEC_HAVE_X86
+    switch (qm_codec_impl()) {
+    case QM_CODEC_AVX2:  i = hex_decode_avx2(in, n, out, &ok); break;
+    case QM_CODEC_SSSE3: i = hex_decode_ssse3(in, n, out, &ok); break;
+    default: break;
+    }
+#endif
+    int rc = ok ? hex_decode_scalar(in + i, n - i, out + i/2) : -1;
+    QM_STATS_END(QM_STAT_HEX_DECODE, n);
+    return rc;
+}
+
+/* ===================== Base64 ===================== */
+
+size_t qm_base64_encoded_len(size_t n, int flags) {
+    if (flags & QM_B64_URL) return n / 3 * 4 + (n % 3 ? n % 3 + 1 : 0);
+    return (n + 2) / 3 * 4;
+}
+
+size_t qm_base64_decoded_max(size_t n) {
+    return n / 4 * 3 + 2;
+}
+
+size_t qm_base64_encode(const uint8_t *in, size_t n, char *out, int flags) {
+    QM_STATS_BEGIN(QM_STAT_B64_ENCODE);
+    const int url = (flags & QM_B64_URL) != 0;
+    const char *abc = url ? B64_URL : B64_STD;
+    size_t i = 0;
+#ifdef QM_CODEC_HAVE_X86
+    switch (qm_codec_impl()) {
+    case QM_CODEC_AVX2:  i = b64_encode_avx2(in, n, out, url); break;
+    case QM_CODEC_SSSE3: i = b64_encode_ssse3(in, n, out, url); break;
+    default: break;
+    }
+#endif
+    size_t whole = n - (n - i) % 3;
+    b64_encode_scalar(in + i, whole - i, out + i / 3 * 4, abc);
+    char *p = out + whole / 3 * 4;
+
+    size_t rem = n - whole;
+    if (rem) {
+        uint32_t v = (uint32_t)in[whole] << 16 | (rem == 2 ? (uint32_t)in[whole + 1] << 8 : 0);
+        *p++ = abc[v >> 18];
+        *p++ = abc[(v >> 12) & 63];
+        if (rem == 2) *p++ = abc[(v >> 6) & 63];
+        if (!url) { if (rem == 1) *p++ = '='; *p++ = '='; }
+    }
+    QM_STATS_END(QM_STAT_B64_ENCODE, n);
+    return (size_t)(p - out);
+}
+
+int qm_base64_decode(const char *in, size_t n, uint8_t *out, size_t *out_len, int flags) {
+    const int url = (flags & QM_B64_URL) != 0;
+
+    /* Padding: required for base64, optional for base64url, and when present
+       it must complete the last quantum. */
+    size_t pad = 0;
+    if (n >= 1 && in[n-1] == '=') pad = (n >= 2 && in[n-2] == '=') ? 2 : 1;
+    if ((!url || pad) && n % 4) return -1;
+    size_t m = n - pad;                 /* data chars */
+    size_t tail = m % 4;
+    if (tail == 1 || (pad && tail + pad != 4)) return -1;
+
+    QM_STATS_BEGIN(QM_STAT_B64_DECODE);
+    size_t i = 0;
+    int ok = 1;
+#ifdef QM_CODEC_HAVE_X86
+    switch (qm_codec_impl()) {
+    case QM_CODEC_AVX2:  i = b64_decode_avx2(in, m, out, url, &ok); break;
+    case QM_CODEC_SSSE3: i = b64_decode_ssse3(in, m, out, url, &ok); break;
+    default: break;
+    }
+#endif
+    size_t whole = m - tail;
+    int rc = ok ? b64_decode_scalar(in + i, whole - i, out + i / 4 * 3, url) : -1;
+
+    if (rc == 0 && tail) {
+        int a = b64_value((unsigned char)in[whole], url), b = b64_value((unsigned char)in[whole+1], url);
+        int c = tail == 3 ? b64_value((unsigned char)in[whole+2], url) : 0;
+        uint8_t *p = out + whole / 4 * 3;
+        /* the bits past the last whole byte must be zero (canonical form) */
+        if ((a | b | c) < 0 || (tail == 2 ? (b & 15) : (c & 3)) != 0) rc = -1;
+        else {
+            p[0] = (uint8_t)(a << 2 | b >> 4);
+            if (tail == 3) p[1] = (uint8_t)(b << 4 | c >> 2);
+        }
+    }
+    if (rc == 0 && out_len) *out_len = whole / 4 * 3 + (tail ? tail - 1 : 0);
+    QM_STATS_END(QM_STAT_B64_DECODE, n);
+    return rc;
+}
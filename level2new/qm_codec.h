@@ -0,0 +1,57 @@
+#ifndef QM_CODEC_H
+#define QM_CODEC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Hex, base64 and base64url codecs for the text boundaries (CLI output,
+ * relay JSON). SSSE3 and AVX2 paths with a scalar fallback; all produce
+ * byte-identical output and reject exactly the same inputs.
+ *
+ *   hex       lowercase on encode; either case accepted on decode
+ *   base64    RFC 4648 alphabet, '=' padding required on decode
+ *   base64url '-' '_' alphabet, no padding on encode (like the relays'
+ *             rstrip('=')), padding optional on decode
+ *
+ * Decoding is strict: no whitespace, no characters outside the alphabet,
+ * '=' only at the end, and the unused bits of the last quantum must be
+ * zero, so every byte string has exactly one accepted encoding.
+ * Outputs are not NUL-terminated.
+ */
+
+typedef enum {
+    QM_CODEC_AUTO = 0,
+    QM_CODEC_SCALAR,
+    QM_CODEC_SSSE3,
+    QM_CODEC_AVX2
+} qm_codec_impl_t;
+
+#define QM_B64_STD 0
+#define QM_B64_URL 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Active implementation: best available, or QUMAIL_CODEC=scalar|ssse3|avx2. */
+qm_codec_impl_t qm_codec_impl(void);
+int             qm_codec_set_impl(qm_codec_impl_t impl);  /* -1 if not available here */
+const char     *qm_codec_impl_name(qm_codec_impl_t impl);
+
+/* Hex: out gets 2*n chars; decode takes an even n and writes n/2 bytes. */
+void qm_hex_encode(const uint8_t *in, size_t n, char *out);
+int  qm_hex_decode(const char *in, size_t n, uint8_t *out);
+
+/* Base64: encode returns the number of chars written (see encoded_len);
+   decode writes at most qm_base64_decoded_max(n) bytes. */
+size_t qm_base64_encoded_len(size_t n, int flags);
+size_t qm_base64_decoded_max(size_t n);
+size_t qm_base64_encode(const uint8_t *in, size_t n, char *out, int flags);
+int    qm_base64_decode(const char *in, size_t n, uint8_t *out, size_t *out_len, int flags);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* QM_CODEC_H */
@@ -0,0 +1,156 @@
+/*
+ * qmcodec: Python bindings for qm_codec.c, used by the relays when built.
+ *
+ *   gcc -O2 -shared -fPIC $(python3-config --includes) \
+ *       -o qmcodec$(python3-config --extension-suffix) qm_codec_py.c qm_codec.c
+ *
+ * Encoders take any bytes-like object and return str; decoders take str
+ * (ASCII) or bytes-like and return bytes, raising ValueError on input that
+ * qm_codec rejects. Large buffers are converted without holding the GIL.
+ */
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include "qm_codec.h"
+
+#define NOGIL_THRESHOLD 65536
+
+/* Borrow the characters of a str (ASCII only) or a bytes-like object. */
+static int get_text(PyObject *obj, Py_buffer *view, const char **p, Py_ssize_t *n) {
+    view->obj = NULL;
+    if (PyUnicode_Check(obj)) {
+        if (!PyUnicode_IS_ASCII(obj)) {
+            PyErr_SetString(PyExc_ValueError, "non-ASCII character in encoded input");
+            return -1;
+        }
+        *p = (const char *)PyUnicode_DATA(obj);
+        *n = PyUnicode_GET_LENGTH(obj);
+        return 0;
+    }
+    if (PyObject_GetBuffer(obj, view, PyBUF_SIMPLE) != 0) return -1;
+    *p = (const char *)view->buf;
+    *n = view->len;
+    return 0;
+}
+
+static PyObject *py_hexlify(PyObject *self, PyObject *arg) {
+    (void)self;
+    Py_buffer in;
+    if (PyObject_GetBuffer(arg, &in, PyBUF_SIMPLE) != 0) return NULL;
+    PyObject *out = PyUnicode_New(2 * in.len, 127);
+    if (out) {
+        char *dst = (char *)PyUnicode_DATA(out);
+        if (in.len >= NOGIL_THRESHOLD) {
+            Py_BEGIN_ALLOW_THREADS
+            qm_hex_encode((const uint8_t *)in.buf, (size_t)in.len, dst);
+            Py_END_ALLOW_THREADS
+        } else {
+            qm_hex_encode((const uint8_t *)in.buf, (size_t)in.len, dst);
+        }
+    }
+    PyBuffer_Release(&in);
+    return out;
+}
+
+static PyObject *py_unhexlify(PyObject *self, PyObject *arg) {
+    (void)self;
+    Py_buffer view; const char *src; Py_ssize_t n;
+    if (get_text(arg, &view, &src, &n) != 0) return NULL;
+    PyObject *out = NULL;
+    if (n % 2) {
+        PyErr_SetString(PyExc_ValueError, "odd-length hex string");
+    } else if ((out = PyBytes_FromStringAndSize(NULL, n / 2)) != NULL) {
+        uint8_t *dst = (uint8_t *)PyBytes_AS_STRING(out);
+        int rc;
+        if (n >= NOGIL_THRESHOLD) {
+            Py_BEGIN_ALLOW_THREADS
+            rc = qm_hex_decode(src, (size_t)n, dst);
+            Py_END_ALLOW_THREADS
+        } else {
+            rc = qm_hex_decode(src, (size_t)n, dst);
+        }
+        if (rc != 0) {
+            Py_CLEAR(out);
+            PyErr_SetString(PyExc_ValueError, "invalid hex string");
+        }
+    }
+    if (view.obj) PyBuffer_Release(&view);
+    return out;
+}
+
+static PyObject *py_b64encode(PyObject *self, PyObject *args, PyObject *kw) {
+    (void)self;
+    static char *kwlist[] = {"data", "url", NULL};
+    Py_buffer in; int url = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kw, "y*|p", kwlist, &in, &url)) return NULL;
+    int flags = url ? QM_B64_URL : QM_B64_STD;
+    PyObject *out = PyUnicode_New((Py_ssize_t)qm_base64_encoded_len((size_t)in.len, flags), 127);
+    if (out) {
+        char *dst = (char *)PyUnicode_DATA(out);
+        if (in.len >= NOGIL_THRESHOLD) {
+            Py_BEGIN_ALLOW_THREADS
+            qm_base64_encode((const uint8_t *)in.buf, (size_t)in.len, dst, flags);
+            Py_END_ALLOW_THREADS
+        } else {
+            qm_base64_encode((const uint8_t *)in.buf, (size_t)in.len, dst, flags);
+        }
+    }
+    PyBuffer_Release(&in);
+    return out;
+}
+
+static PyObject *py_b64decode(PyObject *self, PyObject *args, PyObject *kw) {
+    (void)self;
+    static char *kwlist[] = {"data", "url", NULL};
+    PyObject *obj; int url = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kw, "O|p", kwlist, &obj, &url)) return NULL;
+    Py_buffer view; const char *src; Py_ssize_t n;
+    if (get_text(obj, &view, &src, &n) != 0) return NULL;
+
+    int flags = url ? QM_B64_URL : QM_B64_STD;
+    PyObject *out = PyBytes_FromStringAndSize(NULL, (Py_ssize_t)qm_base64_decoded_max((size_t)n));
+    if (out) {
+        uint8_t *dst = (uint8_t *)PyBytes_AS_STRING(out);
+        size_t len = 0;
+        int rc;
+        if (n >= NOGIL_THRESHOLD) {
+            Py_BEGIN_ALLOW_THREADS
+            rc = qm_base64_decode(src, (size_t)n, dst, &len, flags);
+            Py_END_ALLOW_THREADS
+        } else {
+            rc = qm_base64_decode(src, (size_t)n, dst, &len, flags);
+        }
+        if (rc != 0) {
+            Py_CLEAR(out);
+            PyErr_SetString(PyExc_ValueError, url ? "invalid base64url string" : "invalid base64 string");
+        } else if (_PyBytes_Resize(&out, (Py_ssize_t)len) != 0) {
+            out = NULL;
+        }
+    }
+    if (view.obj) PyBuffer_Release(&view);
+    return out;
+}
+
+static PyObject *py_implementation(PyObject *self, PyObject *unused) {
+    (void)self; (void)unused;
+    return PyUnicode_FromString(qm_codec_impl_name(qm_codec_impl()));
+}
+
+static PyMethodDef qmcodec_methods[] = {
+    {"hexlify",   py_hexlify,   METH_O, "hexlify(data) -> str (lowercase hex)"},
+    {"unhexlify", py_unhexlify, METH_O, "unhexlify(text) -> bytes"},
+    {"b64encode", (PyCFunction)(void (*)(void))py_b64encode, METH_VARARGS | METH_KEYWORDS,
+     "b64encode(data, url=False) -> str (base64url is unpadded)"},
+    {"b64decode", (PyCFunction)(void (*)(void))py_b64decode, METH_VARARGS | METH_KEYWORDS,
+     "b64decode(text, url=False) -> bytes (strict; base64url padding optional)"},
+    {"implementation", py_implementation, METH_NOARGS, "Active SIMD path: scalar, ssse3 or avx2"},
+    {NULL, NULL, 0, NULL}
+};
+
+static struct PyModuleDef qmcodec_module = {
+    PyModuleDef_HEAD_INIT, "qmcodec", "SIMD hex/base64/base64url codec (qm_codec.c)", -1, qmcodec_methods,
+    NULL, NULL, NULL, NULL
+};
+
+PyMODINIT_FUNC PyInit_qmcodec(void) {
+    return PyModule_Create(&qmcodec_module);
+}
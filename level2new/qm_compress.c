@@ -0,0 +1,242 @@
+#include "qm_compress.h"
+#include <string.h>
+#include <zlib.h>
+#ifdef QM_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#define SAMPLE_WINDOW 1024
+
+static void secure_zero(void *p, size_t n) {
+    volatile uint8_t *q = (volatile uint8_t*)p;
+    while (n--) *q++ = 0;
+}
+
+/* ===================== Names ===================== */
+
+static const char *const NAMES[] = { "none", "deflate", "zstd" };
+
+int qm_compress_available(uint8_t alg) {
+    switch (alg) {
+    case QM_COMP_NONE:
+    case QM_COMP_DEFLATE: return 1;
+#ifdef QM_HAVE_ZSTD
+    case QM_COMP_ZSTD:    return 1;
+#endif
+    default:              return 0;
+    }
+}
+
+const char *qm_compress_name(uint8_t alg) {
+    if (alg == QM_COMP_AUTO) return "auto";
+    return alg < sizeof(NAMES) / sizeof(NAMES[0]) ? NAMES[alg] : NULL;
+}
+
+int qm_compress_from_name(const char *s, size_t n, uint8_t *alg) {
+    if (!s || !alg) return -1;
+    if (n == 4 && memcmp(s, "auto", 4) == 0) { *alg = QM_COMP_AUTO; return 0; }
+    for (uint8_t i = 0; i < sizeof(NAMES) / sizeof(NAMES[0]); ++i)
+        if (strlen(NAMES[i]) == n && memcmp(s, NAMES[i], n) == 0) { *alg = i; return 0; }
+    return -1;
+}
+
+/* ===================== Pre-check ===================== */
+
+static int has_prefix(const uint8_t *d, size_t len, const void *magic, size_t n) {
+    return len >= n && memcmp(d, magic, n) == 0;
+}
+
+static int known_compressed(const uint8_t *d, size_t len) {
+    static const struct { const char *m; size_t n; } MAGIC[] = {
+        { "\x1f\x8b", 2 },                          /* gzip */
+        { "PK\x03\x04", 4 },                        /* zip, docx/xlsx/odt, jar */
+        { "\x28\xb5\x2f\xfd", 4 },                  /* zstd */
+        { "\xfd" "7zXZ\x00", 6 },                   /* xz */
+        { "BZh", 3 },                               /* bzip2 */
+        { "7z\xbc\xaf\x27\x1c", 6 },                /* 7z */
+        { "Rar!\x1a\x07", 6 },                      /* rar */
+        { "\x89PNG", 4 },
+        { "\xff\xd8\xff", 3 },                      /* JPEG */
+        { "GIF8", 4 },
+        { "OggS", 4 },
+        { "QE\x01", 3 }, { "QE\x02", 3 },          /* already an envelope: ciphertext */
+    };
+    for (size_t i = 0; i < sizeof(MAGIC) / sizeof(MAGIC[0]); ++i)
+        if (has_prefix(d, len, MAGIC[i].m, MAGIC[i].n)) return 1;
+    if (len >= 12 && memcmp(d, "RIFF", 4) == 0 && memcmp(d + 8, "WEBP", 4) == 0) return 1;
+    if (len >= 12 && memcmp(d + 4, "ftyp", 4) == 0) return 1;   /* MP4/MOV/HEIC */
+    return 0;
+}
+
+int qm_compress_worthwhile(const uint8_t *data, size_t len) {
+    if (!data || len < QM_COMPRESS_MIN_LEN || known_compressed(data, len)) return 0;
+
+    /* Byte histogram over the start, middle and end */
+    uint32_t hist[256] = {0};
+    size_t starts[3] = { 0, len / 2, len };
+    size_t n = 0;
+    if (len <= 3 * SAMPLE_WINDOW) {
+        for (size_t i = 0; i < len; ++i) hist[data[i]]++;
+        n = len;
+    } else {
+        starts[1] -= SAMPLE_WINDOW / 2;
+        starts[2] -= SAMPLE_WINDOW;
+        for (int w = 0; w < 3; ++w)
+            for (size_t i = 0; i < SAMPLE_WINDOW; ++i) hist[data[starts[w] + i]]++;
+        n = 3 * SAMPLE_WINDOW;
+    }
+
+    /* Collision entropy -log2(sum p^2) above 7.5 bits/byte means random-looking
+       data; in integers: sum c^2 * 2^7.5 < n^2, with 2^7.5 ~ 181. English text
+       sits near 4.5 bits, random or compressed bytes near 8. */
+    uint64_t sum_sq = 0;
+    for (int i = 0; i < 256; ++i) sum_sq += (uint64_t)hist[i] * hist[i];
+    return sum_sq * 181 >= (uint64_t)n * n;
+}
+
+/* ===================== zlib ===================== */
+
+/* zlib's window and hash tables hold plaintext: wipe them when it frees */
+static voidpf z_alloc(voidpf opaque, uInt items, uInt size) {
+    (void)opaque;
+    size_t n = (size_t)items * size;
+    size_t *p = (size_t*)malloc(n + sizeof(max_align_t));
+    if (!p) return Z_NULL;
+    *p = n;
+    return (uint8_t*)p + sizeof(max_align_t);
+}
+
+static void z_free(voidpf opaque, voidpf address) {
+    (void)opaque;
+    if (!address) return;
+    size_t *p = (size_t*)((uint8_t*)address - sizeof(max_align_t));
+    secure_zero(address, *p);
+    free(p);
+}
+
+/* 0 done, 1 output does not fit in cap, -1 error */
+static int deflate_into(const uint8_t *in, size_t len, uint8_t *out, size_t cap, size_t *out_len) {
+    z_stream z;
+    memset(&z, 0, sizeof(z));
+    z.zalloc = z_alloc; z.zfree = z_free;
+    if (deflateInit(&z, Z_DEFAULT_COMPRESSION) != Z_OK) return -1;
+    z.next_in = (Bytef*)in;
+    z.next_out = out;
+    int rc = Z_OK;
+    /* avail_* are 32-bit: feed big buffers in slices */
+    while (rc == Z_OK) {
+        size_t in_left = len - (size_t)((const uint8_t*)z.next_in - in);
+        size_t out_left = cap - (size_t)(z.next_out - out);
+        if (!out_left) break;
+        z.avail_in = in_left > 0x40000000u ? 0x40000000u : (uInt)in_left;
+        z.avail_out = out_left > 0x40000000u ? 0x40000000u : (uInt)out_left;
+        rc = deflate(&z, z.avail_in == in_left ? Z_FINISH : Z_NO_FLUSH);
+    }
+    *out_len = (size_t)(z.next_out - out);
+    deflateEnd(&z);
+    if (rc == Z_STREAM_END) return 0;
+    return rc == Z_OK || rc == Z_BUF_ERROR ? 1 : -1;
+}
+
+/* Decompresses into a buffer grown by doubling up to max_out */
+static int inflate_al(const qm_alloc_t *al, const uint8_t *in, size_t len, size_t max_out,
+                      uint8_t **out, size_t *cap_out, size_t *out_len) {
+    z_stream z;
+    memset(&z, 0, sizeof(z));
+    z.zalloc = z_alloc; z.zfree = z_free;
+    if (inflateInit(&z) != Z_OK) return -1;
+
+    size_t cap = len * 4 < 4096 ? 4096 : len * 4;
+    if (cap > max_out) cap = max_out ? max_out : 1;
+    uint8_t *buf = (uint8_t*)qm_alloc(al, cap, QM_ALLOC_SECRET);
+    size_t used = 0;
+    int rc = buf ? Z_OK : Z_MEM_ERROR;
+    z.next_in = (Bytef*)in;
+    while (rc == Z_OK) {
+        if (used == cap) {
+            if (cap >= max_out) { rc = Z_BUF_ERROR; break; }
+            size_t ncap = cap * 2 > max_out || cap * 2 < cap ? max_out : cap * 2;
+            uint8_t *nbuf = (uint8_t*)qm_resize(al, buf, cap, ncap, QM_ALLOC_SECRET);
+            if (!nbuf) { rc = Z_MEM_ERROR; break; }
+            buf = nbuf; cap = ncap;
+        }
+        size_t in_left = len - (size_t)((const uint8_t*)z.next_in - in);
+        z.avail_in = in_left > 0x40000000u ? 0x40000000u : (uInt)in_left;
+        z.next_out = buf + used;
+        z.avail_out = cap - used > 0x40000000u ? 0x40000000u : (uInt)(cap - used);
+        size_t before = z.avail_out;
+        rc = inflate(&z, Z_NO_FLUSH);
+        used += before - z.avail_out;
+        if (rc == Z_BUF_ERROR && used == cap) rc = Z_OK;    /* just needs room */
+    }
+    int trailing = (size_t)((const uint8_t*)z.next_in - in) != len;
+    inflateEnd(&z);
+    if (rc != Z_STREAM_END || trailing) {
+        qm_release(al, buf, cap, QM_ALLOC_SECRET);
+        return -1;
+    }
+    *out = buf; *cap_out = cap; *out_len = used;
+    return 0;
+}
+
+/* ===================== Entry points ===================== */
+
+int qm_compress_al(const qm_alloc_t *al, uint8_t alg, const uint8_t *in, size_t len,
+                   uint8_t *used, uint8_t **out, size_t *out_len) {
+    if (!used || !out || !out_len || (!in && len)) return -1;
+    *used = QM_COMP_NONE; *out = NULL; *out_len = 0;
+    if (alg == QM_COMP_AUTO) alg = QM_COMP_DEFLATE;
+    if (alg == QM_COMP_NONE) return 0;
+    if (!qm_compress_available(alg)) return -1;
+    if (!qm_compress_worthwhile(in, len)) return 0;
+
+    /* Worth keeping only when at least 1/16 smaller: output that does not
+       fit in that much room is dropped */
+    size_t cap = len - len / 16, n = 0;
+    uint8_t *buf = (uint8_t*)qm_alloc(al, cap, QM_ALLOC_SECRET);
+    if (!buf) return -1;
+
+    int rc;
+#ifdef QM_HAVE_ZSTD
+    if (alg == QM_COMP_ZSTD) {
+        n = ZSTD_compress(buf, cap, in, len, 3);
+        rc = !ZSTD_isError(n) ? 0 : ZSTD_getErrorCode(n) == ZSTD_error_dstSize_tooSmall ? 1 : -1;
+    } else
+#endif
+    rc = deflate_into(in, len, buf, cap, &n);
+
+    if (rc != 0) {
+        qm_release(al, buf, cap, QM_ALLOC_SECRET);
+        return rc < 0 ? -1 : 0;
+    }
+    uint8_t *fit = (uint8_t*)qm_resize(al, buf, cap, n, QM_ALLOC_SECRET);
+    if (!fit) { qm_release(al, buf, cap, QM_ALLOC_SECRET); return -1; }
+    *used = alg; *out = fit; *out_len = n;
+    return 0;
+}
+
+int qm_decompress_al(const qm_alloc_t *al, uint8_t alg, const uint8_t *in, size_t len,
+                     size_t max_out, uint8_t **out, size_t *out_len) {
+    if (!out || !out_len || (!in && len) || !qm_compress_available(alg) || alg == QM_COMP_NONE) return -1;
+    uint8_t *buf = NULL;
+    size_t cap = 0, n = 0;
+
+#ifdef QM_HAVE_ZSTD
+    if (alg == QM_COMP_ZSTD) {
+        unsigned long long size = ZSTD_getFrameContentSize(in, len);
+        if (size == ZSTD_CONTENTSIZE_ERROR || size == ZSTD_CONTENTSIZE_UNKNOWN || size > max_out) return -1;
+        cap = (size_t)size;
+        if (!(buf = (uint8_t*)qm_alloc(al, cap, QM_ALLOC_SECRET))) return -1;
+        n = ZSTD_decompress(buf, cap, in, len);
+        if (ZSTD_isError(n) || n != cap) { qm_release(al, buf, cap, QM_ALLOC_SECRET); return -1; }
+        *out = buf; *out_len = n;
+        return 0;
+    }
+#endif
+
+    if (inflate_al(al, in, len, max_out, &buf, &cap, &n) != 0) return -1;
+    uint8_t *fit = n == cap ? buf : (uint8_t*)qm_resize(al, buf, cap, n, QM_ALLOC_SECRET);
+    if (!fit) { qm_release(al, buf, cap, QM_ALLOC_SECRET); return -1; }
+    *out = fit; *out_len = n;
+    return 0;
+}
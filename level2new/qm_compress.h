@@ -0,0 +1,75 @@
+#ifndef QM_COMPRESS_H
+#define QM_COMPRESS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "qm_alloc.h"
+
+/*
+ * Optional compression in front of the encryption layers. Every OTP pad
+ * byte is KM key material, so compressing text before the pad is sized
+ * shrinks pad use and ciphertext alike; AES/PQC layers carry less too.
+ *
+ * The algorithm is recorded in the COMP record of the layer that carries
+ * the compressed plaintext (qm_envelope.h), or in the "compression" field
+ * of the JSON routes; absent means none.
+ *
+ * Algorithm ids (wire values, shared with qm_envelope.py / QuMailEnvelope):
+ *   1 deflate - zlib stream (RFC 1950: deflate + Adler-32)
+ *   2 zstd    - zstd frame; only builds with -DQM_HAVE_ZSTD -lzstd have it
+ *
+ * Build: add qm_compress.c and -lz (plus -DQM_HAVE_ZSTD -lzstd for zstd).
+ */
+
+#define QM_COMP_NONE     0
+#define QM_COMP_DEFLATE  1
+#define QM_COMP_ZSTD     2
+#define QM_COMP_AUTO     0xFF   /* request only: let qm_compress_al pick (deflate) */
+
+/* Below this the container overhead eats the gain. */
+#define QM_COMPRESS_MIN_LEN 64
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* 1 if this build can compress and decompress alg. */
+int         qm_compress_available(uint8_t alg);
+
+/* "none", "deflate", "zstd", "auto"; NULL for an unknown id. */
+const char *qm_compress_name(uint8_t alg);
+
+/* Inverse of qm_compress_name over n bytes of s; -1 if unknown. */
+int         qm_compress_from_name(const char *s, size_t n, uint8_t *alg);
+
+/*
+ * Cheap pre-check, a few KiB of work whatever len is: 0 for short input,
+ * known compressed or encrypted formats (gzip, zip/docx, zstd, xz, bzip2,
+ * 7z, rar, PNG, JPEG, GIF, WebP, MP4, Ogg, QE envelopes) and input whose
+ * sampled byte entropy says it will not shrink.
+ */
+int qm_compress_worthwhile(const uint8_t *data, size_t len);
+
+/*
+ * Compress in with alg (QM_COMP_AUTO or a specific id). *used is the id
+ * applied, or QM_COMP_NONE when the pre-check said no or the output would
+ * not be at least 1/16 smaller; then *out is NULL and the caller sends the
+ * input as is. The output is allocated from al (QM_ALLOC_SECRET) with
+ * exactly *out_len bytes. -1 on an unavailable alg or allocation failure.
+ */
+int qm_compress_al(const qm_alloc_t *al, uint8_t alg, const uint8_t *in, size_t len,
+                   uint8_t *used, uint8_t **out, size_t *out_len);
+
+/*
+ * Inverse. Output larger than max_out fails (a decompression bomb costs
+ * at most max_out bytes), as do corrupt input and trailing garbage. The
+ * output is allocated from al (QM_ALLOC_SECRET) with exactly *out_len bytes.
+ */
+int qm_decompress_al(const qm_alloc_t *al, uint8_t alg, const uint8_t *in, size_t len,
+                     size_t max_out, uint8_t **out, size_t *out_len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* QM_COMPRESS_H */
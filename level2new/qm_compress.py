@@ -0,0 +1,109 @@
+# qm_compress.py - optional compression in front of the encryption layers (see qm_compress.h)
+#
+# Every OTP pad byte is KM key material, so compressing text before the pad
+# is sized shrinks pad use and ciphertext alike. Ids are the wire values of
+# the envelope COMP record (qm_envelope.COMP_*); the JSON routes carry the
+# name in a "compression" field.
+#
+#   deflate - zlib stream (RFC 1950), always available
+#   zstd    - only when the zstandard module is installed
+
+import zlib
+from collections import Counter
+import qm_envelope
+
+try:
+    import zstandard
+except ImportError:
+    zstandard = None
+
+NONE, DEFLATE, ZSTD = qm_envelope.COMP_NONE, qm_envelope.COMP_DEFLATE, qm_envelope.COMP_ZSTD
+AUTO = 0xFF                     # request only: deflate
+NAMES = {"none": NONE, "deflate": DEFLATE, "zstd": ZSTD, "auto": AUTO}
+
+MIN_LEN = 64                    # below this the container overhead eats the gain
+_WINDOW = 1024
+
+# Formats that are already compressed or encrypted
+_MAGIC = (b"\x1f\x8b", b"PK\x03\x04", b"\x28\xb5\x2f\xfd", b"\xfd7zXZ\x00", b"BZh",
+          b"7z\xbc\xaf\x27\x1c", b"Rar!\x1a\x07", b"\x89PNG", b"\xff\xd8\xff", b"GIF8",
+          b"OggS", b"QE\x01", b"QE\x02")
+
+
+def available(alg):
+    return alg in (NONE, DEFLATE) or (alg == ZSTD and zstandard is not None)
+
+
+def name(alg):
+    for n, v in NAMES.items():
+        if v == alg:
+            return n
+    return None
+
+
+def from_name(s):
+    """Id for a request's "compression" value; ValueError if unknown or not built in."""
+    alg = NAMES.get(s)
+    if alg is None or (alg != AUTO and not available(alg)):
+        raise ValueError("unsupported compression %r" % (s,))
+    return alg
+
+
+def worthwhile(data):
+    """Cheap pre-check, same verdict as qm_compress_worthwhile()."""
+    data = memoryview(data).cast("B") if not isinstance(data, bytes) else data
+    n = len(data)
+    if n < MIN_LEN or bytes(data[:6]).startswith(_MAGIC):
+        return False
+    head = bytes(data[:12])
+    if (head[:4] == b"RIFF" and head[8:12] == b"WEBP") or head[4:8] == b"ftyp":
+        return False
+    if n <= 3 * _WINDOW:
+        sample = bytes(data)
+    else:
+        mid = n // 2 - _WINDOW // 2
+        sample = bytes(data[:_WINDOW]) + bytes(data[mid:mid + _WINDOW]) + bytes(data[n - _WINDOW:])
+    # Collision entropy above 7.5 bits/byte: sum c^2 * 2^7.5 < n^2
+    sum_sq = sum(c * c for c in Counter(sample).values())
+    return sum_sq * 181 >= len(sample) ** 2
+
+
+def compress(alg, data):
+    """(id used, payload): NONE and the input when skipped or not at least 1/16 smaller."""
+    if alg == AUTO:
+        alg = DEFLATE
+    if alg == NONE or not worthwhile(data):
+        return NONE, data
+    if alg == ZSTD:
+        out = zstandard.ZstdCompressor(level=3).compress(data)
+    elif alg == DEFLATE:
+        out = zlib.compress(data)
+    else:
+        raise ValueError("unsupported compression %d" % alg)
+    if len(out) > len(data) - len(data) // 16:
+        return NONE, data
+    return alg, out
+
+
+def decompress(alg, data, max_out):
+    """Inverse of compress(); ValueError past max_out bytes, on corrupt input or trailing data."""
+    if alg == NONE:
+        return data
+    if alg == DEFLATE:
+        d = zlib.decompressobj()
+        try:
+            out = d.decompress(data, max_out)
+        except zlib.error as e:
+            raise ValueError("decompression failed: %s" % e)
+        if d.unconsumed_tail or not d.eof or d.unused_data:
+            raise ValueError("decompression failed")
+        return out
+    if alg == ZSTD and zstandard is not None:
+        try:
+            out = zstandard.ZstdDecompressor().decompress(data, max_output_size=max_out)
+        except zstandard.ZstdError as e:
+            raise ValueError("decompression failed: %s" % e)
+        if len(out) > max_out:
+            raise ValueError("decompression failed")
+        return out
+    raise ValueError("unsupported compression %d" % alg)
@@ -0,0 +1,83 @@
+/*
+ * libqmcrypto: the C ABI in qm_crypto.h over the AES-GCM, OTP and SHA-256
+ * code the demo binaries use. Thin on purpose: every call maps onto one existing
+ * function, so the library and the servers cannot drift apart.
+ */
+#include "qm_crypto.h"
+#include "aes_gcm.h"
+#include "qm_secmem.h"
+#include "qm_sha256.h"
+#include "../level1/otp.h"
+
+/* The opaque handle is the secmem-resident expanded key itself. */
+struct qm_crypto_gcm_key { aes_key_t ks; };
+
+int qm_crypto_abi_version(void) { return QM_CRYPTO_ABI_VERSION; }
+
+qm_crypto_gcm_key_t *qm_crypto_gcm_key_new(const uint8_t *key, size_t key_len)
+{
+    if (!key) return NULL;
+    return (qm_crypto_gcm_key_t *)qm_secmem_key_new(key, key_len);
+}
+
+void qm_crypto_gcm_key_free(qm_crypto_gcm_key_t *k)
+{
+    if (k) qm_secmem_key_free(&k->ks);
+}
+
+int qm_crypto_gcm_seal(const qm_crypto_gcm_key_t *k,
+                       const uint8_t *iv, size_t iv_len,
+                       const uint8_t *aad, size_t aad_len,
+                       const uint8_t *pt, size_t len,
+                       uint8_t *ct, uint8_t tag[QM_CRYPTO_TAG_LEN])
+{
+    if (!k || !tag || (!aad && aad_len)) return -1;
+    return aes_gcm_encrypt_ks(&k->ks, iv, iv_len, aad, aad_len, pt, len, ct, tag);
+}
+
+int qm_crypto_gcm_open(const qm_crypto_gcm_key_t *k,
+                       const uint8_t *iv, size_t iv_len,
+                       const uint8_t *aad, size_t aad_len,
+                       const uint8_t *ct, size_t len,
+                       const uint8_t tag[QM_CRYPTO_TAG_LEN], uint8_t *pt)
+{
+    if (!k || !tag || (!aad && aad_len)) return -1;
+    return aes_gcm_decrypt_ks(&k->ks, iv, iv_len, aad, aad_len, ct, len, tag, pt);
+}
+
+void qm_crypto_otp_xor(uint8_t *out, const uint8_t *in, const uint8_t *pad, size_t len)
+{
+    if (len) otp_xor(out, in, pad, len);
+}
+
+void qm_crypto_sha256(const uint8_t *data, size_t len, uint8_t out[QM_CRYPTO_SHA256_LEN])
+{
+    qm_sha256(data, len, out);
+}
+
+void qm_crypto_sha256_many(const uint8_t *in, size_t len, size_t n, uint8_t *out)
+{
+    if (n) qm_sha256_many(in, len, n, out);
+}
+
+void qm_crypto_hmac_sha256(const uint8_t *key, size_t key_len,
+                           const uint8_t *msg, size_t len,
+                           uint8_t out[QM_CRYPTO_SHA256_LEN])
+{
+    qm_hmac_sha256(key, key_len, msg, len, out);
+}
+
+int qm_crypto_hkdf_sha256(const uint8_t *salt, size_t salt_len,
+                          const uint8_t *ikm, size_t ikm_len,
+                          const uint8_t *info, size_t info_len,
+                          uint8_t *out, size_t out_len)
+{
+    if (!ikm && ikm_len) return -1;
+    return qm_hkdf_sha256(salt, salt_len, ikm, ikm_len, info, info_len, out, out_len);
+}
+
+void qm_crypto_sha256_chain_expand(const uint8_t *seed, size_t seed_len,
+                                   uint8_t *out, size_t out_len)
+{
+    qm_sha256_chain_expand(seed, seed_len, out, out_len);
+}
@@ -0,0 +1,89 @@
+#ifndef QM_CRYPTO_H
+#define QM_CRYPTO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Stable C ABI of libqmcrypto, for in-process callers in other languages
+ * (the .NET backend P/Invokes it, see Services/NativeCrypto.cs).
+ *
+ * Only fixed-width and size_t arguments, opaque key handles and caller-owned
+ * buffers: nothing allocated here is handed back except the key handle, so
+ * no allocator has to match across the boundary. Expanded keys live in the
+ * locked secmem pool and are wiped by qm_crypto_gcm_key_free.
+ *
+ * Build (shared library):
+ *   gcc -O2 -shared -fPIC -o libqmcrypto.so qm_crypto.c aes_gcm.c aes.c aes_ct64.c aes_ni.c \
+ *       qm_sha256.c qm_stats.c qm_secmem.c -I. ../level1/otp_xor.c -lpthread
+ *   (Windows: ... -o qmcrypto.dll, no -fPIC/-lpthread)
+ */
+
+#define QM_CRYPTO_ABI_VERSION 2   /* 2: SHA-256 / HMAC / HKDF */
+#define QM_CRYPTO_TAG_LEN     16
+#define QM_CRYPTO_SHA256_LEN  32
+
+#if defined(_WIN32)
+#define QM_CRYPTO_API __declspec(dllexport)
+#else
+#define QM_CRYPTO_API __attribute__((visibility("default")))
+#endif
+
+typedef struct qm_crypto_gcm_key qm_crypto_gcm_key_t;   /* opaque */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* QM_CRYPTO_ABI_VERSION of the loaded library; callers check it before use. */
+QM_CRYPTO_API int qm_crypto_abi_version(void);
+
+/* Expanded AES key (16, 24 or 32 bytes) for any number of seal/open calls,
+   from any thread. NULL on a bad key length or no memory. */
+QM_CRYPTO_API qm_crypto_gcm_key_t *qm_crypto_gcm_key_new(const uint8_t *key, size_t key_len);
+QM_CRYPTO_API void                 qm_crypto_gcm_key_free(qm_crypto_gcm_key_t *k);   /* NULL is a no-op */
+
+/* AES-GCM, 128-bit tag. ct and pt are len bytes and may be the same buffer.
+   open writes pt only after the tag verifies. 0 on success, -1 on bad
+   arguments or (open) a tag mismatch. */
+QM_CRYPTO_API int qm_crypto_gcm_seal(const qm_crypto_gcm_key_t *k,
+                                     const uint8_t *iv, size_t iv_len,
+                                     const uint8_t *aad, size_t aad_len,
+                                     const uint8_t *pt, size_t len,
+                                     uint8_t *ct, uint8_t tag[QM_CRYPTO_TAG_LEN]);
+
+QM_CRYPTO_API int qm_crypto_gcm_open(const qm_crypto_gcm_key_t *k,
+                                     const uint8_t *iv, size_t iv_len,
+                                     const uint8_t *aad, size_t aad_len,
+                                     const uint8_t *ct, size_t len,
+                                     const uint8_t tag[QM_CRYPTO_TAG_LEN], uint8_t *pt);
+
+/* One-time pad: out[i] = in[i] ^ pad[i] for len bytes (out may alias in). */
+QM_CRYPTO_API void qm_crypto_otp_xor(uint8_t *out, const uint8_t *in, const uint8_t *pad, size_t len);
+
+/* SHA-256 on the fastest engine this CPU has (see qm_sha256.h). */
+QM_CRYPTO_API void qm_crypto_sha256(const uint8_t *data, size_t len, uint8_t out[QM_CRYPTO_SHA256_LEN]);
+
+/* n messages of len bytes packed back to back -> n digests, 32 bytes each. */
+QM_CRYPTO_API void qm_crypto_sha256_many(const uint8_t *in, size_t len, size_t n, uint8_t *out);
+
+QM_CRYPTO_API void qm_crypto_hmac_sha256(const uint8_t *key, size_t key_len,
+                                         const uint8_t *msg, size_t len,
+                                         uint8_t out[QM_CRYPTO_SHA256_LEN]);
+
+/* RFC 5869 extract-then-expand. Empty salt means 32 zero bytes. 0 on
+   success, -1 on out_len > 8160 or bad arguments. */
+QM_CRYPTO_API int qm_crypto_hkdf_sha256(const uint8_t *salt, size_t salt_len,
+                                        const uint8_t *ikm, size_t ikm_len,
+                                        const uint8_t *info, size_t info_len,
+                                        uint8_t *out, size_t out_len);
+
+/* The PQC layers' SHA-256 chain pad expansion (qm_sha256_chain_expand). */
+QM_CRYPTO_API void qm_crypto_sha256_chain_expand(const uint8_t *seed, size_t seed_len,
+                                                 uint8_t *out, size_t out_len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* QM_CRYPTO_H */
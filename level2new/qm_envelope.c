@@ -0,0 +1,257 @@
+#include "qm_envelope.h"
+#include "aes_gcm.h"
+#include "qm_secmem.h"
+#include <string.h>
+#include <stdlib.h>
+
+/* ---------- Helpers: LEB128 lengths ---------- */
+static size_t varint_size(uint64_t v) {
+    size_t n = 1;
+    while (v >= 0x80) { v >>= 7; n++; }
+    return n;
+}
+
+static uint8_t *varint_put(uint8_t *p, uint64_t v) {
+    while (v >= 0x80) { *p++ = (uint8_t)(v | 0x80); v >>= 7; }
+    *p++ = (uint8_t)v;
+    return p;
+}
+
+/* Reads a length from [*p, end); fails on truncation or more than 64 bits. */
+static int varint_get(const uint8_t **p, const uint8_t *end, uint64_t *v) {
+    uint64_t r = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        if (*p >= end) return -1;
+        uint8_t b = *(*p)++;
+        r |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) { *v = r; return 0; }
+    }
+    return -1;
+}
+
+/* ===================== Encode ===================== */
+
+/* Fields in wire order after the header (ALG, FLAGS, COMP, KEY_ID). */
+#define ENV_NFIELDS 5
+static void env_fields(const qm_envelope_t *e, uint8_t type[ENV_NFIELDS],
+                       const uint8_t *val[ENV_NFIELDS], size_t len[ENV_NFIELDS])
+{
+    type[0] = QM_ENV_T_IV;         val[0] = e->iv;     len[0] = e->iv_len;
+    type[1] = QM_ENV_T_AAD;        val[1] = e->aad;    len[1] = e->aad_len;
+    type[2] = QM_ENV_T_KEM_CT;     val[2] = e->kem_ct; len[2] = e->kem_ct_len;
+    type[3] = QM_ENV_T_CIPHERTEXT; val[3] = e->ct;     len[3] = e->ct_len;
+    type[4] = QM_ENV_T_TAG;        val[4] = e->tag;    len[4] = e->tag_len;
+}
+
+/* Optional fields are written only when non-empty, as qm_envelope.py and
+   QuMailEnvelope.cs do; the ciphertext always is, even when empty. */
+static int field_present(uint8_t type, size_t len) {
+    return type == QM_ENV_T_CIPHERTEXT || len != 0;
+}
+
+static uint8_t env_version(const qm_envelope_t *e) {
+    return e->version ? e->version : QM_ENV_VERSION;
+}
+
+/* Magic, version and the ALG, FLAGS, COMP and KEY_ID records: the part of
+   a version 2 envelope its GCM tag covers. */
+static size_t header_size(const qm_envelope_t *e) {
+    size_t n = QM_ENV_HEADER_SIZE + 3;            /* ALG record */
+    if (e->flags) n += 3;                         /* FLAGS record */
+    if (e->comp) n += 3;                          /* COMP record */
+    if (e->key_id_len) n += 1 + varint_size(e->key_id_len) + e->key_id_len;
+    return n;
+}
+
+static uint8_t *header_put(const qm_envelope_t *e, uint8_t *p) {
+    *p++ = QM_ENV_MAGIC0; *p++ = QM_ENV_MAGIC1; *p++ = env_version(e);
+    *p++ = QM_ENV_T_ALG; *p++ = 1; *p++ = e->alg;
+    if (e->flags) { *p++ = QM_ENV_T_FLAGS; *p++ = 1; *p++ = e->flags; }
+    if (e->comp)  { *p++ = QM_ENV_T_COMP;  *p++ = 1; *p++ = e->comp; }
+    if (e->key_id_len) {
+        *p++ = QM_ENV_T_KEY_ID;
+        p = varint_put(p, e->key_id_len);
+        if (e->key_id) memmove(p, e->key_id, e->key_id_len);
+        p += e->key_id_len;
+    }
+    return p;
+}
+
+size_t qm_envelope_size(const qm_envelope_t *e) {
+    uint8_t type[ENV_NFIELDS]; const uint8_t *val[ENV_NFIELDS]; size_t len[ENV_NFIELDS];
+    env_fields(e, type, val, len);
+
+    size_t n = header_size(e);
+    for (int i = 0; i < ENV_NFIELDS; ++i)
+        if (field_present(type[i], len[i]))
+            n += 1 + varint_size(len[i]) + len[i];
+    return n;
+}
+
+int qm_envelope_write(const qm_envelope_t *e, uint8_t *out, size_t cap, size_t *out_len) {
+    if (!e || !out || e->alg == 0) return -1;
+    if (env_version(e) != QM_ENV_VERSION && env_version(e) != QM_ENV_VERSION_1) return -1;
+    size_t need = qm_envelope_size(e);
+    if (cap < need) return -1;
+
+    uint8_t type[ENV_NFIELDS]; const uint8_t *val[ENV_NFIELDS]; size_t len[ENV_NFIELDS];
+    env_fields(e, type, val, len);
+
+    uint8_t *p = header_put(e, out);
+    for (int i = 0; i < ENV_NFIELDS; ++i) {
+        if (!field_present(type[i], len[i])) continue;
+        *p++ = type[i];
+        p = varint_put(p, len[i]);
+        if (val[i] && len[i]) memmove(p, val[i], len[i]);   /* val may point into out */
+        p += len[i];
+    }
+    if (out_len) *out_len = (size_t)(p - out);
+    return 0;
+}
+
+size_t qm_envelope_auth_size(const qm_envelope_t *e) {
+    return (env_version(e) == QM_ENV_VERSION_1 ? 0 : header_size(e)) + e->aad_len;
+}
+
+int qm_envelope_auth_data(const qm_envelope_t *e, uint8_t *out, size_t cap, size_t *out_len) {
+    if (!e || (!out && cap) || cap < qm_envelope_auth_size(e)) return -1;
+    uint8_t *p = env_version(e) == QM_ENV_VERSION_1 ? out : header_put(e, out);
+    if (e->aad_len) memcpy(p, e->aad, e->aad_len);
+    if (out_len) *out_len = (size_t)(p - out) + e->aad_len;
+    return 0;
+}
+
+int qm_envelope_encode_al(const qm_alloc_t *al, const qm_envelope_t *e, uint8_t **out, size_t *out_len) {
+    if (!e || !out) return -1;
+    size_t n = qm_envelope_size(e);
+    *out = (uint8_t*)qm_alloc(al, n, 0);
+    if (!*out) return -1;
+    if (qm_envelope_write(e, *out, n, out_len) != 0) { qm_release(al, *out, n, 0); *out = NULL; return -1; }
+    return 0;
+}
+
+int qm_envelope_encode(const qm_envelope_t *e, uint8_t **out, size_t *out_len) {
+    return qm_envelope_encode_al(NULL, e, out, out_len);
+}
+
+/* ===================== Parse ===================== */
+
+int qm_envelope_parse(const uint8_t *buf, size_t len, qm_envelope_t *e) {
+    if (!buf || !e) return -1;
+    memset(e, 0, sizeof(*e));
+    if (len < QM_ENV_HEADER_SIZE || buf[0] != QM_ENV_MAGIC0 || buf[1] != QM_ENV_MAGIC1 ||
+        (buf[2] != QM_ENV_VERSION && buf[2] != QM_ENV_VERSION_1)) return -1;
+    e->version = buf[2];
+
+    const uint8_t *p = buf + QM_ENV_HEADER_SIZE, *end = buf + len;
+    unsigned seen = 0;                            /* bit per mandatory type */
+    while (p < end) {
+        uint8_t type = *p++;
+        uint64_t n;
+        if (varint_get(&p, end, &n) != 0 || n > (uint64_t)(end - p)) return -1;
+        const uint8_t *v = p;
+        p += n;
+
+        if (type >= QM_ENV_T_EXT_MIN) continue;
+        if (type == 0 || type > QM_ENV_T_COMP || (seen & (1u << type))) return -1;
+        seen |= 1u << type;
+
+        switch (type) {
+        case QM_ENV_T_ALG:        if (n != 1) return -1; e->alg = v[0]; break;
+        case QM_ENV_T_FLAGS:      if (n != 1) return -1; e->flags = v[0]; break;
+        case QM_ENV_T_KEY_ID:     e->key_id = v; e->key_id_len = (size_t)n; break;
+        case QM_ENV_T_IV:         e->iv = v;     e->iv_len = (size_t)n; break;
+        case QM_ENV_T_AAD:        e->aad = v;    e->aad_len = (size_t)n; break;
+        case QM_ENV_T_KEM_CT:     e->kem_ct = v; e->kem_ct_len = (size_t)n; break;
+        case QM_ENV_T_CIPHERTEXT: e->ct = v;     e->ct_len = (size_t)n; break;
+        case QM_ENV_T_TAG:        e->tag = v;    e->tag_len = (size_t)n; break;
+        case QM_ENV_T_COMP:       if (n != 1) return -1; e->comp = v[0]; break;
+        }
+    }
+    if (!(seen & (1u << QM_ENV_T_ALG)) || !(seen & (1u << QM_ENV_T_CIPHERTEXT)) || e->alg == 0)
+        return -1;
+    return 0;
+}
+
+/* ===================== AES-GCM layer ===================== */
+
+int qm_envelope_gcm_seal_al(const qm_alloc_t *al,
+                            const uint8_t *key, size_t key_len, const char *key_id,
+                            const uint8_t *iv, size_t iv_len,
+                            const uint8_t *aad, size_t aad_len,
+                            const uint8_t *pt, size_t pt_len, uint8_t flags,
+                            uint8_t **out, size_t *out_len)
+{
+    if (!out || !out_len || !iv || iv_len == 0 || (!pt && pt_len)) return -1;
+
+    aes_key_t *ks = qm_secmem_key_new(key, key_len);
+    if (!ks) return -1;
+
+    /* Reserve ciphertext and tag, then encrypt straight into their slots */
+    qm_envelope_t e;
+    memset(&e, 0, sizeof(e));
+    e.alg = QM_ALG_AES_GCM;
+    e.flags = flags;
+    e.key_id = (const uint8_t*)key_id; e.key_id_len = key_id ? strlen(key_id) : 0;
+    e.iv = iv;   e.iv_len = iv_len;
+    e.aad = aad; e.aad_len = aad ? aad_len : 0;
+    e.ct_len = pt_len;
+    e.tag_len = 16;
+
+    int rc = -1;
+    size_t auth_len = qm_envelope_auth_size(&e);
+    uint8_t *auth = (uint8_t*)qm_alloc(al, auth_len, 0);
+    if (auth && qm_envelope_auth_data(&e, auth, auth_len, NULL) == 0 &&
+        qm_envelope_encode_al(al, &e, out, out_len) == 0) {
+        qm_envelope_t slots;
+        if (qm_envelope_parse(*out, *out_len, &slots) == 0 &&
+            aes_gcm_encrypt_ks(ks, iv, iv_len, auth, auth_len, pt, pt_len,
+                               (uint8_t*)slots.ct, (uint8_t*)slots.tag) == 0)
+            rc = 0;
+        else { qm_release(al, *out, *out_len, 0); *out = NULL; *out_len = 0; }
+    }
+    qm_release(al, auth, auth_len, 0);
+    qm_secmem_key_free(ks);
+    return rc;
+}
+
+int qm_envelope_gcm_seal(const uint8_t *key, size_t key_len, const char *key_id,
+                         const uint8_t *iv, size_t iv_len,
+                         const uint8_t *aad, size_t aad_len,
+                         const uint8_t *pt, size_t pt_len, uint8_t flags,
+                         uint8_t **out, size_t *out_len)
+{
+    return qm_envelope_gcm_seal_al(NULL, key, key_len, key_id, iv, iv_len, aad, aad_len,
+                                   pt, pt_len, flags, out, out_len);
+}
+
+int qm_envelope_gcm_open_al(const qm_alloc_t *al, const uint8_t *key, size_t key_len,
+                            const uint8_t *env, size_t env_len,
+                            uint8_t **pt, size_t *pt_len, qm_envelope_t *e)
+{
+    qm_envelope_t v;
+    if (!pt || !pt_len || qm_envelope_parse(env, env_len, &v) != 0) return -1;
+    if ((v.alg != QM_ALG_AES_GCM && v.alg != QM_ALG_PQC_HYBRID) || v.tag_len != 16 || v.iv_len == 0) return -1;
+
+    size_t auth_len = qm_envelope_auth_size(&v);
+    uint8_t *auth = (uint8_t*)qm_alloc(al, auth_len, 0);
+    if (!auth || qm_envelope_auth_data(&v, auth, auth_len, NULL) != 0) { qm_release(al, auth, auth_len, 0); return -1; }
+
+    aes_key_t *ks = qm_secmem_key_new(key, key_len);
+    *pt = ks ? (uint8_t*)qm_alloc(al, v.ct_len, QM_ALLOC_SECRET) : NULL;
+    int rc = *pt ? aes_gcm_decrypt_ks(ks, v.iv, v.iv_len, auth, auth_len, v.ct, v.ct_len, v.tag, *pt) : -1;
+    qm_secmem_key_free(ks);
+    qm_release(al, auth, auth_len, 0);
+    if (rc != 0) { qm_release(al, *pt, v.ct_len, QM_ALLOC_SECRET); *pt = NULL; return -1; }
+
+    *pt_len = v.ct_len;
+    if (e) *e = v;
+    return 0;
+}
+
+int qm_envelope_gcm_open(const uint8_t *key, size_t key_len,
+                         const uint8_t *env, size_t env_len,
+                         uint8_t **pt, size_t *pt_len, qm_envelope_t *e)
+{
+    return qm_envelope_gcm_open_al(NULL, key, key_len, env, env_len, pt, pt_len, e);
+}
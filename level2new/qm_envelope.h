@@ -0,0 +1,137 @@
+#ifndef QM_ENVELOPE_H
+#define QM_ENVELOPE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "qm_alloc.h"
+
+/*
+ * Binary envelope shared by every encryption layer ("QE", version 2).
+ *
+ *   0  magic "QE"
+ *   2  version (2; readers still accept 1)
+ *   3  records until the end: type (1 byte) | length (LEB128) | value
+ *
+ * Records (each at most once; the writer emits them in this order, with
+ * COMP right after FLAGS):
+ *   0x01 ALG         1 byte, QM_ALG_*            (required)
+ *   0x02 FLAGS       1 byte, QM_ENV_F_*
+ *   0x03 KEY_ID      KM key id (UTF-8)
+ *   0x04 IV
+ *   0x05 AAD         authenticated, not encrypted
+ *   0x06 KEM_CT      encapsulated key of a PQC layer
+ *   0x07 CIPHERTEXT                              (required)
+ *   0x08 TAG
+ *   0x09 COMP        1 byte, QM_COMP_* (qm_compress.h) the plaintext was
+ *                    compressed with before this layer sealed it
+ * Types 0x80-0xFF are extensions a reader may skip; an unknown type below
+ * 0x80 fails the parse.
+ *
+ * An AES-GCM or PQC layer authenticates its header as well as its AAD. In
+ * version 2 the GCM additional data is the serialized header - magic,
+ * version and the ALG, FLAGS, COMP and KEY_ID records exactly as the writer
+ * lays them out - followed by the AAD value, so a flipped COMP or swapped
+ * KEY_ID fails the tag. Version 1 authenticated the AAD value alone.
+ *
+ * Layers nest by encrypting a whole inner envelope as the next layer's
+ * plaintext (QM_ENV_F_INNER marks this), so each layer adds a few dozen
+ * bytes instead of re-encoding the previous layer as hex or base64 text.
+ */
+
+#define QM_ENV_MAGIC0        'Q'
+#define QM_ENV_MAGIC1        'E'
+#define QM_ENV_VERSION       2
+#define QM_ENV_VERSION_1     1    /* AAD record only under the tag */
+#define QM_ENV_HEADER_SIZE   3
+
+#define QM_ENV_T_ALG         0x01
+#define QM_ENV_T_FLAGS       0x02
+#define QM_ENV_T_KEY_ID      0x03
+#define QM_ENV_T_IV          0x04
+#define QM_ENV_T_AAD         0x05
+#define QM_ENV_T_KEM_CT      0x06
+#define QM_ENV_T_CIPHERTEXT  0x07
+#define QM_ENV_T_TAG         0x08
+#define QM_ENV_T_COMP        0x09
+#define QM_ENV_T_EXT_MIN     0x80
+
+#define QM_ALG_AES_GCM       1    /* ct || 16-byte tag in TAG */
+#define QM_ALG_OTP_XOR       2    /* ct = pt ^ key, no tag */
+#define QM_ALG_AES_GCM_QMC1  3    /* ct is a QMC1 container (aes_gcm_chunked.h) */
+#define QM_ALG_PQC_HYBRID    4    /* Kyber KEM_CT + AES-GCM */
+
+#define QM_ENV_F_INNER       0x01 /* plaintext is itself an envelope */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Parsed view; pointers refer into the buffer that was parsed. Absent
+   fields are NULL with length 0. */
+typedef struct {
+    uint8_t        version; /* 0 writes QM_ENV_VERSION */
+    uint8_t        alg;
+    uint8_t        flags;
+    uint8_t        comp;    /* QM_COMP_*, 0 = none */
+    const uint8_t *key_id;  size_t key_id_len;
+    const uint8_t *iv;      size_t iv_len;
+    const uint8_t *aad;     size_t aad_len;
+    const uint8_t *kem_ct;  size_t kem_ct_len;
+    const uint8_t *ct;      size_t ct_len;
+    const uint8_t *tag;     size_t tag_len;
+} qm_envelope_t;
+
+/* Serialized size of e. */
+size_t qm_envelope_size(const qm_envelope_t *e);
+
+/* Serialize e into out (cap >= qm_envelope_size(e)). A field with a NULL
+   pointer and non-zero length is reserved but left unwritten, so a caller
+   can fill ciphertext and tag in place afterwards. */
+int qm_envelope_write(const qm_envelope_t *e, uint8_t *out, size_t cap, size_t *out_len);
+
+/* Same, into a malloc'd buffer. */
+int qm_envelope_encode(const qm_envelope_t *e, uint8_t **out, size_t *out_len);
+
+/* GCM additional data for e's layer (see above) and its size. */
+size_t qm_envelope_auth_size(const qm_envelope_t *e);
+int qm_envelope_auth_data(const qm_envelope_t *e, uint8_t *out, size_t cap, size_t *out_len);
+
+/* Zero-copy parse. Returns -1 on bad magic, version, truncation, duplicate
+   or unknown mandatory records, or a missing ALG/CIPHERTEXT. */
+int qm_envelope_parse(const uint8_t *buf, size_t len, qm_envelope_t *e);
+
+/* AES-GCM layer straight into an envelope: the ciphertext and tag are
+   written into the output buffer, no intermediate copies. key_id may be
+   NULL. flags is typically 0 or QM_ENV_F_INNER. */
+int qm_envelope_gcm_seal(const uint8_t *key, size_t key_len, const char *key_id,
+                         const uint8_t *iv, size_t iv_len,
+                         const uint8_t *aad, size_t aad_len,
+                         const uint8_t *pt, size_t pt_len, uint8_t flags,
+                         uint8_t **out, size_t *out_len);
+
+/* Open an AES-GCM envelope, or a PQC-hybrid one given the key the caller
+   decapsulated from its KEM_CT. pt is malloc'd; e (optional) receives the
+   parsed header so the caller can check flags, comp (pt is then still
+   compressed) or key_id. Returns -1 on a
+   parse error, wrong algorithm or authentication failure. */
+int qm_envelope_gcm_open(const uint8_t *key, size_t key_len,
+                         const uint8_t *env, size_t env_len,
+                         uint8_t **pt, size_t *pt_len, qm_envelope_t *e);
+
+/* Same, with outputs from al (NULL = malloc); see qm_alloc.h. */
+int qm_envelope_encode_al(const qm_alloc_t *al, const qm_envelope_t *e, uint8_t **out, size_t *out_len);
+int qm_envelope_gcm_seal_al(const qm_alloc_t *al,
+                            const uint8_t *key, size_t key_len, const char *key_id,
+                            const uint8_t *iv, size_t iv_len,
+                            const uint8_t *aad, size_t aad_len,
+                            const uint8_t *pt, size_t pt_len, uint8_t flags,
+                            uint8_t **out, size_t *out_len);
+int qm_envelope_gcm_open_al(const qm_alloc_t *al, const uint8_t *key, size_t key_len,
+                            const uint8_t *env, size_t env_len,
+                            uint8_t **pt, size_t *pt_len, qm_envelope_t *e);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* QM_ENVELOPE_H */
@@ -0,0 +1,128 @@
+# qm_envelope.py - binary "QE" envelope shared by the relays (see qm_envelope.h)
+#
+#   "QE" | version 2 | records: type (1 byte) | length (LEB128) | value
+#
+# Version 2 GCM layers authenticate the header (magic, version, ALG, FLAGS,
+# COMP and KEY_ID records) ahead of the AAD value; version 1, still read,
+# authenticated the AAD alone.
+#
+# Layers nest by encrypting a whole inner envelope (FLAG_INNER), so each
+# layer adds a constant few dozen bytes instead of re-encoding the previous
+# layer as hex or base64 text.
+
+MAGIC = b"QE"
+VERSION = 2
+VERSION_1 = 1
+
+T_ALG, T_FLAGS, T_KEY_ID, T_IV, T_AAD, T_KEM_CT, T_CIPHERTEXT, T_TAG, T_COMP = range(1, 10)
+T_EXT_MIN = 0x80
+
+ALG_AES_GCM = 1
+ALG_OTP_XOR = 2
+ALG_AES_GCM_QMC1 = 3
+ALG_PQC_HYBRID = 4
+
+FLAG_INNER = 0x01
+
+# T_COMP: what the plaintext was compressed with before this layer (qm_compress.py)
+COMP_NONE = 0
+COMP_DEFLATE = 1
+COMP_ZSTD = 2
+
+CONTENT_TYPE = "application/vnd.qumail.envelope"
+
+# field name -> record type, in wire order
+_FIELDS = (("key_id", T_KEY_ID), ("iv", T_IV), ("aad", T_AAD),
+           ("kem_ct", T_KEM_CT), ("ciphertext", T_CIPHERTEXT), ("tag", T_TAG))
+
+
+def _varint(n):
+    out = bytearray()
+    while n >= 0x80:
+        out.append((n & 0x7f) | 0x80)
+        n >>= 7
+    out.append(n)
+    return bytes(out)
+
+
+def encode(alg, ciphertext, key_id=None, iv=b"", aad=b"", tag=b"", kem_ct=b"", flags=0, comp=COMP_NONE):
+    """Serialize one layer. key_id may be str or bytes; empty fields are omitted."""
+    if isinstance(key_id, str):
+        key_id = key_id.encode("utf-8")
+    vals = {"key_id": key_id or b"", "iv": iv, "aad": aad, "kem_ct": kem_ct,
+            "ciphertext": ciphertext, "tag": tag}
+    parts = [MAGIC, bytes((VERSION, T_ALG, 1, alg))]
+    if flags:
+        parts.append(bytes((T_FLAGS, 1, flags)))
+    if comp:
+        parts.append(bytes((T_COMP, 1, comp)))
+    for name, t in _FIELDS:
+        v = vals[name]
+        if v or t == T_CIPHERTEXT:
+            parts += [bytes((t,)), _varint(len(v)), v]
+    return b"".join(parts)
+
+
+def size(ct_len, key_id=None, iv_len=0, aad_len=0, kem_ct_len=0, tag_len=0, flags=0, comp=COMP_NONE):
+    """Serialized size of encode() with fields of these lengths (qm_envelope_size)."""
+    if isinstance(key_id, str):
+        key_id = key_id.encode("utf-8")
+    n = len(MAGIC) + 1 + 3 + (3 if flags else 0) + (3 if comp else 0)
+    for v in (len(key_id or b""), iv_len, aad_len, kem_ct_len, tag_len):
+        if v:
+            n += 1 + len(_varint(v)) + v
+    return n + 1 + len(_varint(ct_len)) + ct_len
+
+
+def parse(buf):
+    """
+    Parse one layer into a dict (version, alg, flags, comp, key_id as str, iv, aad,
+    kem_ct, ciphertext, tag; values are memoryview slices of buf). Raises ValueError
+    on anything qm_envelope_parse() would reject.
+    """
+    mv = memoryview(buf)
+    if len(mv) < 3 or bytes(mv[:2]) != MAGIC or mv[2] not in (VERSION, VERSION_1):
+        raise ValueError("not a QE envelope")
+    out = {"version": mv[2], "alg": 0, "flags": 0, "comp": COMP_NONE, "key_id": None, "iv": b"", "aad": b"",
+           "kem_ct": b"", "ciphertext": None, "tag": b""}
+    names = {t: name for name, t in _FIELDS}
+    seen = set()
+    p, end = 3, len(mv)
+    while p < end:
+        t = mv[p]; p += 1
+        n = shift = 0
+        while True:
+            if p >= end or shift >= 64:
+                raise ValueError("truncated length")
+            b = mv[p]; p += 1
+            n |= (b & 0x7f) << shift
+            shift += 7
+            if not b & 0x80:
+                break
+        if n > end - p:
+            raise ValueError("truncated record")
+        v = mv[p:p + n]; p += n
+        if t >= T_EXT_MIN:
+            continue
+        if t == 0 or t > T_COMP or t in seen:
+            raise ValueError("bad record type %d" % t)
+        seen.add(t)
+        if t in (T_ALG, T_FLAGS, T_COMP):
+            if n != 1:
+                raise ValueError("bad record length")
+            out[{T_ALG: "alg", T_FLAGS: "flags", T_COMP: "comp"}[t]] = v[0]
+        elif t == T_KEY_ID:
+            out["key_id"] = bytes(v).decode("utf-8")
+        else:
+            out[names[t]] = v
+    if not out["alg"] or out["ciphertext"] is None:
+        raise ValueError("missing alg or ciphertext")
+    return out
+
+
+def is_envelope(buf):
+    try:
+        parse(buf)
+        return True
+    except ValueError:
+        return False
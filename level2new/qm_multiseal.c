@@ -0,0 +1,185 @@
+#include "qm_multiseal.h"
+#include "qm_envelope.h"
+#include "aes_gcm.h"
+#include "qm_secmem.h"
+#include <string.h>
+#include <stdlib.h>
+
+/* Plaintext is swept through all layers this many bytes at a time, so each
+   chunk stays in L1/L2 between the PQC, GCM and OTP passes. */
+#define MS_CHUNK (16u * 1024u)
+
+/* ---------- Helpers: layer headers ---------- */
+static size_t id_len(const char *id) { return id ? strlen(id) : 0; }
+
+/* Header descriptions with ciphertext and tag reserved (NULL, non-zero
+   length) so qm_envelope_write leaves their slots for the sweep. */
+static void pqc_layer(const qm_multiseal_t *m, size_t pt_len, qm_envelope_t *e) {
+    memset(e, 0, sizeof(*e));
+    e->alg = QM_ALG_PQC_HYBRID;
+    e->comp = m->comp;
+    e->key_id = (const uint8_t*)m->pqc_key_id; e->key_id_len = id_len(m->pqc_key_id);
+    e->iv = m->pqc_iv;         e->iv_len = m->pqc_iv_len;
+    e->kem_ct = m->kem_ct;     e->kem_ct_len = m->kem_ct ? m->kem_ct_len : 0;
+    e->ct_len = pt_len;
+    e->tag_len = 16;
+}
+
+static void gcm_layer(const qm_multiseal_t *m, size_t inner_len, qm_envelope_t *e) {
+    memset(e, 0, sizeof(*e));
+    e->alg = QM_ALG_AES_GCM;
+    e->flags = m->pqc_key ? QM_ENV_F_INNER : 0;
+    e->comp = m->pqc_key ? 0 : m->comp;
+    e->key_id = (const uint8_t*)m->gcm_key_id; e->key_id_len = id_len(m->gcm_key_id);
+    e->iv = m->gcm_iv;         e->iv_len = m->gcm_iv_len;
+    e->aad = m->aad;           e->aad_len = m->aad ? m->aad_len : 0;
+    e->ct_len = inner_len;
+    e->tag_len = 16;
+}
+
+static void otp_layer(const qm_multiseal_t *m, size_t inner_len, qm_envelope_t *e) {
+    memset(e, 0, sizeof(*e));
+    e->alg = QM_ALG_OTP_XOR;
+    e->flags = QM_ENV_F_INNER;
+    e->key_id = (const uint8_t*)m->otp_key_id; e->key_id_len = id_len(m->otp_key_id);
+    e->ct_len = inner_len;
+}
+
+static size_t pqc_size(const qm_multiseal_t *m, size_t pt_len) {
+    if (!m->pqc_key) return pt_len;
+    qm_envelope_t e; pqc_layer(m, pt_len, &e);
+    return qm_envelope_size(&e);
+}
+
+/* ===================== Sizes ===================== */
+
+size_t qm_multiseal_pad_len(const qm_multiseal_t *m, size_t pt_len) {
+    qm_envelope_t e; gcm_layer(m, pqc_size(m, pt_len), &e);
+    return qm_envelope_size(&e);
+}
+
+size_t qm_multiseal_size(const qm_multiseal_t *m, size_t pt_len) {
+    size_t n = qm_multiseal_pad_len(m, pt_len);
+    if (!m->otp_pad) return n;
+    qm_envelope_t e; otp_layer(m, n, &e);
+    return qm_envelope_size(&e);
+}
+
+/* ===================== Seal ===================== */
+
+/* Key schedules and GCM states: one locked slot per message */
+typedef struct {
+    aes_key_t ks_pqc, ks_gcm;
+    aes_gcm_ctx_t pqc, gcm;
+    const uint8_t *pad;           /* NULL without an OTP layer */
+    const uint8_t *pad_base;      /* output byte that pad[0] covers */
+} ms_run_t;
+
+/* GCM state for a laid-out layer; its header and AAD are absorbed here. */
+static int ms_gcm_init(aes_gcm_ctx_t *c, const aes_key_t *ks, const qm_envelope_t *e) {
+    size_t n = qm_envelope_auth_size(e);
+    uint8_t *auth = (uint8_t*)malloc(n ? n : 1);
+    int rc = auth && qm_envelope_auth_data(e, auth, n, NULL) == 0 ? aes_gcm_enc_init(c, ks, e->iv, e->iv_len, auth, n) : -1;
+    free(auth);
+    return rc;
+}
+
+/* Bytes in [p, p+n) are final for the GCM layer: apply the pad. */
+static void ms_otp(ms_run_t *r, uint8_t *p, size_t n) {
+    if (!r->pad) return;
+    const uint8_t *k = r->pad + (p - r->pad_base);
+    for (size_t i = 0; i < n; ++i) p[i] ^= k[i];
+}
+
+/* Bytes in [p, p+n) are final for the PQC layer: outer GCM in place, then the pad. */
+static void ms_outer(ms_run_t *r, uint8_t *p, size_t n) {
+    aes_gcm_enc_update(&r->gcm, p, n, p);
+    ms_otp(r, p, n);
+}
+
+int qm_multiseal_al(const qm_alloc_t *al, const qm_multiseal_t *m, const uint8_t *pt, size_t pt_len,
+                    uint8_t **out, size_t *out_len)
+{
+    if (!m || !out || !out_len || (!pt && pt_len)) return -1;
+    if (!m->gcm_key || !m->gcm_iv || m->gcm_iv_len == 0) return -1;
+    if (m->pqc_key && (!m->pqc_iv || m->pqc_iv_len == 0)) return -1;
+
+    size_t inner_len = pqc_size(m, pt_len);
+    size_t gcm_len = qm_multiseal_pad_len(m, pt_len);
+    size_t total = qm_multiseal_size(m, pt_len);
+    if (m->otp_pad && m->otp_pad_len < gcm_len) return -1;
+
+    ms_run_t *r = (ms_run_t*)qm_secmem_alloc(sizeof(*r));
+    if (!r) return -1;
+    uint8_t *buf = NULL;
+    int rc = -1;
+    if (aes_key_init(&r->ks_gcm, m->gcm_key, m->gcm_key_len) != 0) goto done;
+    if (m->pqc_key && aes_key_init(&r->ks_pqc, m->pqc_key, m->pqc_key_len) != 0) goto done;
+
+    buf = (uint8_t*)qm_alloc(al, total, 0);
+    if (!buf) goto done;
+
+    /* Lay out the headers outermost first; each inner envelope is written
+       into the reserved ciphertext slot of the one around it. */
+    qm_envelope_t e, otp, gcm, pqc;
+    uint8_t *gcm_env = buf;
+    if (m->otp_pad) {
+        otp_layer(m, gcm_len, &e);
+        if (qm_envelope_write(&e, buf, total, NULL) != 0 || qm_envelope_parse(buf, total, &otp) != 0) goto done;
+        gcm_env = (uint8_t*)otp.ct;
+        r->pad = m->otp_pad;
+        r->pad_base = gcm_env;
+    }
+    gcm_layer(m, inner_len, &e);
+    if (qm_envelope_write(&e, gcm_env, gcm_len, NULL) != 0 || qm_envelope_parse(gcm_env, gcm_len, &gcm) != 0) goto done;
+    uint8_t *inner = (uint8_t*)gcm.ct, *gcm_tag = (uint8_t*)gcm.tag;
+    uint8_t *ct = inner, *pqc_tag = NULL;
+    if (m->pqc_key) {
+        pqc_layer(m, pt_len, &e);
+        if (qm_envelope_write(&e, inner, inner_len, NULL) != 0 || qm_envelope_parse(inner, inner_len, &pqc) != 0) goto done;
+        ct = (uint8_t*)pqc.ct;
+        pqc_tag = (uint8_t*)pqc.tag;
+    }
+
+    if (ms_gcm_init(&r->gcm, &r->ks_gcm, &gcm) != 0) goto done;
+    if (m->pqc_key && ms_gcm_init(&r->pqc, &r->ks_pqc, &pqc) != 0) goto done;
+
+    /* Plain GCM header under the pad, PQC header under GCM and the pad */
+    ms_otp(r, gcm_env, (size_t)(inner - gcm_env));
+    if (m->pqc_key) ms_outer(r, inner, (size_t)(ct - inner));
+
+    for (size_t off = 0; off < pt_len; off += MS_CHUNK) {
+        size_t n = pt_len - off < MS_CHUNK ? pt_len - off : MS_CHUNK;
+        if (m->pqc_key) {
+            aes_gcm_enc_update(&r->pqc, pt + off, n, ct + off);
+            ms_outer(r, ct + off, n);
+        } else {
+            aes_gcm_enc_update(&r->gcm, pt + off, n, ct + off);
+            ms_otp(r, ct + off, n);
+        }
+    }
+
+    /* Trailers: PQC tag record through GCM and the pad, then the GCM tag record */
+    if (m->pqc_key) {
+        aes_gcm_enc_final(&r->pqc, pqc_tag);
+        ms_outer(r, ct + pt_len, (size_t)(inner + inner_len - (ct + pt_len)));
+    }
+    aes_gcm_enc_final(&r->gcm, gcm_tag);
+    ms_otp(r, inner + inner_len, (size_t)(gcm_env + gcm_len - (inner + inner_len)));
+
+    *out = buf;
+    *out_len = total;
+    buf = NULL;
+    rc = 0;
+
+done:
+    qm_release(al, buf, total, 0);
+    qm_secmem_free(r, sizeof(*r));
+    return rc;
+}
+
+int qm_multiseal(const qm_multiseal_t *m, const uint8_t *pt, size_t pt_len,
+                 uint8_t **out, size_t *out_len)
+{
+    return qm_multiseal_al(NULL, m, pt, pt_len, out, out_len);
+}
@@ -0,0 +1,72 @@
+#ifndef QM_MULTISEAL_H
+#define QM_MULTISEAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "qm_alloc.h"
+
+/*
+ * One-pass layered seal: PQC-hybrid AES-GCM, KM AES-GCM and OTP in a single
+ * sweep over the plaintext, producing the final nested QE envelope directly:
+ *
+ *   OTP env { INNER, otp key id, ct = pad ^
+ *     GCM env { [INNER], gcm key id, IV, AAD, ct = GCM(
+ *       PQC env { key id, IV, KEM_CT, ct = GCM(plaintext), tag }), tag } }
+ *
+ * All three headers are laid out first; then each chunk of plaintext is
+ * encrypted by every layer in turn while it is in cache, in place in the
+ * output buffer. The result is byte-identical to sealing layer by layer,
+ * so /api/otp/decrypt-env and /api/gcm/decrypt-env open it unchanged.
+ *
+ * The KEM itself (Kyber) stays with the caller: pqc_key is the shared
+ * secret, or a key derived from it, and kem_ct is carried for the
+ * recipient. Leave pqc_key NULL to skip the PQC layer and otp_pad NULL to
+ * skip the OTP layer.
+ */
+
+typedef struct {
+    /* PQC hybrid layer (optional) */
+    const uint8_t *pqc_key;  size_t pqc_key_len;   /* 16, 24 or 32 bytes */
+    const uint8_t *pqc_iv;   size_t pqc_iv_len;
+    const uint8_t *kem_ct;   size_t kem_ct_len;
+    const char    *pqc_key_id;                     /* may be NULL */
+
+    /* KM AES-GCM layer (required) */
+    const uint8_t *gcm_key;  size_t gcm_key_len;
+    const uint8_t *gcm_iv;   size_t gcm_iv_len;
+    const uint8_t *aad;      size_t aad_len;
+    const char    *gcm_key_id;
+
+    /* OTP layer (optional); the pad must cover the whole GCM envelope */
+    const uint8_t *otp_pad;  size_t otp_pad_len;
+    const char    *otp_key_id;
+
+    /* QM_COMP_* the plaintext was compressed with (qm_compress_al), recorded
+       on the innermost layer; 0 for none */
+    uint8_t        comp;
+} qm_multiseal_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* OTP pad bytes needed for pt_len bytes of plaintext (the GCM envelope size). */
+size_t qm_multiseal_pad_len(const qm_multiseal_t *m, size_t pt_len);
+
+/* Total output size for pt_len bytes of plaintext. */
+size_t qm_multiseal_size(const qm_multiseal_t *m, size_t pt_len);
+
+/* Seal pt through every configured layer into a malloc'd envelope.
+   Returns -1 on bad parameters (including a short pad) or allocation failure. */
+int qm_multiseal(const qm_multiseal_t *m, const uint8_t *pt, size_t pt_len,
+                 uint8_t **out, size_t *out_len);
+
+/* Same, with the output from al (NULL = malloc); see qm_alloc.h. */
+int qm_multiseal_al(const qm_alloc_t *al, const qm_multiseal_t *m, const uint8_t *pt, size_t pt_len,
+                    uint8_t **out, size_t *out_len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* QM_MULTISEAL_H */
@@ -0,0 +1,1997 @@
+/*
+ * qm_relay.c - event-driven native relay for the AES-GCM and OTP routes.
+ *
+ * Serves the HTTP API of aes_server.py and otp_server.py (same request and
+ * response bodies, status codes, X-Key-Id and Server-Timing headers) from a
+ * single process:
+ *
+ *   POST /api/gcm/encrypt | decrypt | encrypt-chunked | decrypt-chunked
+ *   POST /api/gcm/encrypt-env | decrypt-env, /api/layers/seal
+ *   POST /api/otp/encrypt | decrypt | encrypt-env | decrypt-env
+ *   GET  /health
+ *
+ * One thread runs an epoll loop over the client connections and a pool of
+ * kept-alive, non-blocking KM connections, so a request waiting on key
+ * material is a few hundred bytes of state rather than a blocked worker.
+ * Once a request has its keys, the crypto runs in-process (aes_gcm,
+ * aes_gcm_chunked, qm_envelope, qm_multiseal, otp_xor, qm_codec) on a worker
+ * pool, and the finished response comes back to the loop through an eventfd.
+ * Requests that ask for pre-compression (qm_compress) make one extra trip
+ * through the pool first, since the compressed size decides the pad size.
+ *
+ * Everything a request allocates (parsed fields, ciphertext, response body
+ * and head) comes from an arena that travels with it and is reset, secrets
+ * wiped, when the response is out; requests and their arenas are recycled,
+ * so a warm relay serves a request without touching the heap. Receive
+ * buffers, which a request takes over from its connection, come from a
+ * shared size-class pool. KM keys, pads up to 64 KiB and expanded key
+ * schedules live in locked qm_secmem slots.
+ *
+ * Linux only (epoll, eventfd):
+ *   gcc -O2 -o qm_relay qm_relay.c aes_gcm.c aes_gcm_chunked.c aes.c aes_ct64.c aes_ni.c \
+ *       qm_stats.c qm_envelope.c qm_multiseal.c qm_compress.c qm_codec.c qm_arena.c qm_secmem.c \
+ *       -I. ../level1/otp_xor.c -lpthread -lz
+ *
+ *   ./qm_relay --listen 2022 --listen 2021 --km 127.0.0.1:2020 --threads 4
+ *
+ * With no --km, KM_URL (http://host:port) is used like in the Python relays.
+ */
+#define _GNU_SOURCE
+#include "aes_gcm.h"
+#include "aes_gcm_chunked.h"
+#include "qm_envelope.h"
+#include "qm_multiseal.h"
+#include "qm_compress.h"
+#include "qm_codec.h"
+#include "qm_arena.h"
+#include "qm_secmem.h"
+#include "../level1/otp.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/random.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#define MAX_LISTEN        8
+#define MAX_EVENTS        256
+#define MAX_HDR_BYTES     (64 * 1024)
+#define MAX_KEY_ID        128
+#define MAX_KM_CALLS      3
+#define KM_TIMEOUT_MS     5000               /* same as the relays' requests timeout */
+#define READ_PAUSE_BYTES  (1u << 20)         /* stop reading a busy client past this */
+#define REQ_ARENA_KEEP    (1u << 20)         /* arena blocks a recycled request keeps */
+#define REQ_SPARE_MAX     64                 /* recycled requests kept */
+#define QM_ENVELOPE_CONTENT_TYPE "application/vnd.qumail.envelope"   /* qm_envelope.CONTENT_TYPE */
+
+enum { ST_KM, ST_CRYPTO, ST_ENCODE, ST_COMPRESS, ST_COUNT };
+static const char *STAGE_NAMES[ST_COUNT] = { "km", "crypto", "encode", "compress" };
+
+enum { K_LISTEN, K_CLIENT, K_KM, K_DONE };
+
+/* ===================== Small helpers ===================== */
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+static double ms_since(uint64_t t) { return (double)(now_ns() - t) / 1e6; }
+
+/* Growable byte buffer; al NULL = malloc */
+typedef struct { char *p; size_t len, cap; const qm_alloc_t *al; } buf_t;
+
+static int buf_reserve(buf_t *b, size_t extra) {
+    if (b->len + extra + 1 <= b->cap) return 0;
+    size_t cap = b->cap ? b->cap : 4096;
+    while (cap < b->len + extra + 1) cap *= 2;
+    char *p = (char*)qm_resize(b->al, b->p, b->cap, cap, 0);
+    if (!p) return -1;
+    b->p = p; b->cap = cap;
+    return 0;
+}
+static int buf_append(buf_t *b, const void *d, size_t n) {
+    if (buf_reserve(b, n) != 0) return -1;
+    memcpy(b->p + b->len, d, n);
+    b->len += n; b->p[b->len] = '\0';
+    return 0;
+}
+static int buf_printf(buf_t *b, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(NULL, 0, fmt, ap);
+    va_end(ap);
+    if (n < 0 || buf_reserve(b, (size_t)n) != 0) return -1;
+    va_start(ap, fmt);
+    vsnprintf(b->p + b->len, (size_t)n + 1, fmt, ap);
+    va_end(ap);
+    b->len += (size_t)n;
+    return 0;
+}
+static void buf_free(buf_t *b) { qm_release(b->al, b->p, b->cap, 0); b->p = NULL; b->len = b->cap = 0; }
+
+static void secure_zero(void *p, size_t n) {
+    volatile uint8_t *q = (volatile uint8_t*)p;
+    while (n--) *q++ = 0;
+}
+
+/* "64", "16k", "4m" -> bytes */
+static int parse_size(const char *s, size_t *out) {
+    char *end;
+    double v = strtod(s, &end);
+    if (end == s || v < 0) return -1;
+    switch (*end) {
+        case 'k': case 'K': v *= 1024.0; break;
+        case 'm': case 'M': v *= 1024.0 * 1024.0; break;
+        case 'g': case 'G': v *= 1024.0 * 1024.0 * 1024.0; break;
+        default: break;
+    }
+    *out = (size_t)v;
+    return 0;
+}
+
+/* Hex text (not NUL-terminated) into a buffer from al */
+static int hex_decode_dyn(const qm_alloc_t *al, const char *s, size_t n, unsigned flags, uint8_t **out, size_t *out_len) {
+    if (n % 2) return -1;
+    *out = (uint8_t*)qm_alloc(al, n / 2, flags);
+    if (!*out) return -1;
+    if (qm_hex_decode(s, n, *out) != 0) { qm_release(al, *out, n / 2, flags); *out = NULL; return -1; }
+    *out_len = n / 2;
+    return 0;
+}
+
+/* Appends lowercase hex of d to b */
+static int buf_hex(buf_t *b, const uint8_t *d, size_t n) {
+    if (buf_reserve(b, 2 * n) != 0) return -1;
+    qm_hex_encode(d, n, b->p + b->len);
+    b->len += 2 * n; b->p[b->len] = '\0';
+    return 0;
+}
+
+/* Key ids go into KM request paths and response headers: printable, no
+   separators. */
+static int key_id_ok(const char *s, size_t n) {
+    if (n == 0 || n >= MAX_KEY_ID) return 0;
+    for (size_t i = 0; i < n; ++i) {
+        unsigned char ch = (unsigned char)s[i];
+        if (ch <= 0x20 || ch >= 0x7f || strchr("/?#%&\"\\", ch)) return 0;
+    }
+    return 1;
+}
+
+/* Case-insensitive header lookup in a header block (request or status line first) */
+static const char *header_find(const char *blk, size_t len, const char *name, size_t *vlen) {
+    size_t nl = strlen(name);
+    const char *p = blk, *end = blk + len;
+    while (p < end) {
+        const char *eol = memchr(p, '\n', (size_t)(end - p));
+        if (!eol) break;
+        if ((size_t)(eol - p) > nl && strncasecmp(p, name, nl) == 0 && p[nl] == ':') {
+            const char *v = p + nl + 1;
+            while (v < eol && (*v == ' ' || *v == '\t')) v++;
+            const char *ve = eol;
+            while (ve > v && (ve[-1] == '\r' || ve[-1] == ' ')) ve--;
+            *vlen = (size_t)(ve - v);
+            return v;
+        }
+        p = eol + 1;
+    }
+    return NULL;
+}
+
+/* Query parameter into out (percent-decoded, NUL-terminated); -1 if absent */
+static int query_param(const char *q, const char *name, char *out, size_t cap) {
+    size_t nl = strlen(name);
+    while (q && *q) {
+        const char *amp = strchr(q, '&');
+        size_t seg = amp ? (size_t)(amp - q) : strlen(q);
+        if (seg > nl && strncmp(q, name, nl) == 0 && q[nl] == '=') {
+            size_t o = 0;
+            for (const char *v = q + nl + 1; v < q + seg && o + 1 < cap; ++v) {
+                if (*v == '%' && v + 2 < q + seg && isxdigit((unsigned char)v[1]) && isxdigit((unsigned char)v[2])) {
+                    char hx[3] = { v[1], v[2], 0 };
+                    out[o++] = (char)strtol(hx, NULL, 16);
+                    v += 2;
+                } else {
+                    out[o++] = *v == '+' ? ' ' : *v;
+                }
+            }
+            out[o] = '\0';
+            return 0;
+        }
+        q = amp ? amp + 1 : NULL;
+    }
+    return -1;
+}
+
+/* ---------- Helpers: chunked transfer coding ---------- */
+
+enum { CH_SIZE, CH_DATA, CH_DATA_END, CH_TRAILER };
+typedef struct { int state; size_t left, pos; } chunked_t;
+
+/* Decodes in[c->pos, len) into out. Returns 1 when the body is complete
+   (c->pos is then the end of the message), 0 for more input, -1 if malformed. */
+static int chunked_feed(chunked_t *c, const char *in, size_t len, buf_t *out) {
+    while (c->pos < len) {
+        if (c->state == CH_DATA) {
+            size_t n = len - c->pos < c->left ? len - c->pos : c->left;
+            if (buf_append(out, in + c->pos, n) != 0) return -1;
+            c->pos += n; c->left -= n;
+            if (!c->left) c->state = CH_DATA_END;
+            continue;
+        }
+        const char *eol = memchr(in + c->pos, '\n', len - c->pos);
+        if (!eol) return len - c->pos > 1024 ? -1 : 0;
+        const char *line = in + c->pos;
+        size_t ll = (size_t)(eol - line);
+        c->pos += ll + 1;
+        if (ll && line[ll - 1] == '\r') ll--;
+        switch (c->state) {
+        case CH_SIZE: {
+            char *end;
+            unsigned long long n = strtoull(line, &end, 16);
+            if (end == line) return -1;
+            c->left = (size_t)n;
+            c->state = n ? CH_DATA : CH_TRAILER;
+            break;
+        }
+        case CH_DATA_END:
+            if (ll) return -1;
+            c->state = CH_SIZE;
+            break;
+        case CH_TRAILER:
+            if (!ll) return 1;
+            break;
+        }
+    }
+    return 0;
+}
+
+/* ---------- Helpers: JSON (flat objects) ---------- */
+
+typedef struct { const char *p; size_t n; char *owned; size_t cap; const qm_alloc_t *al; } jstr_t;
+
+static void jstr_free(jstr_t *s) { qm_release(s->al, s->owned, s->cap, 0); memset(s, 0, sizeof(*s)); }
+
+static const char *json_ws(const char *p, const char *e) {
+    while (p < e && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) p++;
+    return p;
+}
+
+/* p at the opening quote; returns one past the closing quote, or NULL */
+static const char *json_skip_string(const char *p, const char *e, int *escaped) {
+    *escaped = 0;
+    for (++p; p < e; ++p) {
+        const char *q = memchr(p, '"', (size_t)(e - p));
+        const char *bs = memchr(p, '\\', q ? (size_t)(q - p) : (size_t)(e - p));
+        if (!bs) return q ? q + 1 : NULL;
+        *escaped = 1;
+        p = bs + 1;
+    }
+    return NULL;
+}
+
+static const char *json_skip_value(const char *p, const char *e) {
+    int esc, depth = 0;
+    do {
+        p = json_ws(p, e);
+        if (p >= e) return NULL;
+        if (*p == '"') { if (!(p = json_skip_string(p, e, &esc))) return NULL; }
+        else if (*p == '{' || *p == '[') { depth++; p++; }
+        else if (*p == '}' || *p == ']') { if (--depth < 0) return NULL; p++; }
+        else if (*p == ',' || *p == ':') { if (!depth) return NULL; p++; }
+        else {
+            const char *s = p;
+            while (p < e && !strchr(" \t\r\n,:]}", *p)) p++;
+            if (p == s) return NULL;
+        }
+    } while (depth);
+    return p;
+}
+
+static void put_utf8(buf_t *b, unsigned cp) {
+    char u[4]; size_t n;
+    if (cp < 0x80)       { u[0] = (char)cp; n = 1; }
+    else if (cp < 0x800) { u[0] = (char)(0xC0 | cp >> 6); u[1] = (char)(0x80 | (cp & 0x3F)); n = 2; }
+    else if (cp < 0x10000) {
+        u[0] = (char)(0xE0 | cp >> 12); u[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        u[2] = (char)(0x80 | (cp & 0x3F)); n = 3;
+    } else {
+        u[0] = (char)(0xF0 | cp >> 18); u[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+        u[2] = (char)(0x80 | ((cp >> 6) & 0x3F)); u[3] = (char)(0x80 | (cp & 0x3F)); n = 4;
+    }
+    buf_append(b, u, n);
+}
+
+static int hex4(const char *p, const char *e, unsigned *v) {
+    if (e - p < 4) return -1;
+    *v = 0;
+    for (int i = 0; i < 4; ++i) {
+        int c = p[i], d = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 :
+                          c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+        if (d < 0) return -1;
+        *v = *v << 4 | (unsigned)d;
+    }
+    return 0;
+}
+
+/* Unescapes the string body [p, e) into UTF-8 */
+static int json_unescape(const char *p, const char *e, buf_t *out) {
+    while (p < e) {
+        const char *bs = memchr(p, '\\', (size_t)(e - p));
+        if (buf_append(out, p, bs ? (size_t)(bs - p) : (size_t)(e - p)) != 0) return -1;
+        if (!bs) break;
+        p = bs + 1;
+        if (p >= e) return -1;
+        char c = *p++;
+        switch (c) {
+        case '"': case '\\': case '/': buf_append(out, &c, 1); break;
+        case 'b': buf_append(out, "\b", 1); break;
+        case 'f': buf_append(out, "\f", 1); break;
+        case 'n': buf_append(out, "\n", 1); break;
+        case 'r': buf_append(out, "\r", 1); break;
+        case 't': buf_append(out, "\t", 1); break;
+        case 'u': {
+            unsigned cp, lo;
+            if (hex4(p, e, &cp) != 0) return -1;
+            p += 4;
+            if (cp >= 0xD800 && cp < 0xDC00 && e - p >= 6 && p[0] == '\\' && p[1] == 'u' &&
+                hex4(p + 2, e, &lo) == 0 && lo >= 0xDC00 && lo < 0xE000) {
+                cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                p += 6;
+            } else if (cp >= 0xD800 && cp < 0xE000) {
+                cp = 0xFFFD;                      /* lone surrogate */
+            }
+            put_utf8(out, cp);
+            break;
+        }
+        default: return -1;
+        }
+    }
+    return 0;
+}
+
+/* Top-level string member `key` of the object in j. Returns 0 when found
+   (out points into j unless escapes had to be decoded into a buffer from
+   al), 1 when absent or not a string, -1 when j is not a JSON object. */
+static int json_string(const qm_alloc_t *al, const char *j, size_t n, const char *key, jstr_t *out) {
+    const char *p = j, *e = j + n;
+    size_t kl = strlen(key);
+    int esc;
+    memset(out, 0, sizeof(*out));
+    p = json_ws(p, e);
+    if (p >= e || *p++ != '{') return -1;
+    p = json_ws(p, e);
+    if (p < e && *p == '}') return 1;
+    while (p < e) {
+        p = json_ws(p, e);
+        if (p >= e || *p != '"') return -1;
+        const char *ks = p + 1, *ke = json_skip_string(p, e, &esc);
+        if (!ke) return -1;
+        int match = !esc && (size_t)(ke - 1 - ks) == kl && memcmp(ks, key, kl) == 0;
+        p = json_ws(ke, e);
+        if (p >= e || *p++ != ':') return -1;
+        p = json_ws(p, e);
+        if (match && p < e && *p == '"') {
+            const char *vs = p + 1, *ve = json_skip_string(p, e, &esc);
+            if (!ve) return -1;
+            if (!esc) { out->p = vs; out->n = (size_t)(ve - 1 - vs); return 0; }
+            buf_t b = { NULL, 0, 0, al };
+            if (buf_reserve(&b, (size_t)(ve - vs)) != 0 || json_unescape(vs, ve - 1, &b) != 0) { buf_free(&b); return -1; }
+            out->owned = b.p; out->p = b.p; out->n = b.len;
+            out->cap = b.cap; out->al = al;
+            return 0;
+        }
+        if (!(p = json_skip_value(p, e))) return -1;
+        p = json_ws(p, e);
+        if (p < e && *p == ',') { p++; continue; }
+        if (p < e && *p == '}') return 1;
+        return -1;
+    }
+    return -1;
+}
+
+/* Appends s as a JSON string literal (UTF-8 passed through) */
+static int json_escape(buf_t *b, const char *s, size_t n) {
+    if (buf_reserve(b, n + 2) != 0) return -1;
+    b->p[b->len++] = '"';
+    size_t i = 0;
+    while (i < n) {
+        size_t run = i;
+        while (run < n && (unsigned char)s[run] >= 0x20 && s[run] != '"' && s[run] != '\\') run++;
+        if (buf_append(b, s + i, run - i) != 0) return -1;
+        if ((i = run) >= n) break;
+        unsigned char ch = (unsigned char)s[i++];
+        if (ch == '"') buf_append(b, "\\\"", 2);
+        else if (ch == '\\') buf_append(b, "\\\\", 2);
+        else if (ch == '\n') buf_append(b, "\\n", 2);
+        else if (ch == '\r') buf_append(b, "\\r", 2);
+        else if (ch == '\t') buf_append(b, "\\t", 2);
+        else buf_printf(b, "\\u%04x", ch);
+    }
+    return buf_append(b, "\"", 1);
+}
+
+static int utf8_valid(const uint8_t *s, size_t n) {
+    size_t i = 0;
+    while (i < n) {
+        uint8_t c = s[i];
+        if (c < 0x80) { i++; continue; }
+        size_t k; unsigned cp;
+        if ((c & 0xE0) == 0xC0)      { k = 1; cp = c & 0x1F; }
+        else if ((c & 0xF0) == 0xE0) { k = 2; cp = c & 0x0F; }
+        else if ((c & 0xF8) == 0xF0) { k = 3; cp = c & 0x07; }
+        else return 0;
+        for (size_t j = 1; j <= k; ++j) {
+            if (i + j >= n || (s[i + j] & 0xC0) != 0x80) return 0;
+            cp = cp << 6 | (s[i + j] & 0x3F);
+        }
+        if ((k == 1 && cp < 0x80) || (k == 2 && cp < 0x800) || (k == 3 && (cp < 0x10000 || cp > 0x10FFFF)) ||
+            (cp >= 0xD800 && cp < 0xE000)) return 0;
+        i += k + 1;
+    }
+    return 1;
+}
+
+/* ===================== Configuration ===================== */
+
+typedef struct {
+    int      ports[MAX_LISTEN];
+    int      nports;
+    char     km_host[128];
+    int      km_port;
+    int      threads;
+    int      km_conns;             /* upper bound on open KM connections */
+    size_t   max_body;
+    size_t   max_plaintext;        /* decompressed payload bound (one mail body or attachment) */
+} relay_config_t;
+
+static relay_config_t cfg;
+static int            epfd;
+static const qm_alloc_t *bufs;        /* receive buffers: shared size-class pool */
+
+/* ===================== Requests ===================== */
+
+typedef struct client client_t;
+typedef struct req req_t;
+
+enum { KM_MINT, KM_LOOKUP, KM_HEALTH };
+
+typedef struct km_call {
+    req_t          *req;
+    int             op;
+    size_t          size;              /* KM_MINT: bytes wanted */
+    char            id[MAX_KEY_ID];    /* KM_LOOKUP: wanted; KM_MINT: returned */
+    int             path_idx;          /* KM_LOOKUP: which id route to try */
+    int             retried;           /* stale kept-alive connection retried once */
+    int             ok;
+    int             http_status;
+    uint8_t        *key;
+    size_t          key_len;
+    const qm_alloc_t *key_al;          /* secmem slot, or the arena for big pads */
+    size_t          key_cap;
+    char            err[160];
+    struct km_call *next;              /* wait queue */
+} km_call_t;
+
+/* Route step results; STEP_COMPRESS compresses r->pl on the pool, then plans on */
+enum { STEP_KM, STEP_RUN, STEP_COMPRESS, STEP_DONE };
+
+typedef struct {
+    const char *method;
+    const char *path;
+    int  (*plan)(req_t *r);            /* loop thread: validate, queue KM calls */
+    void (*run)(req_t *r);             /* worker thread: crypto + encoding */
+} route_t;
+
+struct req {
+    client_t      *c;                  /* NULL once the client has gone away */
+    const route_t *route;
+    buf_t          raw;                /* request as received (headers + body) */
+    size_t         hdr_len;
+    buf_t          dechunked;          /* body of a chunked request */
+    const uint8_t *body;
+    size_t         body_len;
+    char           method[8];
+    char          *target;             /* path, NUL-terminated, in raw */
+    char          *query;              /* after '?', or NULL */
+
+    int            phase;              /* plan() is re-entered after each KM round */
+    km_call_t      km[MAX_KM_CALLS];
+    int            km_n, km_issued, km_pending;
+    uint64_t       km_t0;
+    double         stage_ms[ST_COUNT];
+
+    /* route scratch, parsed on the loop thread */
+    jstr_t         f[5];
+    uint8_t       *bin[3];
+    size_t         bin_len[3];
+    char           key_id[MAX_KEY_ID];
+    int            inner;
+    uint64_t       range_off, range_len;
+    int            ranged;
+
+    /* payload to seal: the request's, or its compressed form once comp is set */
+    const uint8_t *pl;
+    size_t         pl_len;
+    uint8_t        comp;               /* QM_COMP_* asked for, then applied */
+    int            compressing;        /* on the pool for STEP_COMPRESS */
+
+    /* response */
+    int            status;
+    const char    *ctype;
+    buf_t          hdrs;               /* extra header lines */
+    const uint8_t *rbody;              /* in the arena or in raw */
+    size_t         rlen;
+    buf_t          head;
+
+    qm_arena_t    *arena;              /* everything above not in raw/dechunked */
+    const qm_alloc_t *al;
+    req_t         *next;               /* pool / completion queues, spare list */
+};
+
+/* Finished requests, arenas kept warm; loop thread only */
+static req_t *spare_reqs;
+static int    spare_count;
+
+static req_t *req_new(client_t *c) {
+    req_t *r = spare_reqs;
+    if (r) {
+        spare_reqs = r->next;
+        spare_count--;
+    } else {
+        if (!(r = (req_t*)calloc(1, sizeof(*r)))) return NULL;
+        if (!(r->arena = qm_arena_create(0, REQ_ARENA_KEEP))) { free(r); return NULL; }
+        r->al = qm_arena_allocator(r->arena);
+    }
+    r->c = c;
+    r->hdrs.al = r->head.al = r->al;
+    return r;
+}
+
+/* The request buffer held plaintext for the encrypt routes: wipe it as it
+   goes back to the pool. Keys go back to secmem; the arena reset wipes big
+   pads and plaintext. */
+static void req_free(req_t *r) {
+    for (int i = 0; i < r->km_n; ++i)
+        qm_release(r->km[i].key_al, r->km[i].key, r->km[i].key_cap, QM_ALLOC_SECRET);
+    qm_release(r->raw.al, r->raw.p, r->raw.len, QM_ALLOC_SECRET);
+    qm_release(r->dechunked.al, r->dechunked.p, r->dechunked.len, QM_ALLOC_SECRET);
+    qm_arena_reset(r->arena);
+    if (spare_count == REQ_SPARE_MAX) {
+        qm_arena_destroy(r->arena);
+        free(r);
+        return;
+    }
+    qm_arena_t *a = r->arena;
+    const qm_alloc_t *al = r->al;
+    memset(r, 0, sizeof(*r));
+    r->arena = a; r->al = al;
+    r->next = spare_reqs;
+    spare_reqs = r;
+    spare_count++;
+}
+
+static const char *req_header(const req_t *r, const char *name, size_t *vlen) {
+    return header_find(r->raw.p, r->hdr_len, name, vlen);
+}
+
+/* ---------- Helpers: responses ---------- */
+
+/* body lives in r's arena or request buffer until the response is out */
+static void reply(req_t *r, int status, const char *ctype, const uint8_t *body, size_t len) {
+    r->status = status;
+    r->ctype = ctype;
+    r->rbody = body;
+    r->rlen = len;
+}
+
+static void reply_buf(req_t *r, int status, const char *ctype, buf_t *b) {
+    reply(r, status, ctype, (const uint8_t*)b->p, b->len);
+}
+
+/* {"error": e} or {"error": e, "detail": d} */
+static void reply_error(req_t *r, int status, const char *e, const char *detail) {
+    buf_t b = { NULL, 0, 0, r->al };
+    buf_append(&b, "{\"error\":", 9);
+    json_escape(&b, e, strlen(e));
+    if (detail) { buf_append(&b, ",\"detail\":", 10); json_escape(&b, detail, strlen(detail)); }
+    buf_append(&b, "}", 1);
+    reply_buf(r, status, "application/json", &b);
+}
+
+static const char *status_text(int s) {
+    switch (s) {
+    case 200: return "OK";                case 206: return "Partial Content";
+    case 400: return "Bad Request";       case 404: return "Not Found";
+    case 405: return "Method Not Allowed"; case 413: return "Payload Too Large";
+    case 416: return "Range Not Satisfiable"; case 431: return "Request Header Fields Too Large";
+    case 503: return "Service Unavailable";
+    default:  return s >= 500 ? "Internal Server Error" : "Error";
+    }
+}
+
+/* ===================== KM client (non-blocking, pooled) ===================== */
+
+typedef struct km_conn {
+    int             kind, fd;
+    int             connected;
+    int             served;            /* requests completed on this connection */
+    buf_t           out;
+    size_t          out_off;
+    buf_t           in;
+    km_call_t      *call;
+    uint64_t        deadline;
+    struct km_conn *next_idle;
+} km_conn_t;
+
+static struct sockaddr_storage km_addr;
+static socklen_t       km_addr_len;
+static km_conn_t     **km_all;             /* every open connection */
+static int             km_count;
+static km_conn_t      *km_idle;
+static km_call_t      *km_wait_head, *km_wait_tail;
+
+static void call_done(km_call_t *k);
+static void km_submit(km_call_t *k);
+
+static void ep_set(int fd, void *obj, uint32_t events, int add) {
+    struct epoll_event ev;
+    ev.events = events;
+    ev.data.ptr = obj;
+    epoll_ctl(epfd, add ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, fd, &ev);
+}
+
+static void km_close(km_conn_t *k) {
+    for (int i = 0; i < km_count; ++i)
+        if (km_all[i] == k) { km_all[i] = km_all[--km_count]; break; }
+    for (km_conn_t **p = &km_idle; *p; p = &(*p)->next_idle)
+        if (*p == k) { *p = k->next_idle; break; }
+    epoll_ctl(epfd, EPOLL_CTL_DEL, k->fd, NULL);
+    close(k->fd);
+    buf_free(&k->out);
+    if (k->in.p) secure_zero(k->in.p, k->in.cap);
+    buf_free(&k->in);
+    free(k);
+}
+
+static void km_fail(km_call_t *k, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(k->err, sizeof(k->err), fmt, ap);
+    va_end(ap);
+    k->ok = 0;
+    call_done(k);
+}
+
+static void km_start(km_conn_t *kc, km_call_t *k) {
+    static const char *lookup[] = { "/otp/keys/%s", "/otp/keys?id=%s", "/otp/key?id=%s" };
+    char path[MAX_KEY_ID + 32];
+    if (k->op == KM_MINT) snprintf(path, sizeof(path), "/otp/keys?size=%zu", k->size);
+    else if (k->op == KM_LOOKUP) snprintf(path, sizeof(path), lookup[k->path_idx], k->id);
+    else snprintf(path, sizeof(path), "/health");
+
+    kc->call = k;
+    kc->out.len = 0; kc->out_off = 0; kc->in.len = 0;
+    buf_printf(&kc->out, "GET %s HTTP/1.1\r\nHost: %s:%d\r\nConnection: keep-alive\r\n\r\n",
+               path, cfg.km_host, cfg.km_port);
+    kc->deadline = now_ns() + (uint64_t)KM_TIMEOUT_MS * 1000000ull;
+    ep_set(kc->fd, kc, EPOLLIN | EPOLLOUT, 0);
+}
+
+static km_conn_t *km_open(void) {
+    int fd = socket(km_addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) return NULL;
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (connect(fd, (struct sockaddr*)&km_addr, km_addr_len) != 0 && errno != EINPROGRESS) { close(fd); return NULL; }
+    km_conn_t *kc = (km_conn_t*)calloc(1, sizeof(*kc));
+    if (!kc) { close(fd); return NULL; }
+    kc->kind = K_KM; kc->fd = fd;
+    kc->in.al = kc->out.al = bufs;
+    km_all[km_count++] = kc;
+    ep_set(fd, kc, EPOLLOUT, 1);
+    return kc;
+}
+
+static void km_submit(km_call_t *k) {
+    km_conn_t *kc = km_idle;
+    if (kc) {
+        km_idle = kc->next_idle;
+        km_start(kc, k);
+        return;
+    }
+    if (km_count < cfg.km_conns) {
+        if (!(kc = km_open())) { km_fail(k, "cannot connect to KM"); return; }
+        km_start(kc, k);
+        return;
+    }
+    k->next = NULL;
+    if (km_wait_tail) km_wait_tail->next = k; else km_wait_head = k;
+    km_wait_tail = k;
+}
+
+/* Connection finished a call: hand it the next waiting call or park it */
+static void km_release(km_conn_t *kc) {
+    kc->call = NULL;
+    kc->served++;
+    km_call_t *k = km_wait_head;
+    if (k) {
+        if (!(km_wait_head = k->next)) km_wait_tail = NULL;
+        km_start(kc, k);
+        return;
+    }
+    kc->next_idle = km_idle;
+    km_idle = kc;
+    ep_set(kc->fd, kc, EPOLLIN, 0);               /* notices the KM closing it */
+}
+
+/* Decodes a KM answer into k: raw key bytes with X-Key-Id, or JSON with
+   key_hex / iv_hex / key (base64) and key_id, as the relays accept. */
+/* Keys and pads up to a secmem slot go to locked memory; bigger pads stay
+   in the arena, which wipes them on reset. */
+static const qm_alloc_t *km_key_al(km_call_t *k, size_t n) {
+    k->key_al = n <= QM_SECMEM_MAX_SLOT ? qm_secmem_allocator() : k->req->al;
+    k->key_cap = n;
+    return k->key_al;
+}
+
+static void km_decode(km_call_t *k, const char *hdr, size_t hlen, const char *body, size_t blen) {
+    const qm_alloc_t *al = k->req->al;
+    size_t vlen;
+    const char *v = header_find(hdr, hlen, "X-Key-Id", &vlen);
+    if (v && vlen < sizeof(k->id) && k->op == KM_MINT) { memcpy(k->id, v, vlen); k->id[vlen] = '\0'; }
+
+    const char *ct = header_find(hdr, hlen, "Content-Type", &vlen);
+    if (ct && memmem(ct, vlen, "application/json", 16)) {
+        jstr_t s;
+        if (k->op == KM_MINT && json_string(al, body, blen, "key_id", &s) == 0) {
+            if (s.n < sizeof(k->id)) { memcpy(k->id, s.p, s.n); k->id[s.n] = '\0'; }
+            jstr_free(&s);
+        }
+        if (json_string(al, body, blen, "key_hex", &s) == 0 ||
+            (k->op == KM_MINT && json_string(al, body, blen, "iv_hex", &s) == 0)) {
+            int rc = hex_decode_dyn(km_key_al(k, s.n / 2), s.p, s.n, QM_ALLOC_SECRET, &k->key, &k->key_len);
+            jstr_free(&s);
+            if (rc != 0) { km_fail(k, "KM returned bad key_hex"); return; }
+        } else if (json_string(al, body, blen, "key", &s) == 0) {
+            size_t cap = qm_base64_decoded_max(s.n) + 1;
+            k->key = (uint8_t*)qm_alloc(km_key_al(k, cap), cap, QM_ALLOC_SECRET);
+            int rc = k->key ? qm_base64_decode(s.p, s.n, k->key, &k->key_len, QM_B64_STD) : -1;
+            jstr_free(&s);
+            if (rc != 0) { km_fail(k, "KM returned bad base64 key"); return; }
+        }
+    }
+    if (!k->key) {
+        if (!(k->key = (uint8_t*)qm_alloc(km_key_al(k, blen), blen, QM_ALLOC_SECRET))) { km_fail(k, "out of memory"); return; }
+        memcpy(k->key, body, blen);
+        k->key_len = blen;
+    }
+    if (k->op == KM_MINT && !k->id[0]) {
+        /* No id from the KM: synthesize one like the Python relays */
+        uint8_t rnd[4] = {0};
+        if (getrandom(rnd, sizeof(rnd), 0) != (ssize_t)sizeof(rnd)) { /* id is a label only */ }
+        snprintf(k->id, sizeof(k->id), "K-unknown-%02x%02x%02x%02x", rnd[0], rnd[1], rnd[2], rnd[3]);
+    }
+    k->ok = 1;
+    call_done(k);
+}
+
+/* 1 = whole response in kc->in, 0 = need more, -1 = unusable */
+static int km_response_complete(km_conn_t *kc, size_t *hdr_len, size_t *total, int *keep) {
+    char *e = kc->in.len ? memmem(kc->in.p, kc->in.len, "\r\n\r\n", 4) : NULL;
+    if (!e) return kc->in.len > MAX_HDR_BYTES ? -1 : 0;
+    *hdr_len = (size_t)(e - kc->in.p) + 4;
+    int minor = 1;
+    if (sscanf(kc->in.p, "HTTP/1.%d", &minor) != 1) return -1;
+    size_t vlen;
+    const char *v = header_find(kc->in.p, *hdr_len, "Connection", &vlen);
+    *keep = minor >= 1;
+    if (v && vlen >= 5 && strncasecmp(v, "close", 5) == 0) *keep = 0;
+    if (header_find(kc->in.p, *hdr_len, "Transfer-Encoding", &vlen)) return -1;
+    v = header_find(kc->in.p, *hdr_len, "Content-Length", &vlen);
+    if (!v) return -1;
+    *total = *hdr_len + (size_t)strtoull(v, NULL, 10);
+    return kc->in.len >= *total ? 1 : 0;
+}
+
+static void km_event(km_conn_t *kc, uint32_t events) {
+    km_call_t *k = kc->call;
+
+    if (!kc->connected && (events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+        int err = 0; socklen_t el = sizeof(err);
+        getsockopt(kc->fd, SOL_SOCKET, SO_ERROR, &err, &el);
+        if (err) { km_close(kc); if (k) km_fail(k, "cannot connect to KM: %s", strerror(err)); return; }
+        kc->connected = 1;
+    }
+    if (!k) {                                     /* idle: only EOF or junk can arrive */
+        km_close(kc);
+        return;
+    }
+    if ((events & EPOLLOUT) && kc->out_off < kc->out.len) {
+        ssize_t w = send(kc->fd, kc->out.p + kc->out_off, kc->out.len - kc->out_off, MSG_NOSIGNAL);
+        if (w > 0) kc->out_off += (size_t)w;
+        else if (errno != EAGAIN && errno != EINTR) goto broken;
+        if (kc->out_off == kc->out.len) ep_set(kc->fd, kc, EPOLLIN, 0);
+    }
+    if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+        if (buf_reserve(&kc->in, 64 * 1024) != 0) goto broken;
+        ssize_t r = recv(kc->fd, kc->in.p + kc->in.len, kc->in.cap - kc->in.len - 1, 0);
+        if (r == 0 || (r < 0 && errno != EAGAIN && errno != EINTR)) goto broken;
+        if (r > 0) kc->in.len += (size_t)r;
+
+        size_t hdr_len = 0, total = 0;
+        int keep = 0, rc = km_response_complete(kc, &hdr_len, &total, &keep);
+        if (rc < 0) { km_close(kc); km_fail(k, "unreadable KM response"); return; }
+        if (rc == 0) return;
+
+        int status = 0;
+        sscanf(kc->in.p, "HTTP/1.%*d %d", &status);
+        k->http_status = status;
+        if (status == 404 && k->op == KM_LOOKUP && k->path_idx < 2) {
+            k->path_idx++;
+            if (keep) km_release(kc); else km_close(kc);
+            km_submit(k);
+            return;
+        }
+        /* Detach the connection before completing: completion may queue new calls */
+        buf_t in = kc->in;
+        kc->in = (buf_t){ NULL, 0, 0, bufs };
+        if (keep) km_release(kc); else km_close(kc);
+        if (k->op == KM_HEALTH) { k->ok = status == 200; call_done(k); }
+        else if (status != 200) km_fail(k, "KM returned HTTP %d", status);
+        else km_decode(k, in.p, hdr_len, in.p + hdr_len, total - hdr_len);
+        secure_zero(in.p, in.len);
+        buf_free(&in);
+    }
+    return;
+
+broken:
+    /* A kept-alive connection the KM already dropped: retry once on a new one */
+    {
+        int stale = kc->served > 0 && kc->in.len == 0 && !k->retried;
+        km_close(kc);
+        if (stale) { k->retried = 1; km_submit(k); }
+        else km_fail(k, "KM connection failed");
+    }
+}
+
+static void km_sweep(void) {
+    uint64_t now = now_ns();
+    for (int i = km_count - 1; i >= 0; --i) {
+        km_conn_t *kc = km_all[i];
+        if (kc->call && now > kc->deadline) {
+            km_call_t *k = kc->call;
+            km_close(kc);
+            km_fail(k, "KM timeout");
+        }
+    }
+}
+
+/* ===================== Worker pool ===================== */
+
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  pool_cond = PTHREAD_COND_INITIALIZER;
+static req_t          *pool_head, *pool_tail;
+static pthread_mutex_t done_lock = PTHREAD_MUTEX_INITIALIZER;
+static req_t          *done_head;
+static int             done_efd;
+
+static void compress_payload(req_t *r);
+
+static void *pool_thread(void *arg) {
+    (void)arg;
+    for (;;) {
+        pthread_mutex_lock(&pool_lock);
+        while (!pool_head) pthread_cond_wait(&pool_cond, &pool_lock);
+        req_t *r = pool_head;
+        if (!(pool_head = r->next)) pool_tail = NULL;
+        pthread_mutex_unlock(&pool_lock);
+
+        if (r->compressing) compress_payload(r);
+        else r->route->run(r);
+
+        pthread_mutex_lock(&done_lock);
+        r->next = done_head;
+        done_head = r;
+        pthread_mutex_unlock(&done_lock);
+        uint64_t one = 1;
+        if (write(done_efd, &one, sizeof(one)) < 0) { /* counter saturated: already signalled */ }
+    }
+    return NULL;
+}
+
+static void pool_submit(req_t *r) {
+    r->next = NULL;
+    pthread_mutex_lock(&pool_lock);
+    if (pool_tail) pool_tail->next = r; else pool_head = r;
+    pool_tail = r;
+    pthread_cond_signal(&pool_cond);
+    pthread_mutex_unlock(&pool_lock);
+}
+
+/* ===================== Routes ===================== */
+
+/* ---------- Helpers: plan steps ---------- */
+
+static void km_mint(req_t *r, size_t size) {
+    km_call_t *k = &r->km[r->km_n++];
+    memset(k, 0, sizeof(*k));
+    k->req = r; k->op = KM_MINT; k->size = size;
+}
+
+static void km_lookup(req_t *r, const char *id) {
+    km_call_t *k = &r->km[r->km_n++];
+    memset(k, 0, sizeof(*k));
+    k->req = r; k->op = KM_LOOKUP;
+    snprintf(k->id, sizeof(k->id), "%s", id);
+}
+
+/* First failed KM call of the current round, or NULL */
+static const km_call_t *km_failed(const req_t *r) {
+    for (int i = 0; i < r->km_n; ++i) if (!r->km[i].ok) return &r->km[i];
+    return NULL;
+}
+
+static int header_is(const req_t *r, const char *name) {
+    size_t vlen;
+    return req_header(r, name, &vlen) != NULL && vlen > 0;
+}
+
+/* Header value as a NUL-terminated copy in a jstr slot ("" if absent) */
+static void header_copy(req_t *r, const char *name, jstr_t *out) {
+    size_t vlen = 0;
+    const char *v = req_header(r, name, &vlen);
+    memset(out, 0, sizeof(*out));
+    out->owned = (char*)qm_alloc(r->al, vlen + 1, 0);
+    if (!out->owned) return;
+    if (v) memcpy(out->owned, v, vlen);
+    out->owned[vlen] = '\0';
+    out->p = out->owned; out->n = vlen;
+}
+
+/* Optional hex header into bin[slot]; -1 if present but not hex */
+static int header_hex(req_t *r, const char *name, int slot) {
+    size_t vlen;
+    const char *v = req_header(r, name, &vlen);
+    if (!v || !vlen) return 0;
+    return hex_decode_dyn(r->al, v, vlen, QM_ALLOC_SECRET, &r->bin[slot], &r->bin_len[slot]);
+}
+
+static int lookup_by_id(req_t *r, const char *id, size_t n) {
+    if (!key_id_ok(id, n)) return -1;
+    memcpy(r->key_id, id, n);
+    r->key_id[n] = '\0';
+    r->km_n = 0;
+    km_lookup(r, r->key_id);
+    return 0;
+}
+
+static void set_key_id_header(req_t *r, const char *id) {
+    buf_printf(&r->hdrs, "X-Key-Id: %s\r\n", id);
+}
+
+/* ---------- Pre-compression ---------- */
+
+/* Points r->pl at the payload and reads the algorithm asked for (name of n
+   bytes; none when n is 0): 1 when compressing looks worthwhile (return
+   STEP_COMPRESS), 0 to go on without, -1 after a 400 for an unknown name. */
+static int plan_compress(req_t *r, const char *name, size_t n, const uint8_t *pl, size_t pl_len) {
+    r->pl = pl; r->pl_len = pl_len; r->comp = QM_COMP_NONE;
+    if (!n) return 0;
+    uint8_t alg;
+    if (qm_compress_from_name(name, n, &alg) != 0 || (alg != QM_COMP_AUTO && !qm_compress_available(alg))) {
+        reply_error(r, 400, "unsupported_compression", NULL);
+        return -1;
+    }
+    if (alg == QM_COMP_NONE || !qm_compress_worthwhile(pl, pl_len)) return 0;
+    r->comp = alg;
+    return 1;
+}
+
+/* Pool side of STEP_COMPRESS; the payload stays as it is when compressing does not pay */
+static void compress_payload(req_t *r) {
+    uint64_t t0 = now_ns();
+    uint8_t used = QM_COMP_NONE, *out = NULL;
+    size_t out_len = 0;
+    if (qm_compress_al(r->al, r->comp, r->pl, r->pl_len, &used, &out, &out_len) == 0 && out) {
+        r->pl = out; r->pl_len = out_len;
+    } else {
+        used = QM_COMP_NONE;
+    }
+    r->comp = used;
+    r->stage_ms[ST_COMPRESS] += ms_since(t0);
+}
+
+/* Undoes a layer's pre-compression in run(): *p and *n become the original
+   payload, bounded by --max-plaintext. -1 after replying `error`. */
+static int decompress_payload(req_t *r, uint8_t comp, const uint8_t **p, size_t *n, int status, const char *error) {
+    if (comp == QM_COMP_NONE) return 0;
+    uint64_t t0 = now_ns();
+    uint8_t *out = NULL; size_t out_len = 0;
+    if (qm_decompress_al(r->al, comp, *p, *n, cfg.max_plaintext, &out, &out_len) != 0) {
+        reply_error(r, status, error, qm_compress_available(comp) ? "decompression failed" : "unsupported compression");
+        return -1;
+    }
+    *p = out; *n = out_len;
+    r->stage_ms[ST_COMPRESS] += ms_since(t0);
+    return 0;
+}
+
+/* ---------- AES-GCM ---------- */
+
+/* key (16) and IV (12) from the KM, as aes_server.py fetches them */
+static int plan_key_iv(req_t *r, const char *fail_error) {
+    if (r->phase == 0) { km_mint(r, 16); km_mint(r, 12); return STEP_KM; }
+    const km_call_t *k = km_failed(r);
+    if (k) { reply_error(r, 500, fail_error, k->err); return STEP_DONE; }
+    return STEP_RUN;
+}
+
+static int plan_gcm_encrypt(req_t *r) {
+    if (r->phase == 0) header_copy(r, "X-AAD-HEX", &r->f[0]);
+    return plan_key_iv(r, "km_failed");
+}
+
+static void run_gcm_encrypt(req_t *r) {
+    const km_call_t *key = &r->km[0], *iv = &r->km[1];
+    uint64_t t0 = now_ns();
+    aes_key_t *ks = NULL;
+    uint8_t tag[16];
+    uint8_t *aad = NULL; size_t aad_len = 0;
+    if (r->f[0].n && hex_decode_dyn(r->al, r->f[0].p, r->f[0].n, 0, &aad, &aad_len) != 0) { reply_error(r, 500, "crypto_failed", "Bad AAD"); return; }
+    uint8_t *ct = (uint8_t*)qm_alloc(r->al, r->body_len, 0);
+    if (!ct || !(ks = qm_secmem_key_new(key->key, key->key_len)) ||
+        aes_gcm_encrypt_ks(ks, iv->key, iv->key_len, aad, aad_len, r->body, r->body_len, ct, tag) != 0) {
+        qm_secmem_key_free(ks);
+        reply_error(r, 500, "crypto_failed", "Encrypt failed");
+        return;
+    }
+    qm_secmem_key_free(ks);
+    r->stage_ms[ST_CRYPTO] += ms_since(t0);
+
+    t0 = now_ns();
+    buf_t b = { NULL, 0, 0, r->al };
+    buf_reserve(&b, 2 * r->body_len + 256 + r->f[0].n);
+    buf_append(&b, "{\"key_id\":", 10);        json_escape(&b, key->id, strlen(key->id));
+    buf_append(&b, ",\"iv_hex\":\"", 11);      buf_hex(&b, iv->key, iv->key_len);
+    buf_append(&b, "\",\"ciphertext_hex\":\"", 20); buf_hex(&b, ct, r->body_len);
+    buf_append(&b, "\",\"tag_hex\":\"", 13);   buf_hex(&b, tag, 16);
+    buf_append(&b, "\",\"aad_hex\":", 12);     json_escape(&b, r->f[0].p, r->f[0].n);
+    buf_append(&b, "}", 1);
+    reply_buf(r, 200, "application/json", &b);
+    r->stage_ms[ST_ENCODE] += ms_since(t0);
+}
+
+static int plan_gcm_decrypt(req_t *r) {
+    if (r->phase == 0) {
+        static const char *fields[] = { "key_id", "iv_hex", "ciphertext_hex", "tag_hex", "aad_hex" };
+        for (int i = 0; i < 5; ++i) {
+            int rc = json_string(r->al, (const char*)r->body, r->body_len, fields[i], &r->f[i]);
+            if (rc < 0 || (rc > 0 && i < 4)) { reply_error(r, 400, "bad_request", "missing or malformed fields"); return STEP_DONE; }
+        }
+        if (lookup_by_id(r, r->f[0].p, r->f[0].n) != 0) { reply_error(r, 404, "key_lookup_failed", "bad key_id"); return STEP_DONE; }
+        return STEP_KM;
+    }
+    const km_call_t *k = km_failed(r);
+    if (k) {
+        char detail[200];
+        snprintf(detail, sizeof(detail), "Key not found in KM for key_id=%s", r->key_id);
+        reply_error(r, 404, "key_lookup_failed", k->http_status == 404 ? detail : k->err);
+        return STEP_DONE;
+    }
+    return STEP_RUN;
+}
+
+static void run_gcm_decrypt(req_t *r) {
+    const km_call_t *key = &r->km[0];
+    uint64_t t0 = now_ns();
+    uint8_t *iv = NULL, *ct = NULL, *aad = NULL, *tag = NULL;
+    size_t iv_len = 0, ct_len = 0, aad_len = 0, tag_len = 0;
+    uint8_t *pt = NULL;
+    aes_key_t *ks = NULL;
+    int ok = hex_decode_dyn(r->al, r->f[1].p, r->f[1].n, 0, &iv, &iv_len) == 0 && iv_len > 0 &&
+             hex_decode_dyn(r->al, r->f[2].p, r->f[2].n, 0, &ct, &ct_len) == 0 &&
+             hex_decode_dyn(r->al, r->f[3].p, r->f[3].n, 0, &tag, &tag_len) == 0 && tag_len == 16 &&
+             hex_decode_dyn(r->al, r->f[4].p, r->f[4].n, 0, &aad, &aad_len) == 0;
+    r->stage_ms[ST_ENCODE] += ms_since(t0);
+
+    t0 = now_ns();
+    ok = ok && (pt = (uint8_t*)qm_alloc(r->al, ct_len, QM_ALLOC_SECRET)) != NULL &&
+         (ks = qm_secmem_key_new(key->key, key->key_len)) != NULL &&
+         aes_gcm_decrypt_ks(ks, iv, iv_len, aad, aad_len, ct, ct_len, tag, pt) == 0;
+    qm_secmem_key_free(ks);
+    r->stage_ms[ST_CRYPTO] += ms_since(t0);
+    if (!ok) { reply_error(r, 400, "auth_failed", NULL); return; }
+    reply(r, 200, "application/octet-stream", pt, ct_len);
+}
+
+static int plan_gcm_encrypt_chunked(req_t *r) {
+    return plan_key_iv(r, "km_failed");
+}
+
+static void run_gcm_encrypt_chunked(req_t *r) {
+    const km_call_t *key = &r->km[0], *iv = &r->km[1];
+    uint64_t t0 = now_ns();
+    uint8_t *out = NULL; size_t out_len = 0;
+    if (iv->key_len < GCM_CHUNKED_PREFIX_SIZE ||
+        gcm_chunked_encrypt_al(r->al, r->body, r->body_len, key->key, key->key_len, iv->key,
+                               GCM_CHUNKED_DEFAULT_LOG2, &out, &out_len) != 0) {
+        reply_error(r, 500, "crypto_failed", "Encrypt failed");
+        return;
+    }
+    r->stage_ms[ST_CRYPTO] += ms_since(t0);
+    set_key_id_header(r, key->id);
+    reply(r, 200, "application/octet-stream", out, out_len);
+}
+
+static int plan_gcm_decrypt_chunked(req_t *r) {
+    if (r->phase == 0) {
+        char id[MAX_KEY_ID] = "";
+        size_t vlen;
+        const char *v;
+        if (query_param(r->query, "key_id", id, sizeof(id)) != 0 || !id[0]) {
+            if ((v = req_header(r, "X-Key-Id", &vlen)) && vlen < sizeof(id)) { memcpy(id, v, vlen); id[vlen] = '\0'; }
+        }
+        if (!id[0]) { reply_error(r, 400, "missing_key_id", NULL); return STEP_DONE; }
+
+        if ((v = req_header(r, "Range", &vlen)) && vlen > 6 && strncmp(v, "bytes=", 6) == 0) {
+            char spec[64];
+            if (vlen - 6 >= sizeof(spec)) { reply_error(r, 416, "bad_range", NULL); return STEP_DONE; }
+            memcpy(spec, v + 6, vlen - 6); spec[vlen - 6] = '\0';
+            char *dash = strchr(spec, '-'), *end;
+            if (!dash || dash == spec) { reply_error(r, 416, "bad_range", NULL); return STEP_DONE; }
+            *dash = '\0';
+            r->range_off = strtoull(spec, &end, 10);
+            if (*end) { reply_error(r, 416, "bad_range", NULL); return STEP_DONE; }
+            r->range_len = UINT64_MAX;
+            if (dash[1]) {
+                uint64_t last = strtoull(dash + 1, &end, 10);
+                if (*end || last < r->range_off) { reply_error(r, 416, "bad_range", NULL); return STEP_DONE; }
+                r->range_len = last - r->range_off + 1;
+            }
+            r->ranged = 1;
+        }
+        if (lookup_by_id(r, id, strlen(id)) != 0) { reply_error(r, 404, "key_lookup_failed", "bad key_id"); return STEP_DONE; }
+        return STEP_KM;
+    }
+    const km_call_t *k = km_failed(r);
+    if (k) { reply_error(r, 404, "key_lookup_failed", k->err); return STEP_DONE; }
+    return STEP_RUN;
+}
+
+static void run_gcm_decrypt_chunked(req_t *r) {
+    const km_call_t *key = &r->km[0];
+    uint64_t t0 = now_ns();
+    if (!r->ranged) {
+        uint8_t *pt = NULL; size_t pt_len = 0;
+        if (gcm_chunked_decrypt_al(r->al, r->body, r->body_len, key->key, key->key_len, &pt, &pt_len) != 0) {
+            reply_error(r, 400, "auth_failed", NULL);
+            return;
+        }
+        r->stage_ms[ST_CRYPTO] += ms_since(t0);
+        reply(r, 200, "application/octet-stream", pt, pt_len);
+        return;
+    }
+
+    gcm_chunked_t *c = (gcm_chunked_t*)qm_secmem_alloc(sizeof(*c));
+    uint64_t nchunks, pt_len;
+    int bad = !c || r->body_len < GCM_CHUNKED_HEADER_SIZE ||
+              gcm_chunked_init_header(c, key->key, key->key_len, r->body) != 0 ||
+              gcm_chunked_layout(c, r->body_len, &nchunks, &pt_len) != 0;
+    qm_secmem_free(c, sizeof(*c));
+    if (bad) { reply_error(r, 400, "auth_failed", NULL); return; }
+    if (r->range_off >= pt_len) { reply_error(r, 416, "bad_range", NULL); return; }
+    size_t len = (size_t)(pt_len - r->range_off < r->range_len ? pt_len - r->range_off : r->range_len);
+    uint8_t *out = (uint8_t*)qm_alloc(r->al, len, QM_ALLOC_SECRET);
+    if (!out || gcm_chunked_decrypt_range(r->body, r->body_len, key->key, key->key_len, r->range_off, len, out) != 0) {
+        reply_error(r, 400, "auth_failed", NULL);
+        return;
+    }
+    r->stage_ms[ST_CRYPTO] += ms_since(t0);
+    buf_printf(&r->hdrs, "Content-Range: bytes %llu-%llu/%llu\r\n",
+               (unsigned long long)r->range_off, (unsigned long long)(r->range_off + len - 1),
+               (unsigned long long)pt_len);
+    reply(r, 206, "application/octet-stream", out, len);
+}
+
+static int plan_gcm_encrypt_env(req_t *r) {
+    if (r->phase == 0) {
+        char v[4];
+        r->inner = query_param(r->query, "inner", v, sizeof(v)) == 0 && strcmp(v, "1") == 0;
+        header_copy(r, "X-AAD-HEX", &r->f[0]);
+    }
+    return plan_key_iv(r, "km_failed");
+}
+
+static void run_gcm_encrypt_env(req_t *r) {
+    const km_call_t *key = &r->km[0], *iv = &r->km[1];
+    uint64_t t0 = now_ns();
+    uint8_t *aad = NULL; size_t aad_len = 0;
+    uint8_t *out = NULL; size_t out_len = 0;
+    if (r->f[0].n && hex_decode_dyn(r->al, r->f[0].p, r->f[0].n, 0, &aad, &aad_len) != 0) { reply_error(r, 500, "crypto_failed", "Bad AAD"); return; }
+    int rc = qm_envelope_gcm_seal_al(r->al, key->key, key->key_len, key->id, iv->key, iv->key_len, aad, aad_len,
+                                     r->body, r->body_len, r->inner ? QM_ENV_F_INNER : 0, &out, &out_len);
+    if (rc != 0) { reply_error(r, 500, "crypto_failed", "Encrypt failed"); return; }
+    r->stage_ms[ST_CRYPTO] += ms_since(t0);
+    set_key_id_header(r, key->id);
+    reply(r, 200, QM_ENVELOPE_CONTENT_TYPE, out, out_len);
+}
+
+/* Envelope routes: parse the layer header, check its algorithm and look its key up */
+static int plan_env_lookup(req_t *r, uint8_t alg, const char *detail, int lookup_status, const char *lookup_error) {
+    if (r->phase == 0) {
+        qm_envelope_t e;
+        if (qm_envelope_parse(r->body, r->body_len, &e) != 0) { reply_error(r, 400, "bad_envelope", "not a QE envelope"); return STEP_DONE; }
+        if (e.alg != alg || !e.key_id_len) { reply_error(r, 400, "bad_envelope", detail); return STEP_DONE; }
+        r->inner = (e.flags & QM_ENV_F_INNER) != 0;
+        if (lookup_by_id(r, (const char*)e.key_id, e.key_id_len) != 0) { reply_error(r, 400, "bad_envelope", "bad key id"); return STEP_DONE; }
+        return STEP_KM;
+    }
+    const km_call_t *k = km_failed(r);
+    if (k) { reply_error(r, lookup_status, lookup_error, k->err); return STEP_DONE; }
+    return STEP_RUN;
+}
+
+static int plan_gcm_decrypt_env(req_t *r) {
+    return plan_env_lookup(r, QM_ALG_AES_GCM, "not an AES-GCM layer with a key id", 404, "key_lookup_failed");
+}
+
+static void run_gcm_decrypt_env(req_t *r) {
+    const km_call_t *key = &r->km[0];
+    uint64_t t0 = now_ns();
+    uint8_t *pt = NULL; size_t pt_len = 0;
+    qm_envelope_t e;
+    if (qm_envelope_gcm_open_al(r->al, key->key, key->key_len, r->body, r->body_len, &pt, &pt_len, &e) != 0) {
+        reply_error(r, 400, "auth_failed", NULL);
+        return;
+    }
+    r->stage_ms[ST_CRYPTO] += ms_since(t0);
+    const uint8_t *out = pt;
+    if (decompress_payload(r, e.comp, &out, &pt_len, 400, "decryption_failed") != 0) return;
+    reply(r, 200, r->inner ? QM_ENVELOPE_CONTENT_TYPE : "application/octet-stream", out, pt_len);
+}
+
+/* ---------- Layered seal ---------- */
+
+static void layers_params(const req_t *r, qm_multiseal_t *m) {
+    memset(m, 0, sizeof(*m));
+    if (r->bin[0]) {
+        m->pqc_key = r->bin[0]; m->pqc_key_len = r->bin_len[0];
+        m->pqc_iv = r->bin[1];  m->pqc_iv_len = r->bin_len[1];
+        m->kem_ct = r->bin[2];  m->kem_ct_len = r->bin_len[2];
+        m->pqc_key_id = r->f[1].n ? r->f[1].p : NULL;
+    }
+    m->gcm_key = r->km[0].key; m->gcm_key_len = r->km[0].key_len;
+    m->gcm_iv = r->km[1].key;  m->gcm_iv_len = r->km[1].key_len;
+    m->gcm_key_id = r->km[0].id;
+    m->aad = (const uint8_t*)r->f[2].p; m->aad_len = r->f[2].n;   /* decoded below */
+    m->comp = r->comp;
+}
+
+static int plan_layers_seal(req_t *r) {
+    if (r->phase == 0) {
+        int n = header_is(r, "X-PQC-Key") + header_is(r, "X-PQC-IV") + header_is(r, "X-KEM-CT");
+        if (n != 0 && n != 3) { reply_error(r, 400, "bad_request", "X-PQC-Key, X-PQC-IV and X-KEM-CT go together"); return STEP_DONE; }
+        if (n == 3 && (header_hex(r, "X-PQC-Key", 0) != 0 || header_hex(r, "X-PQC-IV", 1) != 0 ||
+                       header_hex(r, "X-KEM-CT", 2) != 0)) {
+            reply_error(r, 500, "crypto_failed", "Bad PQC key, IV or KEM ciphertext");
+            return STEP_DONE;
+        }
+        header_copy(r, "X-PQC-Key-Id", &r->f[1]);
+        header_copy(r, "X-AAD-HEX", &r->f[0]);
+        uint8_t *aad = NULL; size_t aad_len = 0;
+        if (r->f[0].n && hex_decode_dyn(r->al, r->f[0].p, r->f[0].n, 0, &aad, &aad_len) != 0) { reply_error(r, 500, "crypto_failed", "Bad AAD"); return STEP_DONE; }
+        r->f[2].p = (const char*)aad; r->f[2].n = aad_len;
+        header_copy(r, "X-Compression", &r->f[3]);
+        int c = plan_compress(r, r->f[3].p, r->f[3].n, r->body, r->body_len);
+        if (c) return c > 0 ? STEP_COMPRESS : STEP_DONE;
+    }
+    if (r->km_n == 0) { km_mint(r, 16); km_mint(r, 12); return STEP_KM; }
+    const km_call_t *k = km_failed(r);
+    if (k) { reply_error(r, 500, "km_failed", k->err); return STEP_DONE; }
+    if (r->km_n == 2) {
+        /* Keep the key and IV, fetch a pad the size of the GCM envelope */
+        qm_multiseal_t m;
+        layers_params(r, &m);
+        km_mint(r, qm_multiseal_pad_len(&m, r->pl_len));
+        return STEP_KM;
+    }
+    return STEP_RUN;
+}
+
+static void run_layers_seal(req_t *r) {
+    const km_call_t *pad = &r->km[2];
+    qm_multiseal_t m;
+    layers_params(r, &m);
+    m.otp_pad = pad->key; m.otp_pad_len = pad->key_len; m.otp_key_id = pad->id;
+
+    uint64_t t0 = now_ns();
+    uint8_t *out = NULL; size_t out_len = 0;
+    if (qm_multiseal_al(r->al, &m, r->pl, r->pl_len, &out, &out_len) != 0) { reply_error(r, 500, "crypto_failed", "Encrypt failed"); return; }
+    r->stage_ms[ST_CRYPTO] += ms_since(t0);
+    buf_printf(&r->hdrs, "X-Key-Id: %s\r\nX-GCM-Key-Id: %s\r\n", pad->id, r->km[0].id);
+    reply(r, 200, QM_ENVELOPE_CONTENT_TYPE, out, out_len);
+}
+
+/* ---------- OTP ---------- */
+
+/* data ^ pad[:len]; the pad must cover the data (no wrap-around) */
+static int otp_apply(uint8_t *out, const uint8_t *in, size_t len, const km_call_t *pad) {
+    if (pad->key_len < len) return -1;
+    otp_xor(out, in, pad->key, len);
+    return 0;
+}
+
+static int plan_otp_encrypt(req_t *r) {
+    if (r->phase == 0) {
+        if (json_string(r->al, (const char*)r->body, r->body_len, "text", &r->f[0]) != 0) {
+            reply_error(r, 400, "Missing text field", NULL);
+            return STEP_DONE;
+        }
+        json_string(r->al, (const char*)r->body, r->body_len, "compression", &r->f[1]);
+        int c = plan_compress(r, r->f[1].p, r->f[1].n, (const uint8_t*)r->f[0].p, r->f[0].n);
+        if (c) return c > 0 ? STEP_COMPRESS : STEP_DONE;
+    }
+    if (r->km_n == 0) { km_mint(r, r->pl_len); return STEP_KM; }
+    const km_call_t *k = km_failed(r);
+    if (k) { reply_error(r, 500, "encryption_failed", k->err); return STEP_DONE; }
+    return STEP_RUN;
+}
+
+static void run_otp_encrypt(req_t *r) {
+    const km_call_t *pad = &r->km[0];
+    size_t n = r->pl_len;
+    uint64_t t0 = now_ns();
+    uint8_t *ct = (uint8_t*)qm_alloc(r->al, n, 0);
+    if (!ct || otp_apply(ct, r->pl, n, pad) != 0) {
+        reply_error(r, 500, "encryption_failed", "key shorter than data");
+        return;
+    }
+    r->stage_ms[ST_CRYPTO] += ms_since(t0);
+
+    t0 = now_ns();
+    buf_t b = { NULL, 0, 0, r->al };
+    buf_reserve(&b, qm_base64_encoded_len(n, QM_B64_URL) + 64);
+    buf_append(&b, "{\"key_id\":", 10);
+    json_escape(&b, pad->id, strlen(pad->id));
+    buf_append(&b, ",\"ciphertext_b64url\":\"", 22);
+    b.len += qm_base64_encode(ct, n, b.p + b.len, QM_B64_URL);
+    buf_append(&b, "\"", 1);
+    if (r->comp) buf_printf(&b, ",\"compression\":\"%s\"", qm_compress_name(r->comp));
+    buf_append(&b, "}", 1);
+    reply_buf(r, 200, "application/json", &b);
+    r->stage_ms[ST_ENCODE] += ms_since(t0);
+}
+
+static int plan_otp_decrypt(req_t *r) {
+    if (r->phase == 0) {
+        if (json_string(r->al, (const char*)r->body, r->body_len, "key_id", &r->f[0]) != 0 ||
+            json_string(r->al, (const char*)r->body, r->body_len, "ciphertext_b64url", &r->f[1]) != 0) {
+            reply_error(r, 400, "Missing required fields", NULL);
+            return STEP_DONE;
+        }
+        if (json_string(r->al, (const char*)r->body, r->body_len, "compression", &r->f[2]) == 0 &&
+            (qm_compress_from_name(r->f[2].p, r->f[2].n, &r->comp) != 0 || r->comp == QM_COMP_AUTO)) {
+            reply_error(r, 400, "unsupported_compression", NULL);
+            return STEP_DONE;
+        }
+        if (lookup_by_id(r, r->f[0].p, r->f[0].n) != 0) { reply_error(r, 500, "decryption_failed", "bad key_id"); return STEP_DONE; }
+        return STEP_KM;
+    }
+    const km_call_t *k = km_failed(r);
+    if (k) { reply_error(r, 500, "decryption_failed", k->err); return STEP_DONE; }
+    return STEP_RUN;
+}
+
+static void run_otp_decrypt(req_t *r) {
+    const km_call_t *pad = &r->km[0];
+    uint64_t t0 = now_ns();
+    size_t n = 0;
+    uint8_t *pt = (uint8_t*)qm_alloc(r->al, qm_base64_decoded_max(r->f[1].n) + 1, QM_ALLOC_SECRET);
+    if (!pt || qm_base64_decode(r->f[1].p, r->f[1].n, pt, &n, QM_B64_URL) != 0) {
+        reply_error(r, 500, "decryption_failed", "invalid base64url");
+        return;
+    }
+    r->stage_ms[ST_ENCODE] += ms_since(t0);
+
+    t0 = now_ns();
+    int ok = otp_apply(pt, pt, n, pad) == 0;
+    r->stage_ms[ST_CRYPTO] += ms_since(t0);
+    if (!ok) { reply_error(r, 500, "decryption_failed", "key shorter than data"); return; }
+    const uint8_t *text = pt;
+    if (decompress_payload(r, r->comp, &text, &n, 500, "decryption_failed") != 0) return;
+    if (!utf8_valid(text, n)) { reply_error(r, 500, "decryption_failed", "plaintext is not UTF-8"); return; }
+
+    t0 = now_ns();
+    buf_t b = { NULL, 0, 0, r->al };
+    buf_reserve(&b, n + 16);
+    buf_append(&b, "{\"text\":", 8);
+    json_escape(&b, (const char*)text, n);
+    buf_append(&b, "}", 1);
+    reply_buf(r, 200, "application/json", &b);
+    r->stage_ms[ST_ENCODE] += ms_since(t0);
+}
+
+static int plan_otp_encrypt_env(req_t *r) {
+    if (r->phase == 0) {
+        char v[16];
+        r->inner = query_param(r->query, "inner", v, sizeof(v)) == 0 && strcmp(v, "1") == 0;
+        if (query_param(r->query, "compression", v, sizeof(v)) != 0) v[0] = '\0';
+        int c = plan_compress(r, v, strlen(v), r->body, r->body_len);
+        if (c) return c > 0 ? STEP_COMPRESS : STEP_DONE;
+    }
+    if (r->km_n == 0) { km_mint(r, r->pl_len ? r->pl_len : 1); return STEP_KM; }
+    const km_call_t *k = km_failed(r);
+    if (k) { reply_error(r, 500, "encryption_failed", k->err); return STEP_DONE; }
+    return STEP_RUN;
+}
+
+static void run_otp_encrypt_env(req_t *r) {
+    const km_call_t *pad = &r->km[0];
+    uint64_t t0 = now_ns();
+    /* Header first with the ciphertext slot reserved, then XOR into the slot */
+    qm_envelope_t e, slots;
+    memset(&e, 0, sizeof(e));
+    e.alg = QM_ALG_OTP_XOR;
+    e.flags = r->inner ? QM_ENV_F_INNER : 0;
+    e.comp = r->comp;
+    e.key_id = (const uint8_t*)pad->id; e.key_id_len = strlen(pad->id);
+    e.ct_len = r->pl_len;
+    uint8_t *out = NULL; size_t out_len = 0;
+    if (qm_envelope_encode_al(r->al, &e, &out, &out_len) != 0 || qm_envelope_parse(out, out_len, &slots) != 0 ||
+        otp_apply((uint8_t*)slots.ct, r->pl, r->pl_len, pad) != 0) {
+        reply_error(r, 500, "encryption_failed", "key shorter than data");
+        return;
+    }
+    r->stage_ms[ST_CRYPTO] += ms_since(t0);
+    set_key_id_header(r, pad->id);
+    reply(r, 200, QM_ENVELOPE_CONTENT_TYPE, out, out_len);
+}
+
+static int plan_otp_decrypt_env(req_t *r) {
+    return plan_env_lookup(r, QM_ALG_OTP_XOR, "not an OTP layer with a key id", 500, "decryption_failed");
+}
+
+static void run_otp_decrypt_env(req_t *r) {
+    const km_call_t *pad = &r->km[0];
+    qm_envelope_t e;
+    uint64_t t0 = now_ns();
+    /* The request buffer is ours: XOR the ciphertext in place and answer with it */
+    if (qm_envelope_parse(r->body, r->body_len, &e) != 0 ||
+        otp_apply((uint8_t*)e.ct, e.ct, e.ct_len, pad) != 0) {
+        reply_error(r, 500, "decryption_failed", "key shorter than data");
+        return;
+    }
+    r->stage_ms[ST_CRYPTO] += ms_since(t0);
+    const uint8_t *pt = e.ct;
+    size_t n = e.ct_len;
+    if (decompress_payload(r, e.comp, &pt, &n, 500, "decryption_failed") != 0) return;
+    reply(r, 200, r->inner ? QM_ENVELOPE_CONTENT_TYPE : "application/octet-stream", pt, n);
+}
+
+/* ---------- Health ---------- */
+
+static int plan_health(req_t *r) {
+    if (r->phase == 0) {
+        km_call_t *k = &r->km[r->km_n++];
+        memset(k, 0, sizeof(*k));
+        k->req = r; k->op = KM_HEALTH;
+        return STEP_KM;
+    }
+    const km_call_t *k = &r->km[0];
+    const char *km = k->ok ? "healthy" : k->http_status ? "degraded" : "unavailable";
+    qm_secmem_stats_t sm;
+    qm_secmem_stats(&sm);
+    buf_t b = { NULL, 0, 0, r->al };
+    buf_printf(&b, "{\"status\":\"%s\",\"service\":\"qm-relay\",\"version\":\"1.0\","
+                   "\"dependencies\":{\"key_manager\":\"%s\"},\"crypto_threads\":%d,\"km_connections\":%d,"
+                   "\"secmem\":{\"locked_bytes\":%zu,\"in_use\":%zu,\"lock_failures\":%llu}}",
+               k->ok ? "healthy" : "degraded", km, cfg.threads, km_count,
+               sm.locked_bytes, sm.in_use, (unsigned long long)sm.lock_failures);
+    reply_buf(r, k->ok ? 200 : 503, "application/json", &b);
+    return STEP_DONE;
+}
+
+static const route_t ROUTES[] = {
+    { "POST", "/api/gcm/encrypt",         plan_gcm_encrypt,         run_gcm_encrypt },
+    { "POST", "/api/gcm/decrypt",         plan_gcm_decrypt,         run_gcm_decrypt },
+    { "POST", "/api/gcm/encrypt-chunked", plan_gcm_encrypt_chunked, run_gcm_encrypt_chunked },
+    { "POST", "/api/gcm/decrypt-chunked", plan_gcm_decrypt_chunked, run_gcm_decrypt_chunked },
+    { "POST", "/api/gcm/encrypt-env",     plan_gcm_encrypt_env,     run_gcm_encrypt_env },
+    { "POST", "/api/gcm/decrypt-env",     plan_gcm_decrypt_env,     run_gcm_decrypt_env },
+    { "POST", "/api/layers/seal",         plan_layers_seal,         run_layers_seal },
+    { "POST", "/api/otp/encrypt",         plan_otp_encrypt,         run_otp_encrypt },
+    { "POST", "/api/otp/decrypt",         plan_otp_decrypt,         run_otp_decrypt },
+    { "POST", "/api/otp/encrypt-env",     plan_otp_encrypt_env,     run_otp_encrypt_env },
+    { "POST", "/api/otp/decrypt-env",     plan_otp_decrypt_env,     run_otp_decrypt_env },
+    { "GET",  "/health",                  plan_health,              NULL },
+};
+
+/* ===================== Client connections ===================== */
+
+struct client {
+    int        kind, fd;
+    buf_t      in;
+    size_t     hdr_len;            /* 0 until the header block is complete */
+    size_t     body_need;          /* Content-Length */
+    int        chunked, keep, continued;
+    chunked_t  ch;
+    buf_t      dechunked;
+    req_t     *busy;               /* in the pipeline or being written */
+    size_t     wr_off;
+    int        writing, paused, closing;
+    client_t  *next_dead;
+};
+
+/* Closed clients are freed after the current epoll batch, which may still
+   hold events for them (a KM reply or a worker can finish a response that
+   closes its connection). */
+static client_t *dead_clients;
+
+static void client_parse(client_t *c);
+static void client_flush(client_t *c);
+static void respond(req_t *r);
+
+static void client_events(client_t *c) {
+    uint32_t ev = 0;
+    if (!c->paused && !c->closing) ev |= EPOLLIN;
+    if (c->writing) ev |= EPOLLOUT;
+    ep_set(c->fd, c, ev, 0);
+}
+
+static void client_close(client_t *c) {
+    if (c->fd < 0) return;
+    epoll_ctl(epfd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    c->fd = -1;
+    if (c->busy) {
+        if (c->writing) req_free(c->busy);
+        else c->busy->c = NULL;               /* orphaned: freed when its pipeline ends */
+        c->busy = NULL;
+    }
+    buf_free(&c->in);
+    buf_free(&c->dechunked);
+    c->next_dead = dead_clients;
+    dead_clients = c;
+}
+
+/* Short error straight from the parser; the connection closes afterwards */
+static void client_reject(client_t *c, int status, const char *error) {
+    req_t *r = req_new(c);
+    if (!r) { client_close(c); return; }
+    c->keep = 0;
+    c->closing = 1;
+    c->busy = r;
+    reply_error(r, status, error, NULL);
+    respond(r);
+}
+
+/* ---------- Response ---------- */
+
+static void respond(req_t *r) {
+    client_t *c = r->c;
+    if (!c) { req_free(r); return; }
+    buf_printf(&r->head, "HTTP/1.1 %d %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\n",
+               r->status, status_text(r->status), r->ctype ? r->ctype : "application/json", r->rlen);
+    if (r->hdrs.len) buf_append(&r->head, r->hdrs.p, r->hdrs.len);
+    if (r->route) {
+        buf_append(&r->head, "Server-Timing: ", 15);
+        for (int i = 0; i < ST_COUNT; ++i)
+            buf_printf(&r->head, "%s%s;dur=%.3f", i ? ", " : "", STAGE_NAMES[i], r->stage_ms[i]);
+        buf_append(&r->head, "\r\n", 2);
+    }
+    buf_printf(&r->head, "Connection: %s\r\n\r\n", c->keep ? "keep-alive" : "close");
+    client_flush(c);
+}
+
+static void client_flush(client_t *c) {
+    req_t *r = c->busy;
+    if (c->fd < 0) return;
+    c->writing = 1;
+    for (;;) {
+        size_t total = r->head.len + r->rlen;
+        if (c->wr_off >= total) break;
+        struct iovec iov[2];
+        int n = 0;
+        if (c->wr_off < r->head.len) {
+            iov[n].iov_base = r->head.p + c->wr_off;
+            iov[n++].iov_len = r->head.len - c->wr_off;
+            if (r->rlen) { iov[n].iov_base = (void*)r->rbody; iov[n++].iov_len = r->rlen; }
+        } else {
+            size_t o = c->wr_off - r->head.len;
+            iov[n].iov_base = (void*)(r->rbody + o);
+            iov[n++].iov_len = r->rlen - o;
+        }
+        ssize_t w = writev(c->fd, iov, n);
+        if (w < 0 && errno == EINTR) continue;
+        if (w < 0 && errno == EAGAIN) { client_events(c); return; }
+        if (w <= 0) { client_close(c); return; }
+        c->wr_off += (size_t)w;
+    }
+    c->writing = 0;
+    c->wr_off = 0;
+    c->busy = NULL;
+    req_free(r);
+    if (!c->keep) { client_close(c); return; }
+    c->paused = 0;
+    client_parse(c);                          /* pipelined requests already buffered */
+    if (c->fd >= 0 && !c->writing) client_events(c);
+}
+
+/* ---------- Pipeline: plan on the loop, KM rounds, run on the pool ---------- */
+
+static void advance(req_t *r);
+
+static void call_done(km_call_t *k) {
+    req_t *r = k->req;
+    if (--r->km_pending == 0) advance(r);
+}
+
+static void advance(req_t *r) {
+    if (r->km_issued) r->stage_ms[ST_KM] += ms_since(r->km_t0);
+    for (;;) {
+        if (!r->c) { req_free(r); return; }
+        int step = r->route->plan(r);
+        r->phase++;
+        if (step == STEP_DONE) { respond(r); return; }
+        if (step == STEP_RUN) { pool_submit(r); return; }
+        if (step == STEP_COMPRESS) { r->compressing = 1; pool_submit(r); return; }
+
+        /* New KM round. The extra hold keeps a call that fails synchronously
+           (no connection possible) from finishing the round mid-submit. */
+        int first = r->km_issued;
+        r->km_issued = r->km_n;
+        r->km_pending = r->km_n - first + 1;
+        r->km_t0 = now_ns();
+        for (int i = first; i < r->km_n; ++i) km_submit(&r->km[i]);
+        if (--r->km_pending != 0) return;
+        r->stage_ms[ST_KM] += ms_since(r->km_t0);
+    }
+}
+
+static void dispatch(req_t *r) {
+    const char *path = r->target;
+    int path_known = 0;
+    for (size_t i = 0; i < sizeof(ROUTES) / sizeof(ROUTES[0]); ++i) {
+        if (strcmp(ROUTES[i].path, path) != 0) continue;
+        path_known = 1;
+        if (strcmp(ROUTES[i].method, r->method) == 0) { r->route = &ROUTES[i]; break; }
+    }
+    if (!r->route) {
+        if (path_known) { buf_printf(&r->hdrs, "Allow: %s\r\n", strcmp(path, "/health") ? "POST" : "GET"); reply_error(r, 405, "method_not_allowed", NULL); }
+        else reply_error(r, 404, "not_found", NULL);
+        respond(r);
+        return;
+    }
+    advance(r);
+}
+
+static void drain_done(void) {
+    uint64_t n;
+    if (read(done_efd, &n, sizeof(n)) < 0) { /* spurious wakeup */ }
+    pthread_mutex_lock(&done_lock);
+    req_t *list = done_head;
+    done_head = NULL;
+    pthread_mutex_unlock(&done_lock);
+    while (list) {
+        req_t *r = list;
+        list = r->next;
+        if (r->compressing) { r->compressing = 0; advance(r); }
+        else respond(r);
+    }
+}
+
+/* ---------- Request parsing ---------- */
+
+/* Parses the header block at the front of c->in; -1 sends 400 */
+static int client_headers(client_t *c, char *e) {
+    c->hdr_len = (size_t)(e - c->in.p) + 4;
+    const char *blk = c->in.p;
+    size_t vlen;
+    const char *v;
+    int minor = 0;
+    char method[8];
+    if (sscanf(blk, "%7s %*s HTTP/1.%d", method, &minor) != 2) return -1;
+    c->keep = minor >= 1;
+    if ((v = header_find(blk, c->hdr_len, "Connection", &vlen))) {
+        if (vlen >= 5 && strncasecmp(v, "close", 5) == 0) c->keep = 0;
+        else if (vlen >= 10 && strncasecmp(v, "keep-alive", 10) == 0) c->keep = 1;
+    }
+    c->chunked = 0;
+    c->body_need = 0;
+    if ((v = header_find(blk, c->hdr_len, "Transfer-Encoding", &vlen))) {
+        if (vlen < 7 || strncasecmp(v + vlen - 7, "chunked", 7) != 0) return -1;
+        c->chunked = 1;
+        memset(&c->ch, 0, sizeof(c->ch));
+        c->ch.pos = c->hdr_len;
+        c->dechunked.len = 0;
+    } else if ((v = header_find(blk, c->hdr_len, "Content-Length", &vlen))) {
+        char *end;
+        unsigned long long n = strtoull(v, &end, 10);
+        if (end == v) return -1;
+        c->body_need = (size_t)n;
+        if (n > cfg.max_body) return 413;
+    }
+    c->continued = 0;
+    if ((v = header_find(blk, c->hdr_len, "Expect", &vlen)) && vlen >= 12 && strncasecmp(v, "100-continue", 12) == 0) {
+        static const char cont[] = "HTTP/1.1 100 Continue\r\n\r\n";
+        if (send(c->fd, cont, sizeof(cont) - 1, MSG_NOSIGNAL) < 0) { /* client will send anyway */ }
+        c->continued = 1;
+    }
+    return 0;
+}
+
+static void client_parse(client_t *c) {
+    if (c->busy || c->fd < 0) return;
+    if (!c->hdr_len) {
+        char *e = c->in.len ? memmem(c->in.p, c->in.len, "\r\n\r\n", 4) : NULL;
+        if (!e) {
+            if (c->in.len > MAX_HDR_BYTES) client_reject(c, 431, "headers_too_large");
+            return;
+        }
+        int rc = client_headers(c, e);
+        if (rc == 413) { client_reject(c, 413, "payload_too_large"); return; }
+        if (rc != 0) { client_reject(c, 400, "bad_request"); return; }
+    }
+
+    size_t end;
+    if (c->chunked) {
+        int rc = chunked_feed(&c->ch, c->in.p, c->in.len, &c->dechunked);
+        if (rc < 0) { client_reject(c, 400, "bad_chunked_body"); return; }
+        if (c->dechunked.len > cfg.max_body) { client_reject(c, 413, "payload_too_large"); return; }
+        if (rc == 0) return;
+        end = c->ch.pos;
+    } else {
+        end = c->hdr_len + c->body_need;
+        if (c->in.len < end) {
+            /* Body still arriving: make room for all of it in one go */
+            buf_reserve(&c->in, end - c->in.len);
+            return;
+        }
+    }
+
+    /* Complete: the request takes the receive buffer; pipelined bytes move on */
+    req_t *r = req_new(c);
+    if (!r) { client_close(c); return; }
+    r->raw = c->in;
+    r->hdr_len = c->hdr_len;
+    c->in = (buf_t){ NULL, 0, 0, bufs };
+    if (r->raw.len > end) {
+        buf_append(&c->in, r->raw.p + end, r->raw.len - end);
+        r->raw.len = end;
+    }
+    if (c->chunked) {
+        r->dechunked = c->dechunked;
+        c->dechunked = (buf_t){ NULL, 0, 0, bufs };
+        r->body = (const uint8_t*)r->dechunked.p;
+        r->body_len = r->dechunked.len;
+    } else {
+        r->body = (const uint8_t*)r->raw.p + r->hdr_len;
+        r->body_len = c->body_need;
+    }
+    c->hdr_len = 0;
+    c->busy = r;
+
+    /* Request line, split in place: METHOD SP target SP version */
+    char *line = r->raw.p;
+    char *sp1 = strchr(line, ' ');
+    char *sp2 = sp1 ? strchr(sp1 + 1, ' ') : NULL;
+    if (!sp1 || !sp2 || sp1 - line >= (ptrdiff_t)sizeof(r->method)) { c->keep = 0; reply_error(r, 400, "bad_request", NULL); respond(r); return; }
+    memcpy(r->method, line, (size_t)(sp1 - line));
+    r->target = sp1 + 1;
+    *sp2 = '\0';
+    if ((r->query = strchr(r->target, '?'))) *r->query++ = '\0';
+
+    if (c->in.len >= READ_PAUSE_BYTES) c->paused = 1;
+    dispatch(r);
+}
+
+static void client_event(client_t *c, uint32_t events) {
+    if (c->fd < 0) return;
+    if (events & EPOLLOUT) {
+        if (c->writing) { client_flush(c); return; }
+    }
+    if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+        for (;;) {
+            if (buf_reserve(&c->in, 64 * 1024) != 0) { client_close(c); return; }
+            ssize_t n = recv(c->fd, c->in.p + c->in.len, c->in.cap - c->in.len - 1, 0);
+            if (n > 0) {
+                c->in.len += (size_t)n;
+                if (c->in.len - c->hdr_len >= READ_PAUSE_BYTES && c->busy) { c->paused = 1; client_events(c); return; }
+                if ((size_t)n < 64 * 1024) break;
+                continue;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && errno == EAGAIN) break;
+            client_close(c);                  /* EOF or error */
+            return;
+        }
+        client_parse(c);
+        if (c->fd >= 0 && !c->writing && c->paused) client_events(c);
+    }
+}
+
+/* ===================== Main loop ===================== */
+
+typedef struct { int kind, fd; } listener_t;
+
+static int listen_on(int port) {
+    int fd = socket(AF_INET6, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int v6 = fd >= 0;
+    if (!v6) fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    int one = 1, zero = 0;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    int rc;
+    if (v6) {
+        setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &zero, sizeof(zero));
+        struct sockaddr_in6 a;
+        memset(&a, 0, sizeof(a));
+        a.sin6_family = AF_INET6; a.sin6_addr = in6addr_any; a.sin6_port = htons((uint16_t)port);
+        rc = bind(fd, (struct sockaddr*)&a, sizeof(a));
+    } else {
+        struct sockaddr_in a;
+        memset(&a, 0, sizeof(a));
+        a.sin_family = AF_INET; a.sin_addr.s_addr = htonl(INADDR_ANY); a.sin_port = htons((uint16_t)port);
+        rc = bind(fd, (struct sockaddr*)&a, sizeof(a));
+    }
+    if (rc != 0 || listen(fd, 1024) != 0) { close(fd); return -1; }
+    return fd;
+}
+
+static void accept_all(listener_t *l) {
+    for (;;) {
+        int fd = accept4(l->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) return;
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        client_t *c = (client_t*)calloc(1, sizeof(*c));
+        if (!c) { close(fd); continue; }
+        c->kind = K_CLIENT; c->fd = fd;
+        c->in.al = c->dechunked.al = bufs;
+        ep_set(fd, c, EPOLLIN, 1);
+    }
+}
+
+/* "http://host:port[/...]" or "host:port" */
+static int parse_km(const char *s) {
+    if (strncmp(s, "http://", 7) == 0) s += 7;
+    const char *colon = strrchr(s, ':');
+    size_t hl = colon ? (size_t)(colon - s) : strcspn(s, "/");
+    if (hl == 0 || hl >= sizeof(cfg.km_host)) return -1;
+    memcpy(cfg.km_host, s, hl);
+    cfg.km_host[hl] = '\0';
+    cfg.km_port = colon ? atoi(colon + 1) : 80;
+    return cfg.km_port > 0 && cfg.km_port < 65536 ? 0 : -1;
+}
+
+static int resolve_km(void) {
+    struct addrinfo hints, *res = NULL;
+    char port[8];
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_socktype = SOCK_STREAM;
+    snprintf(port, sizeof(port), "%d", cfg.km_port);
+    if (getaddrinfo(cfg.km_host, port, &hints, &res) != 0 || !res) return -1;
+    memcpy(&km_addr, res->ai_addr, res->ai_addrlen);
+    km_addr_len = res->ai_addrlen;
+    freeaddrinfo(res);
+    return 0;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+        "Usage: %s [--listen PORT]... [--km HOST:PORT] [--threads N] [--km-conns N] [--max-body SIZE]\n"
+        "          [--max-plaintext SIZE]\n"
+        "  --listen    port to serve on, repeatable (default $PORT or 2022)\n"
+        "  --km        key manager (default $KM_URL or 127.0.0.1:2020)\n"
+        "  --threads   crypto worker threads (default: online CPUs)\n"
+        "  --km-conns  kept-alive KM connections at most (default 64)\n"
+        "  --max-body  largest request body, e.g. 256m (default 256m)\n"
+        "  --max-plaintext  largest decompressed payload (default $MAX_PLAINTEXT or 25m)\n", argv0);
+}
+
+int main(int argc, char **argv) {
+    const char *km = getenv("KM_URL");
+    if (parse_km(km && *km ? km : "127.0.0.1:2020") != 0) { fprintf(stderr, "Bad KM_URL\n"); return 1; }
+    cfg.threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    cfg.km_conns = 64;
+    cfg.max_body = 256u << 20;
+    const char *mp = getenv("MAX_PLAINTEXT");
+    if (!mp || !*mp || parse_size(mp, &cfg.max_plaintext) != 0) cfg.max_plaintext = 25u << 20;
+
+    for (int i = 1; i < argc; ++i) {
+        const char *a = argv[i];
+        const char *v = i + 1 < argc ? argv[i + 1] : NULL;
+        if (!strcmp(a, "--help") || !strcmp(a, "-h")) { usage(argv[0]); return 0; }
+        if (!v) { usage(argv[0]); return 1; }
+        if (!strcmp(a, "--listen")) {
+            if (cfg.nports == MAX_LISTEN || (cfg.ports[cfg.nports++] = atoi(v)) <= 0) { usage(argv[0]); return 1; }
+        } else if (!strcmp(a, "--km")) {
+            if (parse_km(v) != 0) { fprintf(stderr, "Bad --km %s\n", v); return 1; }
+        } else if (!strcmp(a, "--threads")) {
+            cfg.threads = atoi(v);
+        } else if (!strcmp(a, "--km-conns")) {
+            cfg.km_conns = atoi(v);
+        } else if (!strcmp(a, "--max-body")) {
+            if (parse_size(v, &cfg.max_body) != 0) { usage(argv[0]); return 1; }
+        } else if (!strcmp(a, "--max-plaintext")) {
+            if (parse_size(v, &cfg.max_plaintext) != 0) { usage(argv[0]); return 1; }
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+        ++i;
+    }
+    if (!cfg.nports) {
+        const char *p = getenv("PORT");
+        cfg.ports[cfg.nports++] = p && atoi(p) > 0 ? atoi(p) : 2022;
+    }
+    if (cfg.threads < 1) cfg.threads = 1;
+    if (cfg.km_conns < 1) cfg.km_conns = 1;
+
+    signal(SIGPIPE, SIG_IGN);
+    if (resolve_km() != 0) { fprintf(stderr, "Cannot resolve KM host %s\n", cfg.km_host); return 1; }
+    if (!(km_all = (km_conn_t**)calloc((size_t)cfg.km_conns, sizeof(*km_all)))) return 1;
+    qm_pool_t *pool = qm_pool_create(0);
+    if (!pool) return 1;
+    bufs = qm_pool_allocator(pool);
+
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    done_efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epfd < 0 || done_efd < 0) { perror("epoll/eventfd"); return 1; }
+    static int done_kind = K_DONE;
+    ep_set(done_efd, &done_kind, EPOLLIN, 1);
+
+    static listener_t listeners[MAX_LISTEN];
+    for (int i = 0; i < cfg.nports; ++i) {
+        listeners[i].kind = K_LISTEN;
+        if ((listeners[i].fd = listen_on(cfg.ports[i])) < 0) { fprintf(stderr, "Cannot listen on %d: %s\n", cfg.ports[i], strerror(errno)); return 1; }
+        ep_set(listeners[i].fd, &listeners[i], EPOLLIN, 1);
+    }
+
+    for (int i = 0; i < cfg.threads; ++i) {
+        pthread_t t;
+        if (pthread_create(&t, NULL, pool_thread, NULL) != 0) { perror("pthread_create"); return 1; }
+        pthread_detach(t);
+    }
+
+    fprintf(stderr, "qm_relay: %d port(s) from %d, KM %s:%d, %d crypto threads, AES %s, codec %s\n",
+            cfg.nports, cfg.ports[0], cfg.km_host, cfg.km_port, cfg.threads,
+            aes_backend_name(aes_backend()), qm_codec_impl_name(qm_codec_impl()));
+
+    struct epoll_event evs[MAX_EVENTS];
+    for (;;) {
+        int n = epoll_wait(epfd, evs, MAX_EVENTS, km_count ? 250 : -1);
+        if (n < 0 && errno != EINTR) { perror("epoll_wait"); return 1; }
+        for (int i = 0; i < n; ++i) {
+            int kind = *(int*)evs[i].data.ptr;
+            switch (kind) {
+            case K_LISTEN: accept_all((listener_t*)evs[i].data.ptr); break;
+            case K_CLIENT: client_event((client_t*)evs[i].data.ptr, evs[i].events); break;
+            case K_KM:     km_event((km_conn_t*)evs[i].data.ptr, evs[i].events); break;
+            case K_DONE:   drain_done(); break;
+            }
+        }
+        km_sweep();
+        while (dead_clients) {
+            client_t *c = dead_clients;
+            dead_clients = c->next_dead;
+            free(c);
+        }
+    }
+}
@@ -0,0 +1,203 @@
+#include "qm_secmem.h"
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#define SEC_MIN_SHIFT   6                  /* 64 B: raw keys, IVs, GHASH state */
+#define SEC_MAX_SHIFT   16                 /* 64 KiB (QM_SECMEM_MAX_SLOT): short OTP pads */
+#define SEC_CLASSES     (SEC_MAX_SHIFT - SEC_MIN_SHIFT + 1)
+#define SEC_SLAB_MIN    (64u * 1024u)      /* usable bytes per slab, and at least 4 slots */
+
+static void             *free_slots[SEC_CLASSES];
+static qm_secmem_stats_t stats;
+
+#ifdef _WIN32
+static SRWLOCK sec_lock = SRWLOCK_INIT;
+#define SEC_LOCK()   AcquireSRWLockExclusive(&sec_lock)
+#define SEC_UNLOCK() ReleaseSRWLockExclusive(&sec_lock)
+#else
+static pthread_mutex_t sec_lock = PTHREAD_MUTEX_INITIALIZER;
+#define SEC_LOCK()   pthread_mutex_lock(&sec_lock)
+#define SEC_UNLOCK() pthread_mutex_unlock(&sec_lock)
+#endif
+
+/* ---------- Helpers: wipe, pages ---------- */
+static void secure_zero(void *p, size_t n) {
+    volatile uint8_t *q = (volatile uint8_t*)p;
+    while (n--) *q++ = 0;
+}
+
+static size_t page_size(void) {
+    static size_t ps;
+    if (!ps) {
+#ifdef _WIN32
+        SYSTEM_INFO si;
+        GetSystemInfo(&si);
+        ps = si.dwPageSize;
+#else
+        long v = sysconf(_SC_PAGESIZE);
+        ps = v > 0 ? (size_t)v : 4096;
+#endif
+    }
+    return ps;
+}
+
+static size_t page_round(size_t n) {
+    size_t pg = page_size();
+    return (n + pg - 1) & ~(pg - 1);
+}
+
+/* n usable bytes (a page multiple) between two inaccessible guard pages.
+   *locked tells whether they could be pinned in RAM. */
+static uint8_t *map_guarded(size_t n, int *locked) {
+    size_t pg = page_size();
+#ifdef _WIN32
+    uint8_t *base = (uint8_t*)VirtualAlloc(NULL, n + 2 * pg, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    if (!base) return NULL;
+    DWORD old;
+    if (!VirtualProtect(base, pg, PAGE_NOACCESS, &old) ||
+        !VirtualProtect(base + pg + n, pg, PAGE_NOACCESS, &old)) {
+        VirtualFree(base, 0, MEM_RELEASE);
+        return NULL;
+    }
+    *locked = VirtualLock(base + pg, n) != 0;
+#else
+    uint8_t *base = (uint8_t*)mmap(NULL, n + 2 * pg, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) return NULL;
+    if (mprotect(base + pg, n, PROT_READ | PROT_WRITE) != 0) {
+        munmap(base, n + 2 * pg);
+        return NULL;
+    }
+    *locked = mlock(base + pg, n) == 0;
+#ifdef MADV_DONTDUMP
+    madvise(base + pg, n, MADV_DONTDUMP);
+#endif
+#ifdef MADV_WIPEONFORK
+    madvise(base + pg, n, MADV_WIPEONFORK);
+#endif
+#endif
+    return base + pg;
+}
+
+static void unmap_guarded(uint8_t *p, size_t n) {
+    size_t pg = page_size();
+#ifdef _WIN32
+    VirtualUnlock(p, n);
+    VirtualFree(p - pg, 0, MEM_RELEASE);
+#else
+    munlock(p, n);
+    munmap(p - pg, n + 2 * pg);
+#endif
+}
+
+/* ---------- Helpers: size classes ---------- */
+static unsigned size_class(size_t n) {
+    unsigned c = 0;
+    while (((size_t)1 << (c + SEC_MIN_SHIFT)) < n) c++;
+    return c;
+}
+
+static size_t class_size(unsigned c) { return (size_t)1 << (c + SEC_MIN_SHIFT); }
+
+#define SEC_MAX_SLOT class_size(SEC_CLASSES - 1)
+
+/* Caller holds the lock. Slots go on the list lowest address first. */
+static int slab_refill(unsigned c) {
+    size_t slot = class_size(c);
+    size_t n = page_round(slot * 4 > SEC_SLAB_MIN ? slot * 4 : SEC_SLAB_MIN);
+    int locked = 0;
+    uint8_t *p = map_guarded(n, &locked);
+    if (!p) return -1;
+    for (size_t off = n; off >= slot; off -= slot) {
+        void **s = (void**)(p + off - slot);
+        *s = free_slots[c];
+        free_slots[c] = s;
+    }
+    stats.slabs++;
+    stats.slab_bytes += n;
+    if (locked) stats.locked_bytes += n; else stats.lock_failures++;
+    return 0;
+}
+
+/* ===================== API ===================== */
+
+void *qm_secmem_alloc(size_t n) {
+    if (!n) n = 1;
+    if (n > SEC_MAX_SLOT) {
+        int locked = 0;
+        uint8_t *p = map_guarded(page_round(n), &locked);
+        if (!p) return NULL;
+        SEC_LOCK();
+        stats.large_allocs++;
+        if (!locked) stats.lock_failures++;
+        SEC_UNLOCK();
+        return p;
+    }
+    unsigned c = size_class(n);
+    SEC_LOCK();
+    if (!free_slots[c] && slab_refill(c) != 0) { SEC_UNLOCK(); return NULL; }
+    void **s = (void**)free_slots[c];
+    free_slots[c] = *s;
+    stats.in_use += class_size(c);
+    SEC_UNLOCK();
+    *s = NULL;                  /* the rest of the slot was wiped on return */
+    return s;
+}
+
+void qm_secmem_free(void *p, size_t n) {
+    if (!p) return;
+    if (!n) n = 1;
+    secure_zero(p, n);
+    if (n > SEC_MAX_SLOT) { unmap_guarded((uint8_t*)p, page_round(n)); return; }
+    unsigned c = size_class(n);
+    SEC_LOCK();
+    *(void**)p = free_slots[c];
+    free_slots[c] = p;
+    stats.in_use -= class_size(c);
+    SEC_UNLOCK();
+}
+
+void qm_secmem_stats(qm_secmem_stats_t *s) {
+    SEC_LOCK();
+    *s = stats;
+    SEC_UNLOCK();
+}
+
+/* ---------- qm_alloc_t handle (flags ignored: everything here is secret) ---------- */
+static void *sec_alloc_cb(void *ctx, size_t n, unsigned flags) {
+    (void)ctx; (void)flags;
+    return qm_secmem_alloc(n);
+}
+static void *sec_resize_cb(void *ctx, void *p, size_t old, size_t n, unsigned flags) {
+    (void)ctx; (void)flags;
+    void *q = qm_secmem_alloc(n);
+    if (!q) return NULL;
+    if (p) { memcpy(q, p, old < n ? old : n); qm_secmem_free(p, old); }
+    return q;
+}
+static void sec_release_cb(void *ctx, void *p, size_t n, unsigned flags) {
+    (void)ctx; (void)flags;
+    qm_secmem_free(p, n);
+}
+
+static const qm_alloc_t sec_handle = { sec_alloc_cb, sec_resize_cb, sec_release_cb, NULL };
+
+const qm_alloc_t *qm_secmem_allocator(void) { return &sec_handle; }
+
+/* ---------- Expanded keys ---------- */
+aes_key_t *qm_secmem_key_new(const uint8_t *key, size_t key_len) {
+    aes_key_t *k = (aes_key_t*)qm_secmem_alloc(sizeof(*k));
+    if (!k) return NULL;
+    if (aes_key_init(k, key, key_len) != 0) { qm_secmem_free(k, sizeof(*k)); return NULL; }
+    return k;
+}
+
+void qm_secmem_key_free(aes_key_t *k) {
+    qm_secmem_free(k, sizeof(*k));
+}
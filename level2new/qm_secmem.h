@@ -0,0 +1,53 @@
+#ifndef QM_SECMEM_H
+#define QM_SECMEM_H
+
+#include "qm_alloc.h"
+#include "aes.h"
+
+/*
+ * Locked memory for key material: expanded AES keys, GCM/GHASH state, OTP
+ * pads and raw key bytes.
+ *
+ * Small requests (up to 64 KiB) are served from fixed-size slots: power-of-
+ * two classes carved out of slabs that are mapped once, with a guard page
+ * on each side, mlock'ed (VirtualLock on Windows), excluded from core dumps
+ * and wiped in a forked child where the OS allows it. Taking and returning
+ * a slot is a free-list pop/push under a lock; no system call per message.
+ * Larger requests get their own guarded, locked mapping.
+ *
+ * Every slot is wiped when it is returned and handed out zeroed. If the
+ * memlock limit is reached the memory is still used, just not locked; the
+ * stats say how much is.
+ *
+ * Slabs are kept for the life of the process. The pool is thread-safe.
+ */
+
+#define QM_SECMEM_MAX_SLOT (64u * 1024u)   /* larger requests get their own mapping */
+
+typedef struct {
+    size_t   slab_bytes;      /* usable bytes in slabs */
+    size_t   locked_bytes;    /* slab bytes that are mlock'ed */
+    size_t   in_use;          /* slot bytes handed out */
+    uint64_t slabs;
+    uint64_t large_allocs;    /* own mappings, ever */
+    uint64_t lock_failures;
+} qm_secmem_stats_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void             *qm_secmem_alloc(size_t n);             /* zeroed; NULL on failure */
+void              qm_secmem_free(void *p, size_t n);     /* n as passed to alloc; wipes */
+const qm_alloc_t *qm_secmem_allocator(void);
+void              qm_secmem_stats(qm_secmem_stats_t *s);
+
+/* Expanded key in a locked slot; NULL on a bad key length or no memory. */
+aes_key_t        *qm_secmem_key_new(const uint8_t *key, size_t key_len);
+void              qm_secmem_key_free(aes_key_t *k);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* QM_SECMEM_H */
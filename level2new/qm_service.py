@@ -0,0 +1,126 @@
+# qm_service.py - helpers shared by the Flask relays (aes_server.py, otp_server.py)
+
+from contextlib import contextmanager
+from flask import g
+import requests, binascii, os, time
+
+try:
+    import qmcodec          # SIMD hex/base64 codec (qm_codec_py.c); stdlib fallback when not built
+except ImportError:
+    qmcodec = None
+
+KM = os.getenv("KM_URL", "http://127.0.0.1:2020")
+
+# Decompression bound per payload (one mail body or attachment), like qm_relay --max-plaintext
+MAX_PLAINTEXT = int(os.getenv("MAX_PLAINTEXT", 25 << 20))
+
+def b2h(b): return qmcodec.hexlify(b) if qmcodec else binascii.hexlify(b).decode()
+def h2b(s): return qmcodec.unhexlify(s) if qmcodec else binascii.unhexlify(s)
+
+
+@contextmanager
+def stage(name):
+    """Time a request stage; reported back in the Server-Timing header (ms)."""
+    t0 = time.perf_counter()
+    try:
+        yield
+    finally:
+        if not hasattr(g, "stages"): g.stages = {}
+        g.stages[name] = g.stages.get(name, 0.0) + (time.perf_counter() - t0) * 1000.0
+
+
+def add_server_timing(resp):
+    stages = getattr(g, "stages", None)
+    if stages:
+        resp.headers["Server-Timing"] = ", ".join(f"{n};dur={d:.3f}" for n, d in stages.items())
+    return resp
+
+
+def init_app(app):
+    """Report the stage() timings of every request on app."""
+    app.after_request(add_server_timing)
+
+
+# ---- KM client ----
+
+def get_new_key_and_id(bytes_needed=16):
+    """
+    Fetch a fresh key and its key_id from KM.
+    Supported KM responses:
+      - RAW body (key bytes) + header X-Key-Id
+      - JSON: {"key_hex":"..","key_id":".."}  OR {"key":"<base64>","key_id":".."}
+    """
+    r = requests.get(f"{KM}/otp/keys", params={"size": bytes_needed}, timeout=5)
+    r.raise_for_status()
+
+    # Prefer header
+    key_id = r.headers.get("X-Key-Id")
+
+    # Try JSON
+    key_hex = None
+    if "application/json" in r.headers.get("Content-Type", ""):
+        j = r.json()
+        key_id = j.get("key_id") or key_id
+        key_hex = j.get("key_hex")
+        if not key_hex and "key" in j:  # base64?
+            key_hex = b2h(binascii.a2b_base64(j["key"]))
+    # Fallback raw
+    if not key_hex:
+        key_hex = b2h(r.content)
+
+    if not key_id:
+        # If KM didn't send a header, synthesize one (temporary)
+        key_id = "K-unknown-" + os.urandom(4).hex()
+
+    return key_hex, key_id
+
+
+def get_key_hex_by_id(key_id):
+    """
+    Resolve key bytes by key_id from KM. Tries common patterns:
+      - GET /otp/keys/<key_id>
+      - GET /otp/keys?id=<key_id>
+      - GET /otp/key?id=<key_id>
+    Accepts raw or JSON {key_hex}/base64.
+    """
+    paths = [
+        f"{KM}/otp/keys/{key_id}",
+        f"{KM}/otp/keys?id={key_id}",
+        f"{KM}/otp/key?id={key_id}",
+    ]
+    for url in paths:
+        try:
+            r = requests.get(url, timeout=5)
+            if r.status_code == 404:
+                continue
+            r.raise_for_status()
+            if "application/json" in r.headers.get("Content-Type", ""):
+                j = r.json()
+                if "key_hex" in j: return j["key_hex"]
+                if "key" in j:     return b2h(binascii.a2b_base64(j["key"]))
+            return b2h(r.content)
+        except Exception:
+            continue
+    raise RuntimeError("Key not found in KM for key_id=" + key_id)
+
+
+def get_key_hexes_by_ids(key_ids):
+    """
+    Resolve many key ids in one KM round trip (POST /otp/keys/batch).
+    Falls back to one lookup per id against a KM without that route.
+    Returns {key_id: key_hex}; ids the KM does not know are left out.
+    """
+    key_ids = list(dict.fromkeys(key_ids))
+    if not key_ids:
+        return {}
+    r = requests.post(f"{KM}/otp/keys/batch", json={"key_ids": key_ids}, timeout=5)
+    if r.status_code not in (404, 405):
+        r.raise_for_status()
+        return r.json().get("keys", {})
+    keys = {}
+    for key_id in key_ids:
+        try:
+            keys[key_id] = get_key_hex_by_id(key_id)
+        except RuntimeError:
+            pass
+    return keys
@@ -0,0 +1,439 @@
+#include "qm_sha256.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define QM_SHA_HAVE_X86 1
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+static void secure_zero(void *p, size_t n) {
+    volatile uint8_t *q = (volatile uint8_t*)p;
+    while (n--) *q++ = 0;
+}
+
+static const uint32_t K256[64] = {
+    0x428a2f98,0x71374491,0xb5c0fbcf,0xe9b5dba5,0x3956c25b,0x59f111f1,0x923f82a4,0xab1c5ed5,
+    0xd807aa98,0x12835b01,0x243185be,0x550c7dc3,0x72be5d74,0x80deb1fe,0x9bdc06a7,0xc19bf174,
+    0xe49b69c1,0xefbe4786,0x0fc19dc6,0x240ca1cc,0x2de92c6f,0x4a7484aa,0x5cb0a9dc,0x76f988da,
+    0x983e5152,0xa831c66d,0xb00327c8,0xbf597fc7,0xc6e00bf3,0xd5a79147,0x06ca6351,0x14292967,
+    0x27b70a85,0x2e1b2138,0x4d2c6dfc,0x53380d13,0x650a7354,0x766a0abb,0x81c2c92e,0x92722c85,
+    0xa2bfe8a1,0xa81a664b,0xc24b8b70,0xc76c51a3,0xd192e819,0xd6990624,0xf40e3585,0x106aa070,
+    0x19a4c116,0x1e376c08,0x2748774c,0x34b0bcb5,0x391c0cb3,0x4ed8aa4a,0x5b9cca4f,0x682e6ff3,
+    0x748f82ee,0x78a5636f,0x84c87814,0x8cc70208,0x90befffa,0xa4506ceb,0xbef9a3f7,0xc67178f2
+};
+
+static const uint32_t H0[8] = {
+    0x6a09e667,0xbb67ae85,0x3c6ef372,0xa54ff53a,0x510e527f,0x9b05688c,0x1f83d9ab,0x5be0cd19
+};
+
+static inline uint32_t load_be32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+static inline void store_be32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)(v >> 24); p[1] = (uint8_t)(v >> 16); p[2] = (uint8_t)(v >> 8); p[3] = (uint8_t)v;
+}
+
+/* ===================== Portable ===================== */
+
+#define ROR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void compress_portable(uint32_t h[8], const uint8_t *p, size_t nblocks) {
+    uint32_t w[64];
+    while (nblocks--) {
+        for (int t = 0; t < 16; ++t) w[t] = load_be32(p + 4*t);
+        for (int t = 16; t < 64; ++t) {
+            uint32_t s0 = ROR32(w[t-15], 7) ^ ROR32(w[t-15], 18) ^ (w[t-15] >> 3);
+            uint32_t s1 = ROR32(w[t-2], 17) ^ ROR32(w[t-2], 19) ^ (w[t-2] >> 10);
+            w[t] = w[t-16] + s0 + w[t-7] + s1;
+        }
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], hh = h[7];
+        for (int t = 0; t < 64; ++t) {
+            uint32_t t1 = hh + (ROR32(e, 6) ^ ROR32(e, 11) ^ ROR32(e, 25)) + ((e & f) ^ (~e & g)) + K256[t] + w[t];
+            uint32_t t2 = (ROR32(a, 2) ^ ROR32(a, 13) ^ ROR32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            hh = g; g = f; f = e; e = d + t1; d = c; c = b; b = a; a = t1 + t2;
+        }
+        h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e; h[5] += f; h[6] += g; h[7] += hh;
+        p += QM_SHA256_BLOCK_LEN;
+    }
+    secure_zero(w, sizeof(w));
+}
+
+#ifdef QM_SHA_HAVE_X86
+
+static void cpuid7(unsigned *ebx) {
+    unsigned a, b = 0, c, d;
+    if (__get_cpuid_max(0, NULL) >= 7) __cpuid_count(7, 0, a, b, c, d);
+    *ebx = b;
+}
+
+static int shani_available(void) {
+    unsigned ebx;
+    cpuid7(&ebx);
+    __builtin_cpu_init();
+    return (ebx & (1u << 29)) && __builtin_cpu_supports("sse4.1");
+}
+
+static int avx2_available(void) {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+
+/* ===================== SHA-NI ===================== */
+
+/*
+ * Four rounds per sha256rnds2 pair, message schedule with sha256msg1/2.
+ * State is kept as ABEF/CDGH across blocks.
+ */
+
+#define SHANI_TARGET __attribute__((target("sha,sse4.1")))
+
+#define SHANI_ROUNDS(w, i) do { \
+        __m128i m_ = _mm_add_epi32((w), _mm_loadu_si128((const __m128i*)&K256[4*(i)])); \
+        s1 = _mm_sha256rnds2_epu32(s1, s0, m_); \
+        s0 = _mm_sha256rnds2_epu32(s0, s1, _mm_shuffle_epi32(m_, 0x0E)); \
+    } while (0)
+
+/* w0 = W[t-4..t-1] becomes W[t..t+3] */
+#define SHANI_SCHEDULE(w0, w1, w2, w3) \
+    (w0 = _mm_sha256msg2_epu32(_mm_add_epi32(_mm_sha256msg1_epu32(w0, w1), _mm_alignr_epi8(w3, w2, 4)), w3))
+
+SHANI_TARGET
+static void compress_shani(uint32_t h[8], const uint8_t *p, size_t nblocks) {
+    const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&h[0]), 0xB1);   /* CDAB */
+    __m128i s1  = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&h[4]), 0x1B);   /* EFGH */
+    __m128i s0  = _mm_alignr_epi8(tmp, s1, 8);                                       /* ABEF */
+    s1 = _mm_blend_epi16(s1, tmp, 0xF0);                                             /* CDGH */
+
+    while (nblocks--) {
+        const __m128i abef = s0, cdgh = s1;
+        __m128i w0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(p +  0)), bswap);
+        __m128i w1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(p + 16)), bswap);
+        __m128i w2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(p + 32)), bswap);
+        __m128i w3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(p + 48)), bswap);
+
+        SHANI_ROUNDS(w0, 0); SHANI_ROUNDS(w1, 1); SHANI_ROUNDS(w2, 2); SHANI_ROUNDS(w3, 3);
+        for (int i = 4; i < 16; i += 4) {
+            SHANI_SCHEDULE(w0, w1, w2, w3); SHANI_ROUNDS(w0, i);
+            SHANI_SCHEDULE(w1, w2, w3, w0); SHANI_ROUNDS(w1, i + 1);
+            SHANI_SCHEDULE(w2, w3, w0, w1); SHANI_ROUNDS(w2, i + 2);
+            SHANI_SCHEDULE(w3, w0, w1, w2); SHANI_ROUNDS(w3, i + 3);
+        }
+
+        s0 = _mm_add_epi32(s0, abef);
+        s1 = _mm_add_epi32(s1, cdgh);
+        p += QM_SHA256_BLOCK_LEN;
+    }
+
+    tmp = _mm_shuffle_epi32(s0, 0x1B);                                               /* FEBA */
+    s1  = _mm_shuffle_epi32(s1, 0xB1);                                               /* DCHG */
+    _mm_storeu_si128((__m128i*)&h[0], _mm_blend_epi16(tmp, s1, 0xF0));               /* DCBA */
+    _mm_storeu_si128((__m128i*)&h[4], _mm_alignr_epi8(s1, tmp, 8));                  /* HGFE */
+}
+
+/* ===================== AVX2, eight messages ===================== */
+
+#define AVX2_TARGET __attribute__((target("avx2")))
+
+#define V_ROR(x, n) _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - (n)))
+
+/* One block of each of eight messages; lane i reads blocks[i]. */
+AVX2_TARGET
+static void compress_avx2x8(__m256i st[8], const uint8_t *const blocks[8]) {
+    __m256i w[16];
+    for (int t = 0; t < 16; ++t)
+        w[t] = _mm256_setr_epi32((int)load_be32(blocks[0] + 4*t), (int)load_be32(blocks[1] + 4*t),
+                                 (int)load_be32(blocks[2] + 4*t), (int)load_be32(blocks[3] + 4*t),
+                                 (int)load_be32(blocks[4] + 4*t), (int)load_be32(blocks[5] + 4*t),
+                                 (int)load_be32(blocks[6] + 4*t), (int)load_be32(blocks[7] + 4*t));
+
+    __m256i a = st[0], b = st[1], c = st[2], d = st[3], e = st[4], f = st[5], g = st[6], h = st[7];
+    for (int t = 0; t < 64; ++t) {
+        __m256i wt;
+        if (t < 16) {
+            wt = w[t];
+        } else {
+            __m256i x = w[(t - 15) & 15], y = w[(t - 2) & 15];
+            __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(V_ROR(x, 7), V_ROR(x, 18)), _mm256_srli_epi32(x, 3));
+            __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(V_ROR(y, 17), V_ROR(y, 19)), _mm256_srli_epi32(y, 10));
+            wt = w[t & 15] = _mm256_add_epi32(_mm256_add_epi32(w[t & 15], s0), _mm256_add_epi32(w[(t - 7) & 15], s1));
+        }
+        __m256i S1 = _mm256_xor_si256(_mm256_xor_si256(V_ROR(e, 6), V_ROR(e, 11)), V_ROR(e, 25));
+        __m256i ch = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+        __m256i t1 = _mm256_add_epi32(_mm256_add_epi32(h, S1),
+                     _mm256_add_epi32(ch, _mm256_add_epi32(_mm256_set1_epi32((int)K256[t]), wt)));
+        __m256i S0 = _mm256_xor_si256(_mm256_xor_si256(V_ROR(a, 2), V_ROR(a, 13)), V_ROR(a, 22));
+        __m256i mj = _mm256_or_si256(_mm256_and_si256(a, b), _mm256_and_si256(c, _mm256_or_si256(a, b)));
+        __m256i t2 = _mm256_add_epi32(S0, mj);
+        h = g; g = f; f = e; e = _mm256_add_epi32(d, t1); d = c; c = b; b = a; a = _mm256_add_epi32(t1, t2);
+    }
+    st[0] = _mm256_add_epi32(st[0], a); st[1] = _mm256_add_epi32(st[1], b);
+    st[2] = _mm256_add_epi32(st[2], c); st[3] = _mm256_add_epi32(st[3], d);
+    st[4] = _mm256_add_epi32(st[4], e); st[5] = _mm256_add_epi32(st[5], f);
+    st[6] = _mm256_add_epi32(st[6], g); st[7] = _mm256_add_epi32(st[7], h);
+}
+
+/* Eight messages of len bytes at in + i*len; digests to out + i*32. */
+AVX2_TARGET
+static void sha256_x8(const uint8_t *in, size_t len, uint8_t *out) {
+    __m256i st[8];
+    for (int j = 0; j < 8; ++j) st[j] = _mm256_set1_epi32((int)H0[j]);
+
+    const uint8_t *blk[8];
+    size_t full = len / QM_SHA256_BLOCK_LEN;
+    for (size_t b = 0; b < full; ++b) {
+        for (int i = 0; i < 8; ++i) blk[i] = in + (size_t)i * len + b * QM_SHA256_BLOCK_LEN;
+        compress_avx2x8(st, blk);
+    }
+
+    /* Same length everywhere, so every lane needs the same number of tail blocks */
+    size_t rem = len - full * QM_SHA256_BLOCK_LEN;
+    size_t tail_blocks = rem + 9 <= QM_SHA256_BLOCK_LEN ? 1 : 2;
+    uint8_t tail[8][2 * QM_SHA256_BLOCK_LEN];
+    uint64_t bits = (uint64_t)len * 8;
+    for (int i = 0; i < 8; ++i) {
+        memset(tail[i], 0, sizeof(tail[i]));
+        memcpy(tail[i], in + (size_t)i * len + full * QM_SHA256_BLOCK_LEN, rem);
+        tail[i][rem] = 0x80;
+        uint8_t *lenp = tail[i] + tail_blocks * QM_SHA256_BLOCK_LEN - 8;
+        for (int k = 0; k < 8; ++k) lenp[k] = (uint8_t)(bits >> (56 - 8*k));
+    }
+    for (size_t b = 0; b < tail_blocks; ++b) {
+        for (int i = 0; i < 8; ++i) blk[i] = tail[i] + b * QM_SHA256_BLOCK_LEN;
+        compress_avx2x8(st, blk);
+    }
+    secure_zero(tail, sizeof(tail));
+
+    uint32_t lanes[8][8];   /* [word][lane] */
+    for (int j = 0; j < 8; ++j) _mm256_storeu_si256((__m256i*)lanes[j], st[j]);
+    for (int i = 0; i < 8; ++i)
+        for (int j = 0; j < 8; ++j) store_be32(out + 32*i + 4*j, lanes[j][i]);
+    secure_zero(lanes, sizeof(lanes));
+}
+
+#endif /* QM_SHA_HAVE_X86 */
+
+/* ===================== Backend dispatch ===================== */
+
+static qm_sha_backend_t g_backend = QM_SHA_BACKEND_AUTO;
+
+static int backend_usable(qm_sha_backend_t b) {
+    switch (b) {
+    case QM_SHA_BACKEND_PORTABLE: return 1;
+#ifdef QM_SHA_HAVE_X86
+    case QM_SHA_BACKEND_AVX2X8:   return avx2_available();
+    case QM_SHA_BACKEND_SHANI:    return shani_available();
+#endif
+    default:                      return 0;
+    }
+}
+
+qm_sha_backend_t qm_sha_backend(void) {
+    if (g_backend == QM_SHA_BACKEND_AUTO) {
+        qm_sha_backend_t b = QM_SHA_BACKEND_PORTABLE;
+        if      (backend_usable(QM_SHA_BACKEND_SHANI))  b = QM_SHA_BACKEND_SHANI;
+        else if (backend_usable(QM_SHA_BACKEND_AVX2X8)) b = QM_SHA_BACKEND_AVX2X8;
+        const char *env = getenv("QUMAIL_SHA_BACKEND");
+        if (env) {
+            if      (strcmp(env, "portable") == 0) b = QM_SHA_BACKEND_PORTABLE;
+            else if (strcmp(env, "avx2x8") == 0 && backend_usable(QM_SHA_BACKEND_AVX2X8)) b = QM_SHA_BACKEND_AVX2X8;
+            else if (strcmp(env, "shani") == 0 && backend_usable(QM_SHA_BACKEND_SHANI))   b = QM_SHA_BACKEND_SHANI;
+        }
+        g_backend = b;  /* idempotent, so a racing first call is harmless */
+    }
+    return g_backend;
+}
+
+int qm_sha_set_backend(qm_sha_backend_t b) {
+    if (b != QM_SHA_BACKEND_AUTO && !backend_usable(b)) return -1;
+    g_backend = b;
+    return 0;
+}
+
+const char *qm_sha_backend_name(qm_sha_backend_t b) {
+    switch (b) {
+    case QM_SHA_BACKEND_PORTABLE: return "portable";
+    case QM_SHA_BACKEND_AVX2X8:   return "avx2x8";
+    case QM_SHA_BACKEND_SHANI:    return "shani";
+    default:                      return "auto";
+    }
+}
+
+static void compress(uint32_t h[8], const uint8_t *p, size_t nblocks) {
+#ifdef QM_SHA_HAVE_X86
+    if (qm_sha_backend() == QM_SHA_BACKEND_SHANI) { compress_shani(h, p, nblocks); return; }
+#endif
+    compress_portable(h, p, nblocks);
+}
+
+/* ===================== Streaming hash ===================== */
+
+void qm_sha256_init(qm_sha256_ctx *c) {
+    memcpy(c->h, H0, sizeof(H0));
+    c->total = 0;
+    c->buf_len = 0;
+}
+
+void qm_sha256_update(qm_sha256_ctx *c, const uint8_t *data, size_t len) {
+    c->total += len;
+    if (c->buf_len) {
+        size_t take = QM_SHA256_BLOCK_LEN - c->buf_len;
+        if (take > len) take = len;
+        memcpy(c->buf + c->buf_len, data, take);
+        c->buf_len += take; data += take; len -= take;
+        if (c->buf_len < QM_SHA256_BLOCK_LEN) return;
+        compress(c->h, c->buf, 1);
+        c->buf_len = 0;
+    }
+    size_t n = len / QM_SHA256_BLOCK_LEN;
+    if (n) {
+        compress(c->h, data, n);
+        data += n * QM_SHA256_BLOCK_LEN; len -= n * QM_SHA256_BLOCK_LEN;
+    }
+    if (len) {
+        memcpy(c->buf, data, len);
+        c->buf_len = len;
+    }
+}
+
+void qm_sha256_final(qm_sha256_ctx *c, uint8_t out[QM_SHA256_DIGEST_LEN]) {
+    uint64_t bits = c->total * 8;
+    c->buf[c->buf_len++] = 0x80;
+    if (c->buf_len > QM_SHA256_BLOCK_LEN - 8) {
+        memset(c->buf + c->buf_len, 0, QM_SHA256_BLOCK_LEN - c->buf_len);
+        compress(c->h, c->buf, 1);
+        c->buf_len = 0;
+    }
+    memset(c->buf + c->buf_len, 0, QM_SHA256_BLOCK_LEN - 8 - c->buf_len);
+    for (int k = 0; k < 8; ++k) c->buf[QM_SHA256_BLOCK_LEN - 8 + k] = (uint8_t)(bits >> (56 - 8*k));
+    compress(c->h, c->buf, 1);
+    for (int j = 0; j < 8; ++j) store_be32(out + 4*j, c->h[j]);
+    secure_zero(c, sizeof(*c));
+}
+
+void qm_sha256(const uint8_t *data, size_t len, uint8_t out[QM_SHA256_DIGEST_LEN]) {
+    qm_sha256_ctx c;
+    qm_sha256_init(&c);
+    qm_sha256_update(&c, data, len);
+    qm_sha256_final(&c, out);
+}
+
+void qm_sha256_many(const uint8_t *in, size_t len, size_t n, uint8_t *out) {
+    size_t i = 0;
+#ifdef QM_SHA_HAVE_X86
+    if (qm_sha_backend() == QM_SHA_BACKEND_AVX2X8)
+        for (; i + 8 <= n; i += 8) sha256_x8(in + i * len, len, out + i * QM_SHA256_DIGEST_LEN);
+#endif
+    for (; i < n; ++i) qm_sha256(in + i * len, len, out + i * QM_SHA256_DIGEST_LEN);
+}
+
+/* ===================== HMAC / HKDF ===================== */
+
+void qm_hmac_sha256_key_init(qm_hmac_sha256_key *k, const uint8_t *key, size_t key_len) {
+    uint8_t block[QM_SHA256_BLOCK_LEN] = {0};
+    if (key_len > QM_SHA256_BLOCK_LEN) qm_sha256(key, key_len, block);
+    else if (key_len) memcpy(block, key, key_len);
+
+    for (int i = 0; i < QM_SHA256_BLOCK_LEN; ++i) block[i] ^= 0x36;
+    qm_sha256_init(&k->inner);
+    qm_sha256_update(&k->inner, block, sizeof(block));
+    for (int i = 0; i < QM_SHA256_BLOCK_LEN; ++i) block[i] ^= 0x36 ^ 0x5c;
+    qm_sha256_init(&k->outer);
+    qm_sha256_update(&k->outer, block, sizeof(block));
+    secure_zero(block, sizeof(block));
+}
+
+void qm_hmac_sha256_with(const qm_hmac_sha256_key *k, const uint8_t *msg, size_t len,
+                         uint8_t out[QM_SHA256_DIGEST_LEN]) {
+    qm_sha256_ctx c = k->inner;
+    uint8_t inner[QM_SHA256_DIGEST_LEN];
+    qm_sha256_update(&c, msg, len);
+    qm_sha256_final(&c, inner);
+    c = k->outer;
+    qm_sha256_update(&c, inner, sizeof(inner));
+    qm_sha256_final(&c, out);
+    secure_zero(inner, sizeof(inner));
+}
+
+void qm_hmac_sha256(const uint8_t *key, size_t key_len, const uint8_t *msg, size_t len,
+                    uint8_t out[QM_SHA256_DIGEST_LEN]) {
+    qm_hmac_sha256_key k;
+    qm_hmac_sha256_key_init(&k, key, key_len);
+    qm_hmac_sha256_with(&k, msg, len, out);
+    secure_zero(&k, sizeof(k));
+}
+
+void qm_hkdf_sha256_extract(const uint8_t *salt, size_t salt_len, const uint8_t *ikm, size_t ikm_len,
+                            uint8_t prk[QM_SHA256_DIGEST_LEN]) {
+    static const uint8_t zero_salt[QM_SHA256_DIGEST_LEN] = {0};
+    if (!salt || !salt_len) { salt = zero_salt; salt_len = sizeof(zero_salt); }
+    qm_hmac_sha256(salt, salt_len, ikm, ikm_len, prk);
+}
+
+int qm_hkdf_sha256_expand(const uint8_t *prk, size_t prk_len, const uint8_t *info, size_t info_len,
+                          uint8_t *out, size_t out_len) {
+    if (out_len > 255 * QM_SHA256_DIGEST_LEN || (!out && out_len) || (!info && info_len)) return -1;
+
+    /* T(i) = HMAC(PRK, T(i-1) || info || i); the keyed state is set up once */
+    qm_hmac_sha256_key k;
+    qm_hmac_sha256_key_init(&k, prk, prk_len);
+    uint8_t t[QM_SHA256_DIGEST_LEN];
+    size_t off = 0;
+    for (uint8_t i = 1; off < out_len; ++i) {
+        qm_sha256_ctx c = k.inner;
+        if (i > 1) qm_sha256_update(&c, t, sizeof(t));
+        if (info_len) qm_sha256_update(&c, info, info_len);
+        qm_sha256_update(&c, &i, 1);
+        qm_sha256_final(&c, t);
+        c = k.outer;
+        qm_sha256_update(&c, t, sizeof(t));
+        qm_sha256_final(&c, t);
+
+        size_t n = out_len - off < sizeof(t) ? out_len - off : sizeof(t);
+        memcpy(out + off, t, n);
+        off += n;
+    }
+    secure_zero(t, sizeof(t));
+    secure_zero(&k, sizeof(k));
+    return 0;
+}
+
+int qm_hkdf_sha256(const uint8_t *salt, size_t salt_len, const uint8_t *ikm, size_t ikm_len,
+                   const uint8_t *info, size_t info_len, uint8_t *out, size_t out_len) {
+    uint8_t prk[QM_SHA256_DIGEST_LEN];
+    qm_hkdf_sha256_extract(salt, salt_len, ikm, ikm_len, prk);
+    int rc = qm_hkdf_sha256_expand(prk, sizeof(prk), info, info_len, out, out_len);
+    secure_zero(prk, sizeof(prk));
+    return rc;
+}
+
+void qm_sha256_chain_expand(const uint8_t *seed, size_t seed_len, uint8_t *out, size_t out_len) {
+    if (out_len <= seed_len) {
+        if (out_len) memcpy(out, seed, out_len);
+        return;
+    }
+    /* ceil(out_len / seed_len) rounds, as the .NET original ran: a seed longer
+       than a digest leaves the output past rounds * 32 bytes zero */
+    size_t rounds = seed_len ? out_len / seed_len + (out_len % seed_len != 0) : 0;
+    size_t fill = rounds > out_len / QM_SHA256_DIGEST_LEN ? out_len : rounds * QM_SHA256_DIGEST_LEN;
+    memset(out + fill, 0, out_len - fill);
+
+    uint8_t prev[QM_SHA256_DIGEST_LEN], ctr[4];
+    size_t off = 0;
+    for (uint32_t r = 0; off < fill; ++r) {
+        ctr[0] = (uint8_t)r; ctr[1] = (uint8_t)(r >> 8); ctr[2] = (uint8_t)(r >> 16); ctr[3] = (uint8_t)(r >> 24);
+        qm_sha256_ctx c;
+        qm_sha256_init(&c);
+        if (r == 0) qm_sha256_update(&c, seed, seed_len);
+        else        qm_sha256_update(&c, prev, sizeof(prev));
+        qm_sha256_update(&c, ctr, sizeof(ctr));
+        qm_sha256_final(&c, prev);
+
+        size_t n = fill - off < sizeof(prev) ? fill - off : sizeof(prev);
+        memcpy(out + off, prev, n);
+        off += n;
+    }
+    secure_zero(prev, sizeof(prev));
+}
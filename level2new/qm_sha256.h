@@ -0,0 +1,77 @@
+#ifndef QM_SHA256_H
+#define QM_SHA256_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * SHA-256, HMAC-SHA256 and HKDF-SHA256 (RFC 5869) for key derivation.
+ *
+ * Engines, picked once at first use like the AES backends:
+ *   shani   - x86 SHA extensions, one message at a time
+ *   avx2x8  - eight equal-length messages side by side (qm_sha256_many);
+ *             single messages use the portable code
+ *   portable
+ * QUMAIL_SHA_BACKEND=portable|avx2x8|shani overrides the choice (an
+ * unavailable engine is ignored). Output is identical on every engine.
+ */
+
+#define QM_SHA256_DIGEST_LEN 32
+#define QM_SHA256_BLOCK_LEN  64
+
+typedef enum {
+    QM_SHA_BACKEND_AUTO = 0,
+    QM_SHA_BACKEND_PORTABLE,
+    QM_SHA_BACKEND_AVX2X8,
+    QM_SHA_BACKEND_SHANI
+} qm_sha_backend_t;
+
+typedef struct {
+    uint32_t h[8];
+    uint64_t total;                      /* bytes hashed so far */
+    uint8_t  buf[QM_SHA256_BLOCK_LEN];
+    size_t   buf_len;
+} qm_sha256_ctx;
+
+/* HMAC key with the ipad/opad blocks already absorbed, so each message
+   costs two compressions fewer than keying from scratch. */
+typedef struct {
+    qm_sha256_ctx inner, outer;
+} qm_hmac_sha256_key;
+
+void qm_sha256_init(qm_sha256_ctx *c);
+void qm_sha256_update(qm_sha256_ctx *c, const uint8_t *data, size_t len);
+void qm_sha256_final(qm_sha256_ctx *c, uint8_t out[QM_SHA256_DIGEST_LEN]);   /* wipes c */
+void qm_sha256(const uint8_t *data, size_t len, uint8_t out[QM_SHA256_DIGEST_LEN]);
+
+/* n messages of len bytes each, packed back to back in `in`; n digests to
+   `out`. Runs eight at a time on avx2x8. */
+void qm_sha256_many(const uint8_t *in, size_t len, size_t n, uint8_t *out);
+
+void qm_hmac_sha256_key_init(qm_hmac_sha256_key *k, const uint8_t *key, size_t key_len);
+void qm_hmac_sha256_with(const qm_hmac_sha256_key *k, const uint8_t *msg, size_t len,
+                         uint8_t out[QM_SHA256_DIGEST_LEN]);
+void qm_hmac_sha256(const uint8_t *key, size_t key_len, const uint8_t *msg, size_t len,
+                    uint8_t out[QM_SHA256_DIGEST_LEN]);
+
+/* RFC 5869. A NULL/empty salt means 32 zero bytes. expand fails (-1) for
+   out_len > 255 * 32. */
+void qm_hkdf_sha256_extract(const uint8_t *salt, size_t salt_len, const uint8_t *ikm, size_t ikm_len,
+                            uint8_t prk[QM_SHA256_DIGEST_LEN]);
+int  qm_hkdf_sha256_expand(const uint8_t *prk, size_t prk_len, const uint8_t *info, size_t info_len,
+                           uint8_t *out, size_t out_len);
+int  qm_hkdf_sha256(const uint8_t *salt, size_t salt_len, const uint8_t *ikm, size_t ikm_len,
+                    const uint8_t *info, size_t info_len, uint8_t *out, size_t out_len);
+
+/* The .NET PQC layers' pad expansion (Level1OneTimePadEngine.ExpandKey):
+   block r = SHA-256(prev || r as little-endian uint32), prev starting as
+   the seed; an output no longer than the seed is the seed's prefix. Runs
+   ceil(out_len / seed_len) rounds like the original, so with a seed over 32
+   bytes the output past rounds * 32 bytes is zero. */
+void qm_sha256_chain_expand(const uint8_t *seed, size_t seed_len, uint8_t *out, size_t out_len);
+
+qm_sha_backend_t qm_sha_backend(void);
+int              qm_sha_set_backend(qm_sha_backend_t b);   /* -1 if not available here */
+const char      *qm_sha_backend_name(qm_sha_backend_t b);
+
+#endif /* QM_SHA256_H */
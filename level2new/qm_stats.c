@@ -0,0 +1,243 @@
+#include "qm_stats.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+static const char *STAT_NAMES[QM_STAT_NUM] = {
+    "key_expansion", "aes_blocks", "cbc_encrypt", "cbc_decrypt", "ctr", "gctr", "ghash",
+    "gcm_encrypt", "gcm_decrypt", "otp_xor", "hex_encode", "hex_decode",
+    "base64_encode", "base64_decode", "km_fetch"
+};
+
+const char *qm_stats_name(qm_stat_id_t id) {
+    return (unsigned)id < QM_STAT_NUM ? STAT_NAMES[id] : "unknown";
+}
+
+#ifdef QM_STATS
+
+/* ===================== Thread blocks ===================== */
+
+/* stat[] must stay first: qm_stats_tls points at it */
+typedef struct qm_block {
+    qm_stat_t        stat[QM_STAT_NUM];
+    struct qm_block *prev, *next;
+} qm_block_t;
+
+QM_THREAD_LOCAL qm_stat_t *qm_stats_tls;
+
+static qm_block_t *live;                       /* blocks of running threads */
+static qm_stat_t   retired[QM_STAT_NUM];       /* folded in when a thread exits */
+static qm_stat_t   baseline[QM_STAT_NUM];      /* totals at the last reset */
+
+#ifdef _WIN32
+static SRWLOCK     reg_lock = SRWLOCK_INIT;
+static INIT_ONCE   reg_once = INIT_ONCE_STATIC_INIT;
+static DWORD       reg_fls = FLS_OUT_OF_INDEXES;
+#define REG_LOCK()   AcquireSRWLockExclusive(&reg_lock)
+#define REG_UNLOCK() ReleaseSRWLockExclusive(&reg_lock)
+#else
+static pthread_mutex_t reg_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t  reg_once = PTHREAD_ONCE_INIT;
+static pthread_key_t   reg_key;
+#define REG_LOCK()   pthread_mutex_lock(&reg_lock)
+#define REG_UNLOCK() pthread_mutex_unlock(&reg_lock)
+#endif
+
+static uint64_t load_relaxed(const uint64_t *p) {
+#if defined(_MSC_VER)
+    return *(const volatile uint64_t*)p;
+#else
+    return __atomic_load_n(p, __ATOMIC_RELAXED);
+#endif
+}
+
+static void sum_into(qm_stat_t *dst, const qm_stat_t *src) {
+    for (int i = 0; i < QM_STAT_NUM; ++i) {
+        dst[i].calls += load_relaxed(&src[i].calls);
+        dst[i].bytes += load_relaxed(&src[i].bytes);
+        dst[i].ticks += load_relaxed(&src[i].ticks);
+    }
+}
+
+/* Thread exit: keep its totals, drop its block */
+#ifdef _WIN32
+static void WINAPI block_retire(void *p)
+#else
+static void block_retire(void *p)
+#endif
+{
+    qm_block_t *b = (qm_block_t*)p;
+    if (!b) return;
+    REG_LOCK();
+    sum_into(retired, b->stat);
+    if (b->prev) b->prev->next = b->next; else live = b->next;
+    if (b->next) b->next->prev = b->prev;
+    REG_UNLOCK();
+    free(b);
+}
+
+#ifdef _WIN32
+static BOOL CALLBACK reg_init(PINIT_ONCE once, PVOID param, PVOID *ctx) {
+    (void)once; (void)param; (void)ctx;
+    reg_fls = FlsAlloc(block_retire);
+    return TRUE;
+}
+#else
+static void reg_init(void) {
+    pthread_key_create(&reg_key, block_retire);
+}
+#endif
+
+qm_stat_t *qm_stats_thread_block(void) {
+#ifdef _WIN32
+    InitOnceExecuteOnce(&reg_once, reg_init, NULL, NULL);
+#else
+    pthread_once(&reg_once, reg_init);
+#endif
+    qm_block_t *b = (qm_block_t*)calloc(1, sizeof(*b));
+    if (!b) return NULL;
+#ifdef _WIN32
+    if (reg_fls == FLS_OUT_OF_INDEXES || !FlsSetValue(reg_fls, b)) { free(b); return NULL; }
+#else
+    if (pthread_setspecific(reg_key, b) != 0) { free(b); return NULL; }
+#endif
+    REG_LOCK();
+    b->next = live;
+    if (live) live->prev = b;
+    live = b;
+    REG_UNLOCK();
+    qm_stats_tls = b->stat;
+    return b->stat;
+}
+
+/* ===================== Clock ===================== */
+
+uint64_t qm_stats_clock(void) {
+#ifdef _WIN32
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER now;
+    if (!freq.QuadPart) QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (uint64_t)((double)now.QuadPart * 1e9 / (double)freq.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+/* rdtsc ticks per ns, measured once against the monotonic clock */
+static double ticks_per_ns(void) {
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+    static double cached;
+    if (cached == 0) {
+        uint64_t n0 = qm_stats_clock(), c0 = qm_stats_ticks();
+#ifdef _WIN32
+        Sleep(20);
+#else
+        usleep(20000);
+#endif
+        uint64_t n1 = qm_stats_clock(), c1 = qm_stats_ticks();
+        cached = n1 > n0 ? (double)(c1 - c0) / (double)(n1 - n0) : 1.0;
+    }
+    return cached;
+#else
+    return 1.0;
+#endif
+}
+
+static void totals(qm_stat_t *out) {
+    memcpy(out, retired, sizeof(retired));
+    for (qm_block_t *b = live; b; b = b->next) sum_into(out, b->stat);
+}
+
+void qm_stats_snapshot(qm_stats_snapshot_t *out) {
+    memset(out, 0, sizeof(*out));
+    out->enabled = 1;
+    out->ticks_per_ns = ticks_per_ns();
+    REG_LOCK();
+    totals(out->stat);
+    for (int i = 0; i < QM_STAT_NUM; ++i) {
+        out->stat[i].calls -= baseline[i].calls;
+        out->stat[i].bytes -= baseline[i].bytes;
+        out->stat[i].ticks -= baseline[i].ticks;
+    }
+    REG_UNLOCK();
+}
+
+/* Moves the baseline instead of clearing other threads' blocks, which only
+   their owners may write. */
+void qm_stats_reset(void) {
+    REG_LOCK();
+    totals(baseline);
+    REG_UNLOCK();
+}
+
+#else /* !QM_STATS */
+
+void qm_stats_snapshot(qm_stats_snapshot_t *out) {
+    memset(out, 0, sizeof(*out));
+    out->ticks_per_ns = 1.0;
+}
+
+void qm_stats_reset(void) {}
+
+#endif /* QM_STATS */
+
+/* ===================== Prometheus text ===================== */
+
+typedef struct { char *buf; size_t cap, len; } text_t;
+
+static void text_printf(text_t *t, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    size_t room = t->len < t->cap ? t->cap - t->len : 0;
+    int n = vsnprintf(room ? t->buf + t->len : NULL, room, fmt, ap);
+    va_end(ap);
+    if (n > 0) t->len += (size_t)n;
+}
+
+size_t qm_stats_format_prometheus(char *buf, size_t cap) {
+    static const char *METRICS[3][2] = {
+        { "qumail_native_stage_calls_total",   "Calls into an instrumented native stage." },
+        { "qumail_native_stage_bytes_total",   "Bytes processed by an instrumented native stage." },
+        { "qumail_native_stage_seconds_total", "Time spent in an instrumented native stage (inclusive)." },
+    };
+    qm_stats_snapshot_t s;
+    qm_stats_snapshot(&s);
+    text_t t = { buf, cap, 0 };
+    if (buf && cap) buf[0] = '\0';
+
+    text_printf(&t, "# HELP qumail_native_stats_enabled 1 if the binary was built with QM_STATS.\n"
+                    "# TYPE qumail_native_stats_enabled gauge\nqumail_native_stats_enabled %d\n", s.enabled);
+    for (int m = 0; m < 3; ++m) {
+        text_printf(&t, "# HELP %s %s\n# TYPE %s counter\n", METRICS[m][0], METRICS[m][1], METRICS[m][0]);
+        for (int i = 0; i < QM_STAT_NUM; ++i) {
+            const qm_stat_t *st = &s.stat[i];
+            if (m == 2)
+                text_printf(&t, "%s{stage=\"%s\"} %.9f\n", METRICS[m][0], STAT_NAMES[i],
+                            (double)st->ticks / s.ticks_per_ns / 1e9);
+            else
+                text_printf(&t, "%s{stage=\"%s\"} %llu\n", METRICS[m][0], STAT_NAMES[i],
+                            (unsigned long long)(m == 0 ? st->calls : st->bytes));
+        }
+    }
+    return t.len;
+}
+
+void qm_stats_dump_prometheus(FILE *f) {
+    size_t need = qm_stats_format_prometheus(NULL, 0);
+    char *buf = (char*)malloc(need + 1);
+    if (!buf) return;
+    qm_stats_format_prometheus(buf, need + 1);
+    fputs(buf, f);
+    free(buf);
+}
@@ -0,0 +1,124 @@
+#ifndef QM_STATS_H
+#define QM_STATS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/*
+ * Per-thread stage counters and cycle timers for the native crypto paths.
+ *
+ * Off by default: unless the build defines QM_STATS, QM_STATS_BEGIN/END/ADD
+ * expand to nothing and the instrumented code is identical to an
+ * uninstrumented build. The snapshot/dump functions below always exist and
+ * report enabled == 0 in that case, so callers need no #ifdefs.
+ *
+ *   gcc -O2 -DQM_STATS -o aes_gcm_demo aes_gcm.c aes_gcm_chunked.c aes.c aes_ct64.c aes_ni.c qm_stats.c qm_envelope.c qm_multiseal.c qm_codec.c qm_arena.c qm_secmem.c main_gcm.c
+ *
+ * Each thread bumps its own block (no shared cache lines, no locks on the hot
+ * path); a snapshot sums the live blocks plus the totals of exited threads.
+ * Timings are inclusive: gctr time is also part of the enclosing gcm_encrypt.
+ */
+
+typedef enum {
+    QM_STAT_KEY_EXPANSION = 0,
+    QM_STAT_AES_BLOCKS,       /* multi-block dispatch (bytes = 16 * blocks) */
+    QM_STAT_CBC_ENCRYPT,
+    QM_STAT_CBC_DECRYPT,
+    QM_STAT_CTR,
+    QM_STAT_GCTR,
+    QM_STAT_GHASH,
+    QM_STAT_GCM_ENCRYPT,
+    QM_STAT_GCM_DECRYPT,
+    QM_STAT_OTP_XOR,
+    QM_STAT_HEX_ENCODE,
+    QM_STAT_HEX_DECODE,
+    QM_STAT_B64_ENCODE,
+    QM_STAT_B64_DECODE,
+    QM_STAT_KM_FETCH,
+    QM_STAT_NUM
+} qm_stat_id_t;
+
+typedef struct {
+    uint64_t calls;
+    uint64_t bytes;
+    uint64_t ticks;           /* rdtsc cycles on x86, nanoseconds elsewhere */
+} qm_stat_t;
+
+typedef struct {
+    int       enabled;        /* 0 when built without QM_STATS */
+    double    ticks_per_ns;   /* for converting ticks to time */
+    qm_stat_t stat[QM_STAT_NUM];
+} qm_stats_snapshot_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+const char *qm_stats_name(qm_stat_id_t id);
+
+/* Totals across all threads (live and exited) since start or last reset. */
+void qm_stats_snapshot(qm_stats_snapshot_t *out);
+void qm_stats_reset(void);
+
+/* Prometheus text exposition format. Returns the length the full text needs
+   (like snprintf); writes at most cap-1 bytes plus a NUL. */
+size_t qm_stats_format_prometheus(char *buf, size_t cap);
+void   qm_stats_dump_prometheus(FILE *f);
+
+#ifdef QM_STATS
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define QM_THREAD_LOCAL __declspec(thread)
+#else
+#define QM_THREAD_LOCAL _Thread_local
+#endif
+#if (defined(__x86_64__) || defined(__i386__)) && !defined(_MSC_VER)
+#include <x86intrin.h>
+#endif
+
+extern QM_THREAD_LOCAL qm_stat_t *qm_stats_tls;
+qm_stat_t *qm_stats_thread_block(void);
+uint64_t   qm_stats_clock(void);
+
+static inline uint64_t qm_stats_ticks(void) {
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+    return __rdtsc();
+#else
+    return qm_stats_clock();
+#endif
+}
+
+/* Only the owning thread writes its block; relaxed stores keep concurrent
+   snapshot reads well-defined and compile to plain moves. */
+static inline void qm_stats_add(qm_stat_id_t id, uint64_t bytes, uint64_t ticks) {
+    qm_stat_t *b = qm_stats_tls ? qm_stats_tls : qm_stats_thread_block();
+    if (!b) return;
+    qm_stat_t *s = &b[id];
+#if defined(_MSC_VER)
+    s->calls += 1; s->bytes += bytes; s->ticks += ticks;
+#else
+    __atomic_store_n(&s->calls, s->calls + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&s->bytes, s->bytes + bytes, __ATOMIC_RELAXED);
+    __atomic_store_n(&s->ticks, s->ticks + ticks, __ATOMIC_RELAXED);
+#endif
+}
+
+#define QM_STATS_BEGIN(id)        uint64_t qm_t0_##id = qm_stats_ticks()
+#define QM_STATS_END(id, nbytes)  qm_stats_add((id), (uint64_t)(nbytes), qm_stats_ticks() - qm_t0_##id)
+#define QM_STATS_ADD(id, nbytes)  qm_stats_add((id), (uint64_t)(nbytes), 0)
+
+#else
+
+#define QM_STATS_BEGIN(id)        ((void)0)
+#define QM_STATS_END(id, nbytes)  ((void)0)
+#define QM_STATS_ADD(id, nbytes)  ((void)0)
+
+#endif /* QM_STATS */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* QM_STATS_H */
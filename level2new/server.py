@@ -1,13 +1,33 @@
 # server.py
 from flask import Flask, request, jsonify
-import requests, subprocess, binascii, os
+import requests, subprocess, binascii, os, base64
 
 KM = os.getenv("KM_URL", "http://127.0.0.1:2020")
 AES_BIN = os.getenv("AES_GCM_BIN", os.path.abspath("./aes_gcm_demo"))  # .exe on Windows
 
 app = Flask(__name__)
 
-def b2h(b): return binascii.hexlify(b).decode()
+try:
+    import qmcodec          # SIMD hex/base64 codec (qm_codec_py.c); stdlib fallback when not built
+except ImportError:
+    qmcodec = None
+
+try:
+    import otpxor           # native OTP XOR (level1/otp_xor_py.c); big-int fallback when not built
+except ImportError:
+    otpxor = None
+
+def b2h(b): return qmcodec.hexlify(b) if qmcodec else binascii.hexlify(b).decode()
+def h2b(s): return qmcodec.unhexlify(s) if qmcodec else binascii.unhexlify(s)
+
+def b64url_encode(b):
+    if qmcodec: return qmcodec.b64encode(b, url=True)
+    return base64.urlsafe_b64encode(b).decode('ascii').rstrip('=')
+
+def b64url_decode(s):
+    """Unpadded or padded base64url."""
+    if qmcodec: return qmcodec.b64decode(s, url=True)
+    return base64.urlsafe_b64decode(s + '=' * (-len(s) % 4))
 
 def get_iv_hex():
     # IV doesn’t need an id; 12B recommended
@@ -143,6 +163,17 @@ def decrypt_gcm():
     # plaintext bytes out
     return proc.stdout, 200, {"Content-Type": "application/octet-stream"}
 
+def xor_pad(data, key):
+    """data ^ key[:len(data)]; the pad must be at least as long as the data."""
+    if otpxor:
+        return otpxor.xor(data, key)
+    if len(key) < len(data):
+        raise ValueError("key shorter than data")
+    n = len(data)
+    if n == 0:
+        return b""
+    return (int.from_bytes(data, "big") ^ int.from_bytes(key[:n], "big")).to_bytes(n, "big")
+
 @app.post("/api/otp/encrypt")
 def encrypt_otp():
     """OTP encryption endpoint for compatibility with backend"""
@@ -155,17 +186,14 @@ def encrypt_otp():
         
         # Get a new key for OTP encryption
         key_hex, key_id = get_new_key_and_id(len(plaintext.encode('utf-8')))
-        key_bytes = binascii.unhexlify(key_hex)
+        key_bytes = h2b(key_hex)
         plaintext_bytes = plaintext.encode('utf-8')
         
         # XOR encryption (OTP)
-        ciphertext_bytes = bytearray()
-        for i, byte in enumerate(plaintext_bytes):
-            ciphertext_bytes.append(byte ^ key_bytes[i % len(key_bytes)])
+        ciphertext_bytes = xor_pad(plaintext_bytes, key_bytes)
         
         # Convert to base64url
-        import base64
-        ciphertext_b64url = base64.urlsafe_b64encode(ciphertext_bytes).decode('ascii').rstrip('=')
+        ciphertext_b64url = b64url_encode(ciphertext_bytes)
         
         return jsonify({
             "key_id": key_id,
@@ -186,21 +214,14 @@ def decrypt_otp():
         ciphertext_b64url = body["ciphertext_b64url"]
 
         # Convert from base64url
-        import base64
-        # Add padding if needed
-        missing_padding = len(ciphertext_b64url) % 4
-        if missing_padding:
-            ciphertext_b64url += '=' * (4 - missing_padding)
-        ciphertext_bytes = base64.urlsafe_b64decode(ciphertext_b64url)
+        ciphertext_bytes = b64url_decode(ciphertext_b64url)
 
         # Get the key
         key_hex = get_key_hex_by_id(key_id)
-        key_bytes = binascii.unhexlify(key_hex)
+        key_bytes = h2b(key_hex)
 
         # XOR decryption (OTP)
-        plaintext_bytes = bytearray()
-        for i, byte in enumerate(ciphertext_bytes):
-            plaintext_bytes.append(byte ^ key_bytes[i % len(key_bytes)])
+        plaintext_bytes = xor_pad(ciphertext_bytes, key_bytes)
 
         return jsonify({
             "text": plaintext_bytes.decode('utf-8')
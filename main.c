@@ -23,6 +23,37 @@ static void usage(const char *prog) {
       prog, prog, prog, prog);
 }
 
+static void wipe_free(unsigned char *p, size_t n) {
+    if (!p) return;
+    volatile unsigned char *q = p;
+    while (n--) *q++ = 0;
+    free(p);
+}
+
+// Whole file into a malloc'd buffer (at least 1 byte, so empty files work)
+static int read_file(const char *path, unsigned char **out, size_t *out_len) {
+    FILE *f = fopen(path, "rb");
+    if (!f) { perror(path); return 1; }
+    long sz = -1;
+    if (fseek(f, 0, SEEK_END) == 0) sz = ftell(f);
+    if (sz < 0 || fseek(f, 0, SEEK_SET) != 0) { perror(path); fclose(f); return 1; }
+    unsigned char *buf = (unsigned char*)malloc(sz ? (size_t)sz : 1);
+    if (!buf) { fprintf(stderr, "Out of memory\n"); fclose(f); return 1; }
+    if (fread(buf, 1, (size_t)sz, f) != (size_t)sz) { perror(path); wipe_free(buf, (size_t)sz); fclose(f); return 1; }
+    fclose(f);
+    *out = buf; *out_len = (size_t)sz;
+    return 0;
+}
+
+static int write_file(const char *path, const void *data, size_t len) {
+    FILE *f = fopen(path, "wb");
+    if (!f) { perror(path); return 1; }
+    int rc = fwrite(data, 1, len, f) != len;
+    if (fclose(f) != 0) rc = 1;
+    if (rc) perror(path);
+    return rc;
+}
+
 // tiny helper to read exactly N bytes (key file)
 
 
@@ -51,67 +82,60 @@ int main(int argc, char *argv[]){
             const char *cipher_path = argv[4];
             const char *keyid_path  = argv[5];
 
-            FILE *fplain = fopen(plain_path, "rb");
-            FILE *fcipher = fopen(cipher_path, "wb");
-            if (!fplain || !fcipher) { perror("fopen"); if(fplain)fclose(fplain); if(fcipher)fclose(fcipher); return 1; }
+            unsigned char *buf = NULL; size_t len = 0;
+            if (read_file(plain_path, &buf, &len) != 0) return 1;
 
-            // get plaintext size
-            if (fseek(fplain, 0, SEEK_END) != 0) { perror("fseek"); fclose(fplain); fclose(fcipher); return 1; }
-            long sz = ftell(fplain);
-            if (sz < 0) { perror("ftell"); fclose(fplain); fclose(fcipher); return 1; }
-            rewind(fplain);
-
-            // fetch key of same size from KM -> key.bin + key_id.txt
-            if (km_fetch_new_key((size_t)sz, "key.bin", keyid_path) != 0) {
+            // key of the same size from KM, kept in memory
+            unsigned char *key = NULL; size_t key_len = 0;
+            char key_id[KM_KEY_ID_MAX];
+            if (km_fetch_new_key_mem(len, &key, &key_len, key_id) != 0) {
                 fprintf(stderr, "KM fetch new key failed\n");
-                fclose(fplain); fclose(fcipher); return 1;
+                wipe_free(buf, len); return 1;
             }
 
-            FILE *fkey = fopen("key.bin", "rb");
-            if (!fkey) { perror("key.bin"); fclose(fplain); fclose(fcipher); return 1; }
-
-            int rc = one_time_pad(fplain, fkey, fcipher);
-            fclose(fplain); fclose(fkey); fclose(fcipher);
+            otp_xor(buf, buf, key, len);
+            km_key_free(key, key_len);
+            int rc = write_file(cipher_path, buf, len) || write_file(keyid_path, key_id, strlen(key_id));
+            wipe_free(buf, len);
             if (rc != 0) { fprintf(stderr, "OTP encrypt failed\n"); return rc; }
             return 0;
         }
 
-
+        // ./qumail 1 dec <cipher.bin> <key_id.txt> <output>
         const char *cipher_path = argv[3];
-            const char *keyid_path  = argv[4];
-            const char *out_path    = argv[5];
-
-            // read key id
-            char key_id[256] = {0};
-            FILE *fid = fopen(keyid_path, "rb");
-            if (!fid) { perror("key_id.txt"); return 1; }
-            fgets(key_id, sizeof(key_id), fid);
-            fclose(fid);
-
-            // fetch key by id -> key.bin
-            if (km_fetch_key_by_id(key_id, "key.bin") != 0) {
-                fprintf(stderr, "KM fetch key by id failed\n");
-                return 1;
-            }
-
-            // check sizes: key.bin must equal cipher.bin
-            FILE *fc = fopen(cipher_path, "rb"); fseek(fc, 0, SEEK_END); long clen = ftell(fc); fclose(fc);
-            FILE *fk = fopen("key.bin", "rb");  fseek(fk, 0, SEEK_END); long klen = ftell(fk); fclose(fk);
-            if (klen != clen) {
-                fprintf(stderr, "KM key length (%ld) != ciphertext length (%ld)\n", klen, clen);
-                return 1;
+        const char *keyid_path  = argv[4];
+        const char *out_path    = argv[5];
+
+        // read key id
+        char key_id[KM_KEY_ID_MAX] = {0};
+        FILE *fid = fopen(keyid_path, "rb");
+        if (!fid) { perror("key_id.txt"); return 1; }
+        if (!fgets(key_id, sizeof(key_id), fid)) key_id[0] = '\0';
+        fclose(fid);
+
+        unsigned char *buf = NULL; size_t len = 0;
+        if (read_file(cipher_path, &buf, &len) != 0) return 1;
+
+        unsigned char *key = NULL; size_t key_len = 0;
+        if (km_fetch_key_by_id_mem(key_id, &key, &key_len) != 0) {
+            fprintf(stderr, "KM fetch key by id failed\n");
+            wipe_free(buf, len); return 1;
         }
 
-            FILE *fcipher = fopen(cipher_path, "rb");
-            FILE *fkey    = fopen("key.bin", "rb");
-            FILE *fout    = fopen(out_path, "wb");
-            if (!fcipher || !fkey || !fout) { perror("fopen"); if(fcipher)fclose(fcipher); if(fkey)fclose(fkey); if(fout)fclose(fout); return 1; }
-
-            int rc = one_time_pad_decoder(fkey, fcipher, fout);
-            fclose(fcipher); fclose(fkey); fclose(fout);
-            if (rc != 0) { fprintf(stderr, "OTP decrypt failed (key mismatch/short?)\n"); return rc; }
-            return 0;
+        // the pad must be exactly as long as the ciphertext
+        if (key_len != len) {
+            fprintf(stderr, "KM key length (%lu) != ciphertext length (%lu)\n", (unsigned long)key_len, (unsigned long)len);
+            km_key_free(key, key_len); wipe_free(buf, len);
+            return 1;
         }
+
+        otp_xor(buf, buf, key, len);
+        km_key_free(key, key_len);
+        int rc = write_file(out_path, buf, len);
+        wipe_free(buf, len);
+        if (rc != 0) { fprintf(stderr, "OTP decrypt failed\n"); return rc; }
+        return 0;
+    }
 /*
     else if (level == 2) {
         if (argc < 6) { usage(argv[0]); return 1; }
@@ -1,6 +1,31 @@
 import os
+import ctypes
 from crypto.crystal.utils import xor_bytes
-from Crypto.Cipher import AES
+
+try:
+    from Crypto.Cipher import AES
+except ImportError:
+    AES = None
+
+
+def _load_native_drbg():
+    """
+    Load the native CTR_DRBG (level2new/ctr_drbg.c) if it has been built.
+    Set QUMAIL_CTR_DRBG_LIB to its path; falls back to the pure Python class.
+    """
+    path = os.getenv("QUMAIL_CTR_DRBG_LIB")
+    if not path or not os.path.exists(path):
+        return None
+    lib = ctypes.CDLL(path)
+    lib.ctr_drbg_ctx_size.restype = ctypes.c_size_t
+    lib.ctr_drbg_instantiate.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_char_p, ctypes.c_size_t]
+    lib.ctr_drbg_reseed.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_char_p, ctypes.c_size_t]
+    lib.ctr_drbg_generate.argtypes = [ctypes.c_void_p, ctypes.c_void_p, ctypes.c_size_t, ctypes.c_char_p, ctypes.c_size_t]
+    lib.ctr_drbg_zeroize.argtypes = [ctypes.c_void_p]
+    return lib
+
+
+_native = _load_native_drbg()
 
 
 class AES256_CTR_DRBG:
@@ -101,3 +126,57 @@ class AES256_CTR_DRBG:
         self.ctr_drbg_update(additional)
         self.reseed_ctr += 1
         return output_bytes
+
+
+class NativeAES256_CTR_DRBG:
+    """
+    Same interface and output stream as AES256_CTR_DRBG, backed by the
+    native implementation: one key schedule per update, counter blocks
+    generated in batches and written straight into the output buffer.
+    """
+
+    def __init__(self, seed=None, personalization=b""):
+        self.seed_length = 48
+        self.entropy_input = self.__check_entropy_input(seed)
+        if len(personalization) > self.seed_length:
+            raise ValueError(
+                f"The Personalization String must be at most length: {self.seed_length}. Input has length {len(personalization)}"
+            )
+        self._ctx = ctypes.create_string_buffer(_native.ctr_drbg_ctx_size())
+        _native.ctr_drbg_instantiate(self._ctx, self.entropy_input, personalization, len(personalization))
+
+    def __del__(self):
+        if getattr(self, "_ctx", None) is not None:
+            _native.ctr_drbg_zeroize(self._ctx)
+
+    def __check_entropy_input(self, entropy_input):
+        if entropy_input is None:
+            return os.urandom(self.seed_length)
+        elif len(entropy_input) != self.seed_length:
+            raise ValueError(
+                f"The entropy input must be of length: {self.seed_length}. Input has length {len(entropy_input)}"
+            )
+        return entropy_input
+
+    def reseed(self, additional_information=b""):
+        if len(additional_information) > self.seed_length:
+            raise ValueError(
+                f"The Personalization String must be at most length: {self.seed_length}. Input has length {len(additional_information)}"
+            )
+        _native.ctr_drbg_reseed(self._ctx, self.entropy_input, additional_information, len(additional_information))
+
+    def random_bytes(self, num_bytes, additional=None):
+        if additional is not None and len(additional) > self.seed_length:
+            raise ValueError(
+                f"The additional input must be of length at most: {self.seed_length}. Input has length {len(additional)}"
+            )
+        out = ctypes.create_string_buffer(num_bytes)
+        add_len = 0 if additional is None else len(additional)
+        rc = _native.ctr_drbg_generate(self._ctx, out, num_bytes, additional, add_len)
+        if rc == -2:
+            raise Warning("The DRBG has been exhausted! Reseed!")
+        return out.raw
+
+
+if _native is not None:
+    AES256_CTR_DRBG = NativeAES256_CTR_DRBG
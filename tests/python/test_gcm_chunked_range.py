@@ -0,0 +1,76 @@
+"""
+Range requests against aes_server's /api/gcm/decrypt-chunked
+
+Needs the native aes_gcm_demo (AES_GCM_BIN, default level2new/aes_gcm_demo);
+the Key Manager lookup is stubbed, so no services have to be running.
+"""
+
+import unittest
+import subprocess
+import sys
+import os
+
+LEVEL2 = os.path.abspath(os.path.join(os.path.dirname(__file__), '../../level2new'))
+sys.path.insert(0, LEVEL2)
+os.environ.setdefault("AES_GCM_BIN", os.path.join(LEVEL2, "aes_gcm_demo"))
+
+try:
+    import aes_server
+except ImportError:                 # flask/requests not installed
+    aes_server = None
+
+KEY_HEX = "000102030405060708090a0b0c0d0e0f"
+PT_LEN = 200000
+
+
+@unittest.skipIf(aes_server is None, "aes_server not importable")
+@unittest.skipUnless(os.path.exists(os.environ["AES_GCM_BIN"]), "aes_gcm_demo not built")
+class TestChunkedRange(unittest.TestCase):
+    """Range handling of the chunked (QMC1) attachment opener"""
+
+    @classmethod
+    def setUpClass(cls):
+        cls.pt = bytes(i * 7 % 251 for i in range(PT_LEN))
+        proc = subprocess.run([aes_server.AES_BIN, KEY_HEX, "101112131415161718191a1b", "--seal-chunked"],
+                              input=cls.pt, capture_output=True, check=True)
+        cls.container = proc.stdout
+        cls._lookup = aes_server.get_key_hex_by_id
+        aes_server.get_key_hex_by_id = lambda key_id: KEY_HEX
+        cls.client = aes_server.app.test_client()
+
+    @classmethod
+    def tearDownClass(cls):
+        aes_server.get_key_hex_by_id = cls._lookup
+
+    def fetch(self, rng):
+        return self.client.post("/api/gcm/decrypt-chunked?key_id=K1", data=self.container,
+                                headers={"Range": rng})
+
+    def test_range_inside(self):
+        """A range within the plaintext returns exactly those bytes"""
+        r = self.fetch("bytes=65530-65545")
+        self.assertEqual(r.status_code, 206)
+        self.assertEqual(r.data, self.pt[65530:65546])
+        self.assertEqual(r.headers["Content-Range"], "bytes 65530-65545/%d" % PT_LEN)
+
+    def test_range_end_past_eof(self):
+        """An END past the plaintext is clamped instead of failing authentication"""
+        r = self.fetch("bytes=199000-203999")
+        self.assertEqual(r.status_code, 206)
+        self.assertEqual(r.data, self.pt[199000:])
+        self.assertEqual(r.headers["Content-Range"], "bytes 199000-199999/%d" % PT_LEN)
+
+    def test_range_open_ended(self):
+        """bytes=START- runs to the end of the plaintext"""
+        r = self.fetch("bytes=150000-")
+        self.assertEqual(r.status_code, 206)
+        self.assertEqual(r.data, self.pt[150000:])
+        self.assertEqual(r.headers["Content-Range"], "bytes 150000-199999/%d" % PT_LEN)
+
+    def test_range_start_past_eof(self):
+        """A START at or past the end is 416"""
+        self.assertEqual(self.fetch("bytes=%d-" % PT_LEN).status_code, 416)
+
+
+if __name__ == '__main__':
+    unittest.main()